@@ -0,0 +1,108 @@
+/*
+* Replacement global operator new / operator delete that feed alloc_counter.h.
+*/
+
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#if defined(__GLIBC__)
+#include <malloc.h>             // for malloc_usable_size
+#endif
+
+namespace {
+
+std::atomic<size_t> allocations{0};
+std::atomic<size_t> deallocations{0};
+std::atomic<size_t> live_bytes{0};
+std::atomic<size_t> total_bytes{0};
+
+#if defined(__GLIBC__)
+void* counted_malloc(size_t size) noexcept {
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr != nullptr) {
+        size_t bytes = malloc_usable_size(ptr);
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        live_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        total_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    return ptr;
+}
+
+void counted_free(void* ptr) noexcept {
+    if (ptr == nullptr) return;
+    deallocations.fetch_add(1, std::memory_order_relaxed);
+    live_bytes.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+    std::free(ptr);
+}
+#else
+// without malloc_usable_size, remember the requested size in a header in front of the block
+constexpr size_t kHeader = alignof(std::max_align_t);
+
+void* counted_malloc(size_t size) noexcept {
+    char* block = static_cast<char*>(std::malloc(size + kHeader));
+    if (block == nullptr) return nullptr;
+    *reinterpret_cast<size_t*>(block) = size;
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    live_bytes.fetch_add(size, std::memory_order_relaxed);
+    total_bytes.fetch_add(size, std::memory_order_relaxed);
+    return block + kHeader;
+}
+
+void counted_free(void* ptr) noexcept {
+    if (ptr == nullptr) return;
+    char* block = static_cast<char*>(ptr) - kHeader;
+    deallocations.fetch_add(1, std::memory_order_relaxed);
+    live_bytes.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+#endif
+
+}
+
+namespace alloc_counter {
+
+snapshot current() noexcept {
+    return {allocations.load(std::memory_order_relaxed),
+            deallocations.load(std::memory_order_relaxed),
+            live_bytes.load(std::memory_order_relaxed),
+            total_bytes.load(std::memory_order_relaxed)};
+}
+
+}
+
+void* operator new(size_t size) {
+    void* ptr = counted_malloc(size);
+    if (ptr == nullptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return counted_malloc(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    counted_free(ptr);
+}
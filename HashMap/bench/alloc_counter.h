@@ -0,0 +1,37 @@
+/*
+* Global allocation counter for the HashMap benchmarks.
+*
+*      alloc_counter.cpp replaces the global operator new and operator delete, so any
+*      benchmark executable that links it can ask how many bytes are live on the heap.
+*      On glibc, byte counts are the usable size of each block as reported by malloc,
+*      so they include the allocator's rounding (but not its per-block header).
+*      Elsewhere they are the requested sizes.
+*
+* Usage:
+*      auto before = alloc_counter::current();
+*      HashMap<int, int> map = build_map();
+*      size_t bytes = alloc_counter::current().live_bytes - before.live_bytes;
+*/
+
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstddef>              // for size_t
+
+namespace alloc_counter {
+
+struct snapshot {
+    size_t allocations;         // number of calls to operator new so far
+    size_t deallocations;       // number of calls to operator delete so far
+    size_t live_bytes;          // bytes currently allocated
+    size_t total_bytes;         // bytes allocated so far, including freed ones
+};
+
+/*
+* Returns the counters at this point of the program. Thread safe.
+*/
+snapshot current() noexcept;
+
+}
+
+#endif // ALLOC_COUNTER_H
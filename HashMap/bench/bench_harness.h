@@ -0,0 +1,253 @@
+/*
+* Small benchmark harness shared by the HashMap benchmarks.
+*
+*      run_benchmark times a body several times (after some untimed warmup runs),
+*      with a fresh, untimed setup before each run, and reports the median and
+*      percentiles of the time per operation. A single measurement is too noisy to
+*      compare two versions of HashMap; the median of many is not.
+*
+*      Results can be printed as a table or written as JSON for later comparison.
+*
+*      With --perf, the hardware counters of perf_counters.h are also read around every
+*      timed run, and reported per operation: for a lookup benchmark, L1d and LLC misses
+*      per operation are the cache misses per lookup.
+*
+* Usage:
+*      bench_config config = parse_bench_args(argc, argv);
+*      auto result = run_benchmark(config, "insert", "int", n, n,
+*                                  [&] { return HashMap<int, int>(n); },
+*                                  [&](auto& map) { for (int k : keys) map.insert({k, k}); });
+*/
+
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+#include <algorithm>            // for sort, min, max
+#include <chrono>               // for steady_clock
+#include <cstdlib>              // for strtoull, exit
+#include <cstring>              // for strcmp
+#include <fstream>              // for ofstream
+#include <iomanip>              // for setw, setprecision
+#include <iostream>             // for cout, cerr
+#include <optional>             // for optional
+#include <string>               // for string
+#include <vector>               // for vector
+#include "perf_counters.h"
+
+/*
+* Command line settings common to all the benchmarks.
+*/
+struct bench_config {
+    size_t min_size = 10;               // --min-size: smallest number of elements
+    size_t max_size = 1000000;          // --max-size: largest number of elements (up to 10^8)
+    size_t repetitions = 11;            // --reps: timed runs per benchmark
+    size_t warmup = 2;                  // --warmup: untimed runs per benchmark
+    std::string filter;                 // --filter: only run benchmarks whose name contains this
+    std::string json_path;              // --json: also write the results to this file
+    bool perf = false;                  // --perf: also read the hardware counters
+};
+
+/*
+* Result of one benchmark: times are nanoseconds per operation.
+*/
+struct bench_result {
+    std::string name;
+    std::string variant;                // key type, container or distribution
+    size_t size = 0;                    // elements in the map
+    size_t operations = 0;              // operations per timed run
+    std::vector<double> samples;        // ns per operation, one per timed run, sorted
+    double min = 0, p10 = 0, median = 0, p90 = 0, p99 = 0, max = 0;
+    perf_counts perf;                   // summed over the timed runs, if --perf was given
+};
+
+/*
+* Hardware count per operation of result, averaged over its timed runs.
+*/
+inline double perf_per_op(const bench_result& result, perf_event_kind kind) {
+    return result.perf.per_op(kind, result.operations * result.samples.size());
+}
+
+/*
+* Keeps the compiler from discarding a computation whose result is otherwise unused.
+*/
+template <typename T>
+inline void do_not_optimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const T* sink;
+    sink = &value;
+#endif
+}
+
+/*
+* Returns the p-th percentile (0 <= p <= 1) of sorted, interpolating between samples.
+*/
+inline double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    double rank = p * (sorted.size() - 1);
+    size_t lower = static_cast<size_t>(rank);
+    size_t upper = std::min(lower + 1, sorted.size() - 1);
+    return sorted[lower] + (rank - lower) * (sorted[upper] - sorted[lower]);
+}
+
+/*
+* Sorts the samples of result and fills in its summary statistics.
+*/
+inline void summarize(bench_result& result) {
+    std::sort(result.samples.begin(), result.samples.end());
+    result.min = result.samples.front();
+    result.p10 = percentile(result.samples, 0.10);
+    result.median = percentile(result.samples, 0.50);
+    result.p90 = percentile(result.samples, 0.90);
+    result.p99 = percentile(result.samples, 0.99);
+    result.max = result.samples.back();
+}
+
+/*
+* Runs setup() then body(state) config.warmup + config.repetitions times, timing only
+* body, and returns the time per operation (operations per run is the argument).
+*/
+template <typename Setup, typename Body>
+bench_result run_benchmark(const bench_config& config, const std::string& name, const std::string& variant,
+                           size_t size, size_t operations, Setup setup, Body body) {
+    bench_result result;
+    result.name = name;
+    result.variant = variant;
+    result.size = size;
+    result.operations = std::max<size_t>(operations, 1);
+    std::optional<perf_counters> counters;
+    if (config.perf) counters.emplace();
+
+    for (size_t run = 0; run < config.warmup + config.repetitions; ++run) {
+        auto state = setup();
+        if (counters) counters->start();
+        auto start = std::chrono::steady_clock::now();
+        body(state);
+        auto end = std::chrono::steady_clock::now();
+        perf_counts counts = counters ? counters->stop() : perf_counts();
+        do_not_optimize(state);
+        if (run < config.warmup) continue;
+        result.perf += counts;
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        result.samples.push_back(ns / result.operations);
+    }
+    summarize(result);
+    return result;
+}
+
+/*
+* Whether a benchmark called name passes the --filter of config.
+*/
+inline bool bench_selected(const bench_config& config, const std::string& name) {
+    return config.filter.empty() || name.find(config.filter) != std::string::npos;
+}
+
+/*
+* Parses the options documented in bench_config, starting from defaults.
+* Exits with a usage message on errors.
+*/
+inline bench_config parse_bench_args(int argc, char** argv, bench_config defaults = {}) {
+    bench_config config = defaults;
+    auto usage = [&]() {
+        std::cerr << "usage: " << argv[0] << " [--min-size N] [--max-size N] [--reps N]"
+                  << " [--warmup N] [--filter NAME] [--json FILE] [--perf]" << std::endl;
+        std::exit(1);
+    };
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--perf") == 0) {
+            config.perf = true;
+            if (!perf_counters().available()) {
+                std::cerr << "--perf: hardware counters unavailable, reporting times only" << std::endl;
+            }
+            continue;
+        }
+        if (i + 1 >= argc) usage();
+        std::string value = argv[i + 1];
+        if (std::strcmp(argv[i], "--min-size") == 0) config.min_size = std::strtoull(value.c_str(), nullptr, 10);
+        else if (std::strcmp(argv[i], "--max-size") == 0) config.max_size = std::strtoull(value.c_str(), nullptr, 10);
+        else if (std::strcmp(argv[i], "--reps") == 0) config.repetitions = std::strtoull(value.c_str(), nullptr, 10);
+        else if (std::strcmp(argv[i], "--warmup") == 0) config.warmup = std::strtoull(value.c_str(), nullptr, 10);
+        else if (std::strcmp(argv[i], "--filter") == 0) config.filter = value;
+        else if (std::strcmp(argv[i], "--json") == 0) config.json_path = value;
+        else usage();
+        ++i;
+    }
+    if (config.repetitions == 0 || config.min_size == 0 || config.min_size > config.max_size) usage();
+    return config;
+}
+
+/*
+* Returns min_size, 10 * min_size, ... up to max_size.
+*/
+inline std::vector<size_t> bench_sizes(const bench_config& config) {
+    std::vector<size_t> sizes;
+    for (size_t n = config.min_size; n <= config.max_size; n *= 10) sizes.push_back(n);
+    return sizes;
+}
+
+/*
+* Prints the header of the table printed by print_result.
+*/
+inline void print_header(std::ostream& os) {
+    os << std::left << std::setw(16) << "benchmark" << std::setw(20) << "variant" << std::right
+       << std::setw(11) << "size" << std::setw(14) << "median ns" << std::setw(14) << "p10"
+       << std::setw(14) << "p90" << std::setw(14) << "max" << std::endl;
+}
+
+/*
+* Prints one line of the result table, followed by a line of hardware counts per
+* operation if any were collected.
+*/
+inline void print_result(std::ostream& os, const bench_result& result) {
+    os << std::left << std::setw(16) << result.name << std::setw(20) << result.variant << std::right
+       << std::setw(11) << result.size << std::fixed << std::setprecision(2)
+       << std::setw(14) << result.median << std::setw(14) << result.p10
+       << std::setw(14) << result.p90 << std::setw(14) << result.max << std::endl;
+    if (result.perf.any()) {
+        os << std::defaultfloat << "    per op: ";
+        print_perf_counts(os, result.perf, result.operations * result.samples.size());
+        os << std::fixed << std::endl;
+    }
+}
+
+/*
+* Writes the results as a JSON array, one object per benchmark.
+*/
+inline void write_json(std::ostream& os, const std::vector<bench_result>& results) {
+    os << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        os << "  {\"name\": \"" << r.name << "\", \"variant\": \"" << r.variant << "\""
+           << ", \"size\": " << r.size << ", \"operations\": " << r.operations
+           << ", \"repetitions\": " << r.samples.size()
+           << ", \"ns_per_op\": {\"min\": " << r.min << ", \"p10\": " << r.p10
+           << ", \"median\": " << r.median << ", \"p90\": " << r.p90
+           << ", \"p99\": " << r.p99 << ", \"max\": " << r.max << "}";
+        if (r.perf.any()) {
+            os << ", \"per_op\": {";
+            const char* separator = "";
+            for (size_t e = 0; e < kPerfEventCount; ++e) {
+                if (!r.perf.available[e]) continue;
+                os << separator << "\"" << kPerfEventNames[e] << "\": "
+                   << perf_per_op(r, static_cast<perf_event_kind>(e));
+                separator = ", ";
+            }
+            os << "}";
+        }
+        os << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "]\n";
+}
+
+/*
+* Writes the results to config.json_path, if one was given.
+*/
+inline void write_json_file(const bench_config& config, const std::vector<bench_result>& results) {
+    if (config.json_path.empty()) return;
+    std::ofstream out(config.json_path);
+    write_json(out, results);
+    if (!out) std::cerr << "could not write " << config.json_path << std::endl;
+}
+
+#endif // BENCH_HARNESS_H
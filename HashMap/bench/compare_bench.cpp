@@ -0,0 +1,186 @@
+/*
+* Head-to-head comparison of the HashMap containers with the standard library.
+*
+*      Runs the same workloads (insert every key, look up keys, erase every key) on
+*      HashMap, FlatHashMap, OrderedHashMap, std::unordered_map and std::map, all with
+*      uint64_t keys and values, for four key distributions (see distributions.h):
+*      uniform, zipfian, sequential and collisions. The collisions workload uses a
+*      hash that sends every key to one bucket, like FunctorZero in C_move_time, so
+*      it is capped at kMaxCollisionSize elements.
+*
+*      For each workload it prints the median ns per operation, the throughput of
+*      each container relative to HashMap (above 1 means faster than HashMap) and the
+*      heap bytes per entry of the built map, counted by alloc_counter.
+*
+* Usage:
+*      ./HashMapCompareBench                            # sizes 1000 to 10^6
+*      ./HashMapCompareBench --filter zipfian --json compare.json
+*/
+
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "alloc_counter.h"
+#include "bench_harness.h"
+#include "distributions.h"
+#include "flat_hashmap.h"
+#include "hashmap.h"
+#include "ordered_hashmap.h"
+
+using namespace std;
+
+/*
+* Largest map built with the colliding hash: every operation on it is O(n).
+*/
+const size_t kMaxCollisionSize = 5000;
+
+/*
+* Bytes of allocator bookkeeping per heap block, as in memory_footprint.cpp.
+*/
+const size_t kMallocHeader = sizeof(void*);
+
+/*
+* Medians of one container on one workload.
+*/
+struct compare_result {
+    string container;
+    double insert_ns = 0;
+    double lookup_ns = 0;
+    double erase_ns = 0;
+    double bytes_per_entry = 0;
+};
+
+/*
+* Creates an empty map sized for n elements. std::map takes no size or hash, and the
+* other containers get one bucket per element.
+*/
+template <typename Map>
+Map make_map(size_t n) {
+    if constexpr (requires { Map(n); }) {
+        return Map(n);
+    } else {
+        return Map();
+    }
+}
+
+/*
+* Heap bytes per entry held by a Map built from keys.
+*/
+template <typename Map>
+double bytes_per_entry(const vector<uint64_t>& keys) {
+    auto before = alloc_counter::current();
+    Map map = make_map<Map>(keys.size());
+    for (uint64_t key : keys) map.insert({key, key});
+    auto after = alloc_counter::current();
+
+    size_t blocks = (after.allocations - after.deallocations) - (before.allocations - before.deallocations);
+    size_t bytes = after.live_bytes - before.live_bytes + blocks * kMallocHeader;
+    return static_cast<double>(bytes) / keys.size();
+}
+
+/*
+* Times insert, lookup and erase of one container on one workload, appending the raw
+* results to results.
+*/
+template <typename Map>
+compare_result compare(const bench_config& config, const string& container, const workload_keys& keys,
+                       vector<bench_result>& results) {
+    size_t n = keys.inserts.size();
+    string variant = container + "/" + keys.distribution;
+    // every erase run gets a map built the same way as this one: copying a HashMap
+    // reverses its chains, which would erase each key from the far end of its chain
+    auto build = [&] {
+        Map map = make_map<Map>(n);
+        for (uint64_t key : keys.inserts) map.insert({key, key});
+        return map;
+    };
+    Map built = build();
+
+    auto run = [&](const string& name, auto setup, auto body) {
+        results.push_back(run_benchmark(config, name, variant, n, n, setup, body));
+        return results.back().median;
+    };
+
+    compare_result result;
+    result.container = container;
+    result.insert_ns = run("insert", [&] { return make_map<Map>(n); }, [&](Map& map) {
+        for (uint64_t key : keys.inserts) map.insert({key, key});
+    });
+    result.lookup_ns = run("lookup", [] { return 0; }, [&](int&) {
+        size_t found = 0;
+        for (uint64_t key : keys.lookups) found += built.contains(key);
+        do_not_optimize(found);
+    });
+    result.erase_ns = run("erase", build, [&](Map& map) {
+        for (uint64_t key : keys.inserts) map.erase(key);
+    });
+    result.bytes_per_entry = bytes_per_entry<Map>(keys.inserts);
+    return result;
+}
+
+/*
+* Runs every container on one workload, using hash function H for the hashed ones.
+*/
+template <typename H>
+vector<compare_result> compare_all(const bench_config& config, const workload_keys& keys,
+                                   vector<bench_result>& results) {
+    return {
+        compare<HashMap<uint64_t, uint64_t, H>>(config, "HashMap", keys, results),
+        compare<FlatHashMap<uint64_t, uint64_t, H>>(config, "FlatHashMap", keys, results),
+        compare<OrderedHashMap<uint64_t, uint64_t, H>>(config, "OrderedHashMap", keys, results),
+        compare<unordered_map<uint64_t, uint64_t, H>>(config, "unordered_map", keys, results),
+        compare<map<uint64_t, uint64_t>>(config, "map", keys, results),
+    };
+}
+
+/*
+* Prints the results of one workload, with throughputs relative to the first
+* container (HashMap).
+*/
+void print_comparison(const string& distribution, size_t n, const vector<compare_result>& rows) {
+    const auto& base = rows.front();
+    cout << "\n" << distribution << ", " << n << " elements" << endl;
+    cout << left << setw(16) << "container" << right
+         << setw(12) << "insert ns" << setw(8) << "x"
+         << setw(12) << "lookup ns" << setw(8) << "x"
+         << setw(12) << "erase ns" << setw(8) << "x"
+         << setw(14) << "bytes/entry" << endl;
+    cout << fixed;
+    for (const auto& row : rows) {
+        cout << left << setw(16) << row.container << right << setprecision(1)
+             << setw(12) << row.insert_ns << setw(8) << setprecision(2) << base.insert_ns / row.insert_ns
+             << setw(12) << setprecision(1) << row.lookup_ns << setw(8) << setprecision(2) << base.lookup_ns / row.lookup_ns
+             << setw(12) << setprecision(1) << row.erase_ns << setw(8) << setprecision(2) << base.erase_ns / row.erase_ns
+             << setw(14) << setprecision(1) << row.bytes_per_entry << endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    bench_config defaults;
+    defaults.min_size = 1000;
+    defaults.repetitions = 5;
+    bench_config config = parse_bench_args(argc, argv, defaults);
+    vector<bench_result> results;
+    mt19937_64 rng(106);
+
+    cout << "Throughput relative to HashMap (x > 1 is faster), uint64_t -> uint64_t" << endl;
+    for (const string distribution : {"uniform", "zipfian", "sequential", "collisions"}) {
+        if (!bench_selected(config, distribution)) continue;
+        for (size_t n : bench_sizes(config)) {
+            if (distribution == "collisions" && n > kMaxCollisionSize) break;
+            auto keys = make_workload(distribution, n, rng);
+            auto rows = keys.colliding_hash ? compare_all<colliding_hash>(config, keys, results)
+                                            : compare_all<std::hash<uint64_t>>(config, keys, results);
+            print_comparison(distribution, n, rows);
+        }
+    }
+
+    write_json_file(config, results);
+    return 0;
+}
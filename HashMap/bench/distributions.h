@@ -0,0 +1,105 @@
+/*
+* Key distributions for the HashMap benchmarks.
+*
+*      uniform    - random 64-bit keys, looked up uniformly
+*      zipfian    - keys 0..n-1, looked up with a Zipfian (theta = 0.99) skew, so a few
+*                   keys get most of the lookups (the usual skew of cache and index traffic)
+*      sequential - keys 0..n-1 inserted and looked up in order, like auto-increment IDs
+*      collisions - keys 0..n-1 with a hash function that sends every key to bucket 0,
+*                   the worst case (same as FunctorZero in the test harness)
+*/
+
+#ifndef DISTRIBUTIONS_H
+#define DISTRIBUTIONS_H
+
+#include <cmath>                // for pow
+#include <cstdint>              // for uint64_t
+#include <numeric>              // for iota
+#include <random>               // for mt19937_64, uniform_real_distribution
+#include <string>               // for string
+#include <vector>               // for vector
+
+/*
+* Draws integers in [0, n) with P(i) proportional to 1 / (i + 1)^theta, in O(1) per
+* draw, using the method of Gray et al., "Quickly Generating Billion-Record Synthetic
+* Databases" (the generator used by YCSB). Item 0 is the most popular.
+*/
+class zipfian_generator {
+public:
+    explicit zipfian_generator(uint64_t n, double theta = 0.99) :
+        _n(n), _theta(theta), _zeta_n(zeta(n, theta)), _alpha(1.0 / (1.0 - theta)) {
+        double zeta2 = zeta(2, theta);
+        _eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / _zeta_n);
+    }
+
+    template <typename Rng>
+    uint64_t operator()(Rng& rng) {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        double uz = u * _zeta_n;
+        if (uz < 1.0) return 0;
+        if (uz < 1.0 + std::pow(0.5, _theta)) return std::min<uint64_t>(1, _n - 1);
+        auto value = static_cast<uint64_t>(_n * std::pow(_eta * u - _eta + 1.0, _alpha));
+        return value < _n ? value : _n - 1;
+    }
+
+    uint64_t items() const { return _n; }
+
+private:
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; ++i) sum += 1.0 / std::pow(static_cast<double>(i), theta);
+        return sum;
+    }
+
+    uint64_t _n;
+    double _theta;
+    double _zeta_n;
+    double _alpha;
+    double _eta;
+};
+
+/*
+* Keys to insert and keys to look up for one distribution.
+*/
+struct workload_keys {
+    std::string distribution;
+    std::vector<uint64_t> inserts;      // distinct keys, in insertion order
+    std::vector<uint64_t> lookups;      // keys to look up, all present in inserts
+    bool colliding_hash = false;        // whether the maps must use a constant hash
+};
+
+/*
+* Builds the keys of the named distribution (see the top of this file) for n elements,
+* with one lookup per element.
+*/
+inline workload_keys make_workload(const std::string& distribution, size_t n, std::mt19937_64& rng) {
+    workload_keys keys;
+    keys.distribution = distribution;
+    keys.inserts.resize(n);
+    keys.lookups.resize(n);
+
+    if (distribution == "uniform") {
+        for (auto& key : keys.inserts) key = rng();
+        std::uniform_int_distribution<size_t> pick(0, n - 1);
+        for (auto& key : keys.lookups) key = keys.inserts[pick(rng)];
+    } else if (distribution == "zipfian") {
+        std::iota(keys.inserts.begin(), keys.inserts.end(), 0);
+        zipfian_generator zipf(n);
+        for (auto& key : keys.lookups) key = zipf(rng);
+    } else {
+        // sequential and collisions
+        std::iota(keys.inserts.begin(), keys.inserts.end(), 0);
+        keys.lookups = keys.inserts;
+        keys.colliding_hash = distribution == "collisions";
+    }
+    return keys;
+}
+
+/*
+* Hash function that sends every key to the same bucket.
+*/
+struct colliding_hash {
+    size_t operator()(uint64_t) const { return 0; }
+};
+
+#endif // DISTRIBUTIONS_H
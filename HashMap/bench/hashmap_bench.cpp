@@ -0,0 +1,160 @@
+/*
+* HashMap microbenchmark suite.
+*
+*      Times insert, hit and miss lookups, erase, iteration, rehash, copy and move on
+*      HashMaps from --min-size to --max-size elements (powers of 10), for three key
+*      types: int, short strings (12 characters, fit in the small string buffer) and
+*      long strings (64 characters, heap allocated). Every map starts with one bucket
+*      per element, since HashMap does not grow by itself.
+*
+*      The int and long string suites run a second time on maps with a Bloom filter
+*      (variants int_bloom and long_string_bloom), to show what the filter saves on
+*      lookup_miss and what it costs everywhere else. The int suite also runs on maps
+*      whose bucket array and nodes are on huge pages (variant int_hugepage); with
+*      --perf, compare the dTLB misses per lookup of int and int_hugepage.
+*
+* Usage:
+*      ./HashMapBench                                   # sizes 10 to 10^6
+*      ./HashMapBench --max-size 100000000 --reps 5     # up to 10^8 (needs a lot of memory)
+*      ./HashMapBench --filter lookup --json baseline.json
+*      ./HashMapBench --filter lookup --perf            # cache misses per lookup (Linux)
+*      ./HashMapBench --filter lookup --perf --min-size 10000000 --max-size 10000000
+*/
+
+#include <algorithm>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+#include "bench_harness.h"
+#include "hashmap.h"
+
+using namespace std;
+
+/*
+* Returns n distinct keys of type K, numbered from first, in random order.
+*/
+template <typename K>
+vector<K> make_keys(size_t n, size_t first, mt19937_64& rng);
+
+template <>
+vector<int> make_keys<int>(size_t n, size_t first, mt19937_64& rng) {
+    vector<int> keys(n);
+    iota(keys.begin(), keys.end(), static_cast<int>(first));
+    shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+}
+
+template <>
+vector<string> make_keys<string>(size_t n, size_t first, mt19937_64& rng) {
+    vector<string> keys;
+    keys.reserve(n);
+    for (size_t i = 0; i < n; ++i) keys.push_back(to_string(first + i));
+    shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+}
+
+/*
+* Pads every key to exactly length characters, keeping the keys distinct.
+*/
+vector<string> pad_keys(vector<string> keys, size_t length) {
+    for (auto& key : keys) key = string(length > key.size() ? length - key.size() : 0, 'k') + key;
+    return keys;
+}
+
+/*
+* std::hash under another name, whose maps use a Bloom filter.
+*/
+template <typename K>
+struct bloom_hash : hash<K> {};
+
+template <typename K>
+struct hashmap_policy<K, int, bloom_hash<K>> : bloom_hashmap_policy {};
+
+/*
+* std::hash under yet another name, whose maps are on huge pages.
+*/
+template <typename K>
+struct huge_page_hash : hash<K> {};
+
+template <typename K>
+struct hashmap_policy<K, int, huge_page_hash<K>> : huge_page_hashmap_policy {};
+
+/*
+* Runs every benchmark for one key type and one size, appending to results.
+*/
+template <typename K, typename H = hash<K>>
+void run_suite(const bench_config& config, const string& variant, size_t n,
+               const vector<K>& keys, const vector<K>& missing, vector<bench_result>& results) {
+    using Map = HashMap<K, int, H>;
+    Map built(n);
+    for (const auto& key : keys) built.insert({key, 1});
+
+    auto add = [&](const string& name, size_t operations, auto setup, auto body) {
+        if (!bench_selected(config, name)) return;
+        results.push_back(run_benchmark(config, name, variant, n, operations, setup, body));
+        print_result(cout, results.back());
+    };
+    auto fresh = [&] { return Map(n); };
+    auto copy = [&] { return Map(built); };
+    auto none = [] { return 0; };
+
+    add("insert", n, fresh, [&](Map& map) {
+        for (const auto& key : keys) map.insert({key, 1});
+    });
+    add("lookup_hit", n, none, [&](int&) {
+        size_t found = 0;
+        for (const auto& key : keys) found += built.contains(key);
+        do_not_optimize(found);
+    });
+    add("lookup_miss", n, none, [&](int&) {
+        size_t found = 0;
+        for (const auto& key : missing) found += built.contains(key);
+        do_not_optimize(found);
+    });
+    add("erase", n, copy, [&](Map& map) {
+        for (const auto& key : keys) map.erase(key);
+    });
+    add("iterate", n, none, [&](int&) {
+        long sum = 0;
+        for (const auto& [key, mapped] : built) sum += mapped;
+        do_not_optimize(sum);
+    });
+    add("rehash", n, copy, [&](Map& map) { map.rehash(2 * n); });
+    // the copies are kept in the state, so that destroying them is not timed
+    add("copy", n, [] { return optional<Map>(); }, [&](optional<Map>& copied) {
+        copied.emplace(built);
+    });
+    add("move", 1, [&] { return pair<Map, optional<Map>>(built, nullopt); },
+        [&](pair<Map, optional<Map>>& maps) {
+        maps.second.emplace(std::move(maps.first));
+    });
+}
+
+int main(int argc, char** argv) {
+    bench_config config = parse_bench_args(argc, argv);
+    vector<bench_result> results;
+    mt19937_64 rng(106);
+
+    print_header(cout);
+    for (size_t n : bench_sizes(config)) {
+        auto ints = make_keys<int>(n, 0, rng);
+        auto missing_ints = make_keys<int>(n, n, rng);
+        run_suite(config, "int", n, ints, missing_ints, results);
+        run_suite<int, bloom_hash<int>>(config, "int_bloom", n, ints, missing_ints, results);
+        run_suite<int, huge_page_hash<int>>(config, "int_hugepage", n, ints, missing_ints, results);
+
+        auto strings = make_keys<string>(n, 0, rng);
+        auto missing_strings = make_keys<string>(n, n, rng);
+        run_suite(config, "short_string", n, pad_keys(strings, 12), pad_keys(missing_strings, 12), results);
+        auto long_strings = pad_keys(strings, 64);
+        auto missing_long_strings = pad_keys(missing_strings, 64);
+        run_suite(config, "long_string", n, long_strings, missing_long_strings, results);
+        run_suite<string, bloom_hash<string>>(config, "long_string_bloom", n, long_strings,
+                                              missing_long_strings, results);
+    }
+
+    write_json_file(config, results);
+    return 0;
+}
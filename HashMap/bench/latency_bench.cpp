@@ -0,0 +1,222 @@
+/*
+* Per-operation latency benchmark: the tail latency of insert, operator[] and erase.
+*
+*      Throughput benchmarks report averages, which hide the occasional operation
+*      that has to rehash the whole table. This benchmark times every single operation
+*      of a long run and records it in a latency_histogram, then reports p50, p99,
+*      p99.9 and max. Operations during which the table grew are also recorded in a
+*      second histogram, so the report shows how much of the tail comes from rehash.
+*
+*      HashMap never grows by itself, so the growth strategy is part of the workload:
+*          presized    - HashMap rehashed once, up front, to enough buckets for the run
+*          double      - HashMap rehashed to 2x the buckets whenever the load factor
+*                        passes 1 (one-shot rehash, amortized O(1))
+*          grow_25pct  - the same, growing by 1.25x: more rehashes, each one smaller
+*          flat        - FlatHashMap, which doubles by itself at a load of 7/8
+*      The time of an operation includes the rehash it triggered, as a caller would see it.
+*
+*      Each strategy runs three phases on one map of --max-size elements:
+*          insert      - insert every key
+*          operator[]  - operator[] on keys half present, half new (the new ones grow the map)
+*          erase       - erase every key
+*
+*      Every sample includes the cost of reading the clock twice (printed at the start).
+*
+*      --reps N repeats every strategy N times (default 1) on a fresh map, and merges
+*      the samples of all the runs into one histogram per phase; --warmup N first runs
+*      it N times without recording anything (default 0). --perf is refused: reading
+*      the counters around every operation would cost more than the operation.
+*
+* Usage:
+*      ./HashMapLatencyBench                            # 10^6 elements per strategy
+*      ./HashMapLatencyBench --max-size 10000000 --filter double --json latency.json
+*      ./HashMapLatencyBench --reps 5 --warmup 1        # 5x the samples for the tail
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "bench_harness.h"
+#include "flat_hashmap.h"
+#include "hashmap.h"
+#include "latency_histogram.h"
+
+using namespace std;
+using bench_clock = std::chrono::steady_clock;
+
+/*
+* Latencies of one phase of one strategy.
+*/
+struct phase_result {
+    string strategy;
+    string operation;
+    latency_histogram all;              // every operation
+    latency_histogram rehash;           // only the operations during which the table grew
+};
+
+/*
+* Times one call of op, in nanoseconds.
+*/
+template <typename Op>
+uint64_t time_ns(Op op) {
+    auto start = bench_clock::now();
+    op();
+    auto end = bench_clock::now();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+/*
+* Median cost of reading the clock twice, which every sample includes.
+*/
+uint64_t clock_overhead() {
+    latency_histogram histogram;
+    for (int i = 0; i < 100000; ++i) histogram.record(time_ns([] {}));
+    return histogram.percentile(0.5);
+}
+
+/*
+* Runs the three phases on map. grow(map) is called after every operation that can
+* add an element, and is timed as part of that operation.
+*/
+template <typename Map, typename Grow>
+vector<phase_result> run_strategy(const string& strategy, Map map, Grow grow,
+                                  const vector<uint64_t>& keys, const vector<uint64_t>& access_keys) {
+    vector<phase_result> results(3);
+    auto record = [&](phase_result& result, size_t buckets_before, uint64_t ns) {
+        result.all.record(ns);
+        if (map.bucket_count() != buckets_before) result.rehash.record(ns);
+    };
+
+    results[0].operation = "insert";
+    for (uint64_t key : keys) {
+        size_t buckets = map.bucket_count();
+        record(results[0], buckets, time_ns([&] {
+            map.insert({key, key});
+            grow(map);
+        }));
+    }
+
+    results[1].operation = "operator[]";
+    for (uint64_t key : access_keys) {
+        size_t buckets = map.bucket_count();
+        record(results[1], buckets, time_ns([&] {
+            map[key] += 1;
+            grow(map);
+        }));
+    }
+
+    results[2].operation = "erase";
+    for (uint64_t key : keys) {
+        size_t buckets = map.bucket_count();
+        record(results[2], buckets, time_ns([&] { map.erase(key); }));
+    }
+
+    for (auto& result : results) result.strategy = strategy;
+    return results;
+}
+
+/*
+* Growth policy for HashMap: multiplies the bucket count by factor once the load
+* factor passes 1.
+*/
+auto grow_by(double factor) {
+    return [factor](HashMap<uint64_t, uint64_t>& map) {
+        if (map.size() > map.bucket_count()) {
+            map.rehash(static_cast<size_t>(map.bucket_count() * factor) + 1);
+        }
+    };
+}
+
+void print_latency_header() {
+    cout << left << setw(13) << "strategy" << setw(12) << "operation" << right
+         << setw(10) << "p50 ns" << setw(10) << "p99" << setw(10) << "p99.9" << setw(12) << "max"
+         << setw(10) << "rehashes" << setw(14) << "rehash p50" << setw(14) << "rehash max" << endl;
+}
+
+void print_phase(const phase_result& r) {
+    cout << left << setw(13) << r.strategy << setw(12) << r.operation << right
+         << setw(10) << r.all.percentile(0.5) << setw(10) << r.all.percentile(0.99)
+         << setw(10) << r.all.percentile(0.999) << setw(12) << r.all.max()
+         << setw(10) << r.rehash.count() << setw(14) << r.rehash.percentile(0.5)
+         << setw(14) << r.rehash.max() << endl;
+}
+
+void write_latency_json(const string& path, const vector<phase_result>& results) {
+    std::ofstream out(path);
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        out << "  {\"strategy\": \"" << r.strategy << "\", \"operation\": \"" << r.operation << "\""
+            << ", \"count\": " << r.all.count()
+            << ", \"ns\": {\"p50\": " << r.all.percentile(0.5) << ", \"p99\": " << r.all.percentile(0.99)
+            << ", \"p999\": " << r.all.percentile(0.999) << ", \"max\": " << r.all.max() << "}"
+            << ", \"rehash\": {\"count\": " << r.rehash.count() << ", \"p50\": " << r.rehash.percentile(0.5)
+            << ", \"max\": " << r.rehash.max() << "}}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+    if (!out) std::cerr << "could not write " << path << std::endl;
+}
+
+int main(int argc, char** argv) {
+    bench_config defaults;
+    defaults.repetitions = 1;
+    defaults.warmup = 0;
+    bench_config config = parse_bench_args(argc, argv, defaults);
+    if (config.perf) {
+        cerr << "--perf is not supported: the counters would cost more than the operations they measure" << endl;
+        return EXIT_FAILURE;
+    }
+    size_t n = config.max_size;
+    mt19937_64 rng(106);
+
+    vector<uint64_t> keys(n);
+    for (auto& key : keys) key = rng();
+    // half of the operator[] keys are present, half are new
+    vector<uint64_t> access_keys(n);
+    for (size_t i = 0; i < n; ++i) access_keys[i] = i % 2 == 0 ? keys[rng() % n] : rng();
+
+    cout << n << " elements, " << config.repetitions << " runs per strategy, clock overhead "
+         << clock_overhead() << " ns per sample" << endl;
+    print_latency_header();
+
+    vector<phase_result> results;
+    // runs a strategy --warmup times for nothing, then --reps times into one set of phases
+    auto add = [&](const string& strategy, auto make_map, auto grow) {
+        for (size_t i = 0; i < config.warmup; ++i) run_strategy(strategy, make_map(), grow, keys, access_keys);
+        vector<phase_result> phases = run_strategy(strategy, make_map(), grow, keys, access_keys);
+        for (size_t rep = 1; rep < config.repetitions; ++rep) {
+            vector<phase_result> more = run_strategy(strategy, make_map(), grow, keys, access_keys);
+            for (size_t i = 0; i < phases.size(); ++i) {
+                phases[i].all.merge(more[i].all);
+                phases[i].rehash.merge(more[i].rehash);
+            }
+        }
+        for (auto& phase : phases) {
+            print_phase(phase);
+            results.push_back(std::move(phase));
+        }
+    };
+    using Map = HashMap<uint64_t, uint64_t>;
+    if (bench_selected(config, "presized")) {
+        add("presized", [n] { return Map(2 * n); }, [](Map&) {});
+    }
+    if (bench_selected(config, "double")) {
+        add("double", [] { return Map(); }, grow_by(2.0));
+    }
+    if (bench_selected(config, "grow_25pct")) {
+        add("grow_25pct", [] { return Map(); }, grow_by(1.25));
+    }
+    if (bench_selected(config, "flat")) {
+        add("flat", [] { return FlatHashMap<uint64_t, uint64_t>(); }, [](auto&) {});
+    }
+
+    if (!config.json_path.empty()) write_latency_json(config.json_path, results);
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+* Log-linear latency histogram, in the style of HdrHistogram.
+*
+*      Values (nanoseconds) are grouped by their highest set bit, and each group is
+*      split into kSubBuckets linear sub-buckets, so every recorded value is kept with
+*      a relative error below 1 / kSubBuckets (about 1.6%) whatever its magnitude. The
+*      histogram has a fixed size (a few KB), so it can record hundreds of millions of
+*      samples, where keeping every sample to sort would not fit in memory.
+*
+* Usage:
+*      latency_histogram histogram;
+*      for (...) histogram.record(ns);
+*      std::cout << histogram.percentile(0.999) << " " << histogram.max() << std::endl;
+*/
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <algorithm>            // for max, min
+#include <array>                // for array
+#include <bit>                  // for bit_width
+#include <cstdint>              // for uint64_t
+
+class latency_histogram {
+public:
+    static constexpr unsigned kSubBucketBits = 6;
+    static constexpr uint64_t kSubBuckets = uint64_t{1} << kSubBucketBits;
+
+    /*
+    * Adds one sample.
+    *
+    * Complexity: O(1)
+    */
+    void record(uint64_t value) noexcept {
+        ++_counts[index_of(value)];
+        ++_count;
+        _max = std::max(_max, value);
+        _min = _count == 1 ? value : std::min(_min, value);
+    }
+
+    /*
+    * Adds every sample of other.
+    */
+    void merge(const latency_histogram& other) noexcept {
+        if (other._count == 0) return;
+        for (size_t i = 0; i < _counts.size(); ++i) _counts[i] += other._counts[i];
+        _min = _count == 0 ? other._min : std::min(_min, other._min);
+        _max = std::max(_max, other._max);
+        _count += other._count;
+    }
+
+    /*
+    * Returns the smallest value v such that a fraction p (0 <= p <= 1) of the samples
+    * are at most v, rounded up to the top of v's sub-bucket, and never above max().
+    *
+    * Complexity: O(size of the histogram)
+    */
+    uint64_t percentile(double p) const noexcept {
+        if (_count == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(p * _count);
+        if (rank < 1) rank = 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < _counts.size(); ++i) {
+            seen += _counts[i];
+            if (seen >= rank) return std::min(highest_value(i), _max);
+        }
+        return _max;
+    }
+
+    uint64_t count() const noexcept { return _count; }
+    uint64_t min() const noexcept { return _min; }
+    uint64_t max() const noexcept { return _max; }
+
+private:
+    /*
+    * Values below kSubBuckets have one bucket each. Above that, the values with highest
+    * bit b (b >= kSubBucketBits) occupy kSubBuckets buckets starting at
+    * (b - kSubBucketBits + 1) * kSubBuckets, indexed by the kSubBucketBits bits below b.
+    */
+    static size_t index_of(uint64_t value) noexcept {
+        if (value < kSubBuckets) return static_cast<size_t>(value);
+        unsigned shift = std::bit_width(value) - 1 - kSubBucketBits;
+        return static_cast<size_t>((shift + 1) * kSubBuckets + ((value >> shift) - kSubBuckets));
+    }
+
+    static uint64_t highest_value(size_t index) noexcept {
+        if (index < kSubBuckets) return index;
+        unsigned shift = static_cast<unsigned>(index / kSubBuckets - 1);
+        uint64_t sub = index % kSubBuckets + kSubBuckets;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::array<uint64_t, (64 - kSubBucketBits + 1) * kSubBuckets> _counts{};
+    uint64_t _count = 0;
+    uint64_t _min = 0;
+    uint64_t _max = 0;
+};
+
+#endif // LATENCY_HISTOGRAM_H
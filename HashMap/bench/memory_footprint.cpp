@@ -0,0 +1,184 @@
+/*
+* Memory footprint benchmark: heap bytes per entry of integer maps.
+*
+*      Builds HashMap<int64_t, int64_t> (one node per element),
+*      FlatHashMap<int64_t, int64_t> (structure of arrays) and
+*      PackedHashMap<int64_t, int64_t> (compressed blocks) with the same keys and
+*      reports the heap bytes each one holds, divided by the number of entries.
+*      Each heap block is also charged kMallocHeader bytes for the allocator's own
+*      bookkeeping, which is what makes one small allocation per element expensive.
+*
+*      Then, for several key/value type combinations, reports the bytes per entry of
+*      HashMap at load factors from 0.25 to 4, both as estimated by
+*      HashMap::memory_usage() and as measured by alloc_counter, with the breakdown
+*      of the estimate: table (bucket array and bitmap), nodes, heap owned by the keys
+*      and values, and allocator overhead.
+*
+*      Finally compares HashMap<std::string, int> with StringHashMap<int>, which keeps
+*      the key characters in a pool, for keys of several lengths: grown one insert at
+*      a time, and reserved for its final size.
+*
+* Usage:
+*      ./HashMapMemoryBench
+*/
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "alloc_counter.h"
+#include "flat_hashmap.h"
+#include "hashmap.h"
+#include "packed_hashmap.h"
+#include "string_hashmap.h"
+
+using namespace std;
+
+/*
+* Bytes of allocator bookkeeping per heap block (the chunk header on 64-bit glibc).
+*/
+const size_t kMallocHeader = sizeof(void*);
+
+struct footprint_result {
+    double bytes_per_entry;
+    float load_factor;
+};
+
+/*
+* Builds a Map with n entries, starting from one bucket per entry, and returns the
+* heap bytes it holds per entry.
+*/
+template <typename Map>
+footprint_result footprint(size_t n) {
+    auto before = alloc_counter::current();
+    Map map(n);
+    for (size_t i = 0; i < n; ++i) {
+        map.insert({static_cast<int64_t>(i * 7919), static_cast<int64_t>(i)});
+    }
+    auto after = alloc_counter::current();
+
+    size_t blocks = (after.allocations - after.deallocations) - (before.allocations - before.deallocations);
+    size_t bytes = after.live_bytes - before.live_bytes + blocks * kMallocHeader;
+    return {static_cast<double>(bytes) / n, map.load_factor()};
+}
+
+/*
+* Returns the n-th key or value of type T: integers, or strings of length bytes.
+*/
+template <typename T>
+T make_value(size_t i, size_t length) {
+    if constexpr (std::is_same_v<T, string>) {
+        string value = to_string(i);
+        return string(length > value.size() ? length - value.size() : 0, 'x') + value;
+    } else {
+        return static_cast<T>(i);
+    }
+}
+
+/*
+* Prints one line per load factor for HashMap<K, M>, with n elements.
+*/
+template <typename K, typename M>
+void footprint_by_load_factor(const string& name, size_t n, size_t key_length, size_t mapped_length) {
+    vector<K> keys;
+    vector<M> values;
+    for (size_t i = 0; i < n; ++i) {
+        keys.push_back(make_value<K>(i * 7919, key_length));
+        values.push_back(make_value<M>(i, mapped_length));
+    }
+    for (double load_factor : {0.25, 0.5, 1.0, 2.0, 4.0}) {
+        auto before = alloc_counter::current();
+        HashMap<K, M> map(static_cast<size_t>(n / load_factor));
+        for (size_t i = 0; i < n; ++i) map.insert({keys[i], values[i]});
+        auto after = alloc_counter::current();
+
+        size_t blocks = (after.allocations - after.deallocations) - (before.allocations - before.deallocations);
+        double measured = static_cast<double>(after.live_bytes - before.live_bytes + blocks * kMallocHeader) / n;
+        HashMapMemoryUsage usage = map.memory_usage();
+        cout << left << setw(27) << name << right << setw(8) << setprecision(2) << map.load_factor()
+             << setw(11) << setprecision(1) << usage.bytes_per_entry() << setw(11) << measured
+             << setw(9) << static_cast<double>(usage.bucket_bytes) / n
+             << setw(9) << static_cast<double>(usage.node_bytes) / n
+             << setw(9) << static_cast<double>(usage.key_heap_bytes + usage.mapped_heap_bytes) / n
+             << setw(10) << static_cast<double>(usage.allocator_overhead) / n << endl;
+    }
+}
+
+/*
+* Returns the heap bytes per entry held by map after calling build(map), measured
+* by alloc_counter.
+*/
+template <typename Map, typename Build>
+double measured_bytes_per_entry(Map& map, size_t n, Build build) {
+    auto before = alloc_counter::current();
+    build(map);
+    auto after = alloc_counter::current();
+    size_t blocks = (after.allocations - after.deallocations) - (before.allocations - before.deallocations);
+    return static_cast<double>(after.live_bytes - before.live_bytes + blocks * kMallocHeader) / n;
+}
+
+/*
+* Prints the bytes per entry of HashMap<string, int> and StringHashMap<int> holding
+* the same n keys of key_length characters.
+*/
+void string_key_footprint(size_t n, size_t key_length) {
+    vector<string> keys;
+    for (size_t i = 0; i < n; ++i) keys.push_back(make_value<string>(i * 7919, key_length));
+
+    HashMap<string, int> nodes(n);
+    double node_bytes = measured_bytes_per_entry(nodes, n, [&](auto& map) {
+        for (size_t i = 0; i < n; ++i) map.insert({keys[i], static_cast<int>(i)});
+    });
+    StringHashMap<int> pooled;
+    double pooled_bytes = measured_bytes_per_entry(pooled, n, [&](auto& map) {
+        for (size_t i = 0; i < n; ++i) map.insert({keys[i], static_cast<int>(i)});
+    });
+    StringHashMap<int> reserved;
+    double reserved_bytes = measured_bytes_per_entry(reserved, n, [&](auto& map) {
+        map.reserve(n);
+        for (size_t i = 0; i < n; ++i) map.insert({keys[i], static_cast<int>(i)});
+    });
+    cout << setw(10) << key_length << setw(16) << setprecision(1) << node_bytes
+         << setw(16) << pooled_bytes << setw(10) << setprecision(2) << pooled_bytes / node_bytes
+         << setw(16) << setprecision(1) << reserved_bytes
+         << setw(10) << setprecision(2) << reserved_bytes / node_bytes << endl;
+}
+
+int main() {
+    cout << "Heap bytes per entry, int64_t -> int64_t (payload is 16 bytes)" << endl;
+    cout << setw(10) << "entries"
+         << setw(16) << "HashMap" << setw(8) << "load"
+         << setw(16) << "FlatHashMap" << setw(8) << "load"
+         << setw(16) << "PackedHashMap" << endl;
+    cout << fixed;
+    for (size_t n : {1000, 10000, 100000, 500000, 1000000, 5000000}) {
+        auto node = footprint<HashMap<int64_t, int64_t>>(n);
+        auto flat = footprint<FlatHashMap<int64_t, int64_t>>(n);
+        auto packed = footprint<PackedHashMap<int64_t, int64_t>>(n);
+        cout << setw(10) << n
+             << setw(16) << setprecision(1) << node.bytes_per_entry
+             << setw(8) << setprecision(2) << node.load_factor
+             << setw(16) << setprecision(1) << flat.bytes_per_entry
+             << setw(8) << setprecision(2) << flat.load_factor
+             << setw(16) << setprecision(1) << packed.bytes_per_entry << endl;
+    }
+
+    const size_t n = 100000;
+    cout << endl << "HashMap bytes per entry by load factor, " << n << " entries" << endl;
+    cout << left << setw(27) << "key -> mapped" << right << setw(8) << "load" << setw(11) << "estimate"
+         << setw(11) << "measured" << setw(9) << "table" << setw(9) << "nodes" << setw(9) << "owned"
+         << setw(10) << "overhead" << endl;
+    footprint_by_load_factor<int, int>("int -> int", n, 0, 0);
+    footprint_by_load_factor<int64_t, int64_t>("int64 -> int64", n, 0, 0);
+    footprint_by_load_factor<string, int>("string(12) -> int", n, 12, 0);
+    footprint_by_load_factor<string, int>("string(64) -> int", n, 64, 0);
+    footprint_by_load_factor<int64_t, string>("int64 -> string(100)", n, 0, 100);
+    footprint_by_load_factor<string, string>("string(24) -> string(200)", n, 24, 200);
+
+    cout << endl << "String keys -> int, bytes per entry, " << n << " entries" << endl;
+    cout << setw(10) << "key bytes" << setw(16) << "HashMap" << setw(16) << "StringHashMap"
+         << setw(10) << "ratio" << setw(16) << "reserved" << setw(10) << "ratio" << endl;
+    for (size_t key_length : {8, 16, 24, 40, 64, 128}) string_key_footprint(n, key_length);
+    return 0;
+}
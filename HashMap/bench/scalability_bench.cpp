@@ -0,0 +1,202 @@
+/*
+* Multi-threaded scalability benchmark: how HashMap-based structures behave under contention.
+*
+*      Runs 1, 2, 4, ... up to std::thread::hardware_concurrency() threads. Every thread
+*      does the same number of operations (90% lookups, 10% updates of existing keys,
+*      on keys picked uniformly), so a structure that scales perfectly keeps the time
+*      per operation constant and multiplies throughput by the number of threads.
+*
+*          local           - every thread has its own HashMap (the upper bound)
+*          mutex           - one shared HashMap behind a std::mutex
+*          read_only       - one shared HashMap, lookups only, no lock
+*          packed_counters - like local, and every thread also counts its operations
+*                            in an array of adjacent uint64_t (one cache line for all)
+*          padded_counters - the same, with every counter on its own cache line
+*
+*      The difference between packed_counters and padded_counters is the cost of false
+*      sharing: the counters are never shared, but their cache line is. Any concurrent
+*      map has to beat mutex to be worth having.
+*
+*      Each map has --max-size elements (default 10^5) and every thread does
+*      kOpsPerThread operations per run.
+*
+* Usage:
+*      ./HashMapScalabilityBench
+*      ./HashMapScalabilityBench --max-size 1000000 --filter mutex --json scaling.json
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench_harness.h"
+#include "hashmap.h"
+
+using namespace std;
+using Map = HashMap<uint64_t, uint64_t>;
+
+const size_t kOpsPerThread = 1000000;
+const size_t kCacheLine = 64;
+
+/*
+* Small, fast random number generator for the threads (splitmix64).
+*/
+struct thread_rng {
+    uint64_t state;
+    uint64_t operator()() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+};
+
+/*
+* Starts threads that each call body(thread_index), releases them together and waits
+* for all of them.
+*/
+template <typename Body>
+void run_threads(size_t threads, Body body) {
+    atomic<bool> go{false};
+    vector<thread> pool;
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            while (!go.load(memory_order_acquire)) this_thread::yield();
+            body(t);
+        });
+    }
+    go.store(true, memory_order_release);
+    for (auto& thread : pool) thread.join();
+}
+
+Map build_map(size_t n) {
+    Map map(n);
+    for (uint64_t key = 0; key < n; ++key) map.insert({key, key});
+    return map;
+}
+
+/*
+* One operation of the 90% lookup / 10% update mix on map.
+*/
+inline void mixed_op(Map& map, thread_rng& rng, size_t n, uint64_t& sum) {
+    uint64_t r = rng();
+    uint64_t key = r % n;
+    if ((r >> 56) < 26) {
+        map[key] += 1;                  // about 10%
+    } else if (map.contains(key)) {
+        sum += map.at(key);
+    }
+}
+
+struct alignas(kCacheLine) padded_counter {
+    uint64_t value = 0;
+};
+
+inline void increment(uint64_t& counter) { ++counter; }
+inline void increment(padded_counter& counter) { ++counter.value; }
+
+/*
+* Runs the operation mix on thread-local maps, with every thread also counting its
+* operations in counters[thread], which is stored to memory on every operation.
+*/
+template <typename Counter>
+void run_counted(vector<Map>& maps, vector<Counter>& counters, size_t threads, size_t n) {
+    run_threads(threads, [&](size_t t) {
+        thread_rng rng{t + 1};
+        uint64_t sum = 0;
+        for (size_t i = 0; i < kOpsPerThread; ++i) {
+            mixed_op(maps[t], rng, n, sum);
+            increment(counters[t]);
+            do_not_optimize(counters[t]);
+        }
+        do_not_optimize(sum);
+    });
+}
+
+int main(int argc, char** argv) {
+    bench_config defaults;
+    defaults.max_size = 100000;
+    defaults.repetitions = 5;
+    defaults.warmup = 1;
+    bench_config config = parse_bench_args(argc, argv, defaults);
+    size_t n = config.max_size;
+
+    size_t max_threads = max(1u, thread::hardware_concurrency());
+    vector<size_t> thread_counts;
+    for (size_t t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+    thread_counts.push_back(max_threads);
+
+    vector<bench_result> results;
+    Map shared = build_map(n);
+    mutex shared_mutex;
+
+    cout << n << " elements, " << kOpsPerThread << " operations per thread, up to "
+         << max_threads << " threads" << endl;
+    cout << left << setw(18) << "structure" << right << setw(9) << "threads" << setw(14) << "Mops/s"
+         << setw(12) << "speedup" << setw(14) << "efficiency" << setw(14) << "ns/op/thread" << endl;
+
+    auto add = [&](const string& name, auto setup, auto body) {
+        if (!bench_selected(config, name)) return;
+        double base = 0;
+        for (size_t threads : thread_counts) {
+            size_t ops = threads * kOpsPerThread;
+            results.push_back(run_benchmark(config, name, "threads=" + to_string(threads), n, ops,
+                                            [&] { return setup(threads); },
+                                            [&](auto& state) { body(state, threads); }));
+            double mops = 1000.0 / results.back().median;
+            if (threads == 1) base = mops;
+            cout << left << setw(18) << name << right << setw(9) << threads << fixed << setprecision(2)
+                 << setw(14) << mops << setw(12) << mops / base << setw(13) << 100 * mops / base / threads << "%"
+                 << setw(14) << results.back().median * threads << endl;
+        }
+    };
+
+    add("local", [&](size_t threads) { return vector<Map>(threads, shared); },
+        [&](vector<Map>& maps, size_t threads) {
+        run_threads(threads, [&](size_t t) {
+            thread_rng rng{t + 1};
+            uint64_t sum = 0;
+            for (size_t i = 0; i < kOpsPerThread; ++i) mixed_op(maps[t], rng, n, sum);
+            do_not_optimize(sum);
+        });
+    });
+
+    add("mutex", [](size_t) { return 0; }, [&](int&, size_t threads) {
+        run_threads(threads, [&](size_t t) {
+            thread_rng rng{t + 1};
+            uint64_t sum = 0;
+            for (size_t i = 0; i < kOpsPerThread; ++i) {
+                lock_guard lock(shared_mutex);
+                mixed_op(shared, rng, n, sum);
+            }
+            do_not_optimize(sum);
+        });
+    });
+
+    add("read_only", [](size_t) { return 0; }, [&](int&, size_t threads) {
+        const Map& map = shared;
+        run_threads(threads, [&](size_t t) {
+            thread_rng rng{t + 1};
+            uint64_t sum = 0;
+            for (size_t i = 0; i < kOpsPerThread; ++i) {
+                uint64_t key = rng() % n;
+                if (map.contains(key)) sum += map.at(key);
+            }
+            do_not_optimize(sum);
+        });
+    });
+
+    add("packed_counters", [&](size_t threads) {
+        return make_pair(vector<Map>(threads, shared), vector<uint64_t>(threads, 0));
+    }, [&](auto& state, size_t threads) { run_counted(state.first, state.second, threads, n); });
+    add("padded_counters", [&](size_t threads) {
+        return make_pair(vector<Map>(threads, shared), vector<padded_counter>(threads));
+    }, [&](auto& state, size_t threads) { run_counted(state.first, state.second, threads, n); });
+
+    write_json_file(config, results);
+    return 0;
+}
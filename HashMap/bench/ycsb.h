@@ -0,0 +1,255 @@
+/*
+* YCSB-style workload generator and trace files for the HashMap benchmarks.
+*
+*      A workload is a load phase (record_count keys inserted before timing starts)
+*      followed by a list of operations drawn from a ycsb_spec: each operation is a
+*      read, update, insert, delete or scan, picked with the spec's proportions, on a
+*      key picked with one of the key distributions of YCSB:
+*          uniform   - every existing key equally likely
+*          zipfian   - a few keys get most of the operations; which keys are popular
+*                      is scrambled, so they are not the first ones inserted
+*          latest    - zipfian over insertion order, newest first (recent items are hot)
+*
+*      Keys are identified by a number (the order they were inserted in); ycsb_key
+*      turns that number into the key string, whose length is drawn from the spec's key
+*      size range. Updates and inserts carry a value size drawn from the value size range.
+*
+*      A generated workload can be saved as a trace and replayed later, so that two
+*      versions of HashMap are compared on exactly the same operations. Traces are text,
+*      one operation per line after a header:
+*
+*          ycsb-trace 1 <record_count> <key_size_min> <key_size_max>
+*          R <key>              read
+*          U <key> <size>       update with a value of <size> bytes
+*          I <key> <size>       insert
+*          D <key>              delete
+*          S <key> <length>     scan <length> elements starting at <key>
+*
+* Usage:
+*      ycsb_spec spec = ycsb_preset("A");
+*      ycsb_workload workload = generate_workload(spec);
+*      write_trace(std::ofstream("a.trace"), workload);
+*/
+
+#ifndef YCSB_H
+#define YCSB_H
+
+#include <algorithm>            // for max
+#include <cstdint>              // for uint32_t, uint64_t
+#include <iostream>             // for istream, ostream
+#include <random>               // for mt19937_64, uniform_int_distribution
+#include <stdexcept>            // for invalid_argument, runtime_error
+#include <string>               // for string, to_string
+#include <vector>               // for vector
+#include "distributions.h"
+
+enum class ycsb_op_type : char {
+    read = 'R',
+    update = 'U',
+    insert = 'I',
+    erase = 'D',
+    scan = 'S',
+};
+
+/*
+* One operation of a workload. size is the value size of an update or insert, and
+* the number of elements of a scan.
+*/
+struct ycsb_op {
+    ycsb_op_type type;
+    uint64_t key;
+    uint32_t size;
+};
+
+/*
+* Parameters of a workload. The proportions need not add up to 1; they are weights.
+*/
+struct ycsb_spec {
+    size_t record_count = 100000;       // keys inserted by the load phase
+    size_t operation_count = 1000000;
+    double read = 0.5;
+    double update = 0.5;
+    double insert = 0;
+    double erase = 0;
+    double scan = 0;
+    std::string distribution = "zipfian";       // uniform, zipfian or latest
+    uint32_t key_size_min = 16, key_size_max = 16;
+    uint32_t value_size_min = 100, value_size_max = 100;
+    uint32_t scan_length_max = 100;
+    uint64_t seed = 106;
+};
+
+/*
+* The standard YCSB core workloads, plus "M" (a mix with deletes):
+*      A - 50% read, 50% update, zipfian             (session store)
+*      B - 95% read, 5% update, zipfian              (photo tagging)
+*      C - 100% read, zipfian                        (user profile cache)
+*      D - 95% read, 5% insert, latest               (status updates)
+*      E - 95% scan, 5% insert, zipfian              (threaded conversations)
+*      F - 50% read, 50% read-modify-write, zipfian  (run here as updates)
+*      M - 70% read, 10% update, 10% insert, 10% delete, zipfian
+*
+* Exceptions: std::invalid_argument for any other name.
+*/
+inline ycsb_spec ycsb_preset(const std::string& name) {
+    ycsb_spec spec;
+    auto mix = [&](double read, double update, double insert, double erase, double scan) {
+        spec.read = read;
+        spec.update = update;
+        spec.insert = insert;
+        spec.erase = erase;
+        spec.scan = scan;
+    };
+    if (name == "A" || name == "F") mix(0.5, 0.5, 0, 0, 0);
+    else if (name == "B") mix(0.95, 0.05, 0, 0, 0);
+    else if (name == "C") mix(1, 0, 0, 0, 0);
+    else if (name == "D") mix(0.95, 0, 0.05, 0, 0);
+    else if (name == "E") mix(0, 0, 0.05, 0, 0.95);
+    else if (name == "M") mix(0.7, 0.1, 0.1, 0.1, 0);
+    else throw std::invalid_argument("ycsb_preset: unknown workload " + name);
+    if (name == "D") spec.distribution = "latest";
+    return spec;
+}
+
+/*
+* A generated (or replayed) workload.
+*/
+struct ycsb_workload {
+    size_t record_count = 0;
+    uint32_t key_size_min = 16, key_size_max = 16;
+    std::vector<ycsb_op> ops;
+};
+
+/*
+* Mixes the bits of x (the 64-bit finalizer of MurmurHash3).
+*/
+inline uint64_t ycsb_scramble(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/*
+* Key string of key number id: "user", then '0's, then the digits of id, with as many
+* '0's as needed to reach a length between the workload's key sizes that depends only
+* on id. The digits come last so that two ids never give the same key.
+*/
+inline std::string ycsb_key(uint64_t id, uint32_t size_min, uint32_t size_max) {
+    uint64_t mixed = ycsb_scramble(id);
+    size_t size = size_min + (size_max > size_min ? mixed % (size_max - size_min + 1) : 0);
+    std::string digits = std::to_string(id);
+    std::string key = "user";
+    if (key.size() + digits.size() < size) key.append(size - key.size() - digits.size(), '0');
+    return key + digits;
+}
+
+/*
+* Generates the operations of spec. The key of an insert is the next unused key number.
+*
+* Exceptions: std::invalid_argument if the distribution is unknown, the proportions
+* are all zero, or a size range is empty.
+*/
+inline ycsb_workload generate_workload(const ycsb_spec& spec) {
+    if (spec.distribution != "uniform" && spec.distribution != "zipfian" && spec.distribution != "latest") {
+        throw std::invalid_argument("generate_workload: unknown distribution " + spec.distribution);
+    }
+    double total = spec.read + spec.update + spec.insert + spec.erase + spec.scan;
+    if (total <= 0 || spec.record_count == 0) {
+        throw std::invalid_argument("generate_workload: no operations or no records");
+    }
+    if (spec.key_size_min > spec.key_size_max || spec.value_size_min > spec.value_size_max) {
+        throw std::invalid_argument("generate_workload: empty size range");
+    }
+
+    ycsb_workload workload;
+    workload.record_count = spec.record_count;
+    workload.key_size_min = spec.key_size_min;
+    workload.key_size_max = spec.key_size_max;
+    workload.ops.reserve(spec.operation_count);
+
+    std::mt19937_64 rng(spec.seed);
+    std::uniform_real_distribution<double> coin(0, total);
+    std::uniform_int_distribution<uint32_t> value_size(spec.value_size_min, spec.value_size_max);
+    std::uniform_int_distribution<uint32_t> scan_length(1, std::max<uint32_t>(spec.scan_length_max, 1));
+    // sized for every key that can exist, so that inserted keys can become popular too
+    zipfian_generator zipf(spec.record_count + static_cast<size_t>(spec.operation_count * spec.insert / total) + 1);
+    uint64_t key_count = spec.record_count;
+
+    auto choose_key = [&]() -> uint64_t {
+        if (spec.distribution == "uniform") {
+            return std::uniform_int_distribution<uint64_t>(0, key_count - 1)(rng);
+        }
+        uint64_t rank = zipf(rng) % key_count;
+        if (spec.distribution == "latest") return key_count - 1 - rank;
+        return ycsb_scramble(rank) % key_count;
+    };
+
+    for (size_t i = 0; i < spec.operation_count; ++i) {
+        double pick = coin(rng);
+        if ((pick -= spec.read) < 0) {
+            workload.ops.push_back({ycsb_op_type::read, choose_key(), 0});
+        } else if ((pick -= spec.update) < 0) {
+            workload.ops.push_back({ycsb_op_type::update, choose_key(), value_size(rng)});
+        } else if ((pick -= spec.insert) < 0) {
+            workload.ops.push_back({ycsb_op_type::insert, key_count++, value_size(rng)});
+        } else if ((pick -= spec.erase) < 0) {
+            workload.ops.push_back({ycsb_op_type::erase, choose_key(), 0});
+        } else {
+            workload.ops.push_back({ycsb_op_type::scan, choose_key(), scan_length(rng)});
+        }
+    }
+    return workload;
+}
+
+/*
+* Writes workload as a trace (format at the top of this file).
+*/
+inline void write_trace(std::ostream& os, const ycsb_workload& workload) {
+    os << "ycsb-trace 1 " << workload.record_count << " " << workload.key_size_min
+       << " " << workload.key_size_max << "\n";
+    for (const auto& op : workload.ops) {
+        os << static_cast<char>(op.type) << " " << op.key;
+        if (op.type != ycsb_op_type::read && op.type != ycsb_op_type::erase) os << " " << op.size;
+        os << "\n";
+    }
+}
+
+/*
+* Reads a trace written by write_trace.
+*
+* Exceptions: std::runtime_error if the input is not a valid trace.
+*/
+inline ycsb_workload read_trace(std::istream& is) {
+    ycsb_workload workload;
+    std::string magic;
+    int version = 0;
+    if (!(is >> magic >> version >> workload.record_count >> workload.key_size_min >> workload.key_size_max)
+            || magic != "ycsb-trace" || version != 1) {
+        throw std::runtime_error("read_trace: not a ycsb trace");
+    }
+    char type;
+    while (is >> type) {
+        ycsb_op op{static_cast<ycsb_op_type>(type), 0, 0};
+        is >> op.key;
+        switch (op.type) {
+        case ycsb_op_type::read:
+        case ycsb_op_type::erase:
+            break;
+        case ycsb_op_type::update:
+        case ycsb_op_type::insert:
+        case ycsb_op_type::scan:
+            is >> op.size;
+            break;
+        default:
+            throw std::runtime_error(std::string("read_trace: unknown operation ") + type);
+        }
+        if (!is) throw std::runtime_error("read_trace: truncated operation");
+        workload.ops.push_back(op);
+    }
+    return workload;
+}
+
+#endif // YCSB_H
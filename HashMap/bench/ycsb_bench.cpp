@@ -0,0 +1,302 @@
+/*
+* YCSB-style mixed workload driver for HashMap<std::string, std::string>.
+*
+*      Generates a workload (see ycsb.h) or replays a recorded trace, loads the
+*      initial records, then runs the operations on one or more threads and reports
+*      the throughput and the latency percentiles of each kind of operation.
+*
+*      HashMap is not thread safe, so with --threads > 1 the map is split into
+*      --shards HashMaps, each behind a std::shared_mutex: reads and scans share the
+*      lock of their shard, updates, inserts and deletes take it exclusively. With
+*      one shard this is a single map behind a reader-writer lock. Thread t runs
+*      operations t, t + threads, t + 2 * threads, ... of the workload.
+*
+*      A scan reads up to <length> elements starting at its key, in the map's
+*      (unordered) iteration order, so it stays within the key's shard.
+*
+* Usage:
+*      ./HashMapYcsbBench --workload A                          # YCSB workload A
+*      ./HashMapYcsbBench --workload M --threads 8 --shards 64
+*      ./HashMapYcsbBench --read 0.8 --insert 0.2 --distribution latest --value-size 10:1000
+*      ./HashMapYcsbBench --workload B --record b.trace         # save the generated operations
+*      ./HashMapYcsbBench --replay b.trace --threads 4          # run exactly the same ones
+*/
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench_harness.h"
+#include "hashmap.h"
+#include "latency_histogram.h"
+#include "ycsb.h"
+
+using namespace std;
+using bench_clock = std::chrono::steady_clock;
+using Map = HashMap<string, string>;
+
+const array<ycsb_op_type, 5> kOpTypes = {
+    ycsb_op_type::read, ycsb_op_type::update, ycsb_op_type::insert, ycsb_op_type::erase, ycsb_op_type::scan
+};
+const array<const char*, 5> kOpNames = {"read", "update", "insert", "delete", "scan"};
+
+size_t op_index(ycsb_op_type type) {
+    for (size_t i = 0; i < kOpTypes.size(); ++i) if (kOpTypes[i] == type) return i;
+    return 0;
+}
+
+/*
+* The map, split into shards that each have their own lock.
+*/
+class sharded_map {
+public:
+    sharded_map(size_t shard_count, size_t expected_size) {
+        for (size_t i = 0; i < shard_count; ++i) {
+            _shards.push_back(make_unique<shard>(expected_size / shard_count + 1));
+        }
+    }
+
+    template <typename Op>
+    auto read(const string& key, Op op) {
+        auto& s = shard_of(key);
+        shared_lock lock(s.mutex);
+        return op(static_cast<const Map&>(s.map));
+    }
+
+    template <typename Op>
+    auto write(const string& key, Op op) {
+        auto& s = shard_of(key);
+        unique_lock lock(s.mutex);
+        return op(s.map);
+    }
+
+    size_t size() const {
+        size_t total = 0;
+        for (const auto& s : _shards) total += s->map.size();
+        return total;
+    }
+
+private:
+    struct shard {
+        explicit shard(size_t buckets) : map(buckets) {}
+        shared_mutex mutex;
+        Map map;
+    };
+
+    shard& shard_of(const string& key) {
+        // scrambled, so that a shard's keys do not all fall into the same buckets of its map
+        return *_shards[ycsb_scramble(std::hash<string>()(key)) % _shards.size()];
+    }
+
+    vector<unique_ptr<shard>> _shards;
+};
+
+/*
+* Latencies and outcomes recorded by one thread.
+*/
+struct thread_result {
+    array<latency_histogram, 5> latency;
+    size_t read_hits = 0;
+    size_t scanned = 0;
+};
+
+/*
+* Runs operations first, first + step, ... of workload on map.
+*/
+void run_ops(sharded_map& map, const ycsb_workload& workload, const string& values,
+             size_t first, size_t step, thread_result& result) {
+    for (size_t i = first; i < workload.ops.size(); i += step) {
+        const ycsb_op& op = workload.ops[i];
+        string key = ycsb_key(op.key, workload.key_size_min, workload.key_size_max);
+        auto start = bench_clock::now();
+        switch (op.type) {
+        case ycsb_op_type::read:
+            result.read_hits += map.read(key, [&](const Map& m) {
+                if (!m.contains(key)) return false;
+                do_not_optimize(m.at(key).size());
+                return true;
+            });
+            break;
+        case ycsb_op_type::update:
+            map.write(key, [&](Map& m) { m[key].assign(values, 0, op.size); });
+            break;
+        case ycsb_op_type::insert:
+            map.write(key, [&](Map& m) { m.insert({key, values.substr(0, op.size)}); });
+            break;
+        case ycsb_op_type::erase:
+            map.write(key, [&](Map& m) { m.erase(key); });
+            break;
+        case ycsb_op_type::scan:
+            result.scanned += map.read(key, [&](const Map& m) {
+                size_t count = 0, bytes = 0;
+                for (auto it = m.find(key); count < op.size && it != m.end(); ++it, ++count) {
+                    bytes += it->second.size();
+                }
+                do_not_optimize(bytes);
+                return count;
+            });
+            break;
+        }
+        auto end = bench_clock::now();
+        result.latency[op_index(op.type)].record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+    }
+}
+
+struct ycsb_options {
+    ycsb_spec spec;
+    size_t threads = 1;
+    size_t shards = 1;
+    string record_path;
+    string replay_path;
+};
+
+/*
+* Parses a size range written MIN:MAX (or a single size).
+*/
+bool parse_range(const string& text, uint32_t& min, uint32_t& max) {
+    auto colon = text.find(':');
+    min = static_cast<uint32_t>(std::strtoul(text.c_str(), nullptr, 10));
+    max = colon == string::npos ? min : static_cast<uint32_t>(std::strtoul(text.c_str() + colon + 1, nullptr, 10));
+    return min > 0 && min <= max;
+}
+
+ycsb_options parse_args(int argc, char** argv) {
+    ycsb_options options;
+    auto usage = [&]() {
+        cerr << "usage: " << argv[0] << " [--workload A|B|C|D|E|F|M] [--records N] [--operations N]"
+             << " [--read W] [--update W] [--insert W] [--delete W] [--scan W]"
+             << " [--distribution uniform|zipfian|latest] [--key-size MIN:MAX] [--value-size MIN:MAX]"
+             << " [--scan-length N] [--seed N] [--threads N] [--shards N]"
+             << " [--record FILE] [--replay FILE]" << endl;
+        std::exit(1);
+    };
+    try {
+        for (int i = 1; i < argc; i += 2) {
+            if (i + 1 >= argc) usage();
+            string flag = argv[i];
+            string value = argv[i + 1];
+            auto number = [&] { return std::strtoull(value.c_str(), nullptr, 10); };
+            auto& spec = options.spec;
+            if (flag == "--workload") {
+                ycsb_spec preset = ycsb_preset(value);
+                preset.record_count = spec.record_count;
+                preset.operation_count = spec.operation_count;
+                spec = preset;
+            }
+            else if (flag == "--records") spec.record_count = number();
+            else if (flag == "--operations") spec.operation_count = number();
+            else if (flag == "--read") spec.read = std::strtod(value.c_str(), nullptr);
+            else if (flag == "--update") spec.update = std::strtod(value.c_str(), nullptr);
+            else if (flag == "--insert") spec.insert = std::strtod(value.c_str(), nullptr);
+            else if (flag == "--delete") spec.erase = std::strtod(value.c_str(), nullptr);
+            else if (flag == "--scan") spec.scan = std::strtod(value.c_str(), nullptr);
+            else if (flag == "--distribution") spec.distribution = value;
+            else if (flag == "--key-size") { if (!parse_range(value, spec.key_size_min, spec.key_size_max)) usage(); }
+            else if (flag == "--value-size") { if (!parse_range(value, spec.value_size_min, spec.value_size_max)) usage(); }
+            else if (flag == "--scan-length") spec.scan_length_max = static_cast<uint32_t>(number());
+            else if (flag == "--seed") spec.seed = number();
+            else if (flag == "--threads") options.threads = number();
+            else if (flag == "--shards") options.shards = number();
+            else if (flag == "--record") options.record_path = value;
+            else if (flag == "--replay") options.replay_path = value;
+            else usage();
+        }
+    } catch (const std::invalid_argument& e) {
+        cerr << e.what() << endl;
+        usage();
+    }
+    if (options.threads == 0 || options.shards == 0) usage();
+    return options;
+}
+
+int main(int argc, char** argv) {
+    ycsb_options options = parse_args(argc, argv);
+
+    ycsb_workload workload;
+    try {
+        if (!options.replay_path.empty()) {
+            std::ifstream in(options.replay_path);
+            if (!in) throw std::runtime_error("cannot open " + options.replay_path);
+            workload = read_trace(in);
+        } else {
+            workload = generate_workload(options.spec);
+        }
+    } catch (const std::exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    if (!options.record_path.empty()) {
+        std::ofstream out(options.record_path);
+        write_trace(out, workload);
+        if (!out) cerr << "could not write " << options.record_path << endl;
+    }
+
+    size_t max_value = 1;
+    size_t inserts = 0;
+    for (const auto& op : workload.ops) {
+        if (op.type == ycsb_op_type::update || op.type == ycsb_op_type::insert) {
+            max_value = std::max<size_t>(max_value, op.size);
+        }
+        inserts += op.type == ycsb_op_type::insert;
+    }
+    string values(std::max<size_t>(max_value, options.spec.value_size_max), 'v');
+
+    // load phase, untimed; one bucket per record, since HashMap does not grow by itself
+    sharded_map map(options.shards, workload.record_count + inserts);
+    for (uint64_t id = 0; id < workload.record_count; ++id) {
+        string key = ycsb_key(id, workload.key_size_min, workload.key_size_max);
+        map.write(key, [&](Map& m) { m.insert({key, values.substr(0, options.spec.value_size_min)}); });
+    }
+
+    vector<thread_result> results(options.threads);
+    auto start = bench_clock::now();
+    if (options.threads == 1) {
+        run_ops(map, workload, values, 0, 1, results[0]);
+    } else {
+        vector<std::thread> threads;
+        for (size_t t = 0; t < options.threads; ++t) {
+            threads.emplace_back(run_ops, std::ref(map), std::cref(workload), std::cref(values),
+                                 t, options.threads, std::ref(results[t]));
+        }
+        for (auto& thread : threads) thread.join();
+    }
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    thread_result total;
+    for (const auto& result : results) {
+        for (size_t i = 0; i < total.latency.size(); ++i) total.latency[i].merge(result.latency[i]);
+        total.read_hits += result.read_hits;
+        total.scanned += result.scanned;
+    }
+
+    cout << workload.ops.size() << " operations on " << workload.record_count << " records, "
+         << options.threads << " thread(s), " << options.shards << " shard(s)" << endl;
+    cout << fixed << setprecision(0) << "throughput: " << workload.ops.size() / seconds << " ops/sec ("
+         << setprecision(3) << seconds << " s), final size " << map.size() << endl;
+    cout << left << setw(10) << "operation" << right << setw(12) << "count" << setw(10) << "p50 ns"
+         << setw(10) << "p99" << setw(10) << "p99.9" << setw(12) << "max" << endl;
+    latency_histogram all;
+    for (size_t i = 0; i < kOpTypes.size(); ++i) {
+        const auto& h = total.latency[i];
+        all.merge(h);
+        if (h.count() == 0) continue;
+        cout << left << setw(10) << kOpNames[i] << right << setw(12) << h.count() << setw(10) << h.percentile(0.5)
+             << setw(10) << h.percentile(0.99) << setw(10) << h.percentile(0.999) << setw(12) << h.max() << endl;
+    }
+    cout << left << setw(10) << "all" << right << setw(12) << all.count() << setw(10) << all.percentile(0.5)
+         << setw(10) << all.percentile(0.99) << setw(10) << all.percentile(0.999) << setw(12) << all.max() << endl;
+    size_t reads = total.latency[op_index(ycsb_op_type::read)].count();
+    if (reads > 0) cout << "read hit rate: " << setprecision(3) << 100.0 * total.read_hits / reads << "%" << endl;
+    return 0;
+}
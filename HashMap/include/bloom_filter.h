@@ -0,0 +1,299 @@
+/*
+* A blocked Bloom filter, and the optional filter that HashMap keeps in front of its
+* buckets.
+*
+*      A lookup of a key that is not in a HashMap still hashes it, loads the bucket
+*      and walks the chain. When most lookups miss and the table is larger than the
+*      cache, that is one or more cache misses for nothing. A Bloom filter answers
+*      "definitely not present" from a few bits, so a miss usually ends before the
+*      bucket array is touched.
+*
+*      blocked_bloom_filter is a split block Bloom filter: the hash selects one 32 byte
+*      block, and sets (or tests) one bit in each of its eight 32-bit words. A query
+*      therefore reads a single cache line, and the eight bit tests are independent,
+*      so they compile to a short branch-free loop. When the compiler targets AVX2
+*      (-mavx2; the default build does not, configure with -DHASHMAP_AVX2=ON) the loop
+*      is replaced by one AVX2 instruction per step. With 16 bits per key the false
+*      positive rate is about 0.1%.
+*
+*      A Bloom filter cannot remove a key. HashMap does not count bits to support erase;
+*      instead an erased key leaves its bits behind (it can only cause false positives),
+*      and the filter is rebuilt from the keys in the table on every rehash, when the
+*      table outgrows it, and when the erased keys outnumber the live ones.
+*
+*      The filter is off by default. Turn it on through the policy (see hashmap_stats.h):
+*
+*          template <>
+*          struct hashmap_policy<std::string, int, MyHash> : bloom_hashmap_policy {};
+*/
+
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <algorithm>            // for copy_n, fill, max
+#include <cstddef>              // for size_t
+#include <cstdint>              // for uint32_t, uint64_t, uintptr_t
+#include <utility>              // for move
+#include <vector>               // for vector
+#include "hashmap_stats.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/*
+* Bloom filter made of 32 byte blocks, queried with a 64-bit hash.
+*
+* The hash does not have to be well mixed (std::hash<int> is the identity); it goes
+* through the 64-bit finalizer of MurmurHash3 first.
+*
+* Usage:
+*      blocked_bloom_filter filter;
+*      filter.reset(1000);
+*      filter.add(hash);
+*      if (!filter.may_contain(other_hash)) { ... }      // other_hash was never added
+*/
+class blocked_bloom_filter {
+public:
+    static constexpr size_t kBitsPerKey = 16;
+    static constexpr size_t kBlockWords = 8;
+    static constexpr size_t kBlockBytes = kBlockWords * sizeof(uint32_t);
+
+    blocked_bloom_filter() = default;
+
+    /*
+    * The blocks are aligned by hand (see blocks()), so a copy must copy the blocks
+    * rather than the underlying vector, whose alignment may differ.
+    */
+    blocked_bloom_filter(const blocked_bloom_filter& other) :
+            _words(other._words.size(), 0), _block_count(other._block_count) {
+        std::copy_n(other.blocks(), _block_count * kBlockWords, blocks());
+    }
+
+    blocked_bloom_filter& operator=(const blocked_bloom_filter& other) {
+        if (this != &other) {
+            blocked_bloom_filter copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    blocked_bloom_filter(blocked_bloom_filter&& other) noexcept :
+            _words(std::move(other._words)), _block_count(other._block_count) {
+        other._block_count = 0;
+    }
+
+    blocked_bloom_filter& operator=(blocked_bloom_filter&& other) noexcept {
+        _words = std::move(other._words);
+        _block_count = other._block_count;
+        other._block_count = 0;
+        return *this;
+    }
+
+    /*
+    * Empties the filter and sizes it for expected_keys keys. If the number of blocks
+    * does not grow, the existing allocation is reused and nothing is allocated.
+    *
+    * Exceptions: std::bad_alloc, in which case the filter is unchanged.
+    */
+    void reset(size_t expected_keys) {
+        size_t block_count = std::max<size_t>(1, (expected_keys * kBitsPerKey + kBlockBytes * 8 - 1) / (kBlockBytes * 8));
+        // one extra block, so that a 32 byte aligned run of block_count blocks always fits
+        size_t word_count = (block_count + 1) * kBlockWords;
+        if (word_count > _words.capacity()) {
+            std::vector<uint32_t> words(word_count, 0);
+            _words.swap(words);
+        } else {
+            _words.assign(word_count, 0);
+        }
+        _block_count = block_count;
+    }
+
+    /*
+    * Removes every key, keeping the size.
+    */
+    void clear() noexcept {
+        std::fill(_words.begin(), _words.end(), 0);
+    }
+
+    void add(uint64_t hash) noexcept {
+        if (_block_count == 0) return;
+        auto [block, key] = locate(hash);
+#if defined(__AVX2__)
+        __m256i* words = reinterpret_cast<__m256i*>(block);
+        _mm256_store_si256(words, _mm256_or_si256(_mm256_load_si256(words), block_mask(key)));
+#else
+        for (size_t i = 0; i < kBlockWords; ++i) block[i] |= bit(key, i);
+#endif
+    }
+
+    /*
+    * Returns false if hash was definitely never added, true if it may have been.
+    * An empty (never reset) filter has no blocks and answers true.
+    */
+    bool may_contain(uint64_t hash) const noexcept {
+        if (_block_count == 0) return true;
+        auto [block, key] = locate(hash);
+#if defined(__AVX2__)
+        // testc is 1 when every bit of the mask is also set in the block
+        return _mm256_testc_si256(_mm256_load_si256(reinterpret_cast<const __m256i*>(block)), block_mask(key));
+#else
+        uint32_t missing = 0;
+        for (size_t i = 0; i < kBlockWords; ++i) missing |= bit(key, i) & ~block[i];
+        return missing == 0;
+#endif
+    }
+
+    /*
+    * The number of keys the filter was sized for, and the heap it owns.
+    */
+    size_t capacity() const noexcept { return _block_count * kBlockBytes * 8 / kBitsPerKey; }
+    size_t block_count() const noexcept { return _block_count; }
+    size_t bytes() const noexcept { return _words.capacity() * sizeof(uint32_t); }
+
+private:
+    /*
+    * Odd constants, one per word of a block, that spread the 32-bit key over the
+    * eight words (these are the salts of the Parquet and Impala split block filters).
+    */
+    static constexpr uint32_t kSalts[kBlockWords] = {
+        0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+        0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u
+    };
+
+    struct location {
+        uint32_t* block;
+        uint32_t key;
+    };
+
+    static uint64_t mix(uint64_t hash) noexcept {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    static uint32_t bit(uint32_t key, size_t word) noexcept {
+        return uint32_t{1} << ((key * kSalts[word]) >> 27);
+    }
+
+#if defined(__AVX2__)
+    static __m256i block_mask(uint32_t key) noexcept {
+        __m256i salts = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kSalts));
+        __m256i shifts = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(key), salts), 27);
+        return _mm256_sllv_epi32(_mm256_set1_epi32(1), shifts);
+    }
+#endif
+
+    /*
+    * The high half of the mixed hash picks the block (by multiplying instead of
+    * taking a remainder), the low half is the key whose bits are set in it.
+    */
+    location locate(uint64_t hash) const noexcept {
+        hash = mix(hash);
+        size_t index = static_cast<size_t>(((hash >> 32) * _block_count) >> 32);
+        return {blocks() + index * kBlockWords, static_cast<uint32_t>(hash)};
+    }
+
+    /*
+    * The first 32 byte aligned word of _words, so that no block straddles two
+    * cache lines. (A vector of an alignas(32) type would do this too, but it would
+    * go through the aligned operator new, which malloc_block_size does not model.)
+    */
+    uint32_t* blocks() const noexcept {
+        auto address = reinterpret_cast<uintptr_t>(_words.data());
+        address = (address + kBlockBytes - 1) & ~uintptr_t{kBlockBytes - 1};
+        return const_cast<uint32_t*>(reinterpret_cast<const uint32_t*>(address));
+    }
+
+    std::vector<uint32_t> _words;
+    size_t _block_count = 0;
+};
+
+/*
+* The Bloom filter kept inside a HashMap, with the counters reported by stats().
+* The disabled version is empty: may_contain is always true and everything else
+* compiles to nothing.
+*
+* The map calls may_contain before searching a chain, and on_false_positive when the
+* filter let a key through that the chain did not have. It adds the hash of every
+* key it inserts, calls on_erase for every key it removes, and rebuilds the filter
+* (reset, then add every key) whenever needs_rebuild says so.
+*/
+template <bool Enabled>
+class hashmap_bloom {
+public:
+    bool may_contain(size_t hash) const noexcept {
+        if (_filter.block_count() == 0) return true;        // not built yet
+        _queries.add();
+        if (_filter.may_contain(hash)) return true;
+        _negatives.add();
+        return false;
+    }
+
+    void on_false_positive() const noexcept {
+        if (_filter.block_count() != 0) _false_positives.add();
+    }
+
+    void add(size_t hash) noexcept { _filter.add(hash); }
+    void on_erase() noexcept { ++_erased; }
+
+    /*
+    * Whether a map of size elements has outgrown the filter, or has erased more keys
+    * since the last rebuild than it still holds.
+    */
+    bool needs_rebuild(size_t size) const noexcept {
+        return size > _filter.capacity() || _erased > size;
+    }
+
+    /*
+    * Empties the filter, sized for expected_keys, ready to be refilled.
+    *
+    * Exceptions: std::bad_alloc, in which case the filter is unchanged.
+    */
+    void reset(size_t expected_keys) {
+        _filter.reset(expected_keys);
+        _erased = 0;
+        _rebuilds.add();
+    }
+
+    void clear() noexcept {
+        _filter.clear();
+        _erased = 0;
+    }
+
+    size_t capacity() const noexcept { return _filter.capacity(); }
+    size_t bytes() const noexcept { return _filter.bytes(); }
+    HashMapBloomCounts counts() const noexcept {
+        return {_queries.load(), _negatives.load(), _false_positives.load(), _rebuilds.load()};
+    }
+
+private:
+    blocked_bloom_filter _filter;
+    size_t _erased = 0;                     // keys erased since the last rebuild
+
+    // lookups are const and may run on several threads at once, hence mutable and atomic
+    mutable relaxed_counter _queries;
+    mutable relaxed_counter _negatives;
+    mutable relaxed_counter _false_positives;
+    relaxed_counter _rebuilds;
+};
+
+template <>
+class hashmap_bloom<false> {
+public:
+    bool may_contain(size_t) const noexcept { return true; }
+    void on_false_positive() const noexcept {}
+    void add(size_t) noexcept {}
+    void on_erase() noexcept {}
+    bool needs_rebuild(size_t) const noexcept { return false; }
+    void reset(size_t) noexcept {}
+    void clear() noexcept {}
+    size_t capacity() const noexcept { return 0; }
+    size_t bytes() const noexcept { return 0; }
+    HashMapBloomCounts counts() const noexcept { return {}; }
+};
+
+#endif // BLOOM_FILTER_H
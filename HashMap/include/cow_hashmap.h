@@ -0,0 +1,471 @@
+/*
+* CowHashMap: a HashMap with O(1) copy-on-write snapshots.
+*
+*      The bucket array is split into segments of kSegmentBuckets buckets. A segment
+*      owns the nodes of its buckets and is shared by reference count between every
+*      snapshot that has not modified it; the directory of segments is shared the same
+*      way. So snapshot() (and the copy constructor) copies one shared_ptr, whatever
+*      the size of the map, and allocates nothing.
+*
+*      The first write to a map after a snapshot copies the directory (one pointer per
+*      segment) and the segment it writes to (its buckets and their nodes); later writes
+*      to the same segment copy nothing. Segments that are never written after a
+*      snapshot are never copied. Each segment also keeps an occupancy bitmap of its
+*      buckets, like HashMap's _occupied, which iteration uses to skip empty buckets.
+*
+*      A snapshot never changes, so it can be read by other threads while the map it
+*      was taken from keeps being modified: a writer only ever frees or changes
+*      segments and directories that nothing else references. Reading one CowHashMap
+*      object while modifying that same object is still a data race.
+*
+*      Like HashMap, the map does not rehash automatically. rehash copies every element.
+*
+* Usage:
+*      CowHashMap<std::string, int> counts(100000);
+*      counts.insert({"requests", 0});
+*      auto report = counts.snapshot();    // O(1)
+*      counts["requests"] += 1;            // copies one segment, report still sees 0
+*/
+
+#ifndef COW_HASHMAP_H
+#define COW_HASHMAP_H
+
+#include <array>                // for array
+#include <bit>                  // for countr_zero
+#include <cstdint>              // for uint64_t
+#include <initializer_list>     // for initializer_list
+#include <iterator>             // for forward_iterator_tag
+#include <memory>               // for shared_ptr, make_shared
+#include <stdexcept>            // for out_of_range
+#include <tuple>                // for forward_as_tuple
+#include <utility>              // for pair, piecewise_construct
+#include <vector>               // for vector
+#include "hashmap_memory.h"
+
+/*
+* Template class for a copy-on-write HashMap
+*
+* K = key type
+* M = mapped type
+* H = hash function type used to hash a key; if not provided, defaults to std::hash<K>
+*
+* Concept requirements: same as HashMap.
+*/
+template <typename K, typename M, typename H = std::hash<K>>
+class CowHashMap {
+public:
+    using value_type = std::pair<const K, M>;
+
+    class const_iterator;
+
+    static constexpr size_t kSegmentBuckets = 64;
+
+    /*
+    * Creates an empty map with bucket_count buckets and the given hash function.
+    * Segments are only allocated when something is inserted into them.
+    *
+    * Complexity: O(B / kSegmentBuckets), B = number of buckets
+    */
+    explicit CowHashMap(size_t bucket_count = kDefaultBuckets, const H& hash = H());
+
+    CowHashMap(std::initializer_list<std::pair<K, M>> list);
+
+    /*
+    * Copying a CowHashMap takes a snapshot: the copy shares every segment with other.
+    *
+    * Complexity: O(1)
+    */
+    CowHashMap(const CowHashMap& other) = default;
+    CowHashMap& operator=(const CowHashMap& other) = default;
+    CowHashMap(CowHashMap&& other) noexcept = default;
+    CowHashMap& operator=(CowHashMap&& other) noexcept = default;
+
+    /*
+    * Returns a copy of the map in its current state, which later writes to this map do
+    * not affect (and vice versa).
+    *
+    * Usage:
+    *      std::thread reporter([view = map.snapshot()] { write_report(view); });
+    *
+    * Complexity: O(1), no allocation
+    */
+    CowHashMap snapshot() const { return *this; }
+
+    size_t size() const noexcept { return _size; }
+    bool empty() const noexcept { return _size == 0; }
+    size_t bucket_count() const noexcept { return _bucket_count; }
+    float load_factor() const noexcept { return static_cast<float>(_size) / _bucket_count; }
+
+    /*
+    * Lookups. find returns a pointer to the mapped value of key, or nullptr.
+    *
+    * Exceptions: at throws std::out_of_range if key is not in the map.
+    *
+    * Complexity: O(1) amortized average case, O(N) worst case, N = number of elements
+    */
+    bool contains(const K& key) const { return find(key) != nullptr; }
+    const M* find(const K& key) const;
+    const M& at(const K& key) const;
+
+    /*
+    * Inserts the K/M pair if key is not in the map; otherwise a no-op.
+    *
+    * Return value: true if the pair was inserted.
+    *
+    * Complexity: O(1) amortized average case, plus the copy of the segment of key if
+    * it is shared with a snapshot
+    */
+    bool insert(const value_type& value);
+
+    /*
+    * Returns a reference to the mapped value of key, inserting {key, M()} if key is
+    * not in the map. The segment of key is copied first if it is shared.
+    *
+    * Notes: the reference is valid until the next write to the map, which may copy
+    * the segment it is in.
+    */
+    M& operator[](const K& key);
+
+    /*
+    * Erases key, if it is in the map.
+    *
+    * Return value: true if an element was removed.
+    */
+    bool erase(const K& key);
+
+    /*
+    * Removes every element. Segments shared with snapshots are released, not freed.
+    *
+    * Complexity: O(B / kSegmentBuckets), plus freeing the segments only this map uses
+    */
+    void clear();
+
+    /*
+    * Rebuilds the map with new_bucket_count buckets, copying every element.
+    *
+    * Exceptions: std::out_of_range if new_bucket_count = 0.
+    *
+    * Complexity: O(N + B)
+    */
+    void rehash(size_t new_bucket_count);
+
+    /*
+    * Number of segments in the directory, and number of segments copied because they
+    * were written to while shared, over the map's lifetime.
+    */
+    size_t segment_count() const noexcept { return _directory->size(); }
+    size_t segment_copies() const noexcept { return _segment_copies; }
+
+    /*
+    * Heap used by the map, counting segments shared with snapshots in full.
+    */
+    HashMapMemoryUsage memory_usage() const;
+
+    /*
+    * Iterators visit the elements of the map as it was when begin() was called, and
+    * stay valid until the map is next written to. To iterate while writing, iterate
+    * a snapshot.
+    */
+    const_iterator begin() const { return const_iterator(_directory.get(), 0); }
+    const_iterator end() const { return const_iterator(_directory.get(), _directory->size() * kSegmentBuckets); }
+
+private:
+    static const size_t kDefaultBuckets = 10;
+
+    struct node {
+        value_type value;
+        node* next;
+    };
+
+    /*
+    * kSegmentBuckets buckets and the nodes in them. Copying a segment copies its nodes.
+    */
+    struct segment {
+        std::array<node*, kSegmentBuckets> buckets{};
+        uint64_t occupied = 0;          // bit i is set when buckets[i] is non-empty
+
+        segment() = default;
+        segment(const segment& other);
+        segment& operator=(const segment&) = delete;
+        ~segment() { free_nodes(); }
+
+        void free_nodes() noexcept;
+    };
+
+    using directory = std::vector<std::shared_ptr<segment>>;
+
+    size_t bucket_of(const K& key) const { return _hash_function(key) % _bucket_count; }
+
+    /*
+    * Returns the segment of bucket index, after copying the directory and the segment
+    * if they are shared (or allocating the segment if it does not exist yet).
+    */
+    segment& writable_segment(size_t index);
+
+    size_t _size = 0;
+    size_t _bucket_count;
+    H _hash_function;
+    std::shared_ptr<directory> _directory;
+    size_t _segment_copies = 0;
+
+public:
+    /*
+    * Forward iterator over the elements of one directory.
+    */
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = CowHashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        const_iterator() = default;
+        const_iterator(const directory* dir, size_t bucket) : _directory(dir), _bucket(bucket) {
+            seek();
+        }
+
+        reference operator*() const { return _node->value; }
+        pointer operator->() const { return &_node->value; }
+
+        const_iterator& operator++() {
+            _node = _node->next;
+            if (_node == nullptr) {
+                ++_bucket;
+                seek();
+            }
+            return *this;
+        }
+        const_iterator operator++(int) {
+            const_iterator copy(*this);
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return _bucket == other._bucket && _node == other._node;
+        }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        /*
+        * Moves to the first node of the first non-empty bucket at or after _bucket.
+        */
+        void seek() {
+            size_t end = _directory->size() * kSegmentBuckets;
+            while (_bucket < end) {
+                const segment* seg = (*_directory)[_bucket / kSegmentBuckets].get();
+                uint64_t bits = seg ? seg->occupied >> (_bucket % kSegmentBuckets) : 0;
+                if (bits != 0) {
+                    _bucket += std::countr_zero(bits);
+                    _node = seg->buckets[_bucket % kSegmentBuckets];
+                    return;
+                }
+                _bucket = (_bucket / kSegmentBuckets + 1) * kSegmentBuckets;
+            }
+            _bucket = end;
+            _node = nullptr;
+        }
+
+        const directory* _directory = nullptr;
+        size_t _bucket = 0;
+        const node* _node = nullptr;
+    };
+};
+
+template <typename K, typename M, typename H>
+CowHashMap<K, M, H>::segment::segment(const segment& other) : occupied(other.occupied) {
+    try {
+        for (size_t i = 0; i < kSegmentBuckets; ++i) {
+            // copy the chain in order, so that a copied segment iterates like the original
+            node** tail = &buckets[i];
+            for (const node* curr = other.buckets[i]; curr != nullptr; curr = curr->next) {
+                *tail = new node{curr->value, nullptr};
+                tail = &(*tail)->next;
+            }
+        }
+    } catch (...) {
+        // ~segment does not run when the constructor throws
+        free_nodes();
+        throw;
+    }
+}
+
+template <typename K, typename M, typename H>
+void CowHashMap<K, M, H>::segment::free_nodes() noexcept {
+    for (node*& curr : buckets) {
+        while (curr != nullptr) {
+            node* trash = curr;
+            curr = curr->next;
+            delete trash;
+        }
+    }
+}
+
+template <typename K, typename M, typename H>
+CowHashMap<K, M, H>::CowHashMap(size_t bucket_count, const H& hash) :
+    _bucket_count(bucket_count),
+    _hash_function(hash),
+    _directory(std::make_shared<directory>((bucket_count + kSegmentBuckets - 1) / kSegmentBuckets)) {
+    if (bucket_count == 0) {
+        throw std::out_of_range("CowHashMap: bucket_count must be positive");
+    }
+}
+
+template <typename K, typename M, typename H>
+CowHashMap<K, M, H>::CowHashMap(std::initializer_list<std::pair<K, M>> list) : CowHashMap() {
+    for (const auto& [key, mapped] : list) insert({key, mapped});
+}
+
+template <typename K, typename M, typename H>
+const M* CowHashMap<K, M, H>::find(const K& key) const {
+    size_t index = bucket_of(key);
+    const segment* seg = (*_directory)[index / kSegmentBuckets].get();
+    if (seg == nullptr) return nullptr;
+    for (const node* curr = seg->buckets[index % kSegmentBuckets]; curr != nullptr; curr = curr->next) {
+        if (curr->value.first == key) return &curr->value.second;
+    }
+    return nullptr;
+}
+
+template <typename K, typename M, typename H>
+const M& CowHashMap<K, M, H>::at(const K& key) const {
+    const M* found = find(key);
+    if (found == nullptr) {
+        throw std::out_of_range("CowHashMap<K, M, H>::at: key not found");
+    }
+    return *found;
+}
+
+template <typename K, typename M, typename H>
+typename CowHashMap<K, M, H>::segment& CowHashMap<K, M, H>::writable_segment(size_t index) {
+    if (_directory.use_count() > 1) {
+        _directory = std::make_shared<directory>(*_directory);
+    }
+    std::shared_ptr<segment>& seg = (*_directory)[index / kSegmentBuckets];
+    if (seg == nullptr) {
+        seg = std::make_shared<segment>();
+    } else if (seg.use_count() > 1) {
+        seg = std::make_shared<segment>(*seg);
+        ++_segment_copies;
+    }
+    return *seg;
+}
+
+template <typename K, typename M, typename H>
+bool CowHashMap<K, M, H>::insert(const value_type& value) {
+    if (contains(value.first)) return false;
+    size_t index = bucket_of(value.first);
+    segment& seg = writable_segment(index);
+    node*& front = seg.buckets[index % kSegmentBuckets];
+    front = new node{value, front};
+    seg.occupied |= uint64_t{1} << (index % kSegmentBuckets);
+    ++_size;
+    return true;
+}
+
+template <typename K, typename M, typename H>
+M& CowHashMap<K, M, H>::operator[](const K& key) {
+    // the returned reference may be written through, so the segment is made writable
+    // whether or not the key is present, and searched once
+    size_t index = bucket_of(key);
+    segment& seg = writable_segment(index);
+    node*& front = seg.buckets[index % kSegmentBuckets];
+    for (node* curr = front; curr != nullptr; curr = curr->next) {
+        if (curr->value.first == key) return curr->value.second;
+    }
+    front = new node{value_type(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple()), front};
+    seg.occupied |= uint64_t{1} << (index % kSegmentBuckets);
+    ++_size;
+    return front->value.second;
+}
+
+template <typename K, typename M, typename H>
+bool CowHashMap<K, M, H>::erase(const K& key) {
+    if (!contains(key)) return false;
+    size_t index = bucket_of(key);
+    segment& seg = writable_segment(index);
+    node** link = &seg.buckets[index % kSegmentBuckets];
+    while (!((*link)->value.first == key)) link = &(*link)->next;
+    node* trash = *link;
+    *link = trash->next;
+    delete trash;
+    if (seg.buckets[index % kSegmentBuckets] == nullptr) {
+        seg.occupied &= ~(uint64_t{1} << (index % kSegmentBuckets));
+    }
+    --_size;
+    return true;
+}
+
+template <typename K, typename M, typename H>
+void CowHashMap<K, M, H>::clear() {
+    _directory = std::make_shared<directory>(_directory->size());
+    _size = 0;
+}
+
+template <typename K, typename M, typename H>
+void CowHashMap<K, M, H>::rehash(size_t new_bucket_count) {
+    if (new_bucket_count == 0) {
+        throw std::out_of_range("CowHashMap<K, M, H>::rehash: new_bucket_count must be positive.");
+    }
+    CowHashMap rebuilt(new_bucket_count, _hash_function);
+    for (const auto& value : *this) rebuilt.insert(value);
+    rebuilt._segment_copies = _segment_copies;
+    *this = std::move(rebuilt);
+}
+
+template <typename K, typename M, typename H>
+HashMapMemoryUsage CowHashMap<K, M, H>::memory_usage() const {
+    HashMapMemoryUsage usage;
+    usage.size = size();
+    usage.bucket_count = bucket_count();
+
+    heap_tally buckets;
+    heap_tally nodes;
+    heap_tally keys;
+    heap_tally mapped;
+    // make_shared puts the object in the same block as its control block: a vtable
+    // pointer and two reference counts in libstdc++ and libc++
+    const size_t control_block = sizeof(void*) + 2 * sizeof(int);
+    buckets.add_block(sizeof(directory) + control_block);
+    if (_directory->capacity() > 0) buckets.add_block(_directory->capacity() * sizeof(std::shared_ptr<segment>));
+    for (const auto& seg : *_directory) {
+        if (seg == nullptr) continue;
+        buckets.add_block(sizeof(segment) + control_block);
+        for (const node* head : seg->buckets) {
+            for (const node* curr = head; curr != nullptr; curr = curr->next) {
+                nodes.add_block(sizeof(node));
+                heap_size_estimator<K>::add(curr->value.first, keys);
+                heap_size_estimator<M>::add(curr->value.second, mapped);
+            }
+        }
+    }
+
+    usage.bucket_bytes = buckets.bytes;
+    usage.node_bytes = nodes.bytes;
+    usage.key_heap_bytes = keys.bytes;
+    usage.mapped_heap_bytes = mapped.bytes;
+    usage.allocator_overhead = buckets.overhead + nodes.overhead + keys.overhead + mapped.overhead;
+    usage.heap_blocks = buckets.blocks + nodes.blocks + keys.blocks + mapped.blocks;
+    return usage;
+}
+
+/*
+* Two maps are equal if they contain the same K/M pairs, whatever their bucket counts.
+*/
+template <typename K, typename M, typename H>
+bool operator==(const CowHashMap<K, M, H>& lhs, const CowHashMap<K, M, H>& rhs) {
+    if (lhs.size() != rhs.size()) return false;
+    for (const auto& [key, mapped] : lhs) {
+        const M* other = rhs.find(key);
+        if (other == nullptr || !(*other == mapped)) return false;
+    }
+    return true;
+}
+
+template <typename K, typename M, typename H>
+bool operator!=(const CowHashMap<K, M, H>& lhs, const CowHashMap<K, M, H>& rhs) {
+    return !(lhs == rhs);
+}
+
+#endif // COW_HASHMAP_H
@@ -0,0 +1,395 @@
+/*
+* FlatHashMap: a structure-of-arrays HashMap for small, trivially copyable keys and values.
+*
+*      HashMap allocates one node (key, value and next pointer) per element, which for
+*      a HashMap<int64_t, int64_t> is more overhead than payload. FlatHashMap instead
+*      uses open addressing with linear probing over three parallel arrays:
+*
+*          _ctrl   - one byte per slot: empty, deleted, or 7 bits of the key's hash
+*          _keys   - the keys
+*          _values - the mapped values
+*
+*      A probe compares control bytes first and only reads _keys when the 7 hash bits
+*      match, and never touches _values until the key is found.
+*
+*      CompactHashMap<K, M, H> picks FlatHashMap when use_flat_layout<K, M> holds,
+*      and HashMap otherwise.
+*/
+
+#ifndef FLAT_HASHMAP_H
+#define FLAT_HASHMAP_H
+
+#include <algorithm>            // for max, fill
+#include <bit>                  // for bit_ceil
+#include <cstdint>              // for uint8_t, uint64_t
+#include <iterator>             // for forward_iterator_tag, input_iterator_tag
+#include <memory>               // for construct_at
+#include <new>                  // for launder
+#include <stdexcept>            // for out_of_range
+#include <type_traits>          // for is_trivially_copyable, conditional_t
+#include <vector>               // for vector
+#include "hashmap.h"
+
+/*
+* Trait deciding whether a K/M combination is stored in a FlatHashMap by CompactHashMap.
+* Specialize it to force a layout for your own types.
+*/
+template <typename K, typename M>
+struct use_flat_layout : std::bool_constant<std::is_trivially_copyable_v<K> &&
+                                            std::is_trivially_copyable_v<M> &&
+                                            sizeof(K) <= 16 && sizeof(M) <= 16> {};
+
+/*
+* Template class for a structure-of-arrays HashMap
+*
+* K = key type, must be trivially copyable (it need not be default constructible)
+* M = mapped type, must be trivially copyable; default constructible for operator[]
+* H = hash function type used to hash a key; if not provided, defaults to std::hash<K>
+*
+* Example:
+*      FlatHashMap<int64_t, int64_t> map;
+*      map.insert({3, 9});
+*      map[4] = 16;
+*
+* Notes: elements are not stored as std::pair<const K, M>, so insert returns a pointer
+* to the mapped value, and dereferencing an iterator gives a std::pair<const K&, M&>
+* by value. Such an iterator is a C++20 forward_iterator, but only an input iterator
+* to pre-C++20 algorithms, which expect a reference to a value_type.
+*/
+template <typename K, typename M, typename H = std::hash<K>>
+class FlatHashMap {
+    static_assert(std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<M>,
+                  "FlatHashMap requires trivially copyable keys and mapped values");
+
+    template <bool Const>
+    class basic_iterator;
+
+public:
+    using value_type = std::pair<const K, M>;
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    /*
+    * Creates an empty map with room for at least bucket_count slots.
+    *
+    * Usage:
+    *      FlatHashMap<int, int> map;
+    *      FlatHashMap<int, int> map(1 << 20);
+    *
+    * Complexity: O(B), B = number of slots
+    */
+    explicit FlatHashMap(size_t bucket_count = kMinSlots, const H& hash = H());
+
+    /*
+    * Size, emptiness, number of slots and size/slots.
+    *
+    * Complexity: O(1)
+    */
+    size_t size() const noexcept { return _size; }
+    bool empty() const noexcept { return _size == 0; }
+    size_t bucket_count() const noexcept { return _ctrl.size(); }
+    float load_factor() const noexcept { return static_cast<float>(_size) / bucket_count(); }
+
+    /*
+    * Returns whether or not the map contains the given key.
+    *
+    * Complexity: O(1) amortized average case
+    */
+    bool contains(const K& key) const noexcept { return find_slot(key) != npos; }
+
+    /*
+    * Inserts the K/M pair if the key does not already exist; otherwise a no-op.
+    * Grows (doubling the number of slots) when the table would become 7/8 full.
+    *
+    * Return value: pair<M*, bool> - pointer to the mapped value for the key, and
+    * whether the element was added.
+    *
+    * Complexity: O(1) amortized average case
+    */
+    std::pair<M*, bool> insert(const value_type& value);
+
+    /*
+    * Erases the element with the given key, if one exists. Leaves a tombstone, which
+    * is reclaimed by the next growth or rehash.
+    *
+    * Return value: true if an element was removed.
+    */
+    bool erase(const K& key);
+
+    /*
+    * Removes all elements. The number of slots stays the same.
+    */
+    void clear() noexcept;
+
+    /*
+    * Returns a reference to the mapped value of key.
+    *
+    * Exceptions: std::out_of_range if key is not in the map.
+    */
+    M& at(const K& key);
+    const M& at(const K& key) const;
+
+    /*
+    * Returns a reference to the mapped value of key, inserting {key, M()} if needed.
+    */
+    M& operator[](const K& key) { return *insert({key, M()}).first; }
+
+    /*
+    * Resizes the table to the smallest power of two >= new_bucket_count that keeps
+    * the load factor below 7/8, and reinserts every element.
+    *
+    * Exceptions: std::out_of_range if new_bucket_count = 0.
+    *
+    * Complexity: O(N + B)
+    */
+    void rehash(size_t new_bucket_count);
+
+    /*
+    * Returns an iterator to the element with the given key, or end().
+    */
+    iterator find(const K& key) { return iterator(this, find_slot(key)); }
+    const_iterator find(const K& key) const { return const_iterator(this, find_slot(key)); }
+
+    iterator begin() { return iterator(this, next_full(0)); }
+    iterator end() { return iterator(this, npos); }
+    const_iterator begin() const { return const_iterator(this, next_full(0)); }
+    const_iterator end() const { return const_iterator(this, npos); }
+
+private:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    static constexpr size_t kMinSlots = 8;
+
+    /*
+    * Control byte values. A full slot stores the low 7 bits of the mixed hash,
+    * so its high bit is always clear.
+    */
+    static constexpr uint8_t kEmpty = 0x80;
+    static constexpr uint8_t kDeleted = 0xFE;
+
+    /*
+    * Scrambles the output of H, so that hash functions such as the identity
+    * std::hash<int> still spread over both the slot index and the 7 tag bits.
+    */
+    static uint64_t mix(uint64_t h) noexcept {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    size_t mask() const noexcept { return _ctrl.size() - 1; }
+
+    /*
+    * Storage for one key or value. A slot holds no object until an element is placed
+    * in it, so that neither K nor M has to be default constructible, and it is only
+    * read while its control byte says it is full.
+    */
+    template <typename T>
+    struct raw_slot {
+        alignas(T) unsigned char bytes[sizeof(T)];
+    };
+
+    template <typename T>
+    static T& object(raw_slot<T>& slot) noexcept { return *std::launder(reinterpret_cast<T*>(slot.bytes)); }
+    template <typename T>
+    static const T& object(const raw_slot<T>& slot) noexcept {
+        return *std::launder(reinterpret_cast<const T*>(slot.bytes));
+    }
+    template <typename T>
+    static void place(raw_slot<T>& slot, const T& value) noexcept {
+        std::construct_at(reinterpret_cast<T*>(slot.bytes), value);
+    }
+
+    /*
+    * Returns the slot holding key, or npos.
+    */
+    size_t find_slot(const K& key) const noexcept;
+
+    /*
+    * Returns the first full slot at or after index, or npos.
+    */
+    size_t next_full(size_t index) const noexcept;
+
+    size_t _size;
+    size_t _tombstones;
+    H _hash_function;
+    std::vector<uint8_t> _ctrl;
+    std::vector<raw_slot<K>> _keys;
+    std::vector<raw_slot<M>> _values;
+
+    /*
+    * Iterator over the full slots; dereferences to a std::pair<const K&, M&> prvalue,
+    * so it models std::forward_iterator but only claims input_iterator_tag.
+    */
+    template <bool Const>
+    class basic_iterator {
+        using map_type = std::conditional_t<Const, const FlatHashMap, FlatHashMap>;
+        using mapped_ref = std::conditional_t<Const, const M&, M&>;
+    public:
+        using iterator_concept = std::forward_iterator_tag;
+        using iterator_category = std::input_iterator_tag;
+        using value_type = FlatHashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using reference = std::pair<const K&, mapped_ref>;
+
+        // operator-> has to return something that owns the pair of references
+        struct pointer {
+            reference ref;
+            const reference* operator->() const { return &ref; }
+        };
+
+        basic_iterator() = default;
+        basic_iterator(map_type* map, size_t slot) : _map(map), _slot(slot) {}
+
+        template <bool OtherConst, typename = std::enable_if_t<Const && !OtherConst>>
+        basic_iterator(const basic_iterator<OtherConst>& other) : _map(other._map), _slot(other._slot) {}
+
+        reference operator*() const { return {object(_map->_keys[_slot]), object(_map->_values[_slot])}; }
+        pointer operator->() const { return pointer{**this}; }
+
+        basic_iterator& operator++() {
+            _slot = _map->next_full(_slot + 1);
+            return *this;
+        }
+        basic_iterator operator++(int) {
+            basic_iterator copy(*this);
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const basic_iterator& other) const { return _slot == other._slot; }
+        bool operator!=(const basic_iterator& other) const { return _slot != other._slot; }
+
+    private:
+        template <bool> friend class basic_iterator;
+
+        map_type* _map = nullptr;
+        size_t _slot = npos;
+    };
+};
+
+/*
+* HashMap<K, M, H> with the memory layout best suited to K and M: FlatHashMap for small
+* trivially copyable types (see use_flat_layout), the node-based HashMap otherwise.
+*
+* Usage:
+*      CompactHashMap<int64_t, int64_t> ids;       // a FlatHashMap
+*      CompactHashMap<std::string, int> counts;    // a HashMap
+*/
+template <typename K, typename M, typename H = std::hash<K>>
+using CompactHashMap = std::conditional_t<use_flat_layout<K, M>::value,
+                                          FlatHashMap<K, M, H>, HashMap<K, M, H>>;
+
+template <typename K, typename M, typename H>
+FlatHashMap<K, M, H>::FlatHashMap(size_t bucket_count, const H& hash) :
+    _size(0),
+    _tombstones(0),
+    _hash_function(hash),
+    _ctrl(std::bit_ceil(std::max(bucket_count, kMinSlots)), kEmpty),
+    _keys(_ctrl.size()),
+    _values(_ctrl.size()) { }
+
+template <typename K, typename M, typename H>
+size_t FlatHashMap<K, M, H>::find_slot(const K& key) const noexcept {
+    uint64_t h = mix(_hash_function(key));
+    uint8_t tag = h & 0x7F;
+    for (size_t slot = (h >> 7) & mask(); ; slot = (slot + 1) & mask()) {
+        uint8_t ctrl = _ctrl[slot];
+        if (ctrl == kEmpty) return npos;
+        if (ctrl == tag && object(_keys[slot]) == key) return slot;
+    }
+}
+
+template <typename K, typename M, typename H>
+size_t FlatHashMap<K, M, H>::next_full(size_t index) const noexcept {
+    for (; index < _ctrl.size(); ++index) {
+        if ((_ctrl[index] & 0x80) == 0) return index;
+    }
+    return npos;
+}
+
+template <typename K, typename M, typename H>
+std::pair<M*, bool> FlatHashMap<K, M, H>::insert(const value_type& value) {
+    const auto& [key, mapped] = value;
+    size_t found = find_slot(key);
+    if (found != npos) return {&object(_values[found]), false};
+
+    // keep at least 1/8 of the slots empty so that every probe terminates quickly.
+    // If most of the used slots are tombstones, cleaning them up is enough.
+    if ((_size + _tombstones + 1) * 8 > _ctrl.size() * 7) {
+        size_t slots = _ctrl.size();
+        if ((_size + 1) * 4 > slots) slots *= 2;
+        rehash(slots);
+    }
+
+    uint64_t h = mix(_hash_function(key));
+    size_t slot = (h >> 7) & mask();
+    while ((_ctrl[slot] & 0x80) == 0) slot = (slot + 1) & mask();
+
+    if (_ctrl[slot] == kDeleted) --_tombstones;
+    _ctrl[slot] = h & 0x7F;
+    place(_keys[slot], key);
+    place(_values[slot], mapped);
+    ++_size;
+    return {&object(_values[slot]), true};
+}
+
+template <typename K, typename M, typename H>
+bool FlatHashMap<K, M, H>::erase(const K& key) {
+    size_t found = find_slot(key);
+    if (found == npos) return false;
+    _ctrl[found] = kDeleted;
+    --_size;
+    ++_tombstones;
+    return true;
+}
+
+template <typename K, typename M, typename H>
+void FlatHashMap<K, M, H>::clear() noexcept {
+    std::fill(_ctrl.begin(), _ctrl.end(), kEmpty);
+    _size = 0;
+    _tombstones = 0;
+}
+
+template <typename K, typename M, typename H>
+M& FlatHashMap<K, M, H>::at(const K& key) {
+    return const_cast<M&>(static_cast<const FlatHashMap*>(this)->at(key));
+}
+
+template <typename K, typename M, typename H>
+const M& FlatHashMap<K, M, H>::at(const K& key) const {
+    size_t found = find_slot(key);
+    if (found == npos) {
+        throw std::out_of_range("FlatHashMap<K, M, H>::at: key not found");
+    }
+    return object(_values[found]);
+}
+
+template <typename K, typename M, typename H>
+void FlatHashMap<K, M, H>::rehash(size_t new_bucket_count) {
+    if (new_bucket_count == 0) {
+        throw std::out_of_range("FlatHashMap<K, M, H>::rehash: new_bucket_count must be positive.");
+    }
+    size_t slots = std::bit_ceil(std::max(new_bucket_count, kMinSlots));
+    while (_size * 8 >= slots * 7) slots *= 2;
+
+    std::vector<uint8_t> old_ctrl(slots, kEmpty);
+    std::vector<raw_slot<K>> old_keys(slots);
+    std::vector<raw_slot<M>> old_values(slots);
+    old_ctrl.swap(_ctrl);
+    old_keys.swap(_keys);
+    old_values.swap(_values);
+    _tombstones = 0;
+
+    for (size_t i = 0; i < old_ctrl.size(); ++i) {
+        if (old_ctrl[i] & 0x80) continue;
+        const K& key = object(old_keys[i]);
+        size_t slot = (mix(_hash_function(key)) >> 7) & mask();
+        while (_ctrl[slot] != kEmpty) slot = (slot + 1) & mask();
+        _ctrl[slot] = old_ctrl[i];
+        place(_keys[slot], key);
+        place(_values[slot], object(old_values[i]));
+    }
+}
+
+#endif // FLAT_HASHMAP_H
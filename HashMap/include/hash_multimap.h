@@ -0,0 +1,263 @@
+/*
+* HashMultiMap: a HashMap that maps each key to any number of values.
+*
+*      HashMultiMap<K, M, H> is a HashMap<K, multimap_values<M>, H>: one node per
+*      distinct key, holding every value of that key. A key's values are stored
+*      contiguously, so equal_range is a std::span and visiting the values of a key
+*      is a linear scan rather than a walk through one node per value, as it would
+*      be in std::unordered_multimap.
+*
+*      Most keys of a multimap have a single value, so multimap_values keeps the first
+*      value inline in the node and only allocates a vector when a second one arrives.
+*/
+
+#ifndef HASH_MULTIMAP_H
+#define HASH_MULTIMAP_H
+
+#include <algorithm>            // for equal
+#include <initializer_list>     // for initializer_list
+#include <optional>             // for optional
+#include <span>                 // for span
+#include <utility>              // for pair, move
+#include <vector>               // for vector
+#include "hashmap.h"
+
+/*
+* The values of one key of a HashMultiMap, in insertion order.
+*
+*      _one holds the value while there is exactly one; from the second value on, all
+*      of them live in _many and _one is empty.
+*/
+template <typename M>
+class multimap_values {
+public:
+    size_t size() const noexcept { return _many.empty() ? (_one ? 1 : 0) : _many.size(); }
+    bool empty() const noexcept { return size() == 0; }
+
+    M* data() noexcept { return _many.empty() ? (_one ? &*_one : nullptr) : _many.data(); }
+    const M* data() const noexcept { return _many.empty() ? (_one ? &*_one : nullptr) : _many.data(); }
+
+    M* begin() noexcept { return data(); }
+    M* end() noexcept { return data() + size(); }
+    const M* begin() const noexcept { return data(); }
+    const M* end() const noexcept { return data() + size(); }
+
+    M& operator[](size_t index) noexcept { return data()[index]; }
+    const M& operator[](size_t index) const noexcept { return data()[index]; }
+    M& back() noexcept { return data()[size() - 1]; }
+
+    std::span<M> span() noexcept { return {data(), size()}; }
+    std::span<const M> span() const noexcept { return {data(), size()}; }
+
+    /*
+    * Adds value after the existing values. The first push_back allocates nothing;
+    * the second moves the inline value into a vector.
+    *
+    * Notes: like std::vector, this invalidates pointers to the existing values.
+    */
+    void push_back(const M& value) {
+        if (_many.empty() && !_one) {
+            _one = value;
+            return;
+        }
+        if (_many.empty()) {
+            _many.reserve(2);
+            _many.push_back(std::move(*_one));
+            _one.reset();
+        }
+        _many.push_back(value);
+    }
+
+    bool operator==(const multimap_values& other) const {
+        return std::equal(begin(), end(), other.begin(), other.end());
+    }
+
+private:
+    template <typename, typename>
+    friend struct heap_size_estimator;
+
+    std::optional<M> _one;
+    std::vector<M> _many;
+};
+
+/*
+* The heap of multimap_values is its vector, once there are two values, plus whatever
+* the values own.
+*/
+template <typename M>
+struct heap_size_estimator<multimap_values<M>> {
+    static void add(const multimap_values<M>& values, heap_tally& tally) noexcept {
+        if (values._one) heap_size_estimator<M>::add(*values._one, tally);
+        heap_size_estimator<std::vector<M>>::add(values._many, tally);
+    }
+};
+
+/*
+* Template class for a HashMultiMap
+*
+* K = key type
+* M = mapped type
+* H = hash function type used to hash a key; if not provided, defaults to std::hash<K>
+*
+* Concept requirements: same as HashMap.
+*
+* Example:
+*      HashMultiMap<std::string, std::string> links;
+*      links.insert({"/wiki/Fruit", "/wiki/Apple"});
+*      links.insert({"/wiki/Fruit", "/wiki/Pear"});
+*      for (const auto& link : links.equal_range("/wiki/Fruit")) { ... }
+*/
+template <typename K, typename M, typename H = std::hash<K>>
+class HashMultiMap {
+
+    using map_type = HashMap<K, multimap_values<M>, H>;
+
+public:
+    using key_type = K;
+    using mapped_type = M;
+    using value_list = multimap_values<M>;
+
+    /*
+    * Iterators visit every distinct key once, as a pair<const K, value_list>:
+    *
+    *      for (const auto& [key, values] : multimap) {
+    *          for (const auto& value : values) { ... }
+    *      }
+    */
+    using const_iterator = typename map_type::const_iterator;
+
+    /*
+    * Creates an empty multimap with bucket_count buckets and the given hash function.
+    *
+    * Complexity: O(B), B = number of buckets
+    */
+    explicit HashMultiMap(size_t bucket_count = kDefaultBuckets, const H& hash = H()) :
+        _map(bucket_count, hash) {}
+
+    /*
+    * Creates a multimap from the given pairs. Every pair is kept, including duplicates.
+    *
+    * Usage:
+    *      HashMultiMap<int, char> multimap{{1, 'a'}, {1, 'b'}, {2, 'c'}};
+    */
+    HashMultiMap(std::initializer_list<std::pair<K, M>> list) : HashMultiMap() {
+        for (const auto& value : list) insert(value);
+    }
+
+    /*
+    * size() is the number of K/M pairs; key_count() is the number of distinct keys,
+    * which is what the load factor is computed from.
+    *
+    * Complexity: O(1)
+    */
+    size_t size() const noexcept { return _size; }
+    size_t key_count() const noexcept { return _map.size(); }
+    bool empty() const noexcept { return _size == 0; }
+    size_t bucket_count() const noexcept { return _map.bucket_count(); }
+    float load_factor() const noexcept { return _map.load_factor(); }
+
+    /*
+    * Returns whether key has at least one value, and how many values it has.
+    *
+    * Complexity: O(1) amortized average case, O(K) worst case, K = number of keys
+    */
+    bool contains(const K& key) const noexcept { return _map.contains(key); }
+    size_t count(const K& key) const { return equal_range(key).size(); }
+
+    /*
+    * Adds the K/M pair, after any values key already has.
+    *
+    * Return value: a reference to the value added. Like any reference to a value, it
+    * is invalidated by the next insert with the same key.
+    *
+    * Complexity: O(1) amortized average case
+    */
+    M& insert(const std::pair<K, M>& value) {
+        value_list& values = _map[value.first];
+        values.push_back(value.second);
+        ++_size;
+        return values.back();
+    }
+
+    /*
+    * Returns the values of key, in insertion order, or an empty span if there are none.
+    *
+    * Usage:
+    *      for (auto& value : multimap.equal_range(key)) { ... }
+    *
+    * Complexity: O(1) amortized average case, O(K) worst case, K = number of keys
+    */
+    std::span<M> equal_range(const K& key) {
+        auto it = _map.find(key);
+        return it == _map.end() ? std::span<M>() : it->second.span();
+    }
+
+    std::span<const M> equal_range(const K& key) const {
+        auto it = _map.find(key);
+        return it == _map.end() ? std::span<const M>() : it->second.span();
+    }
+
+    /*
+    * Removes key and all of its values.
+    *
+    * Return value: the number of K/M pairs removed.
+    *
+    * Complexity: O(1) amortized average case, plus the destruction of the values
+    */
+    size_t erase(const K& key) {
+        size_t removed = count(key);
+        _map.erase(key);
+        _size -= removed;
+        return removed;
+    }
+
+    /*
+    * Removes every pair. The number of buckets stays the same.
+    *
+    * Complexity: O(N + B)
+    */
+    void clear() noexcept {
+        _map.clear();
+        _size = 0;
+    }
+
+    /*
+    * Resizes the bucket array; see HashMap::rehash and HashMap::shrink_to_fit.
+    *
+    * Exceptions: std::out_of_range if new_bucket_count = 0.
+    */
+    void rehash(size_t new_bucket_count) { _map.rehash(new_bucket_count); }
+    void shrink_to_fit() { _map.shrink_to_fit(); }
+
+    /*
+    * Chain statistics and heap usage; see HashMap::stats and HashMap::memory_usage.
+    * mapped_heap_bytes includes the vectors of the keys that have several values.
+    */
+    HashMapStats stats() const { return _map.stats(); }
+    HashMapMemoryUsage memory_usage() const { return _map.memory_usage(); }
+
+    const_iterator begin() const { return _map.begin(); }
+    const_iterator end() const { return _map.end(); }
+
+    /*
+    * Two multimaps are equal if every key has the same values, in the same order.
+    */
+    friend bool operator==(const HashMultiMap& lhs, const HashMultiMap& rhs) {
+        if (lhs.size() != rhs.size() || lhs.key_count() != rhs.key_count()) return false;
+        for (const auto& [key, values] : lhs) {
+            auto other = rhs.equal_range(key);
+            if (!std::equal(values.begin(), values.end(), other.begin(), other.end())) return false;
+        }
+        return true;
+    }
+
+    friend bool operator!=(const HashMultiMap& lhs, const HashMultiMap& rhs) { return !(lhs == rhs); }
+
+private:
+    static const size_t kDefaultBuckets = 10;
+
+    map_type _map;
+    size_t _size = 0;
+};
+
+#endif // HASH_MULTIMAP_H
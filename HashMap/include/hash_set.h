@@ -0,0 +1,254 @@
+/*
+* HashSet: a set of keys stored in a HashMap.
+*
+*      HashSet<K, H> is a HashMap<K, set_entry, H> whose mapped type is an empty struct,
+*      so it shares the bucket array, the nodes, the occupancy bitmap, rehash, stats()
+*      and memory_usage() of HashMap instead of having its own copy of them. The map
+*      stores its elements as a key_only<K> (see hashmap_value in hashmap.h), whose
+*      empty mapped value takes no space, so a node is just the key and the next
+*      pointer: for a HashSet<uint64_t>, 16 bytes against 24 for a HashMap<uint64_t, bool>.
+*
+*      Like HashMap, the set does not rehash automatically; pass an expected size to
+*      the constructor or call rehash.
+*/
+
+#ifndef HASH_SET_H
+#define HASH_SET_H
+
+#include <initializer_list>     // for initializer_list
+#include <iterator>             // for forward_iterator_tag
+#include <tuple>                // for tuple
+#include <utility>              // for pair, piecewise_construct_t
+#include "hashmap.h"
+
+namespace hash_set_detail {
+
+/*
+* The mapped type of the HashMap under a HashSet. It has no state, so any two are equal.
+*/
+struct set_entry {
+    bool operator==(const set_entry&) const noexcept { return true; }
+};
+
+/*
+* Element of the HashMap under a HashSet: the key, and a set_entry that takes no space.
+* It has the first and second members and the constructors of std::pair that
+* HashMap uses.
+*/
+template <typename K>
+struct key_only {
+    key_only() : first() {}
+    key_only(const K& key, set_entry) : first(key) {}
+    template <typename KeyArgs>
+    key_only(std::piecewise_construct_t, KeyArgs key_args, std::tuple<>) : first(std::make_from_tuple<K>(key_args)) {}
+
+    const K first;
+    [[no_unique_address]] set_entry second;
+};
+
+}
+
+template <typename K>
+struct hashmap_value<K, hash_set_detail::set_entry> {
+    using type = hash_set_detail::key_only<K>;
+};
+
+/*
+* Template class for a HashSet
+*
+* K = key type
+* H = hash function type used to hash a key; if not provided, defaults to std::hash<K>
+*
+* Concept requirements: same as the key of HashMap.
+*
+* Example:
+*      HashSet<std::string> links{"/wiki/Fruit", "/wiki/Apple"};
+*      links.insert("/wiki/Pear");
+*      if (links.contains("/wiki/Apple")) { ... }
+*/
+template <typename K, typename H = std::hash<K>>
+class HashSet {
+
+    using set_entry = hash_set_detail::set_entry;
+    using map_type = HashMap<K, set_entry, H>;
+
+public:
+    using key_type = K;
+    using value_type = K;
+
+    class const_iterator;
+    using iterator = const_iterator;
+
+    /*
+    * Creates an empty set with bucket_count buckets and the given hash function.
+    *
+    * Usage:
+    *      HashSet<int> set;
+    *      HashSet<int> set(1000);
+    *
+    * Complexity: O(B), B = number of buckets
+    */
+    explicit HashSet(size_t bucket_count = kDefaultBuckets, const H& hash = H()) :
+        _map(bucket_count, hash) {}
+
+    /*
+    * Creates a set from the given keys. Duplicates are ignored.
+    *
+    * Usage:
+    *      HashSet<std::string> set{"A", "B", "A"};      // size() == 2
+    *
+    * Complexity: O(N) average case, N = number of keys given
+    */
+    HashSet(std::initializer_list<K> list) : HashSet(list.begin(), list.end()) {}
+
+    template <typename InputIt>
+    HashSet(InputIt first, InputIt last) : HashSet() {
+        for (; first != last; ++first) insert(*first);
+    }
+
+    /*
+    * Returns the number of keys, whether the set is empty, the number of buckets
+    * and size/bucket_count, respectively.
+    *
+    * Complexity: O(1)
+    */
+    size_t size() const noexcept { return _map.size(); }
+    bool empty() const noexcept { return _map.empty(); }
+    size_t bucket_count() const noexcept { return _map.bucket_count(); }
+    float load_factor() const noexcept { return _map.load_factor(); }
+
+    /*
+    * Returns whether the set contains key, and how many times (0 or 1), respectively.
+    *
+    * Complexity: O(1) amortized average case, O(N) worst case, N = number of keys
+    */
+    bool contains(const K& key) const noexcept { return _map.contains(key); }
+    size_t count(const K& key) const noexcept { return contains(key) ? 1 : 0; }
+
+    /*
+    * Adds key to the set, if it is not already there.
+    *
+    * Return value: pair<const K*, bool>, where the pointer points at the key stored in
+    * the set and the bool is true if the key was added.
+    *
+    * Usage:
+    *      auto [key, added] = set.insert("A");
+    *
+    * Complexity: O(1) amortized average case, O(N) worst case, N = number of keys
+    */
+    std::pair<const K*, bool> insert(const K& key) {
+        auto [value, added] = _map.insert({key, set_entry()});
+        return {&value->first, added};
+    }
+
+    /*
+    * Removes key from the set, if it is there.
+    *
+    * Return value: true if a key was removed.
+    *
+    * Complexity: O(1) amortized average case, O(N) worst case, N = number of keys
+    */
+    bool erase(const K& key) { return _map.erase(key); }
+
+    /*
+    * Removes every key. The number of buckets stays the same.
+    *
+    * Complexity: O(N + B)
+    */
+    void clear() noexcept { _map.clear(); }
+
+    /*
+    * Resizes the bucket array; see HashMap::rehash and HashMap::shrink_to_fit.
+    *
+    * Exceptions: std::out_of_range if new_bucket_count = 0.
+    */
+    void rehash(size_t new_bucket_count) { _map.rehash(new_bucket_count); }
+    void shrink_to_fit() { _map.shrink_to_fit(); }
+
+    /*
+    * Returns an iterator to key, or end() if the set does not contain it.
+    */
+    const_iterator find(const K& key) const { return const_iterator(_map.find(key)); }
+
+    /*
+    * Chain statistics and heap usage of the set; see HashMap::stats and HashMap::memory_usage.
+    */
+    HashMapStats stats() const { return _map.stats(); }
+    HashMapMemoryUsage memory_usage() const { return _map.memory_usage(); }
+
+    /*
+    * Iterators visit the keys in an unspecified order, and are invalidated by
+    * rehash, clear, and erasing the key they point at.
+    */
+    const_iterator begin() const { return const_iterator(_map.begin()); }
+    const_iterator end() const { return const_iterator(_map.end()); }
+
+    /*
+    * Two sets are equal if they contain the same keys, whatever their bucket counts.
+    *
+    * Complexity: O(N) average case
+    */
+    friend bool operator==(const HashSet& lhs, const HashSet& rhs) {
+        if (lhs.size() != rhs.size()) return false;
+        for (const K& key : lhs) {
+            if (!rhs.contains(key)) return false;
+        }
+        return true;
+    }
+
+    friend bool operator!=(const HashSet& lhs, const HashSet& rhs) { return !(lhs == rhs); }
+
+    /*
+    * Forward iterator over the keys, wrapping the const_iterator of the HashMap.
+    */
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = K;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const K*;
+        using reference = const K&;
+
+        explicit const_iterator(const typename map_type::const_iterator& it) : _it(it) {}
+
+        reference operator*() const { return _it->first; }
+        pointer operator->() const { return &_it->first; }
+
+        const_iterator& operator++() {
+            ++_it;
+            return *this;
+        }
+        const_iterator operator++(int) {
+            const_iterator copy(*this);
+            ++_it;
+            return copy;
+        }
+
+        bool operator==(const const_iterator& other) const { return _it == other._it; }
+        bool operator!=(const const_iterator& other) const { return _it != other._it; }
+
+    private:
+        typename map_type::const_iterator _it;
+    };
+
+private:
+    static const size_t kDefaultBuckets = 10;
+
+    map_type _map;
+};
+
+/*
+* Prints the set as {A, B, C}, in iteration order.
+*/
+template <typename K, typename H>
+std::ostream& operator<<(std::ostream& os, const HashSet<K, H>& set) {
+    os << "{";
+    const char* separator = "";
+    for (const K& key : set) {
+        os << separator << key;
+        separator = ", ";
+    }
+    return os << "}";
+}
+
+#endif // HASH_SET_H
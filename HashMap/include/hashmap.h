@@ -15,6 +15,21 @@
 #include <iomanip>              // for setw, setprecision, setfill, right
 #include <sstream>              // for istringstream
 #include <vector>               // for vector
+#include <algorithm>            // for copy, equal, max
+#include <bit>                  // for countr_zero
+#include <span>                 // for span
+#include <chrono>               // for steady_clock
+#include <cstdint>              // for uint64_t
+#include <iterator>             // for forward_iterator_tag, random_access_iterator_tag, default_sentinel
+#include <ranges>               // for views::keys, views::values
+#include <tuple>                // for forward_as_tuple
+#include <type_traits>          // for conditional_t
+#include <utility>              // for in_place, piecewise_construct
+#include "hashmap_codec.h"
+#include "hashmap_stats.h"
+#include "hashmap_memory.h"
+#include "bloom_filter.h"
+#include "huge_page_allocator.h"
 #include "hashmap_iterator.h"
 
 // add any other includes that are necessary
@@ -45,21 +60,35 @@
 *      - H is function type that takes in some type K, and outputs a size_t.
 *      - K and M must be regular (copyable, default constructible, and equality comparable).
 */
+/*
+* The type a HashMap<K, M, H> stores each element as: std::pair<const K, M> unless
+* specialized. A specialization must, like std::pair, have public members first
+* (the const key) and second (the mapped value), be constructible from a key and a
+* mapped value, and piecewise from std::piecewise_construct and two tuples.
+*
+* HashSet specializes it for its empty mapped type, so that a set node holds only
+* the key and the next pointer (see hash_set.h).
+*/
+template <typename K, typename M>
+struct hashmap_value {
+    using type = std::pair<const K, M>;
+};
+
 template <typename K, typename M, typename H = std::hash<K>>
 class HashMap {
 
 
 public:
     /*
-    * Alias for std::pair<const K, M>, used by the STL (such as in std::inserter)
+    * Alias for std::pair<const K, M> (unless hashmap_value is specialized), used by the
+    * STL (such as in std::inserter)
     * As noted above, value_type is not the same as the mapped_type!
     *
     * Usage:
     *      HashMap::value_type val = {3, "Avery"};
     *      map.insert(val);
     */
-    friend class iterator;
-    using value_type = std::pair<const K, M>;
+    using value_type = typename hashmap_value<K, M>::type;
 
     /*
     * Default constructor
@@ -174,6 +203,14 @@ public:
     */
     inline size_t bucket_count() const noexcept;
 
+    /*
+    * Returns a copy of the hash function, as std::unordered_map::hash_function does.
+    *
+    * Usage:
+    *      HashMap<std::string, int, MyHash> other(map.bucket_count(), map.hash_function());
+    */
+    H hash_function() const { return _hash_function; }
+
     /*
     * Returns whether or not the HashMap contains the given key.
     *
@@ -293,6 +330,53 @@ public:
     */
     void debug() const;
 
+    /*
+    * Returns statistics describing the current shape of the hash table (chain length
+    * histogram, probe lengths, empty buckets, memory used) and its history (node
+    * allocations, number of rehashes and the time spent rehashing).
+    *
+    * If hashmap_policy<K, M, H> counts operations (see hashmap_stats.h), the
+    * numbers of lookups, probes, inserts and erases are filled in as well. If it uses
+    * a Bloom filter, so are the filter's size, the lookups it stopped and its false
+    * positive rate.
+    *
+    * Parameters: none
+    * Return value: HashMapStats
+    *
+    * Usage:
+    *      HashMapStats stats = map.stats();
+    *      if (stats.max_chain_length > 8) { ... }      // suspicious hash function
+    *      std::cout << stats << std::endl;
+    *
+    * Complexity: O(N + B), N = number of elements, B = number of buckets
+    *
+    * Notes: unlike debug, this never prints the elements, so it is usable on maps of
+    * any size and with K or M that do not support operator<<.
+    */
+    HashMapStats stats() const;
+
+    /*
+    * Returns the heap memory used by the map, broken down into the bucket array,
+    * occupancy bitmap and Bloom filter (if any), the nodes, the heap owned by the keys and by the mapped values
+    * (as reported by heap_size_estimator<K> and heap_size_estimator<M>), and the
+    * estimated allocator overhead of every one of those blocks.
+    *
+    * Parameters: none
+    * Return value: HashMapMemoryUsage
+    *
+    * Usage:
+    *      HashMap<std::string, std::string> cache;
+    *      ...
+    *      std::cout << cache.memory_usage().bytes_per_entry() << " bytes per entry" << std::endl;
+    *
+    * Complexity: O(N + B), N = number of elements, B = number of buckets
+    *
+    * Notes: the allocator overhead is an estimate (see malloc_block_size); the other
+    * numbers are the bytes actually requested from the allocator, provided the
+    * heap_size_estimator of K and M are exact.
+    */
+    HashMapMemoryUsage memory_usage() const;
+
     /*
     * Resizes the array of buckets, and rehashes all elements. new_buckets could
     * be larger than, smaller than, or equal to the original number of buckets.
@@ -319,8 +403,79 @@ public:
     */
     void rehash(size_t new_buckets);
 
+    /*
+    * Shrinks the array of buckets so that the load factor is (about) 1, and rehashes
+    * all elements. Use this after erasing most of the elements of a large map, so that
+    * iteration no longer has to step over a mostly empty bucket array.
+    *
+    * Parameters: none
+    * Return value: none
+    *
+    * Usage:
+    *      map.shrink_to_fit();
+    *
+    * Complexity: O(N + B), N = number of elements, B = number of buckets
+    *
+    * Notes: the map always keeps at least one bucket.
+    */
+    void shrink_to_fit();
+
     M& operator[](const K& key);
 
+    /*
+    * Writes the map in a compact, versioned binary format: a header (with the element
+    * count and bucket count), then every key, then every mapped value, each encoded by
+    * binary_codec. Arithmetic keys and values are copied as raw bytes.
+    *
+    * Parameters: the output stream, or a span of bytes to write into.
+    * Return value: none for streams; for spans, the number of bytes written.
+    *
+    * Usage:
+    *      std::ofstream out("checkpoint.bin", std::ios::binary);
+    *      map.save(out);
+    *
+    *      std::vector<std::byte> bytes(map.serialized_size());
+    *      map.save(bytes);
+    *
+    * Exceptions: std::length_error if the span is smaller than serialized_size(), or if
+    * a std::string key or value is 4 GiB or longer (its length is saved in 32 bits).
+    *
+    * Complexity: O(N + B), N = number of elements, B = number of buckets
+    *
+    * Notes: unlike operator<<, the output is meant for load, not for people.
+    */
+    void save(std::ostream& os) const;
+    size_t save(std::span<std::byte> out) const;
+
+    /*
+    * Returns the number of bytes save will write.
+    *
+    * Complexity: O(N) (O(1) per element for arithmetic K and M)
+    */
+    size_t serialized_size() const;
+
+    /*
+    * Replaces the contents of the map with a map written by save. The bucket array is
+    * sized before any element is inserted, so the table is allocated once and has a
+    * load factor of at most 1. The saved bucket count is kept, up to twice the element
+    * count plus 1024.
+    *
+    * Parameters: the input stream, or a span holding the saved bytes.
+    * Return value: none
+    *
+    * Usage:
+    *      std::ifstream in("checkpoint.bin", std::ios::binary);
+    *      map.load(in);
+    *
+    * Exceptions: std::runtime_error if the input is truncated or corrupt, or was not
+    * written by save for a HashMap with the same K and M encodings. The map is left
+    * empty. Memory use follows the bytes actually read, never a count in the input.
+    *
+    * Complexity: O(N + B)
+    */
+    void load(std::istream& is);
+    void load(std::span<const std::byte> in);
+
     HashMap&operator=(const HashMap& other);
     HashMap&operator=(HashMap&& other);
 
@@ -351,6 +506,18 @@ private:
         */
         node(const value_type& value = value_type(), node* next = nullptr) :
             value(value), next(next) {}
+
+        /*
+        * Constructs the value in place from args, for callers that do not have a
+        * value_type to copy from.
+        *
+        * Usage:
+        *      node* new_node = node(std::in_place, next_ptr, std::piecewise_construct,
+        *                            std::forward_as_tuple(key), std::forward_as_tuple());
+        */
+        template <typename... Args>
+        node(std::in_place_t, node* next, Args&&... args) :
+            value(std::forward<Args>(args)...), next(next) {}
     };
 
     /*
@@ -363,6 +530,13 @@ private:
     */
     using node_pair = std::pair<typename HashMap::node*, typename HashMap::node*>;
 
+    /*
+    * The type of _buckets_array: its allocator puts large arrays on huge pages if
+    * hashmap_policy<K, M, H> uses huge pages.
+    */
+    using bucket_array = std::vector<node*, std::conditional_t<hashmap_policy<K, M, H>::use_huge_pages,
+            huge_page_allocator<node*, hashmap_policy<K, M, H>::interleave_numa>, std::allocator<node*>>>;
+
     /*
     * Finds the node N with given key, and returns a node_pair consisting of
     * the node whose's next is N, and N. If node is not found, {nullptr, nullptr}
@@ -387,6 +561,88 @@ private:
     */
     node_pair find_node(const K& key) const;
 
+    /*
+    * Links a new node, whose value is constructed from args, at the front of the
+    * bucket of key, which must not be in the map yet. Returns the new node.
+    *
+    * Usage:
+    *      node* added = link_node(key, value);
+    *
+    * Complexity: O(1) amortized
+    *
+    * Notes: insert and operator[] share this, so that operator[] can build the
+    * value straight from the key instead of going through a temporary value_type.
+    */
+    template <typename... Args>
+    node* link_node(const K& key, Args&&... args);
+
+    /*
+    * Returns the index of the first non-empty bucket at or after index,
+    * or bucket_count() if every remaining bucket is empty.
+    *
+    * Usage:
+    *      for (size_t i = next_occupied(0); i < bucket_count(); i = next_occupied(i + 1)) { ... }
+    *
+    * Complexity: O(B / 64) worst case, B = number of buckets
+    *
+    * Notes: this reads _occupied instead of _buckets_array, so a run of 64 empty
+    * buckets is skipped with a single countr_zero.
+    */
+    size_t next_occupied(size_t index) const noexcept;
+
+    /*
+    * Sets or clears the bit of _occupied for the given bucket, depending on
+    * whether the bucket is currently empty. Call this after changing the front
+    * pointer of a bucket.
+    */
+    void update_occupied(size_t index) noexcept;
+
+    /*
+    * Returns the number of 64-bit words needed for an occupancy bitmap of bucket_count bits.
+    */
+    static size_t occupied_words(size_t bucket_count) noexcept;
+
+    /*
+    * Empties the Bloom filter, sizes it for expected_keys, and adds every key of the
+    * map back. Dropping the bits of erased keys this way is how the filter supports erase.
+    *
+    * Complexity: O(N + B / 64), N = number of elements, B = number of buckets
+    *
+    * Exceptions: std::bad_alloc if the filter grows, in which case it is unchanged.
+    */
+    void rebuild_bloom(size_t expected_keys);
+
+    /*
+    * Inserts every element of other into this map, which must be empty. Elements are
+    * inserted straight from other's nodes, so exactly one node is allocated per element.
+    *
+    * Exceptions: if copying an element throws, the elements copied so far are freed.
+    */
+    void copy_nodes_from(const HashMap& other);
+
+    /*
+    * Shared implementation of the stream and span overloads of save and load.
+    * Writer and Reader are the classes from hashmap_codec.h.
+    */
+    template <typename Writer>
+    void save_to(Writer& out) const;
+
+    template <typename Reader>
+    void load_from(Reader& in);
+
+    /*
+    * Reads count values of type T for load_from, growing the result as the values
+    * arrive rather than allocating count of them up front.
+    */
+    template <typename T, typename Reader>
+    static std::vector<T> load_elements(Reader& in, uint64_t count);
+
+    /*
+    * Buckets that load_from allows beyond twice the element count, however many the
+    * saved header asks for.
+    */
+    static constexpr size_t kMaxLoadedEmptyBuckets = 1024;
+
 
     /* Private member variables */
 
@@ -417,7 +673,37 @@ private:
     *      node* ptr = _buckets_array[index];          // _buckets_array is array of node*
     *      const auto& [key, mapped] = ptr->value;     // each node* contains a value that is a pair
     */
-    std::vector<node*> _buckets_array;
+    bucket_array _buckets_array;
+
+    /*
+    * Occupancy bitmap for _buckets_array: bit (i % 64) of word (i / 64) is set
+    * exactly when bucket i is non-empty. The iterators use it to jump straight
+    * to the next non-empty bucket instead of checking every bucket.
+    */
+    std::vector<uint64_t> _occupied;
+
+    /*
+    * Lifetime counters reported by stats(). _op_counters is empty (and free) unless
+    * hashmap_policy<K, M, H> counts operations; it is mutable because lookups are const,
+    * and atomic because several threads may look up in a const map at once.
+    */
+    size_t _node_allocations = 0;
+    size_t _rehash_count = 0;
+    std::chrono::nanoseconds _rehash_time{0};
+    [[no_unique_address]] mutable hashmap_op_counters<hashmap_policy<K, M, H>::count_operations> _op_counters;
+
+    /*
+    * Bloom filter of the hashes of the keys, checked by find_node before the buckets.
+    * Empty (and free) unless hashmap_policy<K, M, H> uses a Bloom filter.
+    */
+    [[no_unique_address]] hashmap_bloom<hashmap_policy<K, M, H>::use_bloom_filter> _bloom;
+
+    /*
+    * Where the nodes come from: new and delete, or slabs on huge pages if
+    * hashmap_policy<K, M, H> uses huge pages.
+    */
+    [[no_unique_address]] hashmap_node_pool<node, hashmap_policy<K, M, H>::use_huge_pages,
+                                            hashmap_policy<K, M, H>::interleave_numa> _nodes;
 
     /*
     * A constant for the default number of buckets for the default constructor.
@@ -436,208 +722,277 @@ private:
        const HashMap<K_, M_, H_>& rhs);
 
 public:
-    class iterator :public std::iterator<std::input_iterator_tag,value_type>{
-    private:
-        const HashMap*hashMap;
-        bool is_end = true;
-        int index = 0;
-        node*curr_node= nullptr;
+    /*
+    * Iterators over the elements, bucket by bucket. Const is whether the elements are
+    * read-only: iterator is basic_iterator<false> and const_iterator is
+    * basic_iterator<true>, and an iterator converts to a const_iterator.
+    *
+    * These are std::forward_iterators, so the map is a std::ranges::forward_range and
+    * works with multi-pass algorithms and range adaptors (see keys() and values()).
+    *
+    * An iterator is at the end exactly when its node is null, so comparing with end()
+    * is a single pointer comparison. Iterators also compare equal to
+    * std::default_sentinel at the end, for loops that do not want to build end():
+    *
+    *      for (auto it = map.begin(); it != std::default_sentinel; ++it) { ... }
+    *
+    * Notes: dereferencing the end iterator is undefined, as it is for the standard
+    * containers. Inserting does not invalidate iterators, but the new element may or may
+    * not be visited by an iteration in progress; erasing invalidates only iterators to
+    * the erased element; rehash invalidates all of them.
+    */
+    template <bool Const>
+    class basic_iterator {
     public:
-        iterator(const HashMap*mp,bool end=false):hashMap(mp),is_end(end){
-            hashMap = mp;
-            if(!is_end){
-                while(index<hashMap->bucket_count()&&hashMap->_buckets_array[index]== nullptr)
-                    ++index;
-                if(index<hashMap->bucket_count()){
-                    curr_node = hashMap->_buckets_array[index];
-                }else{
-                    is_end = true;
-                }
-            }
-        }
-        iterator(const iterator&it){
-            hashMap = it.hashMap;
-            index = it.index;
-            is_end = it.is_end;
-            curr_node = it.curr_node;
-        }
-        bool operator==( iterator&temp){
-            return (is_end&temp.is_end)||(curr_node == temp.curr_node);
-        }
+        using iterator_category = std::forward_iterator_tag;
+        using iterator_concept = std::forward_iterator_tag;
+        using value_type = HashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+        using reference = std::conditional_t<Const, const value_type&, value_type&>;
 
-        bool operator==(const iterator&temp){
-            return (is_end&temp.is_end)||(curr_node == temp.curr_node);
-        }
-        bool operator!=( iterator&temp){
-            return !((*this)==temp);
-        }
-        bool operator!=(const iterator&temp){
-            return !((*this)==temp);
-        }
-        value_type& operator*()const{
-            if(curr_node== nullptr)
-                throw "Error! ";
-            return curr_node->value;
+        basic_iterator() = default;
+
+        /*
+        * An iterator to the first element of map, or the end iterator if it is empty.
+        */
+        explicit basic_iterator(const HashMap* map) noexcept :
+                _map(map), _index(map->next_occupied(0)) {
+            if (_index < map->bucket_count()) _curr = map->_buckets_array[_index];
         }
-        iterator&operator++(){
-            if(curr_node== nullptr){
-                is_end = true;
-                return *this;
-            }
-            curr_node = curr_node->next;
-            if(curr_node== nullptr){
-                ++index;
-                while(index<hashMap->bucket_count()&&hashMap->_buckets_array[index]== nullptr)
-                    ++index;
-                if(index<hashMap->bucket_count()){
-                    curr_node = hashMap->_buckets_array[index];
-                }else{
-                    is_end=true;
-                }
+
+        /*
+        * An iterator to curr, which is in bucket index of map. Used by find.
+        */
+        basic_iterator(const HashMap* map, size_t index, node* curr) noexcept :
+                _map(map), _index(index), _curr(curr) {}
+
+        /*
+        * iterator -> const_iterator
+        */
+        template <bool OtherConst>
+            requires (Const && !OtherConst)
+        basic_iterator(const basic_iterator<OtherConst>& other) noexcept :
+                _map(other._map), _index(other._index), _curr(other._curr) {}
+
+        reference operator*() const noexcept { return _curr->value; }
+        pointer operator->() const noexcept { return &_curr->value; }
+
+        basic_iterator& operator++() noexcept {
+            _curr = _curr->next;
+            if (_curr == nullptr) {
+                _index = _map->next_occupied(_index + 1);
+                if (_index < _map->bucket_count()) _curr = _map->_buckets_array[_index];
             }
             return *this;
         }
-        iterator operator++(int){
-            iterator copy(*this);
-            operator++();
-           return copy;
-        }
 
-        iterator&operator=(iterator&other){
-            if(*this == other)
-                return *this;
-            this->curr_node = other.curr_node;
-            this->is_end = other.is_end;
-            this->index = other.index;
-            this->hashMap = other.hashMap;
-            return *this;
+        basic_iterator operator++(int) noexcept {
+            basic_iterator copy(*this);
+            ++*this;
+            return copy;
         }
 
-        iterator&operator=(const iterator&other){
-            if(*this == other)
-                return *this;
-            this->curr_node = other.curr_node;
-            this->is_end = other.is_end;
-            this->index = other.index;
-            this->hashMap = other.hashMap;
-            return *this;
+        friend bool operator==(const basic_iterator& lhs, const basic_iterator& rhs) noexcept {
+            return lhs._curr == rhs._curr;
         }
-        value_type*operator->() const{
-            if(curr_node == nullptr)
-                throw "error!";
-            return &(curr_node->value);
-        }
-        bool key_equal(const K&key){
-            if(is_end||curr_node== nullptr)
-                return false;
-            return curr_node->value.first == key;
+
+        friend bool operator==(const basic_iterator& it, std::default_sentinel_t) noexcept {
+            return it._curr == nullptr;
         }
-    };
-    class const_iterator :public std::iterator<std::input_iterator_tag,value_type>{
+
     private:
-        const HashMap*hashMap;
-        bool is_end = true;
-        int index = 0;
-        node*curr_node= nullptr;
+        template <bool>
+        friend class basic_iterator;
+
+        const HashMap* _map = nullptr;
+        size_t _index = 0;
+        node* _curr = nullptr;          // nullptr at the end
+    };
+
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    /*
+    * The elements of one bucket (one chain), as a forward range. Const is whether the
+    * elements are read-only.
+    *
+    * Usage:
+    *      for (const auto& [key, mapped] : map.buckets()[3]) { ... }
+    */
+    template <bool Const>
+    class basic_bucket {
     public:
-        explicit const_iterator(const HashMap*mp,bool end=false):hashMap(mp),is_end(end){
-            hashMap = mp;
-            if(!is_end){
-                while(index<hashMap->bucket_count()&&hashMap->_buckets_array[index]== nullptr)
-                    ++index;
-                if(index<hashMap->bucket_count()){
-                    curr_node = hashMap->_buckets_array[index];
-                }else{
-                    is_end = true;
-                }
-            }
-        }
-        const_iterator(const_iterator&it){
-            hashMap = it.hashMap;
-            index = it.index;
-            is_end = it.is_end;
-            curr_node = it.curr_node;
-        }
-        bool operator==( const_iterator&temp){
-            return (is_end&temp.is_end)||(curr_node == temp.curr_node);
-        }
-        bool operator==(const const_iterator&temp){
-            return (is_end&temp.is_end)||(curr_node == temp.curr_node);
-        }
-        bool operator!=(const_iterator&temp){
-            return !((*this)==temp);
-        }
-        bool operator!=(const const_iterator&temp){
-            return !((*this)==temp);
-        }
-        bool key_equal(const K&key){
-            if(!is_end||curr_node== nullptr)
-                return false;
-            return curr_node->value.first == key;
-        }
+        using element_type = std::conditional_t<Const, const HashMap::value_type, HashMap::value_type>;
+
+        class iterator {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = HashMap::value_type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = element_type*;
+            using reference = element_type&;
+
+            iterator() = default;
+            explicit iterator(node* curr) noexcept : _curr(curr) {}
+
+            reference operator*() const noexcept { return _curr->value; }
+            pointer operator->() const noexcept { return &_curr->value; }
+            iterator& operator++() noexcept { _curr = _curr->next; return *this; }
+            iterator operator++(int) noexcept { iterator copy(*this); ++*this; return copy; }
+            bool operator==(const iterator& other) const noexcept = default;
+
+        private:
+            node* _curr = nullptr;
+        };
 
-        const value_type& operator*()const{
-            if(curr_node== nullptr)
-                throw "Error! ";
-            return curr_node->value;
+        basic_bucket() = default;
+        explicit basic_bucket(node* front) noexcept : _front(front) {}
+
+        iterator begin() const noexcept { return iterator(_front); }
+        iterator end() const noexcept { return iterator(); }
+        bool empty() const noexcept { return _front == nullptr; }
+
+        /*
+        * The length of the chain. Complexity: O(length)
+        */
+        size_t size() const noexcept {
+            size_t length = 0;
+            for (node* curr = _front; curr != nullptr; curr = curr->next) ++length;
+            return length;
         }
-        const_iterator&operator++(){
-            if(curr_node== nullptr){
-                is_end = true;
-                return *this;
-            }
-            curr_node = curr_node->next;
-            if(curr_node== nullptr){
-                ++index;
-                while(index<hashMap->bucket_count()&&hashMap->_buckets_array[index]== nullptr)
-                    ++index;
-                if(index<hashMap->bucket_count()){
-                    curr_node = hashMap->_buckets_array[index];
-                }else{
-                    is_end=true;
-                }
+
+    private:
+        node* _front = nullptr;
+    };
+
+    /*
+    * A contiguous run of buckets, as a random-access range of basic_bucket. Unlike
+    * begin()..end(), which can only be walked from the start, a bucket range can be
+    * cut anywhere in O(1), so it can be split between threads (see hashmap_parallel.h)
+    * or handed to std::for_each(std::execution::par, ...).
+    *
+    * Usage:
+    *      auto buckets = map.buckets();
+    *      auto first_half = buckets.slice(0, buckets.size() / 2);
+    *      for (auto bucket : first_half) {
+    *          for (auto& [key, mapped] : bucket) { ... }
+    *      }
+    *
+    * Notes: a bucket range is a view of the bucket array. rehash, shrink_to_fit, load,
+    * and assigning or moving the map invalidate it; insert and erase do not, but the
+    * chains it shows change with them.
+    */
+    template <bool Const>
+    class basic_bucket_range {
+    public:
+        using bucket = basic_bucket<Const>;
+
+        class iterator {
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using iterator_concept = std::random_access_iterator_tag;
+            using value_type = bucket;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = bucket;
+
+            iterator() = default;
+            explicit iterator(node* const* slot) noexcept : _slot(slot) {}
+
+            bucket operator*() const noexcept { return bucket(*_slot); }
+            bucket operator[](difference_type n) const noexcept { return bucket(_slot[n]); }
+
+            iterator& operator++() noexcept { ++_slot; return *this; }
+            iterator operator++(int) noexcept { iterator copy(*this); ++_slot; return copy; }
+            iterator& operator--() noexcept { --_slot; return *this; }
+            iterator operator--(int) noexcept { iterator copy(*this); --_slot; return copy; }
+            iterator& operator+=(difference_type n) noexcept { _slot += n; return *this; }
+            iterator& operator-=(difference_type n) noexcept { _slot -= n; return *this; }
+
+            friend iterator operator+(iterator it, difference_type n) noexcept { return it += n; }
+            friend iterator operator+(difference_type n, iterator it) noexcept { return it += n; }
+            friend iterator operator-(iterator it, difference_type n) noexcept { return it -= n; }
+            friend difference_type operator-(const iterator& lhs, const iterator& rhs) noexcept {
+                return lhs._slot - rhs._slot;
             }
-            return *this;
-        }
-        const_iterator operator++(int){
-            const_iterator copy(*this);
-            operator++();
-            return copy;
-        }
 
-        const_iterator&operator=(const_iterator&other){
-            if(*this == other)
-                return *this;
-            this->curr_node = other.curr_node;
-            this->is_end = other.is_end;
-            this->index = other.index;
-            this->hashMap = other.hashMap;
-            return *this;
-        }
+            bool operator==(const iterator& other) const noexcept = default;
+            auto operator<=>(const iterator& other) const noexcept = default;
 
-        const value_type*operator->()const{
-            if(curr_node == nullptr)
-                throw "error!";
-            return &(curr_node->value);
+        private:
+            node* const* _slot = nullptr;
+        };
+
+        basic_bucket_range() = default;
+        basic_bucket_range(node* const* first, node* const* last) noexcept : _first(first), _last(last) {}
+
+        iterator begin() const noexcept { return iterator(_first); }
+        iterator end() const noexcept { return iterator(_last); }
+        size_t size() const noexcept { return static_cast<size_t>(_last - _first); }
+        bool empty() const noexcept { return _first == _last; }
+        bucket operator[](size_t index) const noexcept { return bucket(_first[index]); }
+
+        /*
+        * The buckets [first, last) of this range.
+        */
+        basic_bucket_range slice(size_t first, size_t last) const noexcept {
+            return basic_bucket_range(_first + first, _first + last);
         }
+
+    private:
+        node* const* _first = nullptr;
+        node* const* _last = nullptr;
     };
-    iterator begin(){
-        return iterator(this,false);
-    }
-    iterator end(){
-        return iterator(this,true);
-    }
 
-    const_iterator begin()const{
-        return const_iterator(this,false);
+    using bucket_range = basic_bucket_range<false>;
+    using const_bucket_range = basic_bucket_range<true>;
+
+    /*
+    * Returns every bucket of the map, in order, as a random-access range.
+    *
+    * Complexity: O(1)
+    */
+    bucket_range buckets() noexcept {
+        return bucket_range(_buckets_array.data(), _buckets_array.data() + bucket_count());
     }
-    const_iterator end()const{
-        return const_iterator(this,true);
+    const_bucket_range buckets() const noexcept {
+        return const_bucket_range(_buckets_array.data(), _buckets_array.data() + bucket_count());
     }
+
+    iterator begin() noexcept { return iterator(this); }
+    iterator end() noexcept { return iterator(); }
+    const_iterator begin() const noexcept { return const_iterator(this); }
+    const_iterator end() const noexcept { return const_iterator(); }
+    const_iterator cbegin() const noexcept { return begin(); }
+    const_iterator cend() const noexcept { return end(); }
+
+    /*
+    * Lazy views of the keys and of the mapped values, in iteration order. Nothing is
+    * copied or allocated; the views read the nodes as they are iterated.
+    *
+    * Usage:
+    *      for (const auto& key : map.keys()) { ... }
+    *      for (auto& mapped : map.values()) mapped = 0;
+    *      auto big = map.values() | std::views::filter([](int v) { return v > 100; });
+    *      long total = std::accumulate(map.values().begin(), map.values().end(), 0L);
+    *
+    * Notes: the views refer to the map, and are invalidated with its iterators.
+    */
+    auto keys() const { return std::views::keys(*this); }
+    auto values() { return std::views::values(*this); }
+    auto values() const { return std::views::values(*this); }
+
     iterator find ( const K& k );
     const_iterator find ( const K& k ) const;
 
-
+    /*
+    * Erases the element at position, or the elements of [first, last).
+    *
+    * Return value: an iterator to the element after the last one erased.
+    *
+    * Complexity: O(1) amortized average case per element
+    */
     iterator erase ( iterator position );
     iterator erase ( iterator first, iterator last );
 
@@ -659,7 +1014,8 @@ template <typename K, typename M, typename H>
 HashMap<K, M, H>::HashMap(size_t bucket_count, const H& hash) :
         _size(0),
         _hash_function(hash),
-        _buckets_array(bucket_count, nullptr) { }
+        _buckets_array(bucket_count, nullptr),
+        _occupied(occupied_words(bucket_count), 0) { }
 
 template <typename K, typename M, typename H>
 HashMap<K, M, H>::~HashMap() {
@@ -697,24 +1053,40 @@ void HashMap<K, M, H>::clear() noexcept {
         while (curr != nullptr) {
             auto trash = curr;
             curr = curr->next;
-            delete trash;
+            _nodes.destroy(trash);
         }
     }
+    _nodes.release();
+    std::fill(_occupied.begin(), _occupied.end(), 0);
+    _bloom.clear();
     _size = 0;
 }
 
 template <typename K, typename M, typename H>
 std::pair<typename HashMap<K, M, H>::value_type*, bool>
 HashMap<K, M, H>::insert(const value_type& value) {
-    const auto& [key, mapped] = value;
+    const auto& key = value.first;
     auto [prev, node_to_edit] = find_node(key);
-    size_t index = _hash_function(key) % bucket_count();
 
     if (node_to_edit != nullptr) return {&(node_to_edit->value), false};
-    _buckets_array[index] = new node(value, _buckets_array[index]);
+    return {&(link_node(key, value)->value), true};
+}
+
+template <typename K, typename M, typename H>
+template <typename... Args>
+typename HashMap<K, M, H>::node* HashMap<K, M, H>::link_node(const K& key, Args&&... args) {
+    size_t hash = _hash_function(key);
+    size_t index = hash % bucket_count();
+    // rebuild before linking the node, so that a failed rebuild leaves the map unchanged
+    if (_bloom.needs_rebuild(_size + 1)) rebuild_bloom(std::max(2 * (_size + 1), bucket_count()));
+    _buckets_array[index] = _nodes.create(std::in_place, _buckets_array[index], std::forward<Args>(args)...);
+    _occupied[index / 64] |= uint64_t{1} << (index % 64);
+    _bloom.add(hash);
+    ++_node_allocations;
+    _op_counters.on_insert();
 
     ++_size;
-    return {&(_buckets_array[index]->value), true};
+    return _buckets_array[index];
 }
 
 template <typename K, typename M, typename H>
@@ -728,15 +1100,27 @@ M& HashMap<K, M, H>::at(const K& key)const {
 
 template <typename K, typename M, typename H>
 typename HashMap<K, M, H>::node_pair HashMap<K, M, H>::find_node(const K& key) const {
-    size_t index = _hash_function(key) % bucket_count();
+    size_t hash = _hash_function(key);
+    if (!_bloom.may_contain(hash)) {
+        _op_counters.on_lookup(0);
+        return {nullptr, nullptr};
+    }
+    size_t index = hash % bucket_count();
     auto curr = _buckets_array[index];
     node* prev = nullptr; // if first node is the key, return {nullptr, front}
+    size_t probes = 0;
     while (curr != nullptr) {
+        ++probes;
         const auto& [found_key, found_mapped] = curr->value;
-        if (found_key == key) return {prev, curr};
+        if (found_key == key) {
+            _op_counters.on_lookup(probes);
+            return {prev, curr};
+        }
         prev = curr;
         curr = curr->next;
     }
+    _op_counters.on_lookup(probes);
+    _bloom.on_false_positive();
     return {nullptr, nullptr}; // key not found at all.
 }
 
@@ -762,6 +1146,85 @@ void HashMap<K, M, H>::debug() const {
     std::cout << std::setw(30) << std::setfill('-') << '\n';
 }
 
+template <typename K, typename M, typename H>
+HashMapStats HashMap<K, M, H>::stats() const {
+    HashMapStats stats;
+    stats.size = size();
+    stats.bucket_count = bucket_count();
+    stats.load_factor = load_factor();
+
+    size_t probe_total = 0;
+    for (size_t i = 0; i < bucket_count(); ++i) {
+        size_t length = 0;
+        for (auto curr = _buckets_array[i]; curr != nullptr; curr = curr->next) {
+            probe_total += ++length;        // the k-th node of a chain takes k probes to find
+        }
+        if (length >= stats.chain_length_histogram.size()) {
+            stats.chain_length_histogram.resize(length + 1, 0);
+        }
+        ++stats.chain_length_histogram[length];
+        stats.max_chain_length = std::max(stats.max_chain_length, length);
+    }
+
+    stats.empty_buckets = stats.chain_length_histogram.empty() ? 0 : stats.chain_length_histogram[0];
+    size_t non_empty = bucket_count() - stats.empty_buckets;
+    stats.empty_bucket_ratio = bucket_count() == 0 ? 0 : static_cast<double>(stats.empty_buckets) / bucket_count();
+    stats.mean_chain_length = non_empty == 0 ? 0 : static_cast<double>(size()) / non_empty;
+    stats.max_probe_length = stats.max_chain_length;
+    stats.mean_probe_length = empty() ? 0 : static_cast<double>(probe_total) / size();
+
+    stats.node_allocations = _node_allocations;
+    stats.bytes_used = memory_usage().total();
+    stats.rehash_count = _rehash_count;
+    stats.rehash_time = _rehash_time;
+    stats.counts_operations = hashmap_policy<K, M, H>::count_operations;
+    stats.op_counts = _op_counters.counts();
+
+    stats.bloom_filter = hashmap_policy<K, M, H>::use_bloom_filter;
+    stats.bloom_bytes = _bloom.bytes();
+    stats.bloom_counts = _bloom.counts();
+    size_t absent = stats.bloom_counts.negatives + stats.bloom_counts.false_positives;
+    stats.bloom_false_positive_rate = absent == 0 ? 0 : static_cast<double>(stats.bloom_counts.false_positives) / absent;
+    return stats;
+}
+
+template <typename K, typename M, typename H>
+HashMapMemoryUsage HashMap<K, M, H>::memory_usage() const {
+    HashMapMemoryUsage usage;
+    usage.size = size();
+    usage.bucket_count = bucket_count();
+
+    heap_tally buckets;
+    if (_buckets_array.capacity() > 0) {
+        if constexpr (hashmap_policy<K, M, H>::use_huge_pages) {
+            bucket_array::allocator_type::add_allocation(_buckets_array.capacity(), buckets);
+        } else {
+            buckets.add_block(_buckets_array.capacity() * sizeof(node*));
+        }
+    }
+    if (_occupied.capacity() > 0) buckets.add_block(_occupied.capacity() * sizeof(uint64_t));
+    if (_bloom.bytes() > 0) buckets.add_block(_bloom.bytes());
+
+    heap_tally nodes;
+    heap_tally keys;
+    heap_tally mapped;
+    _nodes.add_heap(size(), nodes);
+    for (size_t i = next_occupied(0); i < bucket_count(); i = next_occupied(i + 1)) {
+        for (auto curr = _buckets_array[i]; curr != nullptr; curr = curr->next) {
+            heap_size_estimator<K>::add(curr->value.first, keys);
+            heap_size_estimator<M>::add(curr->value.second, mapped);
+        }
+    }
+
+    usage.bucket_bytes = buckets.bytes;
+    usage.node_bytes = nodes.bytes;
+    usage.key_heap_bytes = keys.bytes;
+    usage.mapped_heap_bytes = mapped.bytes;
+    usage.allocator_overhead = buckets.overhead + nodes.overhead + keys.overhead + mapped.overhead;
+    usage.heap_blocks = buckets.blocks + nodes.blocks + keys.blocks + mapped.blocks;
+    return usage;
+}
+
 template <typename K, typename M, typename H>
 bool HashMap<K, M, H>::erase(const K& key) {
     auto [prev, node_to_erase] = find_node(key);
@@ -771,8 +1234,13 @@ bool HashMap<K, M, H>::erase(const K& key) {
     } else {
         size_t index = _hash_function(key) % bucket_count();
         (prev ? prev->next : _buckets_array[index]) = node_to_erase->next;
-        delete node_to_erase;
+        update_occupied(index);
+        _nodes.destroy(node_to_erase);
+        _op_counters.on_erase();
         --_size;
+        // same capacity, so the filter's memory is reused and the rebuild cannot throw
+        _bloom.on_erase();
+        if (_bloom.needs_rebuild(_size)) rebuild_bloom(_bloom.capacity());
         return true;
     }
 }
@@ -783,7 +1251,8 @@ void HashMap<K, M, H>::rehash(size_t new_bucket_count) {
         throw std::out_of_range("HashMap<K, M, H>::rehash: new_bucket_count must be positive.");
     }
 
-    std::vector<node*> new_buckets_array(new_bucket_count);
+    auto start = std::chrono::steady_clock::now();
+    bucket_array new_buckets_array(new_bucket_count);
     /* Optional Milestone 1: begin student code */
 
     // Hint: you should NOT call insert, and you should not call
@@ -795,22 +1264,187 @@ void HashMap<K, M, H>::rehash(size_t new_bucket_count) {
         auto curr = _buckets_array[i];
         while (curr != nullptr) {
             auto node = curr;
-            auto value = node->value;
             curr = curr->next;
-            auto index = _hash_function(value.first)%new_bucket_count;
+            auto index = _hash_function(node->value.first)%new_bucket_count;
             node->next = new_buckets_array[index];
             new_buckets_array[index] = node;
         }
     }
-    _buckets_array = new_buckets_array;
+    _buckets_array = std::move(new_buckets_array);
+    _occupied.assign(occupied_words(new_bucket_count), 0);
+    for (size_t i = 0; i < new_bucket_count; ++i) {
+        update_occupied(i);
+    }
+    if constexpr (hashmap_policy<K, M, H>::use_bloom_filter) rebuild_bloom(std::max(2 * size(), new_bucket_count));
+    ++_rehash_count;
+    _rehash_time += std::chrono::steady_clock::now() - start;
 }
+
 template <typename K, typename M, typename H>
-M& HashMap<K, M, H>::operator[](const K& key){
-    if(!contains(key)) {
-        auto res = new value_type(key, M());
-        insert(*res);
+void HashMap<K, M, H>::copy_nodes_from(const HashMap& other) {
+    // size the filter once, rather than letting the inserts grow it step by step
+    if (_bloom.needs_rebuild(other.size())) rebuild_bloom(std::max(2 * other.size(), bucket_count()));
+    try {
+        for (size_t i = 0; i < other.bucket_count(); ++i) {
+            for (auto curr = other._buckets_array[i]; curr != nullptr; curr = curr->next) {
+                insert(curr->value);
+            }
+        }
+    } catch (...) {
+        clear();
+        throw;
     }
-    return at(key);
+}
+
+template <typename K, typename M, typename H>
+void HashMap<K, M, H>::shrink_to_fit() {
+    rehash(std::max<size_t>(size(), 1));
+}
+
+template <typename K, typename M, typename H>
+void HashMap<K, M, H>::rebuild_bloom(size_t expected_keys) {
+    _bloom.reset(expected_keys);
+    for (size_t i = next_occupied(0); i < bucket_count(); i = next_occupied(i + 1)) {
+        for (auto curr = _buckets_array[i]; curr != nullptr; curr = curr->next) {
+            _bloom.add(_hash_function(curr->value.first));
+        }
+    }
+}
+
+template <typename K, typename M, typename H>
+size_t HashMap<K, M, H>::next_occupied(size_t index) const noexcept {
+    size_t word = index / 64;
+    if (word >= _occupied.size()) return bucket_count();
+
+    // mask off the buckets before index in the first word
+    uint64_t bits = _occupied[word] & (~uint64_t{0} << (index % 64));
+    while (bits == 0) {
+        if (++word == _occupied.size()) return bucket_count();
+        bits = _occupied[word];
+    }
+    return word * 64 + std::countr_zero(bits);
+}
+
+template <typename K, typename M, typename H>
+void HashMap<K, M, H>::update_occupied(size_t index) noexcept {
+    uint64_t bit = uint64_t{1} << (index % 64);
+    if (_buckets_array[index] != nullptr) {
+        _occupied[index / 64] |= bit;
+    } else {
+        _occupied[index / 64] &= ~bit;
+    }
+}
+
+template <typename K, typename M, typename H>
+size_t HashMap<K, M, H>::occupied_words(size_t bucket_count) noexcept {
+    return (bucket_count + 63) / 64;
+}
+template <typename K, typename M, typename H>
+void HashMap<K, M, H>::save(std::ostream& os) const {
+    stream_writer out(os);
+    save_to(out);
+    out.flush();
+}
+
+template <typename K, typename M, typename H>
+size_t HashMap<K, M, H>::save(std::span<std::byte> out) const {
+    span_writer writer(out);
+    save_to(writer);
+    return writer.written();
+}
+
+template <typename K, typename M, typename H>
+size_t HashMap<K, M, H>::serialized_size() const {
+    size_t bytes = sizeof(hashmap_codec_detail::header);
+    if constexpr (binary_codec<K>::is_trivial && binary_codec<M>::is_trivial) {
+        return bytes + size() * (sizeof(K) + sizeof(M));
+    }
+    for (const auto& [key, mapped] : *this) {
+        bytes += binary_codec<K>::size(key) + binary_codec<M>::size(mapped);
+    }
+    return bytes;
+}
+
+template <typename K, typename M, typename H>
+template <typename Writer>
+void HashMap<K, M, H>::save_to(Writer& out) const {
+    hashmap_codec_detail::header header{};
+    std::copy(std::begin(hashmap_codec_detail::kMagic), std::end(hashmap_codec_detail::kMagic), header.magic);
+    header.version = hashmap_codec_detail::kVersion;
+    header.key_tag = binary_codec<K>::tag;
+    header.mapped_tag = binary_codec<M>::tag;
+    header.size = size();
+    header.bucket_count = bucket_count();
+    out.write(&header, sizeof(header));
+
+    // all the keys, then all the mapped values, so each block can be loaded in one read
+    for (const auto& [key, mapped] : *this) binary_codec<K>::write(out, key);
+    for (const auto& [key, mapped] : *this) binary_codec<M>::write(out, mapped);
+}
+
+template <typename K, typename M, typename H>
+void HashMap<K, M, H>::load(std::istream& is) {
+    stream_reader in(is);
+    load_from(in);
+}
+
+template <typename K, typename M, typename H>
+void HashMap<K, M, H>::load(std::span<const std::byte> in) {
+    span_reader reader(in);
+    load_from(reader);
+}
+
+template <typename K, typename M, typename H>
+template <typename Reader>
+void HashMap<K, M, H>::load_from(Reader& in) {
+    clear();
+    hashmap_codec_detail::header header;
+    in.read(&header, sizeof(header));
+    if (!std::equal(std::begin(header.magic), std::end(header.magic), hashmap_codec_detail::kMagic) ||
+        header.version != hashmap_codec_detail::kVersion ||
+        header.key_tag != binary_codec<K>::tag || header.mapped_tag != binary_codec<M>::tag) {
+        throw std::runtime_error("HashMap<K, M, H>::load: not a HashMap saved with these K and M");
+    }
+
+    // the header's counts are not trusted: the vectors grow with the elements actually
+    // read, so a corrupt size throws at the end of the input instead of allocating it
+    std::vector<K> keys = load_elements<K>(in, header.size);
+    std::vector<M> mapped = load_elements<M>(in, header.size);
+
+    // size the table once, up front, instead of growing it while inserting. The saved
+    // bucket count is only a hint, bounded by the element count for the same reason.
+    size_t buckets = std::min<uint64_t>(header.bucket_count, 2 * keys.size() + kMaxLoadedEmptyBuckets);
+    rehash(std::max<size_t>({buckets, keys.size(), 1}));
+    // a key saved twice (only in a corrupt file) keeps its first value, as insert would
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (find_node(keys[i]).second != nullptr) continue;
+        link_node(keys[i], std::move(keys[i]), std::move(mapped[i]));
+    }
+}
+
+template <typename K, typename M, typename H>
+template <typename T, typename Reader>
+std::vector<T> HashMap<K, M, H>::load_elements(Reader& in, uint64_t count) {
+    std::vector<T> values;
+    if constexpr (binary_codec<T>::is_trivial) {
+        constexpr size_t chunk = std::max<size_t>(1, hashmap_codec_detail::kReadChunk / sizeof(T));
+        while (values.size() < count) {
+            size_t done = values.size();
+            values.resize(done + std::min<uint64_t>(count - done, chunk));
+            binary_codec<T>::read_array(in, values.data() + done, values.size() - done);
+        }
+    } else {
+        values.reserve(std::min<uint64_t>(count, hashmap_codec_detail::kReadChunk));
+        for (uint64_t i = 0; i < count; ++i) values.push_back(binary_codec<T>::read(in));
+    }
+    return values;
+}
+
+template <typename K, typename M, typename H>
+M& HashMap<K, M, H>::operator[](const K& key){
+    auto [prev, node_found] = find_node(key);
+    if (node_found != nullptr) return node_found->value.second;
+    return link_node(key, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple())->value.second;
 }
 
 template <typename K, typename M, typename H>
@@ -821,7 +1455,7 @@ std::ostream& operator<<(std::ostream& os, const HashMap<K, M, H>& map){
         auto curr = map._buckets_array[i];
         while (curr != nullptr) {
             auto node = curr;
-            auto value = node->value;
+            const auto& value = node->value;
             os<<str<<value.first<<":"<<value.second;
             str = ", ";
             curr = curr->next;
@@ -840,7 +1474,7 @@ bool operator==(const HashMap<K, M, H>& lhs,
         auto curr = lhs._buckets_array[i];
         while (curr != nullptr) {
             auto node = curr;
-            auto value = node->value;
+            const auto& value = node->value;
             if(!rhs.contains(value.first)||(value.second != rhs.at(value.first))){
                 return false;
             }
@@ -857,67 +1491,58 @@ bool operator!=(const HashMap<K, M, H>& lhs,
 }
 
 template <typename K, typename M, typename H>
-HashMap<K, M, H>::HashMap(HashMap const &other){
-    this->_hash_function = other._hash_function;
-    this->_buckets_array = std::vector<node*>(other.bucket_count(), nullptr);
-    this->_size = 0;
-    for (size_t i = 0; i < other.bucket_count(); ++i) {
-        auto curr = other._buckets_array[i];
-        while (curr != nullptr) {
-            auto value = curr->value;
-            auto node = std::make_pair(value.first,value.second);
-            insert(node);
-            curr = curr->next;
-        }
-    }
+HashMap<K, M, H>::HashMap(HashMap const &other) :
+        _size(0),
+        _hash_function(other._hash_function),
+        _buckets_array(other.bucket_count(), nullptr),
+        _occupied(occupied_words(other.bucket_count()), 0) {
+    copy_nodes_from(other);
 }
 
 template <typename K, typename M, typename H>
-HashMap<K, M, H>::HashMap(HashMap &&other){
-    this->_hash_function = other._hash_function;
-    this->_size = other._size;
-    this->_buckets_array = other._buckets_array;
-
-    other._buckets_array = {};
-    other._size = 0 ;
-
+HashMap<K, M, H>::HashMap(HashMap &&other) :
+        _size(other._size),
+        _hash_function(std::move(other._hash_function)),
+        _buckets_array(std::move(other._buckets_array)),
+        _occupied(std::move(other._occupied)),
+        _bloom(std::move(other._bloom)),
+        _nodes(std::move(other._nodes)) {
+    // moving a vector leaves it empty, so other is left with no buckets
+    other._size = 0;
 }
 
 
 template<typename K, typename M, typename H>
 HashMap<K,M,H> &HashMap<K, M, H>::operator=(const HashMap &other) {
-    if(*this == other) return *this;
+    if(this == &other) return *this;
+    clear();
     this->_hash_function = other._hash_function;
-    this->_size = 0;
-    this->_buckets_array = std::vector<node*>(other.bucket_count(), nullptr);
-    for (size_t i = 0; i < other.bucket_count(); ++i) {
-        auto curr = other._buckets_array[i];
-        while (curr != nullptr) {
-            auto value = curr->value;
-            auto node = std::make_pair(value.first,value.second);
-            insert(node);
-            curr = curr->next;
-        }
-    }
+    // assign reuses the existing arrays when the bucket count does not change
+    this->_buckets_array.assign(other.bucket_count(), nullptr);
+    this->_occupied.assign(occupied_words(other.bucket_count()), 0);
+    copy_nodes_from(other);
     return *this;
 }
 
 template<typename K, typename M, typename H>
 HashMap<K,M,H> &HashMap<K, M, H>::operator=(HashMap &&other) {
-    if(*this == other) return *this;
-    this->_hash_function = other._hash_function;
+    if(this == &other) return *this;
+    clear();
+    this->_hash_function = std::move(other._hash_function);
     this->_size = other._size;
-    this->_buckets_array = other._buckets_array;
-
-    other._buckets_array = {};
-    other._size = 0 ;
+    this->_buckets_array = std::move(other._buckets_array);
+    this->_occupied = std::move(other._occupied);
+    this->_bloom = std::move(other._bloom);
+    this->_nodes = std::move(other._nodes);
+    other._size = 0;
     return *this;
 }
 
 template<typename K, typename M, typename H>
 HashMap<K, M, H>::HashMap(std::initializer_list<std::pair<K, M>>list) {
     this->_size = 0;
-    this->_buckets_array = std::vector<node*>(kDefaultBuckets, nullptr);
+    this->_buckets_array = bucket_array(kDefaultBuckets, nullptr);
+    this->_occupied = std::vector<uint64_t>(occupied_words(kDefaultBuckets), 0);
     for(auto &node:list){
         insert(node);
     }
@@ -927,7 +1552,8 @@ template<typename K, typename M, typename H>
 template<typename interator_input>
 HashMap<K, M, H>::HashMap(interator_input begin,interator_input end) {
     this->_size = 0;
-    this->_buckets_array = std::vector<node*>(kDefaultBuckets, nullptr);
+    this->_buckets_array = bucket_array(kDefaultBuckets, nullptr);
+    this->_occupied = std::vector<uint64_t>(occupied_words(kDefaultBuckets), 0);
     while(begin!=end){
         insert(*begin++);
     }
@@ -935,38 +1561,33 @@ HashMap<K, M, H>::HashMap(interator_input begin,interator_input end) {
 
 template<typename K, typename M, typename H>
 typename HashMap<K,M,H>::iterator HashMap<K, M, H>::find(const K &k) {
-    for(auto iter = begin();iter!=end();++iter){
-        if(iter.key_equal(k))
-            return iter;
-    }
-    return end();
+    auto [prev, node_found] = find_node(k);
+    if (node_found == nullptr) return end();
+    return iterator(this, _hash_function(k) % bucket_count(), node_found);
 }
 template<typename K, typename M, typename H>
 typename HashMap<K,M,H>::const_iterator HashMap<K, M, H>::find(const K &k)const {
-    for(auto iter = begin();iter!=end();++iter){
-        if(iter.key_equal(k))
-            return iter;
-    }
-    return end();
+    auto [prev, node_found] = find_node(k);
+    if (node_found == nullptr) return end();
+    return const_iterator(this, _hash_function(k) % bucket_count(), node_found);
 }
 
 template<typename K, typename M, typename H>
 typename HashMap<K,M,H>::iterator HashMap<K, M, H>::erase(HashMap::iterator position) {
     if(position == end())
         return end();
-    auto res = position;
-    if(erase((*res).first))
-        return position++;
-    return position;
+    // step past the element before its node is freed
+    auto next = std::next(position);
+    erase(position->first);
+    return next;
 }
 
 template<typename K, typename M, typename H>
 typename HashMap<K,M,H>::iterator HashMap<K, M, H>::erase(HashMap::iterator first, HashMap::iterator last) {
-    auto res = first;
-    for(auto iter = first;iter!=last;++iter){
-        res = erase(iter);
+    while (first != last) {
+        first = erase(first);
     }
-    return res;
+    return last;
 }
 
 
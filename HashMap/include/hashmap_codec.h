@@ -0,0 +1,257 @@
+/*
+* Binary encoding used by HashMap::save and HashMap::load.
+*
+*      binary_codec<T> describes how one key or mapped value is written to and read
+*      from a byte stream. Arithmetic types are copied as raw bytes, and a whole array
+*      of them is read in one call; std::string is written as a uint32_t length followed
+*      by its characters. Specialize binary_codec to save maps of your own types; a
+*      trivially copyable type only has to pick a tag:
+*
+*          template <>
+*          struct binary_codec<Point> : trivial_binary_codec<Point, codec_tag(codec_kind::user, 1)> {};
+*
+*      Writers and readers hide where the bytes go:
+*          stream_writer / stream_reader - a std::ostream / std::istream, through a buffer
+*          span_writer / span_reader     - a caller-provided std::span<std::byte>
+*/
+
+#ifndef HASHMAP_CODEC_H
+#define HASHMAP_CODEC_H
+
+#include <algorithm>            // for min
+#include <cstddef>              // for byte, size_t
+#include <cstdint>              // for uint32_t, uint64_t
+#include <cstring>              // for memcpy
+#include <iostream>             // for istream, ostream
+#include <limits>               // for numeric_limits
+#include <span>                 // for span
+#include <stdexcept>            // for runtime_error, length_error
+#include <string>               // for string
+#include <type_traits>          // for is_arithmetic, is_trivially_copyable, enable_if
+#include <vector>               // for vector
+
+/*
+* Writes bytes to a std::ostream, buffering them so that small values do not each
+* cost a call into the stream.
+*/
+class stream_writer {
+public:
+    explicit stream_writer(std::ostream& os) : _os(os) { _buffer.reserve(kBufferSize); }
+    ~stream_writer() { flush(); }
+
+    void write(const void* data, size_t size) {
+        if (_buffer.size() + size > kBufferSize) flush();
+        if (size >= kBufferSize) {
+            _os.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            return;
+        }
+        const char* bytes = static_cast<const char*>(data);
+        _buffer.insert(_buffer.end(), bytes, bytes + size);
+    }
+
+    void flush() {
+        _os.write(_buffer.data(), static_cast<std::streamsize>(_buffer.size()));
+        _buffer.clear();
+    }
+
+private:
+    static constexpr size_t kBufferSize = 64 * 1024;
+    std::ostream& _os;
+    std::vector<char> _buffer;
+};
+
+/*
+* Reads bytes from a std::istream. Throws std::runtime_error if the stream ends early.
+*/
+class stream_reader {
+public:
+    explicit stream_reader(std::istream& is) : _is(is) {}
+
+    void read(void* data, size_t size) {
+        if (!_is.read(static_cast<char*>(data), static_cast<std::streamsize>(size))) {
+            throw std::runtime_error("HashMap::load: unexpected end of input");
+        }
+    }
+
+private:
+    std::istream& _is;
+};
+
+/*
+* Writes bytes to a fixed span. Throws std::length_error if the span is too small.
+*/
+class span_writer {
+public:
+    explicit span_writer(std::span<std::byte> out) : _out(out) {}
+
+    void write(const void* data, size_t size) {
+        if (size > _out.size() - _written) throw std::length_error("HashMap::save: output span too small");
+        std::memcpy(_out.data() + _written, data, size);
+        _written += size;
+    }
+
+    size_t written() const noexcept { return _written; }
+
+private:
+    std::span<std::byte> _out;
+    size_t _written = 0;
+};
+
+/*
+* Reads bytes from a fixed span. Throws std::runtime_error if the span ends early.
+*/
+class span_reader {
+public:
+    explicit span_reader(std::span<const std::byte> in) : _in(in) {}
+
+    void read(void* data, size_t size) {
+        if (size > _in.size() - _read) throw std::runtime_error("HashMap::load: unexpected end of input");
+        std::memcpy(data, _in.data() + _read, size);
+        _read += size;
+    }
+
+private:
+    std::span<const std::byte> _in;
+    size_t _read = 0;
+};
+
+/*
+* Type tags, saved in the header so that a file is only loaded into a map of the
+* types it was saved from. A tag is the kind of the type in its top byte and its size
+* (or, for codec_kind::user, a number chosen by the codec) below it: the size alone
+* would let an int load as a float, or a double as an int64_t.
+*/
+enum class codec_kind : uint32_t {
+    user = 0,
+    boolean = 1,
+    signed_integer = 2,
+    unsigned_integer = 3,
+    floating_point = 4,
+    string = 5
+};
+
+constexpr uint32_t codec_tag(codec_kind kind, uint32_t size) noexcept {
+    return static_cast<uint32_t>(kind) << 24 | (size & 0xffffff);
+}
+
+template <typename T>
+constexpr uint32_t arithmetic_codec_tag() noexcept {
+    static_assert(std::is_arithmetic_v<T>);
+    if constexpr (std::is_same_v<T, bool>) return codec_tag(codec_kind::boolean, sizeof(T));
+    else if constexpr (std::is_floating_point_v<T>) return codec_tag(codec_kind::floating_point, sizeof(T));
+    else if constexpr (std::is_signed_v<T>) return codec_tag(codec_kind::signed_integer, sizeof(T));
+    else return codec_tag(codec_kind::unsigned_integer, sizeof(T));
+}
+
+namespace hashmap_codec_detail {
+
+/*
+* Most bytes a reader allocates for ahead of reading them. Counts and lengths come
+* from the input, so a corrupt one must run into the end of the input before it can
+* run into the end of memory.
+*/
+constexpr size_t kReadChunk = 64 * 1024;
+
+}
+
+/*
+* Binary encoding of one type.
+*
+*      tag                      - identifies the encoding in the saved header (see codec_tag)
+*      size(value)              - bytes that write(out, value) produces
+*      write(out, value)        - appends value to a writer
+*      read(in)                 - reads one value back
+*      read_array(in, dest, n)  - (trivially copyable only) reads n values in one call
+*
+* The primary template handles arithmetic types. Any other type needs a specialization,
+* which must choose its own tag: its size cannot tell it apart from another type.
+*/
+template <typename T, typename = void>
+struct binary_codec {
+    static_assert(std::is_arithmetic_v<T>,
+                  "binary_codec: specialize binary_codec for this type, e.g. from trivial_binary_codec<T, tag>");
+};
+
+/*
+* Raw byte encoding of a trivially copyable type, saved under Tag.
+*/
+template <typename T, uint32_t Tag>
+struct trivial_binary_codec {
+    static_assert(std::is_trivially_copyable_v<T>, "trivial_binary_codec: T must be trivially copyable");
+
+    static constexpr uint32_t tag = Tag;
+    static constexpr bool is_trivial = true;
+
+    static size_t size(const T&) { return sizeof(T); }
+
+    template <typename Writer>
+    static void write(Writer& out, const T& value) { out.write(&value, sizeof(T)); }
+
+    template <typename Reader>
+    static T read(Reader& in) {
+        T value;
+        in.read(&value, sizeof(T));
+        return value;
+    }
+
+    template <typename Reader>
+    static void read_array(Reader& in, T* dest, size_t count) { in.read(dest, count * sizeof(T)); }
+};
+
+template <typename T>
+struct binary_codec<T, std::enable_if_t<std::is_arithmetic_v<T>>> : trivial_binary_codec<T, arithmetic_codec_tag<T>()> {};
+
+template <>
+struct binary_codec<std::string> {
+    static constexpr uint32_t tag = codec_tag(codec_kind::string, 0);
+    static constexpr bool is_trivial = false;
+
+    static size_t size(const std::string& value) { return sizeof(uint32_t) + value.size(); }
+
+    // throws std::length_error for strings of 4 GiB or more, whose length does not fit
+    template <typename Writer>
+    static void write(Writer& out, const std::string& value) {
+        if (value.size() > std::numeric_limits<uint32_t>::max()) {
+            throw std::length_error("HashMap::save: string too long");
+        }
+        uint32_t length = static_cast<uint32_t>(value.size());
+        out.write(&length, sizeof(length));
+        out.write(value.data(), value.size());
+    }
+
+    template <typename Reader>
+    static std::string read(Reader& in) {
+        uint32_t length;
+        in.read(&length, sizeof(length));
+        std::string value;
+        // grow with the bytes actually read, so that a corrupt length throws at the end of input
+        while (value.size() < length) {
+            size_t done = value.size();
+            value.resize(done + std::min<size_t>(length - done, hashmap_codec_detail::kReadChunk));
+            in.read(value.data() + done, value.size() - done);
+        }
+        return value;
+    }
+};
+
+namespace hashmap_codec_detail {
+
+constexpr char kMagic[8] = {'H', 'M', 'A', 'P', 'B', 'I', 'N', '\0'};
+constexpr uint32_t kVersion = 2;        // 2: type tags hold the kind of the type, not only its size
+
+/*
+* Header written in front of the elements by HashMap::save.
+*/
+struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint32_t key_tag;           // binary_codec<K>::tag
+    uint32_t mapped_tag;        // binary_codec<M>::tag
+    uint64_t size;              // number of elements
+    uint64_t bucket_count;      // bucket count of the saved map
+};
+
+}
+
+#endif // HASHMAP_CODEC_H
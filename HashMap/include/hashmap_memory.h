@@ -0,0 +1,134 @@
+/*
+* Memory accounting for HashMap::memory_usage().
+*
+*      The heap used by a HashMap is its bucket array, its occupancy bitmap, one node
+*      per element (the K/M pair and a next pointer), and whatever the keys and mapped
+*      values own themselves, such as the characters of a long std::string. Every heap
+*      block also costs the allocator some bytes: a header, and rounding up to its
+*      alignment. For small nodes that overhead is a large share of the total.
+*
+*      heap_size_estimator<T> reports the heap blocks owned by one T. It knows about
+*      std::string, std::vector and std::pair, and assumes any other type owns no heap;
+*      specialize it for types that do:
+*
+*          template <>
+*          struct heap_size_estimator<Blob> {
+*              static void add(const Blob& blob, heap_tally& tally) { tally.add_block(blob.size); }
+*          };
+*/
+
+#ifndef HASHMAP_MEMORY_H
+#define HASHMAP_MEMORY_H
+
+#include <cstddef>              // for size_t
+#include <iomanip>              // for setprecision
+#include <iostream>             // for ostream
+#include <string>               // for string
+#include <type_traits>          // for remove_const_t
+#include <utility>              // for pair
+#include <vector>               // for vector
+
+/*
+* Estimated size of the block that malloc uses for a request of requested bytes: a
+* size_t header, rounded up to 2 * sizeof(void*), and at least 4 * sizeof(void*).
+* This is glibc's layout on 64-bit Linux (an 8 byte header, 16 byte alignment, 32 byte
+* minimum); other allocators are close to it.
+*/
+constexpr size_t malloc_block_size(size_t requested) noexcept {
+    constexpr size_t alignment = 2 * sizeof(void*);
+    constexpr size_t min_block = 4 * sizeof(void*);
+    size_t block = (requested + sizeof(size_t) + alignment - 1) / alignment * alignment;
+    return block < min_block ? min_block : block;
+}
+
+/*
+* Running total of heap blocks.
+*/
+struct heap_tally {
+    size_t bytes = 0;               // bytes requested from the allocator
+    size_t overhead = 0;            // estimated header and rounding of those blocks
+    size_t blocks = 0;
+
+    void add_block(size_t requested) noexcept {
+        bytes += requested;
+        overhead += malloc_block_size(requested) - requested;
+        ++blocks;
+    }
+
+    // memory mapped from the kernel directly: no header, only rounding to mapped bytes
+    void add_mapping(size_t requested, size_t mapped) noexcept {
+        bytes += requested;
+        overhead += mapped - requested;
+        ++blocks;
+    }
+};
+
+/*
+* Adds the heap blocks owned by a value of type T to a heap_tally. The primary
+* template is for types that own no heap memory (int, double, structs of those, ...).
+*/
+template <typename T, typename = void>
+struct heap_size_estimator {
+    static void add(const T&, heap_tally&) noexcept {}
+};
+
+template <>
+struct heap_size_estimator<std::string> {
+    static void add(const std::string& value, heap_tally& tally) noexcept {
+        // short strings live inside the string object itself
+        static const size_t inline_capacity = std::string().capacity();
+        if (value.capacity() > inline_capacity) tally.add_block(value.capacity() + 1);
+    }
+};
+
+template <typename T>
+struct heap_size_estimator<std::vector<T>> {
+    static void add(const std::vector<T>& value, heap_tally& tally) noexcept {
+        if (value.capacity() > 0) tally.add_block(value.capacity() * sizeof(T));
+        for (const auto& element : value) heap_size_estimator<T>::add(element, tally);
+    }
+};
+
+template <typename A, typename B>
+struct heap_size_estimator<std::pair<A, B>> {
+    static void add(const std::pair<A, B>& value, heap_tally& tally) noexcept {
+        heap_size_estimator<std::remove_const_t<A>>::add(value.first, tally);
+        heap_size_estimator<std::remove_const_t<B>>::add(value.second, tally);
+    }
+};
+
+/*
+* Heap memory of a HashMap, returned by HashMap::memory_usage(). All sizes are bytes.
+* The HashMap object itself (sizeof(HashMap)) is not included.
+*/
+struct HashMapMemoryUsage {
+    size_t size = 0;                    // number of elements
+    size_t bucket_count = 0;
+    size_t bucket_bytes = 0;            // bucket array, occupancy bitmap and Bloom filter
+    size_t node_bytes = 0;              // size * sizeof(node): the K/M pairs and next pointers
+    size_t key_heap_bytes = 0;          // heap owned by the keys, per heap_size_estimator<K>
+    size_t mapped_heap_bytes = 0;       // heap owned by the mapped values, per heap_size_estimator<M>
+    size_t allocator_overhead = 0;      // estimated malloc headers and rounding of all the blocks above
+    size_t heap_blocks = 0;
+
+    size_t total() const noexcept {
+        return bucket_bytes + node_bytes + key_heap_bytes + mapped_heap_bytes + allocator_overhead;
+    }
+
+    double bytes_per_entry() const noexcept {
+        return size == 0 ? 0 : static_cast<double>(total()) / size;
+    }
+};
+
+/*
+* Prints the breakdown of usage on one line.
+*/
+inline std::ostream& operator<<(std::ostream& os, const HashMapMemoryUsage& usage) {
+    os << "total: " << usage.total() << " bytes (" << std::setprecision(3) << usage.bytes_per_entry()
+       << " per entry), buckets: " << usage.bucket_bytes << ", nodes: " << usage.node_bytes
+       << ", key heap: " << usage.key_heap_bytes << ", mapped heap: " << usage.mapped_heap_bytes
+       << ", allocator overhead: " << usage.allocator_overhead << " (" << usage.heap_blocks << " blocks)";
+    return os;
+}
+
+#endif // HASHMAP_MEMORY_H
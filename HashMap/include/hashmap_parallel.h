@@ -0,0 +1,296 @@
+/*
+* Parallel algorithms over the elements of a HashMap.
+*
+*      begin()..end() visits the elements one after the other: an iterator can only be
+*      advanced, so the elements cannot be shared out between threads without walking
+*      them first. The bucket array, on the other hand, can be cut anywhere, and
+*      HashMap::buckets() exposes it as a random-access range. The algorithms below cut
+*      it into many more chunks than there are threads and let the threads take chunks
+*      as they finish the previous ones, so a few long chains (or a few expensive
+*      elements) delay one chunk rather than a whole thread's share of the map.
+*
+*      parallel_for_each   - calls f on every element
+*      parallel_reduce     - combines transform(element) over every element
+*      parallel_transform  - builds a map with the same keys and transformed values
+*
+*      All three run on a thread_pool, by default one shared by the whole program with
+*      one thread per core. The calling thread works too, rather than waiting.
+*
+*      The map must not be modified by another thread while an algorithm runs. The
+*      functions passed in are called concurrently, on different elements.
+*/
+
+#ifndef HASHMAP_PARALLEL_H
+#define HASHMAP_PARALLEL_H
+
+#include <algorithm>            // for max, min
+#include <atomic>               // for atomic
+#include <condition_variable>   // for condition_variable
+#include <cstddef>              // for size_t
+#include <exception>            // for exception_ptr, current_exception, rethrow_exception
+#include <functional>           // for function
+#include <mutex>                // for mutex, unique_lock, lock_guard
+#include <optional>             // for optional
+#include <thread>               // for thread
+#include <type_traits>          // for invoke_result_t, decay_t
+#include <utility>              // for pair, move
+#include <vector>               // for vector
+#include "hashmap.h"
+
+/*
+* A fixed set of threads that run the tasks 0, 1, ..., n - 1 of one job at a time.
+*
+* Usage:
+*      thread_pool pool(4);                    // the caller and 3 worker threads
+*      pool.run(100, [&](size_t task) { ... });
+*
+* Notes: run is not reentrant; a task must not call run on the pool running it.
+* Calls to run from different threads are serialized.
+*/
+class thread_pool {
+public:
+    /*
+    * Creates threads - 1 worker threads; the thread that calls run is the other one.
+    * A pool of 0 or 1 threads runs every task on the calling thread.
+    */
+    explicit thread_pool(size_t threads = std::thread::hardware_concurrency()) {
+        for (size_t i = 1; i < threads; ++i) {
+            _workers.emplace_back([this] { work_loop(); });
+        }
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _wake.notify_all();
+        for (auto& worker : _workers) worker.join();
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    /*
+    * The number of threads that run tasks, including the caller of run.
+    */
+    size_t size() const noexcept { return _workers.size() + 1; }
+
+    /*
+    * Runs task(0), ..., task(tasks - 1) on the pool, and returns once all have finished.
+    *
+    * Exceptions: if a task throws, the tasks not yet started are skipped, and the first
+    * exception is rethrown here once the running ones have finished.
+    */
+    void run(size_t tasks, const std::function<void(size_t)>& task) {
+        std::lock_guard<std::mutex> serialize(_run_mutex);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _task = &task;
+            _task_count = tasks;
+            _next_task.store(0, std::memory_order_relaxed);
+            _busy_workers = _workers.size();
+            _error = nullptr;
+            ++_generation;
+        }
+        _wake.notify_all();
+        run_tasks();
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _done.wait(lock, [this] { return _busy_workers == 0; });
+        _task = nullptr;
+        if (_error) std::rethrow_exception(std::exchange(_error, nullptr));
+    }
+
+private:
+    void work_loop() {
+        size_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _wake.wait(lock, [&] { return _stopping || _generation != seen; });
+                if (_stopping) return;
+                seen = _generation;
+            }
+            run_tasks();
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (--_busy_workers == 0) _done.notify_one();
+        }
+    }
+
+    /*
+    * Takes tasks until there are none left. Every thread of the job runs this.
+    */
+    void run_tasks() {
+        size_t index;
+        while ((index = _next_task.fetch_add(1, std::memory_order_relaxed)) < _task_count) {
+            try {
+                (*_task)(index);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (!_error) _error = std::current_exception();
+                _next_task.store(_task_count, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::vector<std::thread> _workers;
+    std::mutex _run_mutex;
+
+    // the current job; written under _mutex before the workers are woken
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    const std::function<void(size_t)>* _task = nullptr;
+    size_t _task_count = 0;
+    std::atomic<size_t> _next_task{0};
+    size_t _busy_workers = 0;
+    size_t _generation = 0;
+    bool _stopping = false;
+    std::exception_ptr _error;
+};
+
+/*
+* The pool used when none is given: one thread per core, created on first use.
+*/
+inline thread_pool& default_thread_pool() {
+    static thread_pool pool;
+    return pool;
+}
+
+namespace hashmap_parallel_detail {
+
+// chunks per thread: enough that one slow chunk is a small part of a thread's work
+constexpr size_t kChunksPerThread = 16;
+
+inline size_t chunk_count(size_t bucket_count, const thread_pool& pool) {
+    return std::min(bucket_count, pool.size() * kChunksPerThread);
+}
+
+/*
+* Cuts buckets into chunk_count chunks and runs body(chunk_index, chunk) for each of
+* them on pool.
+*/
+template <typename BucketRange, typename Body>
+void for_each_chunk(const BucketRange& buckets, thread_pool& pool, Body body) {
+    size_t chunks = chunk_count(buckets.size(), pool);
+    if (chunks == 0) return;
+    pool.run(chunks, [&](size_t chunk) {
+        // chunk boundaries spread the remainder over the first chunks
+        size_t first = buckets.size() * chunk / chunks;
+        size_t last = buckets.size() * (chunk + 1) / chunks;
+        body(chunk, buckets.slice(first, last));
+    });
+}
+
+} // namespace hashmap_parallel_detail
+
+/*
+* Calls f(element) for every element of map, on the threads of pool. f may modify
+* the mapped values (not the keys) of a non-const map.
+*
+* Usage:
+*      parallel_for_each(prices, [](auto& entry) { entry.second *= 1.1; });
+*
+* Exceptions: the first exception thrown by f; the elements not yet visited are skipped.
+*
+* Complexity: O((N + B) / T), N = number of elements, B = number of buckets, T = threads
+*/
+template <typename K, typename M, typename H, typename F>
+void parallel_for_each(HashMap<K, M, H>& map, F f, thread_pool& pool = default_thread_pool()) {
+    hashmap_parallel_detail::for_each_chunk(map.buckets(), pool, [&](size_t, auto chunk) {
+        for (auto bucket : chunk) {
+            for (auto& element : bucket) f(element);
+        }
+    });
+}
+
+template <typename K, typename M, typename H, typename F>
+void parallel_for_each(const HashMap<K, M, H>& map, F f, thread_pool& pool = default_thread_pool()) {
+    hashmap_parallel_detail::for_each_chunk(map.buckets(), pool, [&](size_t, auto chunk) {
+        for (auto bucket : chunk) {
+            for (const auto& element : bucket) f(element);
+        }
+    });
+}
+
+/*
+* Returns init combined with transform(element) for every element, using reduce:
+* reduce(... reduce(reduce(init, transform(e1)), transform(e2)) ..., transform(en)),
+* with the elements grouped differently.
+*
+* Every chunk of buckets is reduced on its own, then the chunk results are combined
+* with init on the calling thread, in bucket order. reduce must therefore be
+* associative, but need not be commutative.
+*
+* Usage:
+*      long total = parallel_reduce(counts, 0L, std::plus<>(),
+*                                   [](const auto& entry) { return long(entry.second); });
+*
+* Exceptions: the first exception thrown by transform or reduce.
+*
+* Complexity: O((N + B) / T + T) calls, N = elements, B = buckets, T = threads
+*/
+template <typename K, typename M, typename H, typename T, typename Reduce, typename Transform>
+T parallel_reduce(const HashMap<K, M, H>& map, T init, Reduce reduce, Transform transform,
+                  thread_pool& pool = default_thread_pool()) {
+    auto buckets = map.buckets();
+    std::vector<std::optional<T>> partials(hashmap_parallel_detail::chunk_count(buckets.size(), pool));
+    hashmap_parallel_detail::for_each_chunk(buckets, pool, [&](size_t index, auto chunk) {
+        std::optional<T> partial;
+        for (auto bucket : chunk) {
+            for (const auto& element : bucket) {
+                if (partial) {
+                    partial = reduce(std::move(*partial), transform(element));
+                } else {
+                    partial.emplace(transform(element));
+                }
+            }
+        }
+        partials[index] = std::move(partial);
+    });
+    for (auto& partial : partials) {
+        if (partial) init = reduce(std::move(init), std::move(*partial));
+    }
+    return init;
+}
+
+/*
+* Returns a map with the keys of map, where each key is mapped to f(element). The new
+* map has the hash function of map and one bucket per element.
+*
+* f runs on the threads of pool; the results are then inserted on the calling thread,
+* since inserting into a HashMap is not thread-safe. The parallel part is therefore
+* worthwhile when f is more expensive than an insert.
+*
+* Usage:
+*      HashMap<std::string, size_t> lengths =
+*          parallel_transform(pages, [](const auto& page) { return page.second.size(); });
+*
+* Exceptions: the first exception thrown by f, or by copying the keys.
+*
+* Complexity: O((N + B) / T) calls to f, then O(N) inserts
+*/
+template <typename K, typename M, typename H, typename F>
+auto parallel_transform(const HashMap<K, M, H>& map, F f, thread_pool& pool = default_thread_pool())
+        -> HashMap<K, std::decay_t<std::invoke_result_t<F&, const std::pair<const K, M>&>>, H> {
+    using R = std::decay_t<std::invoke_result_t<F&, const std::pair<const K, M>&>>;
+    auto buckets = map.buckets();
+    // the results of each chunk point at the keys in map, which stay put
+    std::vector<std::vector<std::pair<const K*, R>>> results(
+            hashmap_parallel_detail::chunk_count(buckets.size(), pool));
+    hashmap_parallel_detail::for_each_chunk(buckets, pool, [&](size_t index, auto chunk) {
+        auto& out = results[index];
+        for (auto bucket : chunk) {
+            for (const auto& element : bucket) out.emplace_back(&element.first, f(element));
+        }
+    });
+
+    HashMap<K, R, H> transformed(std::max<size_t>(map.size(), 1), map.hash_function());
+    for (auto& chunk : results) {
+        for (auto& [key, value] : chunk) transformed.insert({*key, std::move(value)});
+    }
+    return transformed;
+}
+
+#endif // HASHMAP_PARALLEL_H
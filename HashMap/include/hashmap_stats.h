@@ -0,0 +1,224 @@
+/*
+* Instrumentation types for HashMap.
+*
+*      HashMapStats is the snapshot returned by HashMap::stats(): the shape of the
+*      chains, how much memory the table uses, and how often it was rehashed.
+*
+*      Counting every lookup, insert and erase costs a few increments per operation,
+*      so it is compiled in only when the map's policy asks for it. The policy of
+*      HashMap<K, M, H> is hashmap_policy<K, M, H>; specialize it to turn counting on:
+*
+*          template <>
+*          struct hashmap_policy<std::string, int, MyHash> : counting_hashmap_policy {};
+*
+*      The policy also decides whether the map keeps a Bloom filter in front of its
+*      buckets (see bloom_filter.h); its hit and false positive counts are part of the
+*      stats of a map that has one. And it decides where the bucket array and nodes
+*      live: on the heap, or on huge pages (see huge_page_allocator.h).
+*/
+
+#ifndef HASHMAP_STATS_H
+#define HASHMAP_STATS_H
+
+#include <atomic>               // for atomic, memory_order_relaxed
+#include <chrono>               // for nanoseconds
+#include <cstddef>              // for size_t
+#include <iomanip>              // for setprecision
+#include <iostream>             // for ostream
+#include <vector>               // for vector
+
+/*
+* Policy used by a HashMap unless hashmap_policy is specialized.
+*
+*      count_operations - whether lookups, inserts, erases and probes are counted
+*      use_bloom_filter - whether lookups check a Bloom filter before the buckets
+*      use_huge_pages   - whether the bucket array and nodes go on huge pages
+*      interleave_numa  - whether those huge pages are spread over the NUMA nodes
+*/
+struct default_hashmap_policy {
+    static constexpr bool count_operations = false;
+    static constexpr bool use_bloom_filter = false;
+    static constexpr bool use_huge_pages = false;
+    static constexpr bool interleave_numa = false;
+};
+
+/*
+* Policy that turns on the per-operation counters of HashMapStats.
+*/
+struct counting_hashmap_policy : default_hashmap_policy {
+    static constexpr bool count_operations = true;
+};
+
+/*
+* Policy that puts a Bloom filter in front of the buckets, for maps where most
+* lookups are misses.
+*/
+struct bloom_hashmap_policy : default_hashmap_policy {
+    static constexpr bool use_bloom_filter = true;
+};
+
+/*
+* Policy that puts the bucket array and the nodes of large maps on huge pages, for
+* maps much larger than the TLB covers with 4 KiB pages.
+*/
+struct huge_page_hashmap_policy : default_hashmap_policy {
+    static constexpr bool use_huge_pages = true;
+};
+
+/*
+* Huge pages, interleaved across the NUMA nodes: for a large map that threads on
+* every node read.
+*/
+struct interleaved_huge_page_hashmap_policy : huge_page_hashmap_policy {
+    static constexpr bool interleave_numa = true;
+};
+
+/*
+* Policy selected for HashMap<K, M, H>. Specialize to change it.
+*/
+template <typename K, typename M, typename H>
+struct hashmap_policy : default_hashmap_policy {};
+
+/*
+* Per-operation counters. All zero unless the policy counts operations.
+*/
+struct HashMapOpCounts {
+    size_t lookups = 0;         // key searches, including those done by insert and erase
+    size_t probes = 0;          // nodes whose key was compared during those searches
+    size_t inserts = 0;         // inserts that added an element
+    size_t erases = 0;          // erases that removed an element
+};
+
+/*
+* Bloom filter counters. All zero unless the policy uses a Bloom filter.
+*/
+struct HashMapBloomCounts {
+    size_t queries = 0;         // lookups that checked the filter
+    size_t negatives = 0;       // lookups the filter ended, without touching the buckets
+    size_t false_positives = 0; // lookups the filter let through for a key that was not there
+    size_t rebuilds = 0;        // times the filter was emptied and refilled from the keys
+};
+
+/*
+* A count that const lookups may bump from several threads at once. The updates are
+* relaxed atomic additions: nothing is ordered by a count, it only has to add up.
+* Copying a counter copies its current value.
+*/
+class relaxed_counter {
+public:
+    relaxed_counter() = default;
+    relaxed_counter(const relaxed_counter& other) noexcept : _value(other.load()) {}
+    relaxed_counter& operator=(const relaxed_counter& other) noexcept {
+        _value.store(other.load(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    void add(size_t n = 1) noexcept { _value.fetch_add(n, std::memory_order_relaxed); }
+    size_t load() const noexcept { return _value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<size_t> _value{0};
+};
+
+/*
+* Counters kept inside a HashMap. The disabled version is empty and every call
+* compiles to nothing. The enabled one is safe to update from concurrent readers of
+* a const map, at the price of an atomic addition per lookup.
+*/
+template <bool Enabled>
+class hashmap_op_counters {
+public:
+    void on_lookup(size_t probes) noexcept {
+        _lookups.add();
+        _probes.add(probes);
+    }
+    void on_insert() noexcept { _inserts.add(); }
+    void on_erase() noexcept { _erases.add(); }
+    HashMapOpCounts counts() const noexcept {
+        return {_lookups.load(), _probes.load(), _inserts.load(), _erases.load()};
+    }
+
+private:
+    relaxed_counter _lookups;
+    relaxed_counter _probes;
+    relaxed_counter _inserts;
+    relaxed_counter _erases;
+};
+
+template <>
+class hashmap_op_counters<false> {
+public:
+    void on_lookup(size_t) noexcept {}
+    void on_insert() noexcept {}
+    void on_erase() noexcept {}
+    HashMapOpCounts counts() const noexcept { return {}; }
+};
+
+/*
+* Snapshot of a HashMap's shape and history, returned by HashMap::stats().
+*
+* A chain is the linked list of one bucket. The probe length of an element is the
+* number of nodes a successful lookup of its key visits (1 for the front of a chain).
+*/
+struct HashMapStats {
+    size_t size = 0;
+    size_t bucket_count = 0;
+    float load_factor = 0;
+
+    size_t empty_buckets = 0;
+    double empty_bucket_ratio = 0;          // empty_buckets / bucket_count
+
+    // chain_length_histogram[i] = number of buckets whose chain has i nodes
+    std::vector<size_t> chain_length_histogram;
+    size_t max_chain_length = 0;
+    double mean_chain_length = 0;           // over non-empty buckets
+
+    size_t max_probe_length = 0;            // same as max_chain_length
+    double mean_probe_length = 0;           // over all elements
+
+    size_t node_allocations = 0;            // nodes allocated since construction
+    size_t bytes_used = 0;                  // heap bytes, as HashMap::memory_usage().total()
+
+    size_t rehash_count = 0;                // calls to rehash since construction
+    std::chrono::nanoseconds rehash_time{0};
+
+    bool counts_operations = false;         // whether op_counts is being collected
+    HashMapOpCounts op_counts;
+
+    bool bloom_filter = false;              // whether the map has a Bloom filter
+    size_t bloom_bytes = 0;                 // heap used by the filter (part of bytes_used)
+    HashMapBloomCounts bloom_counts;
+    // false_positives / (negatives + false_positives): how many lookups of absent keys
+    // the filter failed to stop
+    double bloom_false_positive_rate = 0;
+};
+
+/*
+* Prints a short, human readable summary of stats (not the whole histogram).
+*
+* Usage:
+*      std::cout << map.stats() << std::endl;
+*/
+inline std::ostream& operator<<(std::ostream& os, const HashMapStats& stats) {
+    os << "size: " << stats.size << ", buckets: " << stats.bucket_count
+       << ", load factor: " << std::setprecision(3) << stats.load_factor
+       << ", empty buckets: " << stats.empty_bucket_ratio * 100 << "%"
+       << ", chain length (mean/max): " << stats.mean_chain_length << "/" << stats.max_chain_length
+       << ", probe length (mean/max): " << stats.mean_probe_length << "/" << stats.max_probe_length
+       << ", bytes: " << stats.bytes_used
+       << ", node allocations: " << stats.node_allocations
+       << ", rehashes: " << stats.rehash_count << " (" << stats.rehash_time.count() << " ns)";
+    if (stats.counts_operations) {
+        os << ", lookups: " << stats.op_counts.lookups << ", probes: " << stats.op_counts.probes
+           << ", inserts: " << stats.op_counts.inserts << ", erases: " << stats.op_counts.erases;
+    }
+    if (stats.bloom_filter) {
+        os << ", bloom filter: " << stats.bloom_bytes << " bytes, " << stats.bloom_counts.negatives
+           << "/" << stats.bloom_counts.queries << " lookups stopped, false positive rate: "
+           << stats.bloom_false_positive_rate * 100 << "%"
+           << ", rebuilds: " << stats.bloom_counts.rebuilds;
+    }
+    return os;
+}
+
+#endif // HASHMAP_STATS_H
@@ -0,0 +1,345 @@
+/*
+* Huge page backed memory for the bucket array and nodes of large HashMaps.
+*
+*      A lookup in a map of several gigabytes touches two random addresses (a bucket,
+*      then a node), and with 4 KiB pages each of them usually misses the TLB as well
+*      as the cache: the page walk is part of the cost of every lookup. With 2 MiB
+*      pages the same TLB covers 512 times as much memory.
+*
+*      huge_page_allocator<T> is a standard allocator that takes requests of 2 MiB
+*      and more straight from mmap, in 2 MiB aligned regions marked MADV_HUGEPAGE, so
+*      that transparent huge pages can back them (with THP set to "madvise" or
+*      "always"; with "never" the region still works, on small pages). Smaller
+*      requests go to operator new, since a huge page for a small map is waste.
+*      HashMap uses it for its bucket array.
+*
+*      hashmap_node_pool<Node> carves the nodes out of slabs instead of allocating
+*      them one by one. The slabs double from 64 nodes up to 2 MiB, and from then on
+*      every slab is one such region, so the nodes of a large map sit on huge pages
+*      too. Erased nodes are kept on a free list for the next insert; the slabs are
+*      returned when the map is cleared or destroyed.
+*
+*      On machines with several NUMA nodes the regions can also be interleaved across
+*      the nodes (mbind MPOL_INTERLEAVE), which spreads a map that every thread reads
+*      over all memory controllers. Otherwise the kernel's first-touch placement puts
+*      each page on the node of the thread that first writes it: build the map on the
+*      node that will use it. Interleaving is skipped on single node machines and where
+*      mbind is not available.
+*
+*      Both are off by default. Turn them on through the policy (see hashmap_stats.h):
+*
+*          template <>
+*          struct hashmap_policy<uint64_t, uint64_t, MyHash> : huge_page_hashmap_policy {};
+*/
+
+#ifndef HUGE_PAGE_ALLOCATOR_H
+#define HUGE_PAGE_ALLOCATOR_H
+
+#include <algorithm>            // for max, min
+#include <bit>                  // for popcount, countl_zero
+#include <cstddef>              // for size_t, max_align_t
+#include <cstdint>              // for uintptr_t
+#include <fstream>              // for ifstream
+#include <new>                  // for bad_alloc, operator new
+#include <sstream>              // for istringstream
+#include <string>               // for string, getline, stoul
+#include <utility>              // for exchange, forward
+#include <vector>               // for vector
+#include "hashmap_memory.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>           // for mmap, munmap, madvise
+#include <sys/syscall.h>        // for SYS_mbind
+#include <unistd.h>             // for syscall
+#endif
+
+namespace huge_page_detail {
+
+constexpr size_t kHugePageBytes = size_t{2} << 20;
+
+/*
+* Rounds bytes up to a whole number of huge pages.
+*/
+constexpr size_t region_size(size_t bytes) noexcept {
+    return (bytes + kHugePageBytes - 1) / kHugePageBytes * kHugePageBytes;
+}
+
+/*
+* The NUMA nodes that have memory, as a bit mask, read once from sysfs. Node 0 alone
+* where that cannot be read (or names nodes beyond 63).
+*/
+inline unsigned long numa_nodes() {
+    static const unsigned long nodes = [] {
+        std::ifstream file("/sys/devices/system/node/has_memory");
+        std::string list;
+        if (!std::getline(file, list) || list.empty()) return 1UL;
+        // a list of ranges such as "0-1,3"
+        unsigned long mask = 0;
+        std::istringstream ranges(list);
+        std::string range;
+        while (std::getline(ranges, range, ',')) {
+            size_t dash = range.find('-');
+            unsigned long first = std::stoul(range);
+            unsigned long last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+            if (last > 63) return 1UL;
+            for (unsigned long node = first; node <= last; ++node) mask |= 1UL << node;
+        }
+        return mask == 0 ? 1UL : mask;
+    }();
+    return nodes;
+}
+
+/*
+* Spreads the pages of [address, address + bytes) across all NUMA nodes, if there
+* is more than one. Must be called before the pages are first touched. Failure only
+* means the kernel's default placement is used, so it is ignored.
+*/
+inline void interleave(void* address, size_t bytes) {
+#if defined(__linux__) && defined(SYS_mbind)
+    unsigned long mask = numa_nodes();
+    if (std::popcount(mask) < 2) return;
+    constexpr int kInterleave = 3;                  // MPOL_INTERLEAVE in <numaif.h>
+    unsigned long max_node = 64 - std::countl_zero(mask);
+    syscall(SYS_mbind, address, bytes, kInterleave, &mask, max_node + 1, 0);
+#else
+    (void) address;
+    (void) bytes;
+#endif
+}
+
+/*
+* Maps region_size(bytes) bytes, aligned to a huge page and advised to use huge pages.
+*
+* Exceptions: std::bad_alloc if the memory cannot be mapped.
+*/
+inline void* map_region(size_t bytes, bool interleaved) {
+    size_t size = region_size(bytes);
+#if defined(__linux__)
+    // map one huge page more than needed, then trim both ends to an aligned region
+    size_t padded = size + kHugePageBytes;
+    void* mapped = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) throw std::bad_alloc();
+    auto start = reinterpret_cast<uintptr_t>(mapped);
+    uintptr_t aligned = (start + kHugePageBytes - 1) & ~uintptr_t{kHugePageBytes - 1};
+    if (aligned > start) munmap(mapped, aligned - start);
+    size_t tail = start + padded - (aligned + size);
+    if (tail > 0) munmap(reinterpret_cast<void*>(aligned + size), tail);
+
+    auto region = reinterpret_cast<void*>(aligned);
+    madvise(region, size, MADV_HUGEPAGE);
+    if (interleaved) interleave(region, size);
+    return region;
+#else
+    (void) interleaved;
+    return ::operator new(size, std::align_val_t{kHugePageBytes});
+#endif
+}
+
+inline void unmap_region(void* region, size_t bytes) noexcept {
+#if defined(__linux__)
+    munmap(region, region_size(bytes));
+#else
+    ::operator delete(region, std::align_val_t{kHugePageBytes});
+#endif
+}
+
+} // namespace huge_page_detail
+
+/*
+* Standard allocator that serves requests of a huge page or more from huge page
+* regions, and smaller ones from operator new.
+*
+* Usage:
+*      std::vector<uint64_t, huge_page_allocator<uint64_t>> table(1 << 24);
+*/
+template <typename T, bool Interleaved = false>
+struct huge_page_allocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind { using other = huge_page_allocator<U, Interleaved>; };
+
+    huge_page_allocator() noexcept = default;
+    template <typename U>
+    huge_page_allocator(const huge_page_allocator<U, Interleaved>&) noexcept {}
+
+    T* allocate(size_t n) {
+        if (n > static_cast<size_t>(-1) / sizeof(T)) throw std::bad_alloc();
+        size_t bytes = n * sizeof(T);
+        if (bytes < huge_page_detail::kHugePageBytes) return static_cast<T*>(::operator new(bytes));
+        return static_cast<T*>(huge_page_detail::map_region(bytes, Interleaved));
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        size_t bytes = n * sizeof(T);
+        if (bytes < huge_page_detail::kHugePageBytes) {
+            ::operator delete(p);
+        } else {
+            huge_page_detail::unmap_region(p, bytes);
+        }
+    }
+
+    /*
+    * Adds an allocation of n elements to tally: a heap block, or a mapped region
+    * (which has no allocator overhead, only the rounding up to a huge page).
+    */
+    static void add_allocation(size_t n, heap_tally& tally) noexcept {
+        size_t bytes = n * sizeof(T);
+        if (bytes < huge_page_detail::kHugePageBytes) {
+            tally.add_block(bytes);
+        } else {
+            tally.add_mapping(bytes, huge_page_detail::region_size(bytes));
+        }
+    }
+
+    friend bool operator==(const huge_page_allocator&, const huge_page_allocator&) noexcept { return true; }
+};
+
+/*
+* The nodes of a HashMap. By default every node is its own heap block, as if
+* allocated with new; with huge pages turned on they come from slabs (see the top
+* of this file).
+*
+* The map calls create for every node it links and destroy for every node it
+* unlinks, and release once it has destroyed all of them. Copying a pool gives an
+* empty pool, since a copied map creates its own nodes.
+*/
+template <typename Node, bool UseHugePages, bool Interleaved = false>
+class hashmap_node_pool {
+public:
+    template <typename... Args>
+    Node* create(Args&&... args) { return new Node(std::forward<Args>(args)...); }
+    void destroy(Node* node) noexcept { delete node; }
+    void release() noexcept {}
+
+    /*
+    * Adds the heap of count nodes to tally.
+    */
+    void add_heap(size_t count, heap_tally& tally) const noexcept {
+        for (size_t i = 0; i < count; ++i) tally.add_block(sizeof(Node));
+    }
+};
+
+template <typename Node, bool Interleaved>
+class hashmap_node_pool<Node, true, Interleaved> {
+    static_assert(alignof(Node) <= alignof(std::max_align_t), "nodes are carved from operator new blocks");
+
+public:
+    hashmap_node_pool() = default;
+    hashmap_node_pool(const hashmap_node_pool&) noexcept {}
+    hashmap_node_pool& operator=(const hashmap_node_pool&) noexcept { return *this; }
+
+    hashmap_node_pool(hashmap_node_pool&& other) noexcept :
+        _slabs(std::move(other._slabs)),
+        _next(std::exchange(other._next, nullptr)),
+        _end(std::exchange(other._end, nullptr)),
+        _free(std::exchange(other._free, nullptr)) { }
+
+    hashmap_node_pool& operator=(hashmap_node_pool&& other) noexcept {
+        if (this != &other) {
+            release();
+            _slabs = std::move(other._slabs);
+            _next = std::exchange(other._next, nullptr);
+            _end = std::exchange(other._end, nullptr);
+            _free = std::exchange(other._free, nullptr);
+        }
+        return *this;
+    }
+
+    ~hashmap_node_pool() { release(); }
+
+    template <typename... Args>
+    Node* create(Args&&... args) {
+        void* slot = take_slot();
+        try {
+            return new (slot) Node(std::forward<Args>(args)...);
+        } catch (...) {
+            give_back(slot);
+            throw;
+        }
+    }
+
+    void destroy(Node* node) noexcept {
+        node->~Node();
+        give_back(node);
+    }
+
+    /*
+    * Returns every slab. Every node must have been destroyed.
+    */
+    void release() noexcept {
+        for (const auto& slab : _slabs) free_slab(slab);
+        _slabs = std::vector<slab>();
+        _next = _end = nullptr;
+        _free = nullptr;
+    }
+
+    /*
+    * Adds the slabs to tally, however many nodes they hold.
+    */
+    void add_heap(size_t, heap_tally& tally) const noexcept {
+        if (_slabs.capacity() > 0) tally.add_block(_slabs.capacity() * sizeof(slab));
+        for (const auto& slab : _slabs) {
+            if (slab.bytes < huge_page_detail::kHugePageBytes) {
+                tally.add_block(slab.bytes);
+            } else {
+                tally.add_mapping(slab.bytes, slab.bytes);
+            }
+        }
+    }
+
+private:
+    static constexpr size_t kSlotBytes = (std::max(sizeof(Node), sizeof(void*)) + alignof(Node) - 1)
+                                         / alignof(Node) * alignof(Node);
+    static constexpr size_t kFirstSlabNodes = 64;
+
+    struct slab {
+        void* memory;
+        size_t bytes;
+    };
+
+    void* take_slot() {
+        if (_free != nullptr) {
+            void* slot = _free;
+            _free = *static_cast<void**>(_free);
+            return slot;
+        }
+        if (_next == _end) add_slab();
+        void* slot = _next;
+        _next += kSlotBytes;
+        return slot;
+    }
+
+    void give_back(void* slot) noexcept {
+        *static_cast<void**>(slot) = _free;
+        _free = slot;
+    }
+
+    void add_slab() {
+        size_t bytes = _slabs.empty() ? kFirstSlabNodes * kSlotBytes
+                                      : std::min(2 * _slabs.back().bytes, huge_page_detail::kHugePageBytes);
+        if (bytes > huge_page_detail::kHugePageBytes / 2) bytes = huge_page_detail::kHugePageBytes;
+        // make room first, so that the push_back below cannot throw and leak the slab
+        if (_slabs.size() == _slabs.capacity()) _slabs.reserve(std::max<size_t>(8, 2 * _slabs.capacity()));
+        void* memory = bytes < huge_page_detail::kHugePageBytes ? ::operator new(bytes)
+                                                                 : huge_page_detail::map_region(bytes, Interleaved);
+        _slabs.push_back({memory, bytes});
+        _next = static_cast<char*>(memory);
+        _end = _next + bytes / kSlotBytes * kSlotBytes;
+    }
+
+    static void free_slab(const slab& s) noexcept {
+        if (s.bytes < huge_page_detail::kHugePageBytes) {
+            ::operator delete(s.memory);
+        } else {
+            huge_page_detail::unmap_region(s.memory, s.bytes);
+        }
+    }
+
+    std::vector<slab> _slabs;
+    char* _next = nullptr;              // the unused part of the last slab
+    char* _end = nullptr;
+    void* _free = nullptr;              // destroyed nodes, linked through their first bytes
+};
+
+#endif // HUGE_PAGE_ALLOCATOR_H
@@ -0,0 +1,537 @@
+/*
+* LruCache and ClockCache: bounded caches built on HashMap.
+*
+*      Both caches store their entries in a HashMap<K, entry, H>, and bound it by a
+*      CacheCapacity: a maximum number of entries, a maximum number of bytes, or both.
+*      When a put goes over the capacity, entries are evicted until it fits again.
+*      Every operation is O(1) amortized average case.
+*
+*      LruCache evicts the least recently used entry. The recency list is intrusive:
+*      each entry holds prev/next pointers to the neighbouring K/entry pairs, which
+*      stay valid because HashMap never moves a node (rehash relinks the existing ones).
+*      A hit unlinks the entry and relinks it at the front.
+*
+*      ClockCache approximates LRU with the CLOCK (second chance) algorithm. A hit only
+*      sets the entry's referenced bit; eviction sweeps a hand around a ring of the
+*      entries, clearing referenced bits, and evicts the first entry whose bit was
+*      already clear. Hits write one byte instead of six pointers, and an entry costs
+*      a ring slot and an index instead of two pointers.
+*
+*      The size of an entry, for byte capacities, is estimated by cache_charge: the
+*      node, plus the heap owned by the key and the value per heap_size_estimator
+*      (see hashmap_memory.h), plus allocator overhead.
+*
+* Usage:
+*      LruCache<std::string, std::string> pages(CacheCapacity::bytes(64 << 20));
+*      if (const std::string* page = pages.get(url)) return *page;
+*      pages.put(url, download(url));
+*      std::cout << pages.stats() << std::endl;      // hits, misses, evictions, hit rate
+*/
+
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <cstddef>              // for size_t
+#include <iostream>             // for ostream
+#include <limits>               // for numeric_limits
+#include <utility>              // for exchange, move, pair
+#include <vector>               // for vector
+#include "hashmap.h"
+
+/*
+* The bound of a cache. A limit of SIZE_MAX means no limit.
+*
+* Usage:
+*      CacheCapacity::entries(1000)
+*      CacheCapacity::bytes(1 << 20)
+*      CacheCapacity{1000, 1 << 20}         // whichever is reached first
+*/
+struct CacheCapacity {
+    size_t max_entries = std::numeric_limits<size_t>::max();
+    size_t max_bytes = std::numeric_limits<size_t>::max();
+
+    static CacheCapacity entries(size_t max_entries) noexcept { return {max_entries, CacheCapacity().max_bytes}; }
+    static CacheCapacity bytes(size_t max_bytes) noexcept { return {CacheCapacity().max_entries, max_bytes}; }
+
+    bool exceeded(size_t entries, size_t bytes) const noexcept {
+        return entries > max_entries || bytes > max_bytes;
+    }
+};
+
+/*
+* Counters of a cache, returned by stats(). A put of a new key counts as an insertion;
+* a put of a key already in the cache counts as an update.
+*/
+struct CacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t insertions = 0;
+    size_t updates = 0;
+    size_t evictions = 0;
+    size_t size = 0;                    // entries in the cache now
+    size_t bytes = 0;                   // sum of their cache_charge
+
+    double hit_rate() const noexcept {
+        return hits + misses == 0 ? 0 : static_cast<double>(hits) / (hits + misses);
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const CacheStats& stats) {
+    auto old_precision = os.precision(3);
+    os << "size: " << stats.size << " (" << stats.bytes << " bytes), hits: " << stats.hits
+       << ", misses: " << stats.misses << " (hit rate " << 100 * stats.hit_rate() << "%), insertions: "
+       << stats.insertions << ", updates: " << stats.updates << ", evictions: " << stats.evictions;
+    os.precision(old_precision);
+    return os;
+}
+
+/*
+* Estimated bytes used by one cache entry whose K/entry pair has type Slot: the node
+* (the pair and a next pointer), the heap of key and value, and allocator overhead.
+*/
+template <typename Slot, typename K, typename V>
+size_t cache_charge(const K& key, const V& value) noexcept {
+    heap_tally tally;
+    tally.add_block(sizeof(Slot) + sizeof(void*));
+    heap_size_estimator<K>::add(key, tally);
+    heap_size_estimator<V>::add(value, tally);
+    return tally.bytes + tally.overhead;
+}
+
+/*
+* Initial bucket count of a cache: with an entry limit, enough buckets for a full cache,
+* so that it never rehashes. Without one, the caches double the bucket count whenever
+* the load factor would pass 1 (see cache_needs_rehash).
+*/
+inline size_t cache_initial_buckets(const CacheCapacity& capacity) noexcept {
+    bool bounded = capacity.max_entries != CacheCapacity().max_entries;
+    return bounded && capacity.max_entries > 0 ? capacity.max_entries : 10;
+}
+
+inline bool cache_needs_rehash(const CacheCapacity& capacity, size_t size, size_t bucket_count) noexcept {
+    return capacity.max_entries == CacheCapacity().max_entries && size > bucket_count;
+}
+
+/*
+* Template class for a least recently used cache
+*
+* K = key type
+* V = value type
+* H = hash function type used to hash a key; if not provided, defaults to std::hash<K>
+*
+* Concept requirements: same as HashMap (V must be default constructible and copyable).
+*/
+template <typename K, typename V, typename H = std::hash<K>>
+class LruCache {
+    struct entry;
+    using slot = std::pair<const K, entry>;
+
+    struct entry {
+        V value{};
+        slot* prev = nullptr;           // more recently used
+        slot* next = nullptr;           // less recently used
+        size_t charge = 0;
+    };
+
+public:
+    /*
+    * Creates an empty cache. With an entry limit the bucket array is sized for the full
+    * cache up front; otherwise it doubles whenever the load factor would pass 1.
+    *
+    * Usage:
+    *      LruCache<int, std::string> cache(CacheCapacity::entries(100));
+    */
+    explicit LruCache(CacheCapacity capacity, const H& hash = H()) :
+        _capacity(capacity),
+        _map(cache_initial_buckets(capacity), hash) {}
+
+    /*
+    * Copies the entries, the recency order, the byte count and the counters. The
+    * recency list links the nodes of the map, so it is rebuilt over the copy's nodes.
+    *
+    * Complexity: O(N) average case
+    */
+    LruCache(const LruCache& other) :
+        _capacity(other._capacity),
+        _map(other._map),
+        _bytes(other._bytes),
+        _stats(other._stats) {
+        for (const slot* s = other._head; s != nullptr; s = s->second.next) {
+            slot* copy = &*_map.find(s->first);
+            copy->second.prev = _tail;
+            copy->second.next = nullptr;
+            (_tail ? _tail->second.next : _head) = copy;
+            _tail = copy;
+        }
+    }
+
+    LruCache& operator=(const LruCache& other) {
+        if (this != &other) *this = LruCache(other);
+        return *this;
+    }
+
+    /*
+    * Moving keeps the nodes, so the recency list moves along with them. The moved-from
+    * cache may only be assigned to or destroyed.
+    */
+    LruCache(LruCache&& other) :
+        _capacity(other._capacity),
+        _map(std::move(other._map)),
+        _head(std::exchange(other._head, nullptr)),
+        _tail(std::exchange(other._tail, nullptr)),
+        _bytes(std::exchange(other._bytes, 0)),
+        _stats(other._stats) {}
+
+    LruCache& operator=(LruCache&& other) {
+        if (this != &other) {
+            _capacity = other._capacity;
+            _map = std::move(other._map);
+            _head = std::exchange(other._head, nullptr);
+            _tail = std::exchange(other._tail, nullptr);
+            _bytes = std::exchange(other._bytes, 0);
+            _stats = other._stats;
+        }
+        return *this;
+    }
+
+    /*
+    * Returns a pointer to the value of key and marks it most recently used, or returns
+    * nullptr. Counts a hit or a miss.
+    *
+    * Notes: the pointer is valid until key is evicted or erased.
+    */
+    V* get(const K& key) {
+        auto it = _map.find(key);
+        if (it == _map.end()) {
+            ++_stats.misses;
+            return nullptr;
+        }
+        ++_stats.hits;
+        slot* found = &*it;
+        unlink(found);
+        push_front(found);
+        return &found->second.value;
+    }
+
+    /*
+    * Returns a pointer to the value of key, or nullptr, without changing its recency
+    * or the counters.
+    */
+    const V* peek(const K& key) const {
+        auto it = _map.find(key);
+        return it == _map.end() ? nullptr : &it->second.value;
+    }
+
+    bool contains(const K& key) const noexcept { return _map.contains(key); }
+
+    /*
+    * Stores value under key as the most recently used entry, replacing any previous
+    * value, then evicts least recently used entries until the cache is within capacity.
+    *
+    * Return value: true if the entry is in the cache afterwards. An entry larger than
+    * the whole byte capacity is not stored (and any previous value of key is erased).
+    *
+    * Complexity: O(1) amortized average case, plus O(1) per eviction
+    */
+    bool put(const K& key, const V& value) {
+        size_t charge = cache_charge<slot>(key, value);
+        if (charge > _capacity.max_bytes) {
+            erase(key);
+            return false;
+        }
+        auto [stored, added] = _map.insert({key, entry{value, nullptr, nullptr, charge}});
+        if (added) {
+            ++_stats.insertions;
+            if (cache_needs_rehash(_capacity, _map.size(), _map.bucket_count())) {
+                _map.rehash(2 * _map.bucket_count());
+            }
+        } else {
+            ++_stats.updates;
+            unlink(stored);
+            _bytes -= stored->second.charge;
+            stored->second.value = value;
+            stored->second.charge = charge;
+        }
+        _bytes += charge;
+        push_front(stored);
+        while (_capacity.exceeded(_map.size(), _bytes)) evict(_tail);
+        // the front entry is evicted last, so only a zero entry limit evicts it
+        return _capacity.max_entries > 0;
+    }
+
+    /*
+    * Removes key from the cache. This does not count as an eviction.
+    *
+    * Return value: true if key was in the cache.
+    */
+    bool erase(const K& key) {
+        auto it = _map.find(key);
+        if (it == _map.end()) return false;
+        slot* found = &*it;
+        unlink(found);
+        _bytes -= found->second.charge;
+        _map.erase(key);
+        return true;
+    }
+
+    /*
+    * Removes every entry. The counters are kept.
+    */
+    void clear() noexcept {
+        _map.clear();
+        _head = _tail = nullptr;
+        _bytes = 0;
+    }
+
+    /*
+    * Visits the entries from most to least recently used, as fn(key, value), without
+    * changing their recency.
+    */
+    template <typename Fn>
+    void for_each(Fn fn) const {
+        for (const slot* curr = _head; curr != nullptr; curr = curr->second.next) fn(curr->first, curr->second.value);
+    }
+
+    size_t size() const noexcept { return _map.size(); }
+    bool empty() const noexcept { return _map.empty(); }
+    size_t bytes() const noexcept { return _bytes; }
+    CacheCapacity capacity() const noexcept { return _capacity; }
+
+    CacheStats stats() const noexcept {
+        CacheStats stats = _stats;
+        stats.size = size();
+        stats.bytes = _bytes;
+        return stats;
+    }
+
+    void reset_stats() noexcept { _stats = CacheStats(); }
+
+private:
+    void unlink(slot* s) noexcept {
+        entry& e = s->second;
+        (e.prev ? e.prev->second.next : _head) = e.next;
+        (e.next ? e.next->second.prev : _tail) = e.prev;
+        e.prev = e.next = nullptr;
+    }
+
+    void push_front(slot* s) noexcept {
+        s->second.next = _head;
+        (_head ? _head->second.prev : _tail) = s;
+        _head = s;
+    }
+
+    void evict(slot* s) {
+        unlink(s);
+        _bytes -= s->second.charge;
+        ++_stats.evictions;
+        _map.erase(s->first);
+    }
+
+    CacheCapacity _capacity;
+    HashMap<K, entry, H> _map;
+    slot* _head = nullptr;              // most recently used
+    slot* _tail = nullptr;              // least recently used, evicted first
+    size_t _bytes = 0;
+    CacheStats _stats;
+};
+
+/*
+* Template class for a CLOCK (second chance) cache. Same interface as LruCache, except
+* that for_each visits the entries in ring order rather than recency order.
+*/
+template <typename K, typename V, typename H = std::hash<K>>
+class ClockCache {
+    struct entry;
+    using slot = std::pair<const K, entry>;
+
+    struct entry {
+        V value{};
+        size_t ring_index = 0;          // position in _ring
+        size_t charge = 0;
+        bool referenced = false;
+    };
+
+public:
+    explicit ClockCache(CacheCapacity capacity, const H& hash = H()) :
+        _capacity(capacity),
+        _map(cache_initial_buckets(capacity), hash) {}
+
+    /*
+    * Copies the entries, the ring order, the hand, the byte count and the counters.
+    * The ring points at the nodes of the map, so it is rebuilt over the copy's nodes.
+    *
+    * Complexity: O(N) average case
+    */
+    ClockCache(const ClockCache& other) :
+        _capacity(other._capacity),
+        _map(other._map),
+        _hand(other._hand),
+        _bytes(other._bytes),
+        _stats(other._stats) {
+        _ring.reserve(other._ring.size());
+        for (const slot* s : other._ring) _ring.push_back(&*_map.find(s->first));
+    }
+
+    ClockCache& operator=(const ClockCache& other) {
+        if (this != &other) *this = ClockCache(other);
+        return *this;
+    }
+
+    /*
+    * Moving keeps the nodes, so the ring moves along with them. The moved-from cache
+    * may only be assigned to or destroyed.
+    */
+    ClockCache(ClockCache&& other) :
+        _capacity(other._capacity),
+        _map(std::move(other._map)),
+        _ring(std::move(other._ring)),
+        _hand(std::exchange(other._hand, 0)),
+        _bytes(std::exchange(other._bytes, 0)),
+        _stats(other._stats) {}
+
+    ClockCache& operator=(ClockCache&& other) {
+        if (this != &other) {
+            _capacity = other._capacity;
+            _map = std::move(other._map);
+            _ring = std::move(other._ring);
+            _hand = std::exchange(other._hand, 0);
+            _bytes = std::exchange(other._bytes, 0);
+            _stats = other._stats;
+        }
+        return *this;
+    }
+
+    /*
+    * Returns a pointer to the value of key and sets its referenced bit, or returns
+    * nullptr. Counts a hit or a miss.
+    */
+    V* get(const K& key) {
+        auto it = _map.find(key);
+        if (it == _map.end()) {
+            ++_stats.misses;
+            return nullptr;
+        }
+        ++_stats.hits;
+        it->second.referenced = true;
+        return &it->second.value;
+    }
+
+    const V* peek(const K& key) const {
+        auto it = _map.find(key);
+        return it == _map.end() ? nullptr : &it->second.value;
+    }
+
+    bool contains(const K& key) const noexcept { return _map.contains(key); }
+
+    /*
+    * Stores value under key. For a new key, entries are evicted first until the new one
+    * fits; it starts with its referenced bit clear, so it is evicted by the next sweep
+    * that reaches it unless it is read before then. An updated entry is marked
+    * referenced, and entries are evicted afterwards if it grew.
+    *
+    * Return value: as LruCache::put.
+    */
+    bool put(const K& key, const V& value) {
+        size_t charge = cache_charge<slot>(key, value);
+        if (charge > _capacity.max_bytes) {
+            erase(key);
+            return false;
+        }
+        if (!_map.contains(key)) {
+            while (!_ring.empty() && _capacity.exceeded(_map.size() + 1, _bytes + charge)) evict_one();
+        }
+        auto [stored, added] = _map.insert({key, entry{value, _ring.size(), charge, false}});
+        if (added) {
+            ++_stats.insertions;
+            _ring.push_back(stored);
+            if (cache_needs_rehash(_capacity, _map.size(), _map.bucket_count())) {
+                _map.rehash(2 * _map.bucket_count());
+            }
+        } else {
+            ++_stats.updates;
+            _bytes -= stored->second.charge;
+            stored->second.value = value;
+            stored->second.charge = charge;
+            stored->second.referenced = true;
+        }
+        _bytes += charge;
+        while (_capacity.exceeded(_map.size(), _bytes)) evict_one();
+        return _map.contains(key);
+    }
+
+    bool erase(const K& key) {
+        auto it = _map.find(key);
+        if (it == _map.end()) return false;
+        remove_from_ring(it->second.ring_index);
+        _bytes -= it->second.charge;
+        _map.erase(key);
+        return true;
+    }
+
+    void clear() noexcept {
+        _map.clear();
+        _ring.clear();
+        _hand = 0;
+        _bytes = 0;
+    }
+
+    template <typename Fn>
+    void for_each(Fn fn) const {
+        for (const slot* s : _ring) fn(s->first, s->second.value);
+    }
+
+    size_t size() const noexcept { return _map.size(); }
+    bool empty() const noexcept { return _map.empty(); }
+    size_t bytes() const noexcept { return _bytes; }
+    CacheCapacity capacity() const noexcept { return _capacity; }
+
+    CacheStats stats() const noexcept {
+        CacheStats stats = _stats;
+        stats.size = size();
+        stats.bytes = _bytes;
+        return stats;
+    }
+
+    void reset_stats() noexcept { _stats = CacheStats(); }
+
+private:
+    /*
+    * Advances the hand, giving referenced entries a second chance, and evicts the first
+    * entry that is not referenced. Terminates within two revolutions.
+    */
+    void evict_one() {
+        while (true) {
+            if (_hand >= _ring.size()) _hand = 0;
+            slot* s = _ring[_hand];
+            if (s->second.referenced) {
+                s->second.referenced = false;
+                ++_hand;
+                continue;
+            }
+            remove_from_ring(_hand);
+            _bytes -= s->second.charge;
+            ++_stats.evictions;
+            _map.erase(s->first);
+            return;
+        }
+    }
+
+    /*
+    * Removes _ring[index] by moving the last slot into its place. The hand stays put,
+    * so the moved slot is the next one it looks at.
+    */
+    void remove_from_ring(size_t index) noexcept {
+        _ring[index] = _ring.back();
+        _ring[index]->second.ring_index = index;
+        _ring.pop_back();
+    }
+
+    CacheCapacity _capacity;
+    HashMap<K, entry, H> _map;
+    std::vector<slot*> _ring;
+    size_t _hand = 0;
+    size_t _bytes = 0;
+    CacheStats _stats;
+};
+
+#endif // LRU_CACHE_H
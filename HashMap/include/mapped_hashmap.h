@@ -0,0 +1,479 @@
+/*
+* Persistent, memory-mapped HashMap files.
+*
+*      save_mapped(map, path) writes a HashMap to a position-independent file: every
+*      link between entries is a byte offset from the start of the file instead of a
+*      node*. MappedHashMap<K, M> then mmap's that file read-only and answers
+*      contains/at/find straight out of the mapping, so opening a large index costs
+*      one mmap call instead of rebuilding the map. Pages are read by the OS as they
+*      are touched.
+*
+*      File layout (native byte order, every offset 8-byte aligned):
+*
+*          file_header                         magic, version, sizes, type tags
+*          uint64_t buckets[bucket_count]      offset of first entry in bucket, 0 if empty
+*          entries                             entry_header, key bytes, value bytes
+*
+*      The entries of one bucket are written next to each other, so walking a chain
+*      reads consecutive memory.
+*
+*      Supported key and mapped types are std::string, arithmetic types, and trivially
+*      copyable types given a tag of their own (see mapped_codec). Lookups on string
+*      data return std::string_view.
+*
+*      This header uses POSIX mmap and is only available on POSIX systems.
+*/
+
+#ifndef MAPPED_HASHMAP_H
+#define MAPPED_HASHMAP_H
+
+#include <algorithm>            // for max
+#include <cstdint>              // for uint64_t, uint32_t
+#include <cstring>              // for memcpy, memcmp
+#include <fstream>              // for ofstream
+#include <iterator>             // for forward_iterator_tag
+#include <stdexcept>            // for runtime_error, out_of_range
+#include <string>               // for string
+#include <string_view>          // for string_view
+#include <type_traits>          // for is_arithmetic, is_trivially_copyable, enable_if
+#include <utility>              // for exchange, pair
+#include <vector>               // for vector
+#include <fcntl.h>              // for open
+#include <sys/mman.h>           // for mmap, munmap
+#include <sys/stat.h>           // for fstat
+#include <unistd.h>             // for close
+#include "hashmap.h"
+
+/*
+* Describes how a key or mapped type is stored in a mapped file.
+*
+*      tag                 - identifies the encoding in the file header (see codec_tag)
+*      size(value)         - number of bytes written for value
+*      write(dest, value)  - writes value to dest
+*      view(src, size)     - reads a value back, without copying it out of the mapping
+*
+* The primary template handles arithmetic types, stored as raw bytes. Other trivially
+* copyable types are stored the same way, but must choose their own tag:
+*
+*      template <>
+*      struct mapped_codec<Point> : trivial_mapped_codec<Point, codec_tag(codec_kind::user, 1)> {};
+*/
+template <typename T, typename = void>
+struct mapped_codec {
+    static_assert(std::is_arithmetic_v<T>,
+                  "mapped_codec: specialize mapped_codec for this type, e.g. from trivial_mapped_codec<T, tag>");
+};
+
+/*
+* Raw byte storage of a trivially copyable type, tagged with Tag.
+*/
+template <typename T, uint32_t Tag>
+struct trivial_mapped_codec {
+    static_assert(std::is_trivially_copyable_v<T>, "trivial_mapped_codec: T must be trivially copyable");
+    static_assert(alignof(T) <= 8, "trivial_mapped_codec: alignment above 8 is not supported");
+
+    using view_type = const T&;
+    static constexpr uint32_t tag = Tag;
+
+    static size_t size(const T&) { return sizeof(T); }
+    static void write(char* dest, const T& value) { std::memcpy(dest, &value, sizeof(T)); }
+    static view_type view(const char* src, size_t) { return *reinterpret_cast<const T*>(src); }
+    static bool equal(const char* src, size_t, const T& value) { return view(src, sizeof(T)) == value; }
+};
+
+template <typename T>
+struct mapped_codec<T, std::enable_if_t<std::is_arithmetic_v<T>>> : trivial_mapped_codec<T, arithmetic_codec_tag<T>()> {};
+
+template <>
+struct mapped_codec<std::string> {
+    using view_type = std::string_view;
+    static constexpr uint32_t tag = codec_tag(codec_kind::string, 0);
+
+    static size_t size(const std::string& value) { return value.size(); }
+    static void write(char* dest, const std::string& value) { std::memcpy(dest, value.data(), value.size()); }
+    static view_type view(const char* src, size_t size) { return {src, size}; }
+    static bool equal(const char* src, size_t size, const std::string& value) {
+        return size == value.size() && std::memcmp(src, value.data(), size) == 0;
+    }
+};
+
+namespace mapped_detail {
+
+constexpr char kMagic[8] = {'H', 'M', 'A', 'P', 'F', 'I', 'L', 'E'};
+constexpr uint32_t kVersion = 2;        // 2: type tags hold the kind of the type, not only its size
+
+struct file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t key_tag;           // mapped_codec<K>::tag
+    uint32_t mapped_tag;        // mapped_codec<M>::tag
+    uint32_t reserved;
+    uint64_t size;              // number of entries
+    uint64_t bucket_count;
+    uint64_t file_size;
+};
+
+struct entry_header {
+    uint64_t next;              // offset of the next entry in the bucket, 0 if last
+    uint64_t hash;              // full hash of the key, checked before comparing keys
+    uint32_t key_size;
+    uint32_t mapped_size;
+};
+
+inline uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~uint64_t{7};
+}
+
+}
+
+/*
+* Writes map to path in the mapped file format.
+*
+* Parameters:
+*      map          - the HashMap to save
+*      path         - file to create or overwrite
+*      bucket_count - buckets of the file's table; 0 means one bucket per element
+*      hash         - hash function; MappedHashMap must be opened with an equal one.
+*                     Defaults to map.hash_function().
+*
+* Exceptions: std::runtime_error if the file cannot be written.
+*
+* Usage:
+*      save_mapped(index, "index.hmap");
+*
+* Complexity: O(N + B). The file is streamed out section by section, so the extra
+* memory is O(N + B) offsets, not a copy of the file.
+*/
+template <typename K, typename M, typename H>
+void save_mapped(const HashMap<K, M, H>& map, const std::string& path, size_t bucket_count, const H& hash) {
+    using namespace mapped_detail;
+    using key_codec = mapped_codec<K>;
+    using mapped_codec_t = mapped_codec<M>;
+
+    if (bucket_count == 0) bucket_count = std::max<size_t>(map.size(), 1);
+
+    // group the elements by bucket (counting sort), so each chain is contiguous on disk
+    struct element {
+        const typename HashMap<K, M, H>::value_type* value;
+        uint64_t hash;
+        size_t bucket;
+    };
+    std::vector<element> elements;
+    elements.reserve(map.size());
+    std::vector<size_t> bucket_start(bucket_count + 1, 0);
+    for (const auto& value : map) {
+        uint64_t h = hash(value.first);
+        elements.push_back({&value, h, h % bucket_count});
+        ++bucket_start[h % bucket_count + 1];
+    }
+    for (size_t i = 0; i < bucket_count; ++i) bucket_start[i + 1] += bucket_start[i];
+    std::vector<const element*> sorted(elements.size());
+    std::vector<size_t> fill = bucket_start;
+    for (const auto& curr : elements) sorted[fill[curr.bucket]++] = &curr;
+
+    // lay out the file first, so that every offset is known before anything is written
+    uint64_t offset = align8(sizeof(file_header) + bucket_count * sizeof(uint64_t));
+    std::vector<uint64_t> offsets(sorted.size());
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        offsets[i] = offset;
+        const auto& [key, mapped] = *sorted[i]->value;
+        offset = align8(offset + sizeof(entry_header) + key_codec::size(key));
+        offset = align8(offset + mapped_codec_t::size(mapped));
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    stream_writer out(file);
+    uint64_t written = 0;
+    auto write = [&](const void* data, size_t size) {
+        out.write(data, size);
+        written += size;
+    };
+    auto pad_to = [&](uint64_t target) {
+        constexpr char zeros[8] = {};
+        write(zeros, target - written);
+    };
+
+    file_header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.key_tag = key_codec::tag;
+    header.mapped_tag = mapped_codec_t::tag;
+    header.size = map.size();
+    header.bucket_count = bucket_count;
+    header.file_size = offset;
+    write(&header, sizeof(header));
+
+    for (size_t b = 0; b < bucket_count; ++b) {
+        uint64_t first = bucket_start[b] == bucket_start[b + 1] ? 0 : offsets[bucket_start[b]];
+        write(&first, sizeof(first));
+    }
+
+    // each entry is built in a scratch buffer, reused from one entry to the next
+    std::vector<char> scratch;
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        const auto& [key, mapped] = *sorted[i]->value;
+        bool last_in_bucket = i + 1 == sorted.size() || sorted[i + 1]->bucket != sorted[i]->bucket;
+
+        entry_header entry{};
+        entry.next = last_in_bucket ? 0 : offsets[i + 1];
+        entry.hash = sorted[i]->hash;
+        entry.key_size = static_cast<uint32_t>(key_codec::size(key));
+        entry.mapped_size = static_cast<uint32_t>(mapped_codec_t::size(mapped));
+
+        size_t mapped_at = align8(sizeof(entry) + entry.key_size);
+        scratch.assign(mapped_at + entry.mapped_size, 0);
+        std::memcpy(scratch.data(), &entry, sizeof(entry));
+        key_codec::write(scratch.data() + sizeof(entry), key);
+        mapped_codec_t::write(scratch.data() + mapped_at, mapped);
+
+        pad_to(offsets[i]);
+        write(scratch.data(), scratch.size());
+    }
+    pad_to(offset);
+    out.flush();
+    if (!file) throw std::runtime_error("save_mapped: could not write " + path);
+}
+
+template <typename K, typename M, typename H>
+void save_mapped(const HashMap<K, M, H>& map, const std::string& path, size_t bucket_count = 0) {
+    save_mapped(map, path, bucket_count, map.hash_function());
+}
+
+/*
+* Read-only view of a file written by save_mapped.
+*
+* K = key type of the saved HashMap
+* M = mapped type of the saved HashMap
+* H = hash function type; must hash keys exactly like the one used to save the file
+*
+* Usage:
+*      MappedHashMap<std::string, int> index("index.hmap");
+*      if (index.contains("Avery")) std::cout << index.at("Avery");
+*
+* Notes: the object owns the mapping; views returned by at/find/iterators are valid
+* until it is destroyed. Moving is allowed, copying is not.
+*/
+template <typename K, typename M, typename H = std::hash<K>>
+class MappedHashMap {
+    using key_codec = mapped_codec<K>;
+    using mapped_codec_t = mapped_codec<M>;
+
+public:
+    using key_view = typename key_codec::view_type;
+    using mapped_view = typename mapped_codec_t::view_type;
+    using value_type = std::pair<key_view, mapped_view>;
+
+    class const_iterator;
+    using iterator = const_iterator;
+
+    /*
+    * Maps the file at path.
+    *
+    * Exceptions: std::runtime_error if the file cannot be opened or mapped, or is not
+    * a mapped HashMap file for these K and M.
+    *
+    * Complexity: O(1), no entry is read
+    */
+    explicit MappedHashMap(const std::string& path, const H& hash = H());
+
+    MappedHashMap(MappedHashMap&& other) noexcept;
+    MappedHashMap& operator=(MappedHashMap&& other) noexcept;
+    MappedHashMap(const MappedHashMap&) = delete;
+    MappedHashMap& operator=(const MappedHashMap&) = delete;
+    ~MappedHashMap();
+
+    size_t size() const noexcept { return header().size; }
+    bool empty() const noexcept { return size() == 0; }
+    size_t bucket_count() const noexcept { return header().bucket_count; }
+
+    /*
+    * Returns whether the file contains key.
+    *
+    * Complexity: O(1) average case
+    */
+    bool contains(const K& key) const { return find_offset(key) != 0; }
+
+    /*
+    * Returns a view of the mapped value of key.
+    *
+    * Exceptions: std::out_of_range if key is not in the file.
+    */
+    mapped_view at(const K& key) const;
+
+    /*
+    * Returns an iterator to the entry with the given key, or end().
+    */
+    const_iterator find(const K& key) const { return const_iterator(this, find_offset(key)); }
+
+    /*
+    * Iterates over all the entries, in file order.
+    */
+    const_iterator begin() const { return const_iterator(this, first_entry()); }
+    const_iterator end() const { return const_iterator(this, 0); }
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = MappedHashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using reference = value_type;
+
+        struct pointer {
+            value_type value;
+            const value_type* operator->() const { return &value; }
+        };
+
+        const_iterator() = default;
+        const_iterator(const MappedHashMap* map, uint64_t offset) : _map(map), _offset(offset) {}
+
+        reference operator*() const { return {_map->key_at(_offset), _map->mapped_at(_offset)}; }
+        pointer operator->() const { return pointer{**this}; }
+
+        const_iterator& operator++() {
+            _offset = _map->entry_after(_offset);
+            return *this;
+        }
+        const_iterator operator++(int) {
+            const_iterator copy(*this);
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const const_iterator& other) const { return _offset == other._offset; }
+        bool operator!=(const const_iterator& other) const { return _offset != other._offset; }
+
+    private:
+        const MappedHashMap* _map = nullptr;
+        uint64_t _offset = 0;
+    };
+
+private:
+    const mapped_detail::file_header& header() const {
+        return *reinterpret_cast<const mapped_detail::file_header*>(_data);
+    }
+    const mapped_detail::entry_header& entry(uint64_t offset) const {
+        return *reinterpret_cast<const mapped_detail::entry_header*>(_data + offset);
+    }
+    const uint64_t* buckets() const {
+        return reinterpret_cast<const uint64_t*>(_data + sizeof(mapped_detail::file_header));
+    }
+
+    key_view key_at(uint64_t offset) const {
+        return key_codec::view(_data + offset + sizeof(mapped_detail::entry_header), entry(offset).key_size);
+    }
+    mapped_view mapped_at(uint64_t offset) const {
+        uint64_t start = mapped_detail::align8(sizeof(mapped_detail::entry_header) + entry(offset).key_size);
+        return mapped_codec_t::view(_data + offset + start, entry(offset).mapped_size);
+    }
+
+    /*
+    * Returns the offset of the entry holding key, or 0.
+    */
+    uint64_t find_offset(const K& key) const;
+
+    /*
+    * Offset of the first entry, and of the entry laid out after offset, or 0 at the end.
+    */
+    uint64_t first_entry() const;
+    uint64_t entry_after(uint64_t offset) const;
+
+    void unmap() noexcept;
+
+    H _hash_function;
+    const char* _data = nullptr;
+    size_t _length = 0;
+};
+
+template <typename K, typename M, typename H>
+MappedHashMap<K, M, H>::MappedHashMap(const std::string& path, const H& hash) : _hash_function(hash) {
+    using namespace mapped_detail;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("MappedHashMap: could not open " + path);
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(file_header)) {
+        ::close(fd);
+        throw std::runtime_error("MappedHashMap: " + path + " is too small");
+    }
+    _length = static_cast<size_t>(st.st_size);
+    void* data = ::mmap(nullptr, _length, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);            // the mapping keeps the file alive
+    if (data == MAP_FAILED) throw std::runtime_error("MappedHashMap: could not map " + path);
+    _data = static_cast<const char*>(data);
+
+    const auto& h = header();
+    if (std::memcmp(h.magic, kMagic, sizeof(kMagic)) != 0 || h.version != kVersion ||
+        h.key_tag != key_codec::tag || h.mapped_tag != mapped_codec_t::tag ||
+        h.file_size != _length || h.bucket_count == 0 ||
+        sizeof(file_header) + h.bucket_count * sizeof(uint64_t) > _length) {
+        unmap();
+        throw std::runtime_error("MappedHashMap: " + path + " is not a compatible HashMap file");
+    }
+}
+
+template <typename K, typename M, typename H>
+MappedHashMap<K, M, H>::MappedHashMap(MappedHashMap&& other) noexcept :
+    _hash_function(std::move(other._hash_function)),
+    _data(std::exchange(other._data, nullptr)),
+    _length(std::exchange(other._length, 0)) { }
+
+template <typename K, typename M, typename H>
+MappedHashMap<K, M, H>& MappedHashMap<K, M, H>::operator=(MappedHashMap&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        _hash_function = std::move(other._hash_function);
+        _data = std::exchange(other._data, nullptr);
+        _length = std::exchange(other._length, 0);
+    }
+    return *this;
+}
+
+template <typename K, typename M, typename H>
+MappedHashMap<K, M, H>::~MappedHashMap() {
+    unmap();
+}
+
+template <typename K, typename M, typename H>
+void MappedHashMap<K, M, H>::unmap() noexcept {
+    if (_data != nullptr) ::munmap(const_cast<char*>(_data), _length);
+    _data = nullptr;
+    _length = 0;
+}
+
+template <typename K, typename M, typename H>
+typename MappedHashMap<K, M, H>::mapped_view MappedHashMap<K, M, H>::at(const K& key) const {
+    uint64_t offset = find_offset(key);
+    if (offset == 0) {
+        throw std::out_of_range("MappedHashMap<K, M, H>::at: key not found");
+    }
+    return mapped_at(offset);
+}
+
+template <typename K, typename M, typename H>
+uint64_t MappedHashMap<K, M, H>::find_offset(const K& key) const {
+    uint64_t h = _hash_function(key);
+    for (uint64_t curr = buckets()[h % bucket_count()]; curr != 0; curr = entry(curr).next) {
+        const auto& e = entry(curr);
+        if (e.hash == h && key_codec::equal(_data + curr + sizeof(mapped_detail::entry_header), e.key_size, key)) {
+            return curr;
+        }
+    }
+    return 0;
+}
+
+template <typename K, typename M, typename H>
+uint64_t MappedHashMap<K, M, H>::first_entry() const {
+    uint64_t offset = mapped_detail::align8(sizeof(mapped_detail::file_header) +
+                                            bucket_count() * sizeof(uint64_t));
+    return offset < _length ? offset : 0;
+}
+
+template <typename K, typename M, typename H>
+uint64_t MappedHashMap<K, M, H>::entry_after(uint64_t offset) const {
+    const auto& e = entry(offset);
+    uint64_t next = mapped_detail::align8(offset + sizeof(mapped_detail::entry_header) + e.key_size);
+    next = mapped_detail::align8(next + e.mapped_size);
+    return next < _length ? next : 0;
+}
+
+#endif // MAPPED_HASHMAP_H
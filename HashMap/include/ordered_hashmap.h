@@ -0,0 +1,425 @@
+/*
+* OrderedHashMap: a HashMap variant that keeps its elements in insertion order.
+*
+*      The K/M pairs live in one contiguous vector (_entries), in the order they were
+*      inserted. The bucket array only stores indices into that vector, and each entry
+*      stores the index of the next entry in its chain, so lookups work just like in
+*      HashMap but iteration is a linear scan of _entries. This makes iterating a
+*      large map cache friendly, and makes the order of iteration (and of operator<<)
+*      deterministic.
+*
+*      Erasing leaves a hole in _entries, which is reclaimed once the holes outnumber
+*      the elements. Like HashMap, the map does not rehash automatically.
+*/
+
+#ifndef ORDERED_HASHMAP_H
+#define ORDERED_HASHMAP_H
+
+#include <iostream>             // for ostream
+#include <iterator>             // for forward_iterator_tag
+#include <optional>             // for optional
+#include <stdexcept>            // for out_of_range
+#include <tuple>                // for forward_as_tuple
+#include <utility>              // for forward, piecewise_construct
+#include <vector>               // for vector
+
+/*
+* Template class for an insertion-ordered HashMap
+*
+* K = key type
+* M = mapped type
+* H = hash function type used to hash a key; if not provided, defaults to std::hash<K>
+*
+* Concept requirements: same as HashMap.
+*
+* Example:
+*      OrderedHashMap<std::string, int> map;
+*      map.insert({"B", 2});
+*      map.insert({"A", 1});
+*      std::cout << map;       // always prints {B:2, A:1}
+*/
+template <typename K, typename M, typename H = std::hash<K>>
+class OrderedHashMap {
+
+    template <bool Const>
+    class basic_iterator;
+
+public:
+    using value_type = std::pair<const K, M>;
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    /*
+    * Creates an empty map with bucket_count buckets and the given hash function.
+    *
+    * Usage:
+    *      OrderedHashMap<int, int> map;
+    *      OrderedHashMap<int, int> map(1000);
+    *
+    * Complexity: O(B), B = number of buckets
+    */
+    explicit OrderedHashMap(size_t bucket_count = kDefaultBuckets, const H& hash = H());
+
+    /*
+    * Creates a map from the given pairs, in order. Later duplicates are ignored.
+    *
+    * Usage:
+    *      OrderedHashMap<std::string, int> map{{"A", 1}, {"B", 2}};
+    */
+    OrderedHashMap(std::initializer_list<std::pair<K, M>> list);
+
+    /*
+    * Returns the number of (K, M) pairs, whether the map is empty, the number of
+    * buckets and size/bucket_count, respectively.
+    *
+    * Complexity: O(1)
+    */
+    size_t size() const noexcept { return _size; }
+    bool empty() const noexcept { return _size == 0; }
+    size_t bucket_count() const noexcept { return _buckets_array.size(); }
+    float load_factor() const noexcept { return static_cast<float>(_size) / bucket_count(); }
+
+    /*
+    * Returns whether or not the map contains the given key.
+    *
+    * Complexity: O(1) amortized average case, O(N) worst case, N = number of elements
+    */
+    bool contains(const K& key) const;
+
+    /*
+    * Inserts the K/M pair at the end of the iteration order, if the key does not
+    * already exist. If the key exists, then the operation is a no-op.
+    *
+    * Return value: pair<iterator, bool>, where the iterator points at the element
+    * with the given key and the bool is true if the element was added.
+    *
+    * Complexity: O(1) amortized average case
+    */
+    std::pair<iterator, bool> insert(const value_type& value);
+
+    /*
+    * Erases the K/M pair with the given key, if one exists. The relative order of
+    * the remaining elements does not change.
+    *
+    * Return value: true if an element was removed.
+    *
+    * Complexity: O(1) amortized average case
+    *
+    * Notes: iterators are invalidated when the erase triggers a compaction of _entries.
+    */
+    bool erase(const K& key);
+
+    /*
+    * Removes all elements. The number of buckets stays the same.
+    *
+    * Complexity: O(N + B)
+    */
+    void clear() noexcept;
+
+    /*
+    * Returns a reference to the mapped value of key.
+    *
+    * Exceptions: std::out_of_range if key is not in the map.
+    */
+    M& at(const K& key);
+    const M& at(const K& key) const;
+
+    /*
+    * Returns a reference to the mapped value of key, inserting {key, M()} at the
+    * end of the iteration order if key is not in the map.
+    */
+    M& operator[](const K& key);
+
+    /*
+    * Returns an iterator to the element with the given key, or end().
+    */
+    iterator find(const K& key);
+    const_iterator find(const K& key) const;
+
+    /*
+    * Resizes the bucket array and relinks every chain. Does not change the iteration
+    * order, and does not move any element.
+    *
+    * Exceptions: std::out_of_range if new_bucket_count = 0.
+    *
+    * Complexity: O(N + B)
+    */
+    void rehash(size_t new_bucket_count);
+
+    /*
+    * Iterators visit the elements in insertion order.
+    */
+    iterator begin() { return iterator(&_entries, 0); }
+    iterator end() { return iterator(&_entries, _entries.size()); }
+    const_iterator begin() const { return const_iterator(&_entries, 0); }
+    const_iterator end() const { return const_iterator(&_entries, _entries.size()); }
+
+private:
+    /*
+    * Index stored in a bucket (or in entry::next) that does not refer to any entry.
+    */
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    static const size_t kDefaultBuckets = 10;
+
+    /*
+    * An element of _entries. value is empty if the element was erased; next is the
+    * index of the next entry in the same bucket, or npos.
+    */
+    struct entry {
+        std::optional<value_type> value;
+        size_t next;
+    };
+
+    /*
+    * Returns {index of the entry before the one holding key, index of the entry
+    * holding key}, using npos where there is no such entry. Mirrors HashMap::find_node.
+    */
+    std::pair<size_t, size_t> find_index(const K& key) const;
+
+    /*
+    * Appends an entry whose value is constructed from args, and links it into the
+    * bucket of key, which must not be in the map yet. Returns the index of the entry.
+    * Mirrors HashMap::link_node.
+    */
+    template <typename... Args>
+    size_t append(const K& key, Args&&... args);
+
+    /*
+    * Drops the erased entries from _entries and relinks the buckets.
+    */
+    void compact();
+
+    /*
+    * Rebuilds every chain of the bucket array from _entries.
+    */
+    void relink();
+
+    size_t bucket_of(const K& key) const { return _hash_function(key) % bucket_count(); }
+
+    size_t _size;
+    H _hash_function;
+    std::vector<entry> _entries;
+    std::vector<size_t> _buckets_array;
+
+    /*
+    * Forward iterator over the live entries of _entries.
+    */
+    template <bool Const>
+    class basic_iterator {
+        using entries_type = std::conditional_t<Const, const std::vector<entry>, std::vector<entry>>;
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = OrderedHashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+        using reference = std::conditional_t<Const, const value_type&, value_type&>;
+
+        basic_iterator() = default;
+        basic_iterator(entries_type* entries, size_t index) : _entries(entries), _index(index) {
+            skip_erased();
+        }
+
+        // an iterator converts to a const_iterator, but not the other way around
+        template <bool OtherConst, typename = std::enable_if_t<Const && !OtherConst>>
+        basic_iterator(const basic_iterator<OtherConst>& other) :
+            _entries(other._entries), _index(other._index) {}
+
+        reference operator*() const { return *(*_entries)[_index].value; }
+        pointer operator->() const { return &*(*_entries)[_index].value; }
+
+        basic_iterator& operator++() {
+            ++_index;
+            skip_erased();
+            return *this;
+        }
+        basic_iterator operator++(int) {
+            basic_iterator copy(*this);
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const basic_iterator& other) const { return _index == other._index; }
+        bool operator!=(const basic_iterator& other) const { return _index != other._index; }
+
+    private:
+        friend class OrderedHashMap;
+        template <bool> friend class basic_iterator;
+
+        void skip_erased() {
+            while (_index < _entries->size() && !(*_entries)[_index].value) ++_index;
+        }
+
+        entries_type* _entries = nullptr;
+        size_t _index = 0;
+    };
+};
+
+template <typename K, typename M, typename H>
+OrderedHashMap<K, M, H>::OrderedHashMap(size_t bucket_count, const H& hash) :
+    _size(0),
+    _hash_function(hash),
+    _buckets_array(bucket_count, npos) { }
+
+template <typename K, typename M, typename H>
+OrderedHashMap<K, M, H>::OrderedHashMap(std::initializer_list<std::pair<K, M>> list) :
+    OrderedHashMap() {
+    for (const auto& [key, mapped] : list) {
+        insert({key, mapped});
+    }
+}
+
+template <typename K, typename M, typename H>
+std::pair<size_t, size_t> OrderedHashMap<K, M, H>::find_index(const K& key) const {
+    size_t prev = npos;
+    for (size_t curr = _buckets_array[bucket_of(key)]; curr != npos; curr = _entries[curr].next) {
+        if (_entries[curr].value->first == key) return {prev, curr};
+        prev = curr;
+    }
+    return {npos, npos};
+}
+
+template <typename K, typename M, typename H>
+bool OrderedHashMap<K, M, H>::contains(const K& key) const {
+    return find_index(key).second != npos;
+}
+
+template <typename K, typename M, typename H>
+std::pair<typename OrderedHashMap<K, M, H>::iterator, bool>
+OrderedHashMap<K, M, H>::insert(const value_type& value) {
+    auto [prev, found] = find_index(value.first);
+    if (found != npos) return {iterator(&_entries, found), false};
+    return {iterator(&_entries, append(value.first, value)), true};
+}
+
+template <typename K, typename M, typename H>
+template <typename... Args>
+size_t OrderedHashMap<K, M, H>::append(const K& key, Args&&... args) {
+    size_t index = bucket_of(key);
+    entry& added = _entries.emplace_back(entry{std::nullopt, _buckets_array[index]});
+    try {
+        added.value.emplace(std::forward<Args>(args)...);
+    } catch (...) {
+        _entries.pop_back();
+        throw;
+    }
+    _buckets_array[index] = _entries.size() - 1;
+    ++_size;
+    return _entries.size() - 1;
+}
+
+template <typename K, typename M, typename H>
+bool OrderedHashMap<K, M, H>::erase(const K& key) {
+    auto [prev, found] = find_index(key);
+    if (found == npos) return false;
+
+    (prev != npos ? _entries[prev].next : _buckets_array[bucket_of(key)]) = _entries[found].next;
+    _entries[found].value.reset();
+    --_size;
+
+    // reclaim the holes once they outnumber the elements
+    if (_entries.size() > 2 * _size + kDefaultBuckets) compact();
+    return true;
+}
+
+template <typename K, typename M, typename H>
+void OrderedHashMap<K, M, H>::clear() noexcept {
+    _entries.clear();
+    std::fill(_buckets_array.begin(), _buckets_array.end(), npos);
+    _size = 0;
+}
+
+template <typename K, typename M, typename H>
+M& OrderedHashMap<K, M, H>::at(const K& key) {
+    return const_cast<M&>(static_cast<const OrderedHashMap*>(this)->at(key));
+}
+
+template <typename K, typename M, typename H>
+const M& OrderedHashMap<K, M, H>::at(const K& key) const {
+    size_t found = find_index(key).second;
+    if (found == npos) {
+        throw std::out_of_range("OrderedHashMap<K, M, H>::at: key not found");
+    }
+    return _entries[found].value->second;
+}
+
+template <typename K, typename M, typename H>
+M& OrderedHashMap<K, M, H>::operator[](const K& key) {
+    size_t found = find_index(key).second;
+    if (found == npos) {
+        found = append(key, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple());
+    }
+    return _entries[found].value->second;
+}
+
+template <typename K, typename M, typename H>
+typename OrderedHashMap<K, M, H>::iterator OrderedHashMap<K, M, H>::find(const K& key) {
+    size_t found = find_index(key).second;
+    return found == npos ? end() : iterator(&_entries, found);
+}
+
+template <typename K, typename M, typename H>
+typename OrderedHashMap<K, M, H>::const_iterator OrderedHashMap<K, M, H>::find(const K& key) const {
+    size_t found = find_index(key).second;
+    return found == npos ? end() : const_iterator(&_entries, found);
+}
+
+template <typename K, typename M, typename H>
+void OrderedHashMap<K, M, H>::rehash(size_t new_bucket_count) {
+    if (new_bucket_count == 0) {
+        throw std::out_of_range("OrderedHashMap<K, M, H>::rehash: new_bucket_count must be positive.");
+    }
+    _buckets_array.assign(new_bucket_count, npos);
+    relink();
+}
+
+template <typename K, typename M, typename H>
+void OrderedHashMap<K, M, H>::compact() {
+    std::vector<entry> live;
+    live.reserve(_size);
+    for (auto& curr : _entries) {
+        if (curr.value) live.push_back(entry{std::move(curr.value), npos});
+    }
+    _entries = std::move(live);
+    std::fill(_buckets_array.begin(), _buckets_array.end(), npos);
+    relink();
+}
+
+template <typename K, typename M, typename H>
+void OrderedHashMap<K, M, H>::relink() {
+    // walk backwards so that each chain lists its entries in insertion order
+    for (size_t i = _entries.size(); i-- > 0; ) {
+        if (!_entries[i].value) continue;
+        size_t index = bucket_of(_entries[i].value->first);
+        _entries[i].next = _buckets_array[index];
+        _buckets_array[index] = i;
+    }
+}
+
+template <typename K, typename M, typename H>
+std::ostream& operator<<(std::ostream& os, const OrderedHashMap<K, M, H>& map) {
+    os << "{";
+    std::string separator = "";
+    for (const auto& [key, mapped] : map) {
+        os << separator << key << ":" << mapped;
+        separator = ", ";
+    }
+    return os << "}";
+}
+
+template <typename K, typename M, typename H>
+bool operator==(const OrderedHashMap<K, M, H>& lhs, const OrderedHashMap<K, M, H>& rhs) {
+    if (lhs.size() != rhs.size()) return false;
+    for (const auto& [key, mapped] : lhs) {
+        auto found = rhs.find(key);
+        if (found == rhs.end() || found->second != mapped) return false;
+    }
+    return true;
+}
+
+template <typename K, typename M, typename H>
+bool operator!=(const OrderedHashMap<K, M, H>& lhs, const OrderedHashMap<K, M, H>& rhs) {
+    return !(lhs == rhs);
+}
+
+#endif // ORDERED_HASHMAP_H
@@ -0,0 +1,598 @@
+/*
+* PackedHashMap: a map between integers that stores most entries in a few bytes.
+*
+*      HashMap<int64_t, int64_t> spends about 40 bytes on a 16 byte entry, and even
+*      FlatHashMap spends 22 to 36. When the keys and values are mostly small numbers
+*      (IDs, counts, offsets), most of those bytes are zeros. PackedHashMap<K, M>
+*      stores the entries in blocks of 16 to 32, and compresses each block with
+*      frame-of-reference encoding: a block stores the smallest key and the smallest
+*      value once, and every entry as the differences from them, in 0, 1, 2, 4 or 8
+*      bytes (the fewest bytes that hold the largest difference in the block).
+*
+*      The keys of a block are made small too. The low bits of a key choose its block
+*      (after they are mixed with a hash of the high bits, so that keys with a common
+*      pattern in their low bits still spread out), and the block stores only the high
+*      bits, the quotient. A map of 2^b blocks only needs the key's top 64 - b bits
+*      to tell its keys apart, and for keys that are mostly small those are mostly zero.
+*      The key is rebuilt from the quotient and the block index.
+*
+*      A lookup finds the block, then compares the wanted quotient with every stored
+*      one. The stored quotients are an array of equal-width integers, compared in a
+*      plain loop; when the compiler targets AVX2 (-mavx2; the default build does not,
+*      configure with -DHASHMAP_AVX2=ON) 32 bytes are compared per instruction instead.
+*      Nothing has to be decoded before the match is found.
+*
+*      A map of 64-bit IDs to small values takes about 11 bytes per entry when the
+*      keys are spread over 8000 times as many numbers as there are keys, and about 5
+*      when they are dense; run HashMapMemoryBench for the numbers.
+*/
+
+#ifndef PACKED_HASHMAP_H
+#define PACKED_HASHMAP_H
+
+#include <algorithm>            // for max, min, min_element, max_element
+#include <bit>                  // for bit_ceil, countr_zero
+#include <cstdint>              // for uint8_t, uint16_t, uint32_t, uint64_t
+#include <cstring>              // for memcpy
+#include <iterator>             // for input_iterator_tag, forward_iterator_tag
+#include <memory>               // for unique_ptr
+#include <stdexcept>            // for out_of_range
+#include <type_traits>          // for is_integral_v, is_signed_v
+#include <utility>              // for pair
+#include <vector>               // for vector
+#include "hashmap_memory.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace packed_hashmap_detail {
+
+/*
+* Integers as 64-bit patterns that are small when the integer is close to zero:
+* signed integers are zigzag encoded (0, -1, 1, -2, ... become 0, 1, 2, 3, ...).
+*/
+template <typename T>
+uint64_t to_bits(T value) noexcept {
+    if constexpr (std::is_signed_v<T>) {
+        auto wide = static_cast<int64_t>(value);
+        return (static_cast<uint64_t>(wide) << 1) ^ static_cast<uint64_t>(wide >> 63);
+    } else {
+        return static_cast<uint64_t>(value);
+    }
+}
+
+template <typename T>
+T from_bits(uint64_t bits) noexcept {
+    if constexpr (std::is_signed_v<T>) {
+        return static_cast<T>(static_cast<int64_t>((bits >> 1) ^ (~(bits & 1) + 1)));
+    } else {
+        return static_cast<T>(bits);
+    }
+}
+
+/*
+* The fewest bytes (0, 1, 2, 4 or 8) that hold range.
+*/
+inline uint8_t width_for(uint64_t range) noexcept {
+    if (range == 0) return 0;
+    if (range <= UINT8_MAX) return 1;
+    if (range <= UINT16_MAX) return 2;
+    if (range <= UINT32_MAX) return 4;
+    return 8;
+}
+
+inline uint64_t max_for(uint8_t width) noexcept {
+    return width == 8 ? UINT64_MAX : (uint64_t{1} << (8 * width)) - 1;
+}
+
+// A width of 0 stores nothing and may come with bytes == nullptr, which memcpy must not
+// be given even for a zero size, so load and store return before calling it.
+inline uint64_t load(const uint8_t* bytes, uint8_t width) noexcept {
+    uint64_t value = 0;             // little-endian, like every target the tests run on
+    if (width == 0) return value;
+    std::memcpy(&value, bytes, width);
+    return value;
+}
+
+inline void store(uint8_t* bytes, uint8_t width, uint64_t value) noexcept {
+    if (width == 0) return;
+    std::memcpy(bytes, &value, width);
+}
+
+/*
+* Returns the index of target among the count integers of W bytes at bytes, or count.
+*/
+template <size_t W, typename U>
+size_t find(const uint8_t* bytes, size_t count, uint64_t target) noexcept {
+    size_t i = 0;
+#if defined(__AVX2__)
+    constexpr size_t kLanes = 32 / W;
+    __m256i wanted;
+    if constexpr (W == 1) wanted = _mm256_set1_epi8(static_cast<char>(target));
+    if constexpr (W == 2) wanted = _mm256_set1_epi16(static_cast<short>(target));
+    if constexpr (W == 4) wanted = _mm256_set1_epi32(static_cast<int>(target));
+    if constexpr (W == 8) wanted = _mm256_set1_epi64x(static_cast<long long>(target));
+    for (; i + kLanes <= count; i += kLanes) {
+        __m256i stored = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes + i * W));
+        __m256i equal;
+        if constexpr (W == 1) equal = _mm256_cmpeq_epi8(stored, wanted);
+        if constexpr (W == 2) equal = _mm256_cmpeq_epi16(stored, wanted);
+        if constexpr (W == 4) equal = _mm256_cmpeq_epi32(stored, wanted);
+        if constexpr (W == 8) equal = _mm256_cmpeq_epi64(stored, wanted);
+        // one mask bit per byte, so a matching lane sets W bits
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(equal));
+        if (mask != 0) return i + std::countr_zero(mask) / W;
+    }
+#endif
+    for (; i < count; ++i) {
+        U stored;
+        std::memcpy(&stored, bytes + i * W, W);
+        if (stored == static_cast<U>(target)) return i;
+    }
+    return count;
+}
+
+} // namespace packed_hashmap_detail
+
+/*
+* Template class for a compressed map from integers to integers
+*
+* K = key type, M = mapped type; both integral, at most 64 bits
+*
+* Example:
+*      PackedHashMap<int64_t, int64_t> parent;
+*      parent.insert({42, 7});
+*      if (parent.contains(42)) { int64_t p = parent.at(42); ... }
+*
+* Notes:
+*      - The entries are not stored as objects, so nothing returns a reference to
+*        them: at returns a copy, insert returns the mapped value rather than an
+*        iterator, and insert_or_assign replaces operator[] for updates.
+*      - The keys are spread over the blocks by a fixed mixing function, so there
+*        is no hash function parameter.
+*      - Iterators visit the entries as std::pair<K, M> values, in no particular
+*        order, and are invalidated by insert, insert_or_assign, erase and clear.
+*/
+template <typename K, typename M>
+class PackedHashMap {
+    static_assert(std::is_integral_v<K> && sizeof(K) <= sizeof(uint64_t), "PackedHashMap keys are integers");
+    static_assert(std::is_integral_v<M> && sizeof(M) <= sizeof(uint64_t), "PackedHashMap values are integers");
+
+public:
+    using key_type = K;
+    using mapped_type = M;
+    using value_type = std::pair<K, M>;
+    class const_iterator;
+    using iterator = const_iterator;
+
+    /*
+    * Creates an empty map sized for expected_size elements (the blocks are doubled
+    * as needed anyway).
+    *
+    * Complexity: O(expected_size / 32)
+    */
+    explicit PackedHashMap(size_t expected_size = 0);
+
+    PackedHashMap(const PackedHashMap& other);
+    PackedHashMap(PackedHashMap&& other) noexcept = default;
+    PackedHashMap& operator=(const PackedHashMap& other);
+    PackedHashMap& operator=(PackedHashMap&& other) noexcept = default;
+
+    size_t size() const noexcept { return _size; }
+    bool empty() const noexcept { return _size == 0; }
+
+    /*
+    * The number of blocks, each of which holds 16 to 32 elements on average.
+    */
+    size_t bucket_count() const noexcept { return _blocks.size(); }
+    float load_factor() const noexcept { return static_cast<float>(_size) / bucket_count(); }
+
+    /*
+    * Returns whether or not the map contains the given key.
+    *
+    * Complexity: O(1) average case, a scan of one block
+    */
+    bool contains(const K& key) const noexcept;
+
+    /*
+    * Returns the mapped value of key.
+    *
+    * Exceptions: std::out_of_range if key is not in the map.
+    */
+    M at(const K& key) const;
+
+    /*
+    * Inserts the key/mapped pair if the key does not already exist; otherwise a no-op.
+    *
+    * Return value: pair<M, bool> - the value now mapped to the key, and whether the
+    * element was added.
+    *
+    * Complexity: O(1) amortized average case. A value that does not fit the widths
+    * of its block re-encodes the block.
+    */
+    std::pair<M, bool> insert(const value_type& value);
+
+    /*
+    * Maps key to mapped, adding the key if needed.
+    *
+    * Return value: true if the element was added, false if it was assigned.
+    */
+    bool insert_or_assign(const K& key, const M& mapped);
+
+    /*
+    * Erases the element with the given key, if one exists.
+    *
+    * Return value: true if an element was removed.
+    */
+    bool erase(const K& key);
+
+    /*
+    * Removes all elements and frees their blocks' storage. The number of blocks
+    * stays the same.
+    */
+    void clear() noexcept;
+
+    /*
+    * Heap used by the map: bucket_bytes is the block headers, node_bytes the
+    * encoded entries.
+    *
+    * Complexity: O(B), B = number of blocks
+    */
+    HashMapMemoryUsage memory_usage() const;
+
+    const_iterator begin() const noexcept { return const_iterator(this, 0, 0).skip_empty(); }
+    const_iterator end() const noexcept { return const_iterator(this, _blocks.size(), 0); }
+
+private:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // blocks double when they hold more than this many elements on average
+    static constexpr size_t kMaxAverageBlockSize = 32;
+
+    /*
+    * A block: capacity entries' worth of storage, the quotients of the keys first
+    * (key_width bytes each), then the values (value_width bytes each).
+    */
+    struct block {
+        std::unique_ptr<uint8_t[]> data;
+        uint64_t key_base = 0;
+        uint64_t value_base = 0;
+        uint32_t count = 0;
+        uint32_t capacity = 0;
+        uint8_t key_width = 0;
+        uint8_t value_width = 0;
+
+        const uint8_t* keys() const noexcept { return data.get(); }
+        const uint8_t* values() const noexcept { return data.get() + size_t{capacity} * key_width; }
+        uint8_t* keys() noexcept { return data.get(); }
+        uint8_t* values() noexcept { return data.get() + size_t{capacity} * key_width; }
+
+        uint64_t quotient(size_t i) const noexcept {
+            return key_base + packed_hashmap_detail::load(keys() + i * key_width, key_width);
+        }
+        uint64_t value(size_t i) const noexcept {
+            return value_base + packed_hashmap_detail::load(values() + i * value_width, value_width);
+        }
+    };
+
+    struct location {
+        size_t block;
+        uint64_t quotient;
+    };
+
+    static uint64_t mix(uint64_t h) noexcept {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    uint64_t mask() const noexcept { return _blocks.size() - 1; }
+
+    /*
+    * The block and quotient of a key, and back. The low _shift bits of the key are
+    * xored with bits of a hash of the quotient, which can be undone given the quotient.
+    */
+    location locate(uint64_t bits) const noexcept {
+        uint64_t quotient = bits >> _shift;
+        return {static_cast<size_t>((bits ^ mix(quotient)) & mask()), quotient};
+    }
+    uint64_t key_bits(size_t block, uint64_t quotient) const noexcept {
+        return (quotient << _shift) | ((block ^ mix(quotient)) & mask());
+    }
+
+    /*
+    * Returns the index of quotient in b, or npos.
+    */
+    static size_t find_in(const block& b, uint64_t quotient) noexcept;
+
+    /*
+    * Sets entry i of b (appending it when i == b.count), re-encoding b when the entry
+    * does not fit its widths or capacity.
+    */
+    static void put(block& b, size_t i, uint64_t quotient, uint64_t value);
+
+    /*
+    * Rewrites b with the smallest bases and widths that hold its entries, after
+    * setting entry i as put does, and room for capacity entries.
+    */
+    static void encode(block& b, size_t i, uint64_t quotient, uint64_t value, size_t capacity);
+
+    /*
+    * Doubles the number of blocks, moving the entries one old block at a time.
+    */
+    void grow();
+
+    std::vector<block> _blocks;
+    unsigned _shift = 0;            // log2 of the number of blocks
+    size_t _size = 0;
+
+public:
+    /*
+    * Forward iterator over the elements; dereferences to a std::pair<K, M> value.
+    */
+    class const_iterator {
+    public:
+        using iterator_concept = std::forward_iterator_tag;
+        using iterator_category = std::input_iterator_tag;
+        using value_type = PackedHashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using reference = value_type;
+
+        struct pointer {
+            value_type value;
+            const value_type* operator->() const { return &value; }
+        };
+
+        const_iterator() = default;
+
+        reference operator*() const {
+            const block& b = _map->_blocks[_block];
+            return {packed_hashmap_detail::from_bits<K>(_map->key_bits(_block, b.quotient(_entry))),
+                    packed_hashmap_detail::from_bits<M>(b.value(_entry))};
+        }
+        pointer operator->() const { return pointer{**this}; }
+
+        const_iterator& operator++() {
+            ++_entry;
+            return skip_empty();
+        }
+        const_iterator operator++(int) {
+            const_iterator copy(*this);
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return _block == other._block && _entry == other._entry;
+        }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        friend class PackedHashMap;
+
+        const_iterator(const PackedHashMap* map, size_t block, size_t entry) :
+            _map(map), _block(block), _entry(entry) {}
+
+        // moves on to the next block while the current one is exhausted
+        const_iterator& skip_empty() noexcept {
+            while (_block < _map->_blocks.size() && _entry >= _map->_blocks[_block].count) {
+                ++_block;
+                _entry = 0;
+            }
+            return *this;
+        }
+
+        const PackedHashMap* _map = nullptr;
+        size_t _block = 0;
+        size_t _entry = 0;
+    };
+};
+
+template <typename K, typename M>
+PackedHashMap<K, M>::PackedHashMap(size_t expected_size) {
+    size_t blocks = std::bit_ceil(std::max<size_t>(1, expected_size / kMaxAverageBlockSize));
+    _blocks.resize(blocks);
+    _shift = static_cast<unsigned>(std::countr_zero(blocks));
+}
+
+template <typename K, typename M>
+PackedHashMap<K, M>::PackedHashMap(const PackedHashMap& other) :
+    _blocks(other._blocks.size()), _shift(other._shift), _size(other._size) {
+    for (size_t i = 0; i < _blocks.size(); ++i) {
+        const block& from = other._blocks[i];
+        block& to = _blocks[i];
+        size_t bytes = size_t{from.capacity} * (from.key_width + from.value_width);
+        if (bytes > 0) {
+            to.data.reset(new uint8_t[bytes]);
+            std::memcpy(to.data.get(), from.data.get(), bytes);
+        }
+        to.key_base = from.key_base;
+        to.value_base = from.value_base;
+        to.count = from.count;
+        to.capacity = from.capacity;
+        to.key_width = from.key_width;
+        to.value_width = from.value_width;
+    }
+}
+
+template <typename K, typename M>
+PackedHashMap<K, M>& PackedHashMap<K, M>::operator=(const PackedHashMap& other) {
+    if (this != &other) {
+        PackedHashMap copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+template <typename K, typename M>
+size_t PackedHashMap<K, M>::find_in(const block& b, uint64_t quotient) noexcept {
+    using namespace packed_hashmap_detail;
+    if (quotient < b.key_base || quotient - b.key_base > max_for(b.key_width)) return npos;
+    uint64_t target = quotient - b.key_base;
+    size_t index;
+    switch (b.key_width) {
+    case 0: index = 0; break;       // only a block of one entry has width 0
+    case 1: index = find<1, uint8_t>(b.keys(), b.count, target); break;
+    case 2: index = find<2, uint16_t>(b.keys(), b.count, target); break;
+    case 4: index = find<4, uint32_t>(b.keys(), b.count, target); break;
+    default: index = find<8, uint64_t>(b.keys(), b.count, target); break;
+    }
+    return index < b.count ? index : npos;
+}
+
+template <typename K, typename M>
+void PackedHashMap<K, M>::put(block& b, size_t i, uint64_t quotient, uint64_t value) {
+    using namespace packed_hashmap_detail;
+    bool fits = i < b.capacity
+            && quotient >= b.key_base && quotient - b.key_base <= max_for(b.key_width)
+            && value >= b.value_base && value - b.value_base <= max_for(b.value_width);
+    if (!fits) {
+        // grow by a quarter: the blocks are small, and the slack is most of the waste
+        size_t needed = std::max<size_t>(b.count, i + 1);
+        encode(b, i, quotient, value, std::max<size_t>(b.capacity, needed + needed / 4));
+        return;
+    }
+    store(b.keys() + i * b.key_width, b.key_width, quotient - b.key_base);
+    store(b.values() + i * b.value_width, b.value_width, value - b.value_base);
+    if (i == b.count) ++b.count;
+}
+
+template <typename K, typename M>
+void PackedHashMap<K, M>::encode(block& b, size_t i, uint64_t quotient, uint64_t value, size_t capacity) {
+    using namespace packed_hashmap_detail;
+    size_t count = std::max<size_t>(b.count, i + 1);
+    std::vector<uint64_t> quotients(count), values(count);
+    for (size_t j = 0; j < b.count; ++j) {
+        quotients[j] = b.quotient(j);
+        values[j] = b.value(j);
+    }
+    quotients[i] = quotient;
+    values[i] = value;
+
+    block encoded;
+    encoded.key_base = *std::min_element(quotients.begin(), quotients.end());
+    encoded.value_base = *std::min_element(values.begin(), values.end());
+    encoded.key_width = width_for(*std::max_element(quotients.begin(), quotients.end()) - encoded.key_base);
+    encoded.value_width = width_for(*std::max_element(values.begin(), values.end()) - encoded.value_base);
+    encoded.count = static_cast<uint32_t>(count);
+    encoded.capacity = static_cast<uint32_t>(capacity);
+    size_t bytes = capacity * (encoded.key_width + encoded.value_width);
+    if (bytes > 0) encoded.data.reset(new uint8_t[bytes]);
+    for (size_t j = 0; j < count; ++j) {
+        store(encoded.keys() + j * encoded.key_width, encoded.key_width, quotients[j] - encoded.key_base);
+        store(encoded.values() + j * encoded.value_width, encoded.value_width, values[j] - encoded.value_base);
+    }
+    b = std::move(encoded);
+}
+
+template <typename K, typename M>
+bool PackedHashMap<K, M>::contains(const K& key) const noexcept {
+    auto [index, quotient] = locate(packed_hashmap_detail::to_bits(key));
+    return find_in(_blocks[index], quotient) != npos;
+}
+
+template <typename K, typename M>
+M PackedHashMap<K, M>::at(const K& key) const {
+    auto [index, quotient] = locate(packed_hashmap_detail::to_bits(key));
+    const block& b = _blocks[index];
+    size_t found = find_in(b, quotient);
+    if (found == npos) {
+        throw std::out_of_range("PackedHashMap<K, M>::at: key not found");
+    }
+    return packed_hashmap_detail::from_bits<M>(b.value(found));
+}
+
+template <typename K, typename M>
+std::pair<M, bool> PackedHashMap<K, M>::insert(const value_type& value) {
+    const auto& [key, mapped] = value;
+    uint64_t bits = packed_hashmap_detail::to_bits(key);
+    location where = locate(bits);
+    size_t found = find_in(_blocks[where.block], where.quotient);
+    if (found != npos) return {packed_hashmap_detail::from_bits<M>(_blocks[where.block].value(found)), false};
+
+    if (_size + 1 > _blocks.size() * kMaxAverageBlockSize) {
+        grow();
+        where = locate(bits);
+    }
+    block& b = _blocks[where.block];
+    put(b, b.count, where.quotient, packed_hashmap_detail::to_bits(mapped));
+    ++_size;
+    return {mapped, true};
+}
+
+template <typename K, typename M>
+bool PackedHashMap<K, M>::insert_or_assign(const K& key, const M& mapped) {
+    auto [index, quotient] = locate(packed_hashmap_detail::to_bits(key));
+    block& b = _blocks[index];
+    size_t found = find_in(b, quotient);
+    if (found == npos) return insert({key, mapped}).second;
+    put(b, found, quotient, packed_hashmap_detail::to_bits(mapped));
+    return false;
+}
+
+template <typename K, typename M>
+bool PackedHashMap<K, M>::erase(const K& key) {
+    auto [index, quotient] = locate(packed_hashmap_detail::to_bits(key));
+    block& b = _blocks[index];
+    size_t found = find_in(b, quotient);
+    if (found == npos) return false;
+
+    // move the last entry into the hole; the widths still fit it
+    size_t last = b.count - 1;
+    if (found != last) {
+        using packed_hashmap_detail::load, packed_hashmap_detail::store;
+        store(b.keys() + found * b.key_width, b.key_width, load(b.keys() + last * b.key_width, b.key_width));
+        store(b.values() + found * b.value_width, b.value_width, load(b.values() + last * b.value_width, b.value_width));
+    }
+    if (--b.count == 0) b = block();
+    --_size;
+    return true;
+}
+
+template <typename K, typename M>
+void PackedHashMap<K, M>::clear() noexcept {
+    for (auto& b : _blocks) b = block();
+    _size = 0;
+}
+
+template <typename K, typename M>
+void PackedHashMap<K, M>::grow() {
+    std::vector<block> old(_blocks.size() * 2);
+    old.swap(_blocks);
+    unsigned old_shift = _shift++;
+    uint64_t old_mask = old.size() - 1;
+    for (size_t index = 0; index < old.size(); ++index) {
+        block& from = old[index];
+        for (size_t i = 0; i < from.count; ++i) {
+            uint64_t quotient = from.quotient(i);
+            uint64_t bits = (quotient << old_shift) | ((index ^ mix(quotient)) & old_mask);
+            auto [to, new_quotient] = locate(bits);
+            put(_blocks[to], _blocks[to].count, new_quotient, from.value(i));
+        }
+        from = block();             // keeps the peak at about two copies of one block
+    }
+}
+
+template <typename K, typename M>
+HashMapMemoryUsage PackedHashMap<K, M>::memory_usage() const {
+    HashMapMemoryUsage usage;
+    usage.size = _size;
+    usage.bucket_count = _blocks.size();
+
+    heap_tally headers;
+    if (_blocks.capacity() > 0) headers.add_block(_blocks.capacity() * sizeof(block));
+    heap_tally entries;
+    for (const auto& b : _blocks) {
+        if (b.data) entries.add_block(size_t{b.capacity} * (b.key_width + b.value_width));
+    }
+
+    usage.bucket_bytes = headers.bytes;
+    usage.node_bytes = entries.bytes;
+    usage.allocator_overhead = headers.overhead + entries.overhead;
+    usage.heap_blocks = headers.blocks + entries.blocks;
+    return usage;
+}
+
+#endif // PACKED_HASHMAP_H
@@ -0,0 +1,204 @@
+/*
+* Hardware performance counters for the HashMap tests and benchmarks.
+*
+*      perf_counters opens the Linux perf_event_open counters below for the calling
+*      thread, user space only. Timing says that a map is slow; the counters say why:
+*      a lookup that misses the last level cache costs about a hundred cycles, however
+*      few instructions it runs.
+*
+*          cycles, instructions, L1d read misses, LLC read misses, branch misses,
+*          dTLB read misses
+*
+*      Counters that cannot be opened (not Linux, no PMU in a virtual machine,
+*      perf_event_paranoid too strict, too few hardware counters) are reported as
+*      unavailable instead of failing, so code that uses perf_counters runs
+*      everywhere. When the kernel multiplexes more events than the PMU can count at
+*      once, the counts are scaled up by the fraction of time each event was counted.
+*
+* Usage:
+*      perf_counters counters;
+*      counters.start();
+*      for (const auto& key : keys) map.contains(key);
+*      perf_counts counts = counters.stop();
+*      std::cout << counts.per_op(perf_event_kind::llc_misses, keys.size()) << " LLC misses per lookup";
+*/
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <array>                // for array
+#include <cstddef>              // for size_t
+#include <cstdint>              // for uint64_t
+#include <iomanip>              // for setprecision
+#include <iostream>             // for ostream
+
+#if defined(__linux__)
+#include <linux/perf_event.h>   // for perf_event_attr
+#include <sys/ioctl.h>          // for ioctl
+#include <sys/syscall.h>        // for SYS_perf_event_open
+#include <unistd.h>             // for syscall, read, close
+#include <cstring>              // for memset
+#endif
+
+enum class perf_event_kind {
+    cycles,
+    instructions,
+    l1d_misses,
+    llc_misses,
+    branch_misses,
+    dtlb_misses,
+};
+
+constexpr size_t kPerfEventCount = 6;
+
+constexpr const char* kPerfEventNames[kPerfEventCount] = {
+    "cycles", "instructions", "L1d misses", "LLC misses", "branch misses", "dTLB misses"
+};
+
+/*
+* Values read by perf_counters::stop. available[i] is false for events that could
+* not be counted, whose value is then 0.
+*/
+struct perf_counts {
+    std::array<uint64_t, kPerfEventCount> values{};
+    std::array<bool, kPerfEventCount> available{};
+
+    bool has(perf_event_kind kind) const noexcept { return available[static_cast<size_t>(kind)]; }
+    uint64_t get(perf_event_kind kind) const noexcept { return values[static_cast<size_t>(kind)]; }
+
+    // count per operation, e.g. LLC misses per lookup
+    double per_op(perf_event_kind kind, size_t operations) const noexcept {
+        return operations == 0 ? 0 : static_cast<double>(get(kind)) / operations;
+    }
+
+    bool any() const noexcept {
+        for (bool a : available) if (a) return true;
+        return false;
+    }
+
+    // adds other's values, e.g. to total several runs
+    perf_counts& operator+=(const perf_counts& other) noexcept {
+        for (size_t i = 0; i < kPerfEventCount; ++i) {
+            values[i] += other.values[i];
+            available[i] = available[i] || other.available[i];
+        }
+        return *this;
+    }
+};
+
+/*
+* Prints every available count divided by operations (1 for raw totals), plus
+* instructions per cycle when both are available.
+*/
+inline void print_perf_counts(std::ostream& os, const perf_counts& counts, size_t operations = 1) {
+    if (!counts.any()) {
+        os << "hardware counters unavailable";
+        return;
+    }
+    const char* separator = "";
+    auto old_precision = os.precision(3);
+    for (size_t i = 0; i < kPerfEventCount; ++i) {
+        if (!counts.available[i]) continue;
+        os << separator << kPerfEventNames[i] << ": " << static_cast<double>(counts.values[i]) / operations;
+        separator = ", ";
+    }
+    if (counts.has(perf_event_kind::cycles) && counts.has(perf_event_kind::instructions)
+            && counts.get(perf_event_kind::cycles) > 0) {
+        os << ", IPC: " << static_cast<double>(counts.get(perf_event_kind::instructions))
+                           / counts.get(perf_event_kind::cycles);
+    }
+    os.precision(old_precision);
+}
+
+/*
+* The counters of the calling thread. Not copyable: it owns one file descriptor per event.
+*/
+class perf_counters {
+public:
+    perf_counters() {
+#if defined(__linux__)
+        auto cache = [](uint64_t cache, uint64_t op, uint64_t result) {
+            return cache | (op << 8) | (result << 16);
+        };
+        const std::array<std::pair<uint32_t, uint64_t>, kPerfEventCount> events = {{
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                                       PERF_COUNT_HW_CACHE_RESULT_MISS)},
+            {PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                                       PERF_COUNT_HW_CACHE_RESULT_MISS)},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+            {PERF_TYPE_HW_CACHE, cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                                       PERF_COUNT_HW_CACHE_RESULT_MISS)},
+        }};
+        for (size_t i = 0; i < kPerfEventCount; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[i].first;
+            attr.config = events[i].second;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            _fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+
+    ~perf_counters() {
+#if defined(__linux__)
+        for (int fd : _fds) if (fd >= 0) close(fd);
+#endif
+    }
+
+    perf_counters(const perf_counters&) = delete;
+    perf_counters& operator=(const perf_counters&) = delete;
+
+    /*
+    * Whether at least one event could be opened.
+    */
+    bool available() const noexcept {
+        for (int fd : _fds) if (fd >= 0) return true;
+        return false;
+    }
+
+    /*
+    * Resets every counter to zero and starts counting.
+    */
+    void start() noexcept {
+#if defined(__linux__)
+        for (int fd : _fds) {
+            if (fd < 0) continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    /*
+    * Stops counting and returns the counts since start().
+    */
+    perf_counts stop() noexcept {
+        perf_counts counts;
+#if defined(__linux__)
+        for (int fd : _fds) if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        for (size_t i = 0; i < kPerfEventCount; ++i) {
+            if (_fds[i] < 0) continue;
+            uint64_t data[3];       // value, time enabled, time running
+            if (read(_fds[i], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data))) continue;
+            if (data[2] == 0) continue;         // never scheduled on the PMU
+            counts.values[i] = data[2] < data[1]
+                ? static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2])
+                : data[0];
+            counts.available[i] = true;
+        }
+#endif
+        return counts;
+    }
+
+private:
+    std::array<int, kPerfEventCount> _fds = {-1, -1, -1, -1, -1, -1};
+};
+
+#endif // PERF_COUNTERS_H
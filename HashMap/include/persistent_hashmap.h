@@ -0,0 +1,588 @@
+/*
+* PersistentHashMap: an immutable hash map whose modified copies share structure.
+*
+*      The map is a hash array mapped trie (HAMT). Each trie node covers 5 bits of the
+*      key's hash and has up to 32 entries, but only stores the entries that exist: two
+*      32-bit bitmaps say which of the 32 positions hold a K/M pair (datamap) and which
+*      hold a child node (nodemap), and the pairs and children are stored in dense
+*      arrays in position order, so the array index of position p is the popcount of the
+*      bitmap bits below p. This is the CHAMP layout (Steindorfer and Vinju, 2015).
+*
+*      with(key, value) and without(key) return a new map that shares every node except
+*      the O(log32 N) nodes on the path to key, which are copied. Keeping thousands of
+*      versions of a map therefore costs one path per version, not one map per version.
+*      Nodes are reference counted (std::shared_ptr), so a node is freed when the last
+*      version that uses it is destroyed, and versions can be shared between threads.
+*
+*      Keys whose full 64-bit hashes are equal end up in a collision node at the bottom
+*      of the trie, which is searched linearly.
+*
+*      without keeps the trie canonical: a child left with a single pair is replaced by
+*      that pair in its parent, so the shape of the trie depends only on its contents.
+*
+* Usage:
+*      PersistentHashMap<std::string, int> v1;
+*      auto v2 = v1.with("timeout", 30);
+*      auto v3 = v2.with("retries", 3).without("timeout");
+*      v2.at("timeout");           // 30, v2 is unchanged by v3
+*/
+
+#ifndef PERSISTENT_HASHMAP_H
+#define PERSISTENT_HASHMAP_H
+
+#include <array>                // for array
+#include <bit>                  // for popcount
+#include <cstdint>              // for uint32_t, uint64_t
+#include <initializer_list>     // for initializer_list
+#include <iterator>             // for forward_iterator_tag
+#include <memory>               // for shared_ptr, make_shared
+#include <stdexcept>            // for out_of_range
+#include <utility>              // for pair
+#include <vector>               // for vector
+#include "hashmap_memory.h"
+
+/*
+* Template class for a persistent (immutable) HashMap
+*
+* K = key type
+* M = mapped type
+* H = hash function type used to hash a key; if not provided, defaults to std::hash<K>
+*
+* Concept requirements: K and M copyable, K equality comparable. M need not be default
+* constructible.
+*/
+template <typename K, typename M, typename H = std::hash<K>>
+class PersistentHashMap {
+    struct node;
+    using node_ptr = std::shared_ptr<const node>;
+
+public:
+    using value_type = std::pair<const K, M>;
+
+    class const_iterator;
+    using iterator = const_iterator;
+
+    /*
+    * Creates an empty map. Creating an empty map allocates nothing.
+    */
+    explicit PersistentHashMap(const H& hash = H()) : _hash_function(hash) {}
+
+    /*
+    * Creates a map from the given pairs. Later duplicates are ignored, as in HashMap.
+    */
+    PersistentHashMap(std::initializer_list<std::pair<K, M>> list);
+
+    /*
+    * Returns the number of K/M pairs and whether the map is empty.
+    *
+    * Complexity: O(1)
+    */
+    size_t size() const noexcept { return _size; }
+    bool empty() const noexcept { return _size == 0; }
+
+    /*
+    * Lookups, as in HashMap. find returns end() if key is not in the map.
+    *
+    * Exceptions: at throws std::out_of_range if key is not in the map.
+    *
+    * Complexity: O(log32 N), at most 13 nodes visited
+    */
+    bool contains(const K& key) const { return get(key) != nullptr; }
+    const M& at(const K& key) const;
+    const_iterator find(const K& key) const;
+
+    /*
+    * Returns a pointer to the mapped value of key, or nullptr. The pointer is valid for
+    * as long as any version that contains this pair exists.
+    */
+    const M* get(const K& key) const;
+
+    /*
+    * Returns a copy of this map in which key maps to value (whether or not key was
+    * in this map). This map is not modified.
+    *
+    * Usage:
+    *      auto next = config.with("timeout", 60);
+    *
+    * Complexity: O(log32 N) time, and O(log32 N) new nodes
+    */
+    PersistentHashMap with(const K& key, const M& value) const;
+
+    /*
+    * Returns a copy of this map without key. If key is not in the map, the result
+    * shares all of this map's nodes.
+    *
+    * Complexity: O(log32 N) time, and O(log32 N) new nodes
+    */
+    PersistentHashMap without(const K& key) const;
+
+    /*
+    * Returns whether this map and other share their root node, in which case they are
+    * equal without comparing any elements.
+    */
+    bool shares_root_with(const PersistentHashMap& other) const noexcept { return _root == other._root; }
+
+    /*
+    * Heap used by this version, counting every node it can reach, including those it
+    * shares with other versions.
+    */
+    HashMapMemoryUsage memory_usage() const;
+
+    /*
+    * Iterators visit the elements in an order that depends only on the contents and
+    * the hash function, so equal maps iterate in the same order.
+    */
+    const_iterator begin() const { return const_iterator(_root.get()); }
+    const_iterator end() const { return const_iterator(); }
+
+private:
+    static constexpr size_t kBitsPerLevel = 5;
+    static constexpr size_t kHashBits = 64;
+    static constexpr size_t kMaxDepth = (kHashBits + kBitsPerLevel - 1) / kBitsPerLevel + 1;
+
+    /*
+    * A trie node. values and children are the entries present in datamap and nodemap,
+    * in position order. A collision node (below the last level, where no hash bits are
+    * left) has no bitmaps and stores all of its pairs in values.
+    */
+    struct node {
+        uint32_t datamap = 0;
+        uint32_t nodemap = 0;
+        std::vector<value_type> values;
+        std::vector<node_ptr> children;
+    };
+
+    static uint32_t position(uint64_t hash, size_t shift) noexcept {
+        return static_cast<uint32_t>((hash >> shift) & ((1u << kBitsPerLevel) - 1));
+    }
+
+    // index in the dense array of the entry at bit, given the bitmap
+    static size_t dense_index(uint32_t bitmap, uint32_t bit) noexcept {
+        return static_cast<size_t>(std::popcount(bitmap & (bit - 1)));
+    }
+
+    uint64_t hash_of(const K& key) const { return static_cast<uint64_t>(_hash_function(key)); }
+
+    /*
+    * Returns the node for the pairs a and b, whose hashes agree below shift.
+    */
+    node_ptr merge(const value_type& a, uint64_t hash_a, const value_type& b, uint64_t hash_b, size_t shift) const;
+
+    /*
+    * Returns a copy of n with key mapped to value; added is set if key was not in n.
+    */
+    node_ptr with(const node& n, const K& key, const M& value, uint64_t hash, size_t shift, bool& added) const;
+
+    /*
+    * Returns n without key: n itself if key is not in it, or nullptr if nothing is left.
+    */
+    node_ptr without(const node_ptr& n, const K& key, uint64_t hash, size_t shift) const;
+
+    /*
+    * Copies of entries with entry inserted at index, with index removed, and with
+    * index replaced by entry. The nodes are immutable, so their arrays are always
+    * built anew, with exactly the capacity they need.
+    */
+    template <typename T>
+    static std::vector<T> inserted(const std::vector<T>& entries, size_t index, T entry);
+    template <typename T>
+    static std::vector<T> erased(const std::vector<T>& entries, size_t index);
+    template <typename T>
+    static std::vector<T> replaced(const std::vector<T>& entries, size_t index, T entry);
+
+    H _hash_function;
+    node_ptr _root;
+    size_t _size = 0;
+
+public:
+    /*
+    * Forward iterator. It keeps the path from the root to the current pair, so it is
+    * the size of kMaxDepth frames and allocates nothing.
+    */
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = PersistentHashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        const_iterator() = default;
+
+        reference operator*() const { return top().n->values[top().pos]; }
+        pointer operator->() const { return &**this; }
+
+        const_iterator& operator++() {
+            ++top().pos;
+            settle();
+            return *this;
+        }
+        const_iterator operator++(int) {
+            const_iterator copy(*this);
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            if (_depth != other._depth) return false;
+            return _depth == 0 || (top().n == other.top().n && top().pos == other.top().pos);
+        }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        friend class PersistentHashMap;
+
+        /*
+        * Position pos of node n: a pair if pos < values.size(), otherwise the child
+        * pos - values.size(), whose subtree is being visited by the frames above.
+        */
+        struct frame {
+            const node* n;
+            size_t pos;
+        };
+
+        explicit const_iterator(const node* root) {
+            if (root == nullptr) return;
+            _frames[_depth++] = {root, 0};
+            settle();
+        }
+
+        frame& top() { return _frames[_depth - 1]; }
+        const frame& top() const { return _frames[_depth - 1]; }
+
+        /*
+        * Moves to the next pair at or after the current position, descending into
+        * children and popping finished nodes.
+        */
+        void settle() {
+            while (_depth > 0) {
+                frame& f = top();
+                if (f.pos < f.n->values.size()) return;
+                size_t child = f.pos - f.n->values.size();
+                if (child < f.n->children.size()) {
+                    _frames[_depth++] = {f.n->children[child].get(), 0};
+                    continue;
+                }
+                if (--_depth > 0) ++top().pos;
+            }
+        }
+
+        std::array<frame, kMaxDepth> _frames{};
+        size_t _depth = 0;
+    };
+};
+
+template <typename K, typename M, typename H>
+PersistentHashMap<K, M, H>::PersistentHashMap(std::initializer_list<std::pair<K, M>> list) :
+    PersistentHashMap() {
+    for (const auto& [key, mapped] : list) {
+        if (!contains(key)) *this = with(key, mapped);
+    }
+}
+
+template <typename K, typename M, typename H>
+const M* PersistentHashMap<K, M, H>::get(const K& key) const {
+    uint64_t hash = hash_of(key);
+    const node* n = _root.get();
+    for (size_t shift = 0; n != nullptr; shift += kBitsPerLevel) {
+        if (shift >= kHashBits) {
+            for (const auto& value : n->values) {
+                if (value.first == key) return &value.second;
+            }
+            return nullptr;
+        }
+        uint32_t bit = 1u << position(hash, shift);
+        if (n->datamap & bit) {
+            const value_type& value = n->values[dense_index(n->datamap, bit)];
+            return value.first == key ? &value.second : nullptr;
+        }
+        if (!(n->nodemap & bit)) return nullptr;
+        n = n->children[dense_index(n->nodemap, bit)].get();
+    }
+    return nullptr;
+}
+
+template <typename K, typename M, typename H>
+const M& PersistentHashMap<K, M, H>::at(const K& key) const {
+    const M* found = get(key);
+    if (found == nullptr) {
+        throw std::out_of_range("PersistentHashMap<K, M, H>::at: key not found");
+    }
+    return *found;
+}
+
+template <typename K, typename M, typename H>
+typename PersistentHashMap<K, M, H>::const_iterator PersistentHashMap<K, M, H>::find(const K& key) const {
+    // same walk as get, recording the path in the iterator
+    const_iterator it;
+    uint64_t hash = hash_of(key);
+    const node* n = _root.get();
+    for (size_t shift = 0; n != nullptr; shift += kBitsPerLevel) {
+        if (shift >= kHashBits) {
+            for (size_t i = 0; i < n->values.size(); ++i) {
+                if (n->values[i].first == key) {
+                    it._frames[it._depth++] = {n, i};
+                    return it;
+                }
+            }
+            return end();
+        }
+        uint32_t bit = 1u << position(hash, shift);
+        if (n->datamap & bit) {
+            size_t index = dense_index(n->datamap, bit);
+            if (!(n->values[index].first == key)) return end();
+            it._frames[it._depth++] = {n, index};
+            return it;
+        }
+        if (!(n->nodemap & bit)) return end();
+        size_t child = dense_index(n->nodemap, bit);
+        it._frames[it._depth++] = {n, n->values.size() + child};
+        n = n->children[child].get();
+    }
+    return end();
+}
+
+template <typename K, typename M, typename H>
+PersistentHashMap<K, M, H> PersistentHashMap<K, M, H>::with(const K& key, const M& value) const {
+    PersistentHashMap result(*this);
+    bool added = false;
+    if (_root == nullptr) {
+        auto root = std::make_shared<node>();
+        root->datamap = 1u << position(hash_of(key), 0);
+        root->values.emplace_back(key, value);
+        result._root = std::move(root);
+        added = true;
+    } else {
+        result._root = with(*_root, key, value, hash_of(key), 0, added);
+    }
+    if (added) ++result._size;
+    return result;
+}
+
+template <typename K, typename M, typename H>
+PersistentHashMap<K, M, H> PersistentHashMap<K, M, H>::without(const K& key) const {
+    if (!contains(key)) return *this;
+    PersistentHashMap result(*this);
+    result._root = without(_root, key, hash_of(key), 0);
+    --result._size;
+    return result;
+}
+
+template <typename K, typename M, typename H>
+typename PersistentHashMap<K, M, H>::node_ptr
+PersistentHashMap<K, M, H>::merge(const value_type& a, uint64_t hash_a,
+                                  const value_type& b, uint64_t hash_b, size_t shift) const {
+    auto result = std::make_shared<node>();
+    if (shift >= kHashBits) {
+        result->values.reserve(2);
+        result->values.push_back(a);
+        result->values.push_back(b);
+        return result;
+    }
+    uint32_t pos_a = position(hash_a, shift);
+    uint32_t pos_b = position(hash_b, shift);
+    if (pos_a == pos_b) {
+        result->nodemap = 1u << pos_a;
+        result->children.push_back(merge(a, hash_a, b, hash_b, shift + kBitsPerLevel));
+    } else {
+        result->datamap = (1u << pos_a) | (1u << pos_b);
+        result->values.reserve(2);
+        result->values.push_back(pos_a < pos_b ? a : b);
+        result->values.push_back(pos_a < pos_b ? b : a);
+    }
+    return result;
+}
+
+template <typename K, typename M, typename H>
+typename PersistentHashMap<K, M, H>::node_ptr
+PersistentHashMap<K, M, H>::with(const node& n, const K& key, const M& value,
+                                 uint64_t hash, size_t shift, bool& added) const {
+    auto copy = std::make_shared<node>();
+    copy->datamap = n.datamap;
+    copy->nodemap = n.nodemap;
+    if (shift >= kHashBits) {
+        for (size_t i = 0; i < n.values.size(); ++i) {
+            if (n.values[i].first == key) {
+                copy->values = replaced(n.values, i, value_type(key, value));
+                return copy;
+            }
+        }
+        copy->values = inserted(n.values, n.values.size(), value_type(key, value));
+        added = true;
+        return copy;
+    }
+
+    uint32_t bit = 1u << position(hash, shift);
+    if (n.datamap & bit) {
+        size_t index = dense_index(n.datamap, bit);
+        const value_type& existing = n.values[index];
+        if (existing.first == key) {
+            copy->values = replaced(n.values, index, value_type(key, value));
+            copy->children = n.children;
+            return copy;
+        }
+        // two keys at this position: both move down into a new child
+        node_ptr child = merge(existing, hash_of(existing.first), value_type(key, value), hash,
+                               shift + kBitsPerLevel);
+        copy->datamap &= ~bit;
+        copy->nodemap |= bit;
+        copy->values = erased(n.values, index);
+        copy->children = inserted(n.children, dense_index(copy->nodemap, bit), std::move(child));
+        added = true;
+    } else if (n.nodemap & bit) {
+        size_t index = dense_index(n.nodemap, bit);
+        copy->values = std::vector<value_type>(n.values);
+        copy->children = replaced(n.children, index,
+                                  with(*n.children[index], key, value, hash, shift + kBitsPerLevel, added));
+    } else {
+        copy->datamap |= bit;
+        copy->values = inserted(n.values, dense_index(copy->datamap, bit), value_type(key, value));
+        copy->children = n.children;
+        added = true;
+    }
+    return copy;
+}
+
+template <typename K, typename M, typename H>
+typename PersistentHashMap<K, M, H>::node_ptr
+PersistentHashMap<K, M, H>::without(const node_ptr& n, const K& key, uint64_t hash, size_t shift) const {
+    auto copy = std::make_shared<node>();
+    copy->datamap = n->datamap;
+    copy->nodemap = n->nodemap;
+    if (shift >= kHashBits) {
+        for (size_t i = 0; i < n->values.size(); ++i) {
+            if (!(n->values[i].first == key)) continue;
+            if (n->values.size() == 1) return nullptr;
+            copy->values = erased(n->values, i);
+            return copy;
+        }
+        return n;
+    }
+
+    uint32_t bit = 1u << position(hash, shift);
+    if (n->datamap & bit) {
+        size_t index = dense_index(n->datamap, bit);
+        if (!(n->values[index].first == key)) return n;
+        if (n->values.size() == 1 && n->children.empty()) return nullptr;
+        copy->datamap &= ~bit;
+        copy->values = erased(n->values, index);
+        copy->children = n->children;
+        return copy;
+    }
+    if (!(n->nodemap & bit)) return n;
+
+    size_t index = dense_index(n->nodemap, bit);
+    node_ptr child = without(n->children[index], key, hash, shift + kBitsPerLevel);
+    if (child == n->children[index]) return n;
+
+    if (child == nullptr || (child->children.empty() && child->values.size() == 1)) {
+        // the child is gone or holds a single pair: keep the trie canonical by inlining it
+        copy->nodemap &= ~bit;
+        copy->children = erased(n->children, index);
+        copy->values = std::vector<value_type>(n->values);
+        if (child != nullptr) {
+            copy->datamap |= bit;
+            copy->values = inserted(n->values, dense_index(copy->datamap, bit), child->values[0]);
+        }
+        // a node left with one pair and no children is inlined by its own parent in turn
+        if (copy->values.empty() && copy->children.empty()) return nullptr;
+    } else {
+        copy->values = std::vector<value_type>(n->values);
+        copy->children = replaced(n->children, index, std::move(child));
+    }
+    return copy;
+}
+
+// the helpers only copy-construct elements: value_type is not assignable, because of its const K
+
+template <typename K, typename M, typename H>
+template <typename T>
+std::vector<T> PersistentHashMap<K, M, H>::inserted(const std::vector<T>& entries, size_t index, T entry) {
+    std::vector<T> result;
+    result.reserve(entries.size() + 1);
+    for (size_t i = 0; i < index; ++i) result.push_back(entries[i]);
+    result.push_back(std::move(entry));
+    for (size_t i = index; i < entries.size(); ++i) result.push_back(entries[i]);
+    return result;
+}
+
+template <typename K, typename M, typename H>
+template <typename T>
+std::vector<T> PersistentHashMap<K, M, H>::erased(const std::vector<T>& entries, size_t index) {
+    std::vector<T> result;
+    result.reserve(entries.size() - 1);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (i != index) result.push_back(entries[i]);
+    }
+    return result;
+}
+
+template <typename K, typename M, typename H>
+template <typename T>
+std::vector<T> PersistentHashMap<K, M, H>::replaced(const std::vector<T>& entries, size_t index, T entry) {
+    std::vector<T> result;
+    result.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (i == index) {
+            result.push_back(std::move(entry));
+        } else {
+            result.push_back(entries[i]);
+        }
+    }
+    return result;
+}
+
+template <typename K, typename M, typename H>
+HashMapMemoryUsage PersistentHashMap<K, M, H>::memory_usage() const {
+    HashMapMemoryUsage usage;
+    usage.size = size();
+
+    heap_tally nodes;
+    heap_tally keys;
+    heap_tally mapped;
+    // make_shared puts the node in the same block as the control block: a vtable
+    // pointer and two reference counts in libstdc++ and libc++
+    const size_t control_block = sizeof(void*) + 2 * sizeof(int);
+    std::vector<const node*> stack;
+    if (_root != nullptr) stack.push_back(_root.get());
+    while (!stack.empty()) {
+        const node* n = stack.back();
+        stack.pop_back();
+        nodes.add_block(sizeof(node) + control_block);
+        if (n->values.capacity() > 0) nodes.add_block(n->values.capacity() * sizeof(value_type));
+        if (n->children.capacity() > 0) nodes.add_block(n->children.capacity() * sizeof(node_ptr));
+        for (const auto& value : n->values) {
+            heap_size_estimator<K>::add(value.first, keys);
+            heap_size_estimator<M>::add(value.second, mapped);
+        }
+        for (const auto& child : n->children) stack.push_back(child.get());
+    }
+
+    usage.node_bytes = nodes.bytes;
+    usage.key_heap_bytes = keys.bytes;
+    usage.mapped_heap_bytes = mapped.bytes;
+    usage.allocator_overhead = nodes.overhead + keys.overhead + mapped.overhead;
+    usage.heap_blocks = nodes.blocks + keys.blocks + mapped.blocks;
+    return usage;
+}
+
+/*
+* Two maps are equal if they contain the same K/M pairs.
+*/
+template <typename K, typename M, typename H>
+bool operator==(const PersistentHashMap<K, M, H>& lhs, const PersistentHashMap<K, M, H>& rhs) {
+    if (lhs.size() != rhs.size()) return false;
+    if (lhs.shares_root_with(rhs)) return true;
+    for (const auto& [key, mapped] : lhs) {
+        const M* other = rhs.get(key);
+        if (other == nullptr || !(*other == mapped)) return false;
+    }
+    return true;
+}
+
+template <typename K, typename M, typename H>
+bool operator!=(const PersistentHashMap<K, M, H>& lhs, const PersistentHashMap<K, M, H>& rhs) {
+    return !(lhs == rhs);
+}
+
+#endif // PERSISTENT_HASHMAP_H
@@ -0,0 +1,653 @@
+/*
+* StringHashMap: a map from strings to M that keeps the key characters in a pool.
+*
+*      A HashMap<std::string, M> pays for every key twice: one heap node holding a
+*      32 byte std::string, plus, for keys longer than 15 characters, a second heap
+*      block for the characters, each with its own malloc header and rounding.
+*      StringHashMap<M> stores the same elements with no per-element allocation:
+*
+*          _slots    - the open addressing table: per slot, the index of an entry and
+*                      32 bits of the key's hash, so most mismatches are rejected
+*                      without reading the entry
+*          _entries  - one pooled_key per element, densely packed: the key's length,
+*                      its hash, and either the characters themselves (keys of up to
+*                      16 bytes) or a pointer into the pool
+*          _values   - the mapped values, in the same order as _entries
+*          _pool     - the characters of the longer keys, appended to large chunks
+*
+*      Keys are passed and returned as std::string_view. Erasing a key leaves its
+*      characters in the pool; the pool is compacted when the table is rehashed and
+*      more than half of the pool is garbage.
+*
+*      For keys of 16 to 40 characters, a StringHashMap<int> takes 50% to 70% of the
+*      memory of a HashMap<std::string, int>, or 40% to 60% when reserve() is given
+*      the final size; run HashMapMemoryBench for the numbers.
+*/
+
+#ifndef STRING_HASHMAP_H
+#define STRING_HASHMAP_H
+
+#include <algorithm>            // for max, min, fill
+#include <bit>                  // for bit_ceil
+#include <cstdint>              // for uint32_t, uint64_t
+#include <cstring>              // for memcpy, memcmp
+#include <iterator>             // for forward_iterator_tag
+#include <memory>               // for unique_ptr
+#include <stdexcept>            // for out_of_range, length_error
+#include <string_view>          // for string_view
+#include <type_traits>          // for conditional_t
+#include <utility>              // for forward, pair, move, swap
+#include <vector>               // for vector
+#include "hashmap_memory.h"
+
+/*
+* Append-only storage for characters: strings are copied into large chunks, and a
+* stored string never moves until the pool is cleared or destroyed.
+*
+* Usage:
+*      string_pool pool;
+*      std::string_view stored = pool.store(line);     // stays valid while pool lives
+*/
+class string_pool {
+public:
+    string_pool() = default;
+    string_pool(string_pool&&) noexcept = default;
+    string_pool& operator=(string_pool&&) noexcept = default;
+
+    /*
+    * Copies text into the pool and returns the copy.
+    *
+    * Exceptions: std::bad_alloc, in which case the pool is unchanged.
+    */
+    std::string_view store(std::string_view text) {
+        if (text.size() > kMaxChunkBytes / 4) {
+            // long strings get a chunk of their own rather than wasting a shared one
+            char* bytes = add_chunk(text.size());
+            std::memcpy(bytes, text.data(), text.size());
+            _stored += text.size();
+            return {bytes, text.size()};
+        }
+        if (text.size() > _left) {
+            size_t size = std::min(kMaxChunkBytes, std::max(kMinChunkBytes, 2 * _last_chunk_bytes));
+            _next = add_chunk(size);
+            _left = size;
+            _last_chunk_bytes = size;
+        }
+        char* copy = _next;
+        std::memcpy(copy, text.data(), text.size());
+        _next += text.size();
+        _left -= text.size();
+        _stored += text.size();
+        return {copy, text.size()};
+    }
+
+    /*
+    * Records that bytes stored characters are no longer used. They are not reused;
+    * wasted() tells the owner when copying the live strings to a new pool pays off.
+    */
+    void release(size_t bytes) noexcept { _wasted += bytes; }
+
+    /*
+    * Frees every chunk. Every string_view returned by store becomes dangling.
+    */
+    void clear() noexcept {
+        _chunks = std::vector<chunk>();
+        _next = nullptr;
+        _left = 0;
+        _last_chunk_bytes = 0;
+        _stored = 0;
+        _wasted = 0;
+    }
+
+    size_t stored() const noexcept { return _stored; }
+    size_t wasted() const noexcept { return _wasted; }
+
+    /*
+    * Adds the chunks, and the vector that owns them, to tally.
+    */
+    void add_heap(heap_tally& tally) const noexcept {
+        if (_chunks.capacity() > 0) tally.add_block(_chunks.capacity() * sizeof(chunk));
+        for (const auto& chunk : _chunks) tally.add_block(chunk.size);
+    }
+
+private:
+    static constexpr size_t kMinChunkBytes = 1024;
+    static constexpr size_t kMaxChunkBytes = 64 * 1024;
+
+    struct chunk {
+        std::unique_ptr<char[]> bytes;
+        size_t size;
+    };
+
+    char* add_chunk(size_t size) {
+        if (_chunks.size() == _chunks.capacity()) _chunks.reserve(std::max<size_t>(4, 2 * _chunks.size()));
+        _chunks.push_back({std::unique_ptr<char[]>(new char[size]), size});
+        return _chunks.back().bytes.get();
+    }
+
+    std::vector<chunk> _chunks;
+    char* _next = nullptr;
+    size_t _left = 0;
+    size_t _last_chunk_bytes = 0;
+    size_t _stored = 0;
+    size_t _wasted = 0;
+};
+
+/*
+* Template class for a HashMap with string keys
+*
+* M = mapped type
+* H = hash function type for std::string_view; if not provided, std::hash<std::string_view>
+*
+* Example:
+*      StringHashMap<int> counts;
+*      counts.insert({"/wiki/Stanford_University", 1});
+*      ++counts["/wiki/Fruit"];
+*      for (auto [key, count] : counts) { ... }      // key is a std::string_view
+*
+* Notes:
+*      - Elements are not stored as pairs, so insert returns a pointer to the mapped
+*        value and iterators dereference to std::pair<std::string_view, M&>.
+*      - The string_views handed out (by iterators) are invalidated by the next insert,
+*        erase, rehash or clear, like the iterators themselves.
+*      - Keys are at most 4 GiB long, and a map holds fewer than 4G elements.
+*/
+template <typename M, typename H = std::hash<std::string_view>>
+class StringHashMap {
+
+    template <bool Const>
+    class basic_iterator;
+
+public:
+    using key_type = std::string_view;
+    using mapped_type = M;
+    using value_type = std::pair<const std::string_view, M>;
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    /*
+    * Creates an empty map with room for at least bucket_count slots.
+    *
+    * Complexity: O(B), B = number of slots
+    */
+    explicit StringHashMap(size_t bucket_count = kMinSlots, const H& hash = H());
+
+    /*
+    * Copies store the characters of the long keys in a pool of their own.
+    */
+    StringHashMap(const StringHashMap& other);
+    StringHashMap(StringHashMap&& other) noexcept = default;
+    StringHashMap& operator=(const StringHashMap& other);
+    StringHashMap& operator=(StringHashMap&& other) noexcept = default;
+
+    size_t size() const noexcept { return _entries.size(); }
+    bool empty() const noexcept { return _entries.empty(); }
+    size_t bucket_count() const noexcept { return _slots.size(); }
+    float load_factor() const noexcept { return static_cast<float>(size()) / bucket_count(); }
+
+    /*
+    * Returns whether or not the map contains the given key.
+    *
+    * Complexity: O(1) amortized average case
+    */
+    bool contains(std::string_view key) const noexcept { return find_slot(key, hash_key(key)) != npos; }
+
+    /*
+    * Inserts the key/mapped pair if the key does not already exist; otherwise a no-op.
+    * Grows (doubling the number of slots) when the table would become 7/8 full.
+    *
+    * Return value: pair<M*, bool> - pointer to the mapped value for the key, and
+    * whether the element was added.
+    *
+    * Exceptions: std::length_error if the key is 4 GiB or longer.
+    *
+    * Complexity: O(1) amortized average case, plus copying the key
+    */
+    std::pair<M*, bool> insert(const std::pair<std::string_view, M>& value);
+
+    /*
+    * Erases the element with the given key, if one exists. The last entry moves into
+    * its place, so the entries stay dense.
+    *
+    * Return value: true if an element was removed.
+    */
+    bool erase(std::string_view key);
+
+    /*
+    * Removes all elements and frees the pool. The number of slots stays the same.
+    */
+    void clear() noexcept;
+
+    /*
+    * Returns a reference to the mapped value of key.
+    *
+    * Exceptions: std::out_of_range if key is not in the map.
+    */
+    M& at(std::string_view key);
+    const M& at(std::string_view key) const;
+
+    /*
+    * Returns a reference to the mapped value of key, inserting {key, M()} if needed.
+    * M() is only constructed when key is new.
+    *
+    * Exceptions: std::length_error if key is new and 4 GiB or longer.
+    */
+    M& operator[](std::string_view key);
+
+    /*
+    * Resizes the table to the smallest power of two >= new_bucket_count that keeps
+    * the load factor below 7/8, and compacts the pool if most of it is garbage.
+    *
+    * Exceptions: std::out_of_range if new_bucket_count = 0.
+    *
+    * Complexity: O(N + B)
+    */
+    void rehash(size_t new_bucket_count);
+
+    /*
+    * Makes room for count elements: enough slots to stay below 7/8 full, and entry
+    * arrays of exactly count, so that a map whose final size is known carries none of
+    * the slack that doubling leaves.
+    *
+    * Complexity: O(N + B)
+    */
+    void reserve(size_t count);
+
+    /*
+    * Shrinks the table and the entry arrays to fit the current size, and always
+    * compacts the pool.
+    *
+    * Complexity: O(N + B)
+    */
+    void shrink_to_fit();
+
+    /*
+    * Heap used by the map: bucket_bytes is the slot table, node_bytes the entries and
+    * mapped values, key_heap_bytes the pool.
+    *
+    * Complexity: O(N)
+    */
+    HashMapMemoryUsage memory_usage() const;
+
+    /*
+    * Returns an iterator to the element with the given key, or end().
+    */
+    iterator find(std::string_view key) { return iterator(this, entry_of(find_slot(key, hash_key(key)))); }
+    const_iterator find(std::string_view key) const {
+        return const_iterator(this, entry_of(find_slot(key, hash_key(key))));
+    }
+
+    iterator begin() noexcept { return iterator(this, 0); }
+    iterator end() noexcept { return iterator(this, size()); }
+    const_iterator begin() const noexcept { return const_iterator(this, 0); }
+    const_iterator end() const noexcept { return const_iterator(this, size()); }
+
+private:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+    static constexpr size_t kMinSlots = 8;
+    static constexpr size_t kInlineBytes = 16;
+
+    /*
+    * Slot values that are not entry indices.
+    */
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+    static constexpr uint32_t kDeleted = UINT32_MAX - 1;
+
+    struct slot {
+        uint32_t entry = kEmpty;
+        uint32_t hash = 0;
+    };
+
+    /*
+    * A key: short keys are stored in place, longer ones point into the pool.
+    */
+    struct pooled_key {
+        uint32_t size = 0;
+        uint32_t hash = 0;
+        union {
+            char chars[kInlineBytes];
+            const char* data;
+        };
+
+        bool is_inline() const noexcept { return size <= kInlineBytes; }
+        std::string_view view() const noexcept {
+            return is_inline() ? std::string_view(chars, size) : std::string_view(data, size);
+        }
+    };
+
+    /*
+    * The top 32 bits of the hash, after scrambling it as FlatHashMap does.
+    */
+    uint32_t hash_key(std::string_view key) const noexcept {
+        uint64_t h = _hash_function(key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return static_cast<uint32_t>(h >> 32);
+    }
+
+    size_t mask() const noexcept { return _slots.size() - 1; }
+
+    /*
+    * Returns the slot holding key, or npos.
+    */
+    size_t find_slot(std::string_view key, uint32_t hash) const noexcept;
+
+    /*
+    * Returns the slot that refers to entry, which must exist.
+    */
+    size_t slot_of_entry(uint32_t entry) const noexcept;
+
+    size_t entry_of(size_t slot) const noexcept { return slot == npos ? size() : _slots[slot].entry; }
+
+    /*
+    * Adds key, which must not be in the map, with its mapped value constructed from
+    * mapped_args. hash is hash_key(key). Returns the new mapped value.
+    *
+    * Exceptions: std::length_error if the key is 4 GiB or longer.
+    */
+    template <typename... Args>
+    M& append(std::string_view key, uint32_t hash, Args&&... mapped_args);
+
+    /*
+    * Builds the pooled_key for key, storing its characters in pool if they do not fit.
+    */
+    static pooled_key make_key(std::string_view key, uint32_t hash, string_pool& pool);
+
+    /*
+    * Copies every pooled key into a new pool and switches to it.
+    */
+    void compact_pool();
+
+    H _hash_function;
+    std::vector<slot> _slots;
+    std::vector<pooled_key> _entries;
+    std::vector<M> _values;
+    size_t _tombstones = 0;
+    string_pool _pool;
+
+    /*
+    * Forward iterator over the entries; dereferences to std::pair<std::string_view, M&>.
+    */
+    template <bool Const>
+    class basic_iterator {
+        using map_type = std::conditional_t<Const, const StringHashMap, StringHashMap>;
+        using mapped_ref = std::conditional_t<Const, const M&, M&>;
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = StringHashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using reference = std::pair<std::string_view, mapped_ref>;
+
+        // operator-> has to return something that owns the pair
+        struct pointer {
+            reference ref;
+            const reference* operator->() const { return &ref; }
+        };
+
+        basic_iterator() = default;
+        basic_iterator(map_type* map, size_t entry) : _map(map), _entry(entry) {}
+
+        template <bool OtherConst, typename = std::enable_if_t<Const && !OtherConst>>
+        basic_iterator(const basic_iterator<OtherConst>& other) : _map(other._map), _entry(other._entry) {}
+
+        reference operator*() const { return {_map->_entries[_entry].view(), _map->_values[_entry]}; }
+        pointer operator->() const { return pointer{**this}; }
+
+        basic_iterator& operator++() {
+            ++_entry;
+            return *this;
+        }
+        basic_iterator operator++(int) {
+            basic_iterator copy(*this);
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const basic_iterator& other) const { return _entry == other._entry; }
+        bool operator!=(const basic_iterator& other) const { return _entry != other._entry; }
+
+    private:
+        template <bool> friend class basic_iterator;
+
+        map_type* _map = nullptr;
+        size_t _entry = 0;
+    };
+};
+
+template <typename M, typename H>
+StringHashMap<M, H>::StringHashMap(size_t bucket_count, const H& hash) :
+    _hash_function(hash),
+    _slots(std::bit_ceil(std::max(bucket_count, kMinSlots))) { }
+
+template <typename M, typename H>
+StringHashMap<M, H>::StringHashMap(const StringHashMap& other) :
+    _hash_function(other._hash_function),
+    _slots(other._slots),
+    _entries(other._entries),
+    _values(other._values),
+    _tombstones(other._tombstones) {
+    // the copied entries still point into other's pool
+    for (auto& key : _entries) {
+        if (!key.is_inline()) key.data = _pool.store(key.view()).data();
+    }
+}
+
+template <typename M, typename H>
+StringHashMap<M, H>& StringHashMap<M, H>::operator=(const StringHashMap& other) {
+    if (this != &other) {
+        StringHashMap copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+template <typename M, typename H>
+size_t StringHashMap<M, H>::find_slot(std::string_view key, uint32_t hash) const noexcept {
+    for (size_t index = hash & mask(); ; index = (index + 1) & mask()) {
+        const slot& s = _slots[index];
+        if (s.entry == kEmpty) return npos;
+        if (s.hash == hash && s.entry != kDeleted) {
+            const pooled_key& stored = _entries[s.entry];
+            if (stored.size == key.size() && std::memcmp(stored.view().data(), key.data(), key.size()) == 0) {
+                return index;
+            }
+        }
+    }
+}
+
+template <typename M, typename H>
+size_t StringHashMap<M, H>::slot_of_entry(uint32_t entry) const noexcept {
+    size_t index = _entries[entry].hash & mask();
+    while (_slots[index].entry != entry) index = (index + 1) & mask();
+    return index;
+}
+
+template <typename M, typename H>
+typename StringHashMap<M, H>::pooled_key
+StringHashMap<M, H>::make_key(std::string_view key, uint32_t hash, string_pool& pool) {
+    pooled_key stored;
+    stored.size = static_cast<uint32_t>(key.size());
+    stored.hash = hash;
+    if (stored.is_inline()) {
+        std::memcpy(stored.chars, key.data(), key.size());
+    } else {
+        stored.data = pool.store(key).data();
+    }
+    return stored;
+}
+
+template <typename M, typename H>
+std::pair<M*, bool> StringHashMap<M, H>::insert(const std::pair<std::string_view, M>& value) {
+    const auto& [key, mapped] = value;
+    uint32_t hash = hash_key(key);
+    size_t found = find_slot(key, hash);
+    if (found != npos) return {&_values[_slots[found].entry], false};
+    return {&append(key, hash, mapped), true};
+}
+
+template <typename M, typename H>
+M& StringHashMap<M, H>::operator[](std::string_view key) {
+    uint32_t hash = hash_key(key);
+    size_t found = find_slot(key, hash);
+    if (found != npos) return _values[_slots[found].entry];
+    return append(key, hash);
+}
+
+template <typename M, typename H>
+template <typename... Args>
+M& StringHashMap<M, H>::append(std::string_view key, uint32_t hash, Args&&... mapped_args) {
+    if (key.size() >= kDeleted) {
+        throw std::length_error("StringHashMap<M, H>::insert: key too long");
+    }
+
+    // keep at least 1/8 of the slots empty so that every probe terminates quickly.
+    // If most of the used slots are tombstones, cleaning them up is enough.
+    if ((size() + _tombstones + 1) * 8 > _slots.size() * 7) {
+        size_t slots = _slots.size();
+        if ((size() + 1) * 4 > slots) slots *= 2;
+        rehash(slots);
+    }
+
+    // build everything that can throw before the table is touched; the entry arrays
+    // double, so that inserting N keys copies O(N) entries
+    if (size() == _entries.capacity()) _entries.reserve(std::max(kMinSlots, 2 * _entries.capacity()));
+    if (size() == _values.capacity()) _values.reserve(std::max(kMinSlots, 2 * _values.capacity()));
+    pooled_key stored = make_key(key, hash, _pool);
+    try {
+        _values.emplace_back(std::forward<Args>(mapped_args)...);
+    } catch (...) {
+        if (!stored.is_inline()) _pool.release(stored.size);
+        throw;
+    }
+    _entries.push_back(stored);                     // cannot throw: the capacity is there
+
+    size_t index = hash & mask();
+    while (_slots[index].entry < kDeleted) index = (index + 1) & mask();
+    if (_slots[index].entry == kDeleted) --_tombstones;
+    _slots[index] = {static_cast<uint32_t>(size() - 1), hash};
+    return _values.back();
+}
+
+template <typename M, typename H>
+bool StringHashMap<M, H>::erase(std::string_view key) {
+    size_t found = find_slot(key, hash_key(key));
+    if (found == npos) return false;
+
+    uint32_t entry = _slots[found].entry;
+    _slots[found].entry = kDeleted;
+    ++_tombstones;
+    if (!_entries[entry].is_inline()) _pool.release(_entries[entry].size);
+
+    // move the last entry into the hole, and point its slot at the new position
+    uint32_t last = static_cast<uint32_t>(size() - 1);
+    if (entry != last) {
+        _slots[slot_of_entry(last)].entry = entry;
+        _entries[entry] = _entries[last];
+        _values[entry] = std::move(_values[last]);
+    }
+    _entries.pop_back();
+    _values.pop_back();
+    return true;
+}
+
+template <typename M, typename H>
+void StringHashMap<M, H>::clear() noexcept {
+    std::fill(_slots.begin(), _slots.end(), slot());
+    _entries.clear();
+    _values.clear();
+    _tombstones = 0;
+    _pool.clear();
+}
+
+template <typename M, typename H>
+M& StringHashMap<M, H>::at(std::string_view key) {
+    return const_cast<M&>(static_cast<const StringHashMap*>(this)->at(key));
+}
+
+template <typename M, typename H>
+const M& StringHashMap<M, H>::at(std::string_view key) const {
+    size_t found = find_slot(key, hash_key(key));
+    if (found == npos) {
+        throw std::out_of_range("StringHashMap<M, H>::at: key not found");
+    }
+    return _values[_slots[found].entry];
+}
+
+template <typename M, typename H>
+void StringHashMap<M, H>::rehash(size_t new_bucket_count) {
+    if (new_bucket_count == 0) {
+        throw std::out_of_range("StringHashMap<M, H>::rehash: new_bucket_count must be positive.");
+    }
+    size_t slots = std::bit_ceil(std::max(new_bucket_count, kMinSlots));
+    while (size() * 8 >= slots * 7) slots *= 2;
+
+    std::vector<slot> new_slots(slots);
+    if (_pool.wasted() > _pool.stored() / 2) compact_pool();
+    _slots.swap(new_slots);
+    _tombstones = 0;
+
+    // the entries carry their hash, so nothing is rehashed or compared
+    for (uint32_t entry = 0; entry < size(); ++entry) {
+        uint32_t hash = _entries[entry].hash;
+        size_t index = hash & mask();
+        while (_slots[index].entry != kEmpty) index = (index + 1) & mask();
+        _slots[index] = {entry, hash};
+    }
+}
+
+template <typename M, typename H>
+void StringHashMap<M, H>::reserve(size_t count) {
+    if (count > _entries.capacity()) _entries.reserve(count);
+    if (count > _values.capacity()) _values.reserve(count);
+    if (count * 8 >= _slots.size() * 7) rehash(count * 8 / 7 + 1);
+}
+
+template <typename M, typename H>
+void StringHashMap<M, H>::shrink_to_fit() {
+    _entries.shrink_to_fit();
+    _values.shrink_to_fit();
+    compact_pool();
+    rehash(size() * 8 / 7 + 1);
+}
+
+template <typename M, typename H>
+void StringHashMap<M, H>::compact_pool() {
+    string_pool compacted;
+    std::vector<const char*> moved;
+    moved.reserve(size());
+    for (const auto& key : _entries) {
+        moved.push_back(key.is_inline() ? nullptr : compacted.store(key.view()).data());
+    }
+    for (size_t i = 0; i < size(); ++i) {
+        if (moved[i] != nullptr) _entries[i].data = moved[i];
+    }
+    _pool = std::move(compacted);
+}
+
+template <typename M, typename H>
+HashMapMemoryUsage StringHashMap<M, H>::memory_usage() const {
+    HashMapMemoryUsage usage;
+    usage.size = size();
+    usage.bucket_count = bucket_count();
+
+    heap_tally table;
+    if (_slots.capacity() > 0) table.add_block(_slots.capacity() * sizeof(slot));
+    heap_tally entries;
+    if (_entries.capacity() > 0) entries.add_block(_entries.capacity() * sizeof(pooled_key));
+    if (_values.capacity() > 0) entries.add_block(_values.capacity() * sizeof(M));
+    heap_tally keys;
+    _pool.add_heap(keys);
+    heap_tally mapped;
+    for (const auto& value : _values) heap_size_estimator<M>::add(value, mapped);
+
+    usage.bucket_bytes = table.bytes;
+    usage.node_bytes = entries.bytes;
+    usage.key_heap_bytes = keys.bytes;
+    usage.mapped_heap_bytes = mapped.bytes;
+    usage.allocator_overhead = table.overhead + entries.overhead + keys.overhead + mapped.overhead;
+    usage.heap_blocks = table.blocks + entries.blocks + keys.blocks + mapped.blocks;
+    return usage;
+}
+
+#endif // STRING_HASHMAP_H
@@ -46,3 +46,43 @@
 #define RUN_TEST_6F 1
 
 #define RUN_TEST_7 1
+
+// Milestone 8 - extensions beyond the assignment
+// 8A - occupancy bitmap iteration over sparse tables, shrink_to_fit
+#define RUN_TEST_8A 1
+// 8B - OrderedHashMap (insertion-ordered, contiguous entries)
+#define RUN_TEST_8B 1
+// 8C - FlatHashMap (structure-of-arrays layout) and CompactHashMap selection
+#define RUN_TEST_8C 1
+// 8D - save_mapped and MappedHashMap (memory-mapped files, POSIX only)
+#define RUN_TEST_8D 1
+// 8E - binary save and load
+#define RUN_TEST_8E 1
+// 8F - stats() and the operation counting policy
+#define RUN_TEST_8F 1
+// 8G - exact allocation counts per operation, and no leaks
+#define RUN_TEST_8G 1
+// 8H - memory_usage() and heap_size_estimator
+#define RUN_TEST_8H 1
+// 8I - HashSet and HashMultiMap
+#define RUN_TEST_8I 1
+// 8J - LruCache and ClockCache
+#define RUN_TEST_8J 1
+// 8K - TtlHashMap and its timer wheel
+#define RUN_TEST_8K 1
+// 8L - CowHashMap copy-on-write snapshots
+#define RUN_TEST_8L 1
+// 8M - PersistentHashMap (hash array mapped trie)
+#define RUN_TEST_8M 1
+// 8N - the Bloom filter policy
+#define RUN_TEST_8N 1
+// 8O - parallel algorithms and the bucket range
+#define RUN_TEST_8O 1
+// 8P - forward iterators, keys() and values()
+#define RUN_TEST_8P 1
+// 8Q - StringHashMap and its string pool
+#define RUN_TEST_8Q 1
+// 8R - PackedHashMap and its block encoding
+#define RUN_TEST_8R 1
+// 8S - huge page bucket arrays and node slabs
+#define RUN_TEST_8S 1
@@ -0,0 +1,390 @@
+/*
+* TtlHashMap: a HashMap whose entries expire a given time after they were written.
+*
+*      Every entry carries an expiry time. Expired entries are removed two ways:
+*
+*          - lazily: a lookup that finds an expired entry erases it and reports a miss,
+*            so an expired entry is never returned, however late the sweep is;
+*          - incrementally, by a hierarchical timer wheel that expire(now) (and every
+*            insert) advances to the current time.
+*
+*      The wheel has kWheelLevels levels of 64 slots. Time is counted in ticks of the
+*      resolution given to the constructor; level L holds the entries due between 64^L
+*      and 64^(L + 1) ticks from now, in the slot of bits [6L, 6L + 6) of their expiry
+*      tick. Each tick expires the entries of one level 0 slot, and every 64^L ticks
+*      one slot of level L is cascaded into the levels below it. Advancing the wheel by
+*      one tick is O(1) amortized, plus O(1) per entry expired, so there is never an
+*      O(N) sweep over the whole map. Entries due more than 64^kWheelLevels ticks ahead
+*      wait in the top level and are cascaded again until they are due.
+*
+*      Scheduled entries are linked into their wheel slot through prev/next pointers
+*      stored in their HashMap node; nodes never move, so rehash does not disturb them.
+*
+* Usage:
+*      TtlHashMap<std::string, Session> sessions(std::chrono::minutes(30));
+*      sessions.insert(token, session);
+*      if (Session* session = sessions.find(token)) sessions.touch(token);   // sliding expiry
+*      sessions.expire();                  // from a periodic task, or rely on inserts
+*/
+
+#ifndef TTL_HASHMAP_H
+#define TTL_HASHMAP_H
+
+#include <algorithm>            // for min, max
+#include <array>                // for array
+#include <chrono>               // for steady_clock, milliseconds
+#include <cstdint>              // for uint8_t, uint64_t
+#include <optional>             // for optional
+#include <stdexcept>            // for invalid_argument
+#include <utility>              // for pair
+#include "hashmap.h"
+
+/*
+* Template class for a HashMap with expiring entries
+*
+* K = key type
+* M = mapped type
+* H = hash function type used to hash a key; if not provided, defaults to std::hash<K>
+* Clock = clock the expiry times are measured with (a std::chrono clock, or any type
+*         with the same now(), time_point and duration members)
+*
+* Concept requirements: same as HashMap.
+*/
+template <typename K, typename M, typename H = std::hash<K>, typename Clock = std::chrono::steady_clock>
+class TtlHashMap {
+    struct entry;
+    using slot = std::pair<const K, entry>;
+
+public:
+    using time_point = typename Clock::time_point;
+    using duration = typename Clock::duration;
+
+    /*
+    * Creates an empty map whose entries live for default_ttl unless insert is given
+    * another ttl. The wheel advances in ticks of resolution; an entry is swept at most
+    * one tick after it expires.
+    *
+    * Exceptions: std::invalid_argument if resolution is not positive.
+    *
+    * Usage:
+    *      TtlHashMap<int, int> map(std::chrono::seconds(10));
+    *      TtlHashMap<int, int> map(std::chrono::seconds(10), std::chrono::milliseconds(100), 100000);
+    */
+    explicit TtlHashMap(duration default_ttl, duration resolution = std::chrono::milliseconds(1),
+                        size_t bucket_count = kDefaultBuckets, const H& hash = H());
+
+    TtlHashMap(const TtlHashMap&) = delete;
+    TtlHashMap& operator=(const TtlHashMap&) = delete;
+
+    /*
+    * Stores value under key, expiring ttl from now, replacing any previous value and
+    * expiry of key. Advances the wheel to now first.
+    *
+    * Return value: true if key was not in the map (or had expired).
+    *
+    * Complexity: O(1) amortized average case
+    */
+    bool insert(const K& key, const M& value) { return insert(key, value, _default_ttl); }
+    bool insert(const K& key, const M& value, duration ttl);
+
+    /*
+    * Returns a pointer to the value of key, or nullptr if key is not in the map or has
+    * expired. The non-const overload erases an expired entry it finds.
+    *
+    * Notes: the pointer is valid until key is erased or expires and is swept.
+    */
+    M* find(const K& key);
+    const M* find(const K& key) const;
+
+    bool contains(const K& key) const { return find(key) != nullptr; }
+
+    /*
+    * Returns when key expires, or nothing if key is not in the map or has expired.
+    */
+    std::optional<time_point> expiry(const K& key) const;
+
+    /*
+    * Pushes the expiry of key back to ttl from now (default_ttl if not given).
+    *
+    * Return value: false if key is not in the map or has expired.
+    */
+    bool touch(const K& key) { return touch(key, _default_ttl); }
+    bool touch(const K& key, duration ttl);
+
+    /*
+    * Removes key before it expires.
+    *
+    * Return value: true if key was in the map and had not expired.
+    */
+    bool erase(const K& key);
+
+    /*
+    * Advances the timer wheel to now, erasing every entry whose expiry tick has passed.
+    *
+    * Return value: the number of entries erased.
+    *
+    * Complexity: O(T / 64 + E) when the wheel's lowest level is empty, O(T + E) at
+    * worst, T = ticks since the last advance, E = entries erased
+    */
+    size_t expire(time_point now = Clock::now());
+
+    /*
+    * Removes every entry. The wheel keeps its current time.
+    */
+    void clear() noexcept;
+
+    /*
+    * size() counts the entries that have expired but not yet been swept.
+    */
+    size_t size() const noexcept { return _map.size(); }
+    bool empty() const noexcept { return _map.empty(); }
+    size_t bucket_count() const noexcept { return _map.bucket_count(); }
+
+    /*
+    * Number of entries removed because they expired, by expire or by a lookup.
+    */
+    size_t expired_count() const noexcept { return _expired; }
+
+    HashMapMemoryUsage memory_usage() const { return _map.memory_usage(); }
+
+    static constexpr size_t kWheelLevels = 4;
+
+private:
+    static constexpr size_t kSlotBits = 6;
+    static constexpr size_t kSlots = size_t{1} << kSlotBits;
+    static constexpr uint64_t kMaxDelay = (uint64_t{1} << (kSlotBits * kWheelLevels)) - 1;
+    static const size_t kDefaultBuckets = 10;
+
+    struct entry {
+        M value{};
+        time_point expiry{};
+        uint64_t expiry_tick = 0;       // first tick at or after expiry
+        slot* prev = nullptr;           // neighbours in the wheel slot
+        slot* next = nullptr;
+        uint8_t level = 0;              // the wheel slot the entry is linked into
+        uint8_t index = 0;
+    };
+
+    /*
+    * Tick containing t, and first tick that starts at or after t, respectively.
+    */
+    uint64_t tick_floor(time_point t) const noexcept;
+    uint64_t tick_ceil(time_point t) const noexcept;
+
+    /*
+    * Links s into the wheel slot of its expiry tick, which must not be before _now_tick
+    * (an entry due at _now_tick goes into the level 0 slot that the current tick
+    * expires). Entries further away than kMaxDelay go into the top level.
+    */
+    void schedule(slot* s) noexcept;
+    void unlink(slot* s) noexcept;
+
+    /*
+    * Reschedules every entry of slot index of level, which moves them to lower levels.
+    */
+    void cascade(size_t level, size_t index) noexcept;
+
+    /*
+    * Unlinks s and erases its node.
+    */
+    void remove(slot* s);
+
+    duration _default_ttl;
+    duration _resolution;
+    time_point _epoch;                  // start of tick 0
+    uint64_t _now_tick = 0;             // every tick up to and including it has been processed
+    HashMap<K, entry, H> _map;
+    std::array<std::array<slot*, kSlots>, kWheelLevels> _wheel{};
+    std::array<size_t, kWheelLevels> _level_sizes{};
+    size_t _expired = 0;
+};
+
+template <typename K, typename M, typename H, typename Clock>
+TtlHashMap<K, M, H, Clock>::TtlHashMap(duration default_ttl, duration resolution,
+                                       size_t bucket_count, const H& hash) :
+    _default_ttl(default_ttl),
+    _resolution(resolution),
+    _epoch(Clock::now()),
+    _map(bucket_count, hash) {
+    if (resolution <= duration::zero()) {
+        throw std::invalid_argument("TtlHashMap: resolution must be positive");
+    }
+}
+
+template <typename K, typename M, typename H, typename Clock>
+uint64_t TtlHashMap<K, M, H, Clock>::tick_floor(time_point t) const noexcept {
+    return t <= _epoch ? 0 : static_cast<uint64_t>((t - _epoch) / _resolution);
+}
+
+template <typename K, typename M, typename H, typename Clock>
+uint64_t TtlHashMap<K, M, H, Clock>::tick_ceil(time_point t) const noexcept {
+    uint64_t tick = tick_floor(t);
+    return t > _epoch + tick * _resolution ? tick + 1 : tick;
+}
+
+template <typename K, typename M, typename H, typename Clock>
+bool TtlHashMap<K, M, H, Clock>::insert(const K& key, const M& value, duration ttl) {
+    time_point now = Clock::now();
+    expire(now);
+
+    auto [stored, added] = _map.insert({key, entry()});
+    if (added) {
+        if (_map.size() > _map.bucket_count()) _map.rehash(2 * _map.bucket_count());
+    } else {
+        if (now >= stored->second.expiry) {
+            ++_expired;
+            added = true;
+        }
+        unlink(stored);
+    }
+    entry& e = stored->second;
+    e.value = value;
+    e.expiry = now + ttl;
+    // an entry can not be due in a tick that was already processed
+    e.expiry_tick = std::max(tick_ceil(e.expiry), _now_tick + 1);
+    schedule(stored);
+    return added;
+}
+
+template <typename K, typename M, typename H, typename Clock>
+M* TtlHashMap<K, M, H, Clock>::find(const K& key) {
+    auto it = _map.find(key);
+    if (it == _map.end()) return nullptr;
+    if (Clock::now() >= it->second.expiry) {
+        ++_expired;
+        remove(&*it);
+        return nullptr;
+    }
+    return &it->second.value;
+}
+
+template <typename K, typename M, typename H, typename Clock>
+const M* TtlHashMap<K, M, H, Clock>::find(const K& key) const {
+    auto it = _map.find(key);
+    if (it == _map.end() || Clock::now() >= it->second.expiry) return nullptr;
+    return &it->second.value;
+}
+
+template <typename K, typename M, typename H, typename Clock>
+std::optional<typename TtlHashMap<K, M, H, Clock>::time_point>
+TtlHashMap<K, M, H, Clock>::expiry(const K& key) const {
+    auto it = _map.find(key);
+    if (it == _map.end() || Clock::now() >= it->second.expiry) return std::nullopt;
+    return it->second.expiry;
+}
+
+template <typename K, typename M, typename H, typename Clock>
+bool TtlHashMap<K, M, H, Clock>::touch(const K& key, duration ttl) {
+    if (find(key) == nullptr) return false;
+    slot* s = &*_map.find(key);
+    unlink(s);
+    s->second.expiry = Clock::now() + ttl;
+    s->second.expiry_tick = std::max(tick_ceil(s->second.expiry), _now_tick + 1);
+    schedule(s);
+    return true;
+}
+
+template <typename K, typename M, typename H, typename Clock>
+bool TtlHashMap<K, M, H, Clock>::erase(const K& key) {
+    auto it = _map.find(key);
+    if (it == _map.end()) return false;
+    bool live = Clock::now() < it->second.expiry;
+    if (!live) ++_expired;
+    remove(&*it);
+    return live;
+}
+
+template <typename K, typename M, typename H, typename Clock>
+size_t TtlHashMap<K, M, H, Clock>::expire(time_point now) {
+    uint64_t target = tick_floor(now);
+    size_t expired_before = _expired;
+    while (_now_tick < target) {
+        if (_map.empty()) {
+            _now_tick = target;
+            break;
+        }
+        if (_level_sizes[0] == 0) {
+            // nothing can expire before the next cascade, at the next multiple of kSlots
+            _now_tick = std::min(target - 1, _now_tick | (kSlots - 1));
+        }
+        ++_now_tick;
+
+        // every kSlots^L ticks, the next slot of level L comes within reach of level L - 1
+        for (size_t level = 1; level < kWheelLevels; ++level) {
+            if ((_now_tick & ((uint64_t{1} << (kSlotBits * level)) - 1)) != 0) break;
+            cascade(level, (_now_tick >> (kSlotBits * level)) & (kSlots - 1));
+        }
+
+        size_t index = _now_tick & (kSlots - 1);
+        slot* curr = _wheel[0][index];
+        _wheel[0][index] = nullptr;
+        while (curr != nullptr) {
+            slot* next = curr->second.next;
+            --_level_sizes[0];
+            curr->second.prev = curr->second.next = nullptr;
+            if (curr->second.expiry_tick <= _now_tick) {
+                ++_expired;
+                _map.erase(curr->first);
+            } else {
+                schedule(curr);
+            }
+            curr = next;
+        }
+    }
+    return _expired - expired_before;
+}
+
+template <typename K, typename M, typename H, typename Clock>
+void TtlHashMap<K, M, H, Clock>::clear() noexcept {
+    _map.clear();
+    for (auto& level : _wheel) level.fill(nullptr);
+    _level_sizes.fill(0);
+}
+
+template <typename K, typename M, typename H, typename Clock>
+void TtlHashMap<K, M, H, Clock>::schedule(slot* s) noexcept {
+    entry& e = s->second;
+    uint64_t delay = e.expiry_tick > _now_tick ? e.expiry_tick - _now_tick : 0;
+    uint64_t tick = _now_tick + std::min(delay, kMaxDelay);
+
+    size_t level = 0;
+    while (level + 1 < kWheelLevels && (tick - _now_tick) >> (kSlotBits * (level + 1)) != 0) ++level;
+    size_t index = (tick >> (kSlotBits * level)) & (kSlots - 1);
+
+    e.level = static_cast<uint8_t>(level);
+    e.index = static_cast<uint8_t>(index);
+    e.prev = nullptr;
+    e.next = _wheel[level][index];
+    if (e.next != nullptr) e.next->second.prev = s;
+    _wheel[level][index] = s;
+    ++_level_sizes[level];
+}
+
+template <typename K, typename M, typename H, typename Clock>
+void TtlHashMap<K, M, H, Clock>::unlink(slot* s) noexcept {
+    entry& e = s->second;
+    (e.prev ? e.prev->second.next : _wheel[e.level][e.index]) = e.next;
+    if (e.next != nullptr) e.next->second.prev = e.prev;
+    e.prev = e.next = nullptr;
+    --_level_sizes[e.level];
+}
+
+template <typename K, typename M, typename H, typename Clock>
+void TtlHashMap<K, M, H, Clock>::cascade(size_t level, size_t index) noexcept {
+    slot* curr = _wheel[level][index];
+    _wheel[level][index] = nullptr;
+    while (curr != nullptr) {
+        slot* next = curr->second.next;
+        --_level_sizes[level];
+        schedule(curr);
+        curr = next;
+    }
+}
+
+template <typename K, typename M, typename H, typename Clock>
+void TtlHashMap<K, M, H, Clock>::remove(slot* s) {
+    unlink(s);
+    _map.erase(s->first);
+}
+
+#endif // TTL_HASHMAP_H
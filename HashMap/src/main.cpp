@@ -6,6 +6,19 @@
  */
 
 #include "../include/hashmap.h"
+#include "../include/ordered_hashmap.h"
+#include "../include/flat_hashmap.h"
+#include "../include/mapped_hashmap.h"
+#include "../include/hash_set.h"
+#include "../include/hash_multimap.h"
+#include "../include/lru_cache.h"
+#include "../include/ttl_hashmap.h"
+#include "../include/cow_hashmap.h"
+#include "../include/persistent_hashmap.h"
+#include "../include/hashmap_parallel.h"
+#include "../include/string_hashmap.h"
+#include "../include/packed_hashmap.h"
+#include "../include/perf_counters.h"
 //#include "tests.hpp"
 //#include "student_main.cpp"
 #include "../include/test_settings.hpp"
@@ -24,12 +37,27 @@
 using namespace std;
 
 #include <map>
+#include <memory>
 #include <vector>
 #include <utility>
 #include <algorithm>
 #include <sstream>
 #include <set>
 #include <iomanip>
+#include <chrono>
+#include <filesystem>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <optional>
+#include <random>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <ranges>
+#include <limits>
+#include <type_traits>
 
 // ----------------------------------------------------------------------------------------------
 // Global Constants and Type Alises (DO NOT EDIT)
@@ -75,6 +103,95 @@ void VERIFY_TRUE(bool condition, int line) {
     }
 }
 
+// ----------------------------------------------------------------------------------------------
+// Allocation counting
+// The test harness replaces the global operator new and operator delete, so that a test can
+// check exactly how many heap allocations an operation makes, and run_test can report the
+// bytes a test leaves allocated. Every block starts with a header holding its size.
+// Tests start threads that allocate, so the totals are relaxed atomics, as in
+// bench/alloc_counter.cpp.
+namespace alloc_hook {
+
+struct counts {
+    size_t allocations = 0;
+    size_t deallocations = 0;
+    size_t live_bytes = 0;
+};
+
+struct atomic_counts {
+    std::atomic<size_t> allocations{0};
+    std::atomic<size_t> deallocations{0};
+    std::atomic<size_t> live_bytes{0};
+
+    counts load() const noexcept {
+        return {allocations.load(std::memory_order_relaxed), deallocations.load(std::memory_order_relaxed),
+                live_bytes.load(std::memory_order_relaxed)};
+    }
+};
+
+atomic_counts totals;
+
+// a whole max_align_t, so that the block handed out stays suitably aligned
+constexpr size_t kHeader = alignof(std::max_align_t);
+
+void* allocate(size_t size) {
+    void* block = std::malloc(size + kHeader);
+    if (block == nullptr) throw std::bad_alloc();
+    *static_cast<size_t*>(block) = size;
+    totals.allocations.fetch_add(1, std::memory_order_relaxed);
+    totals.live_bytes.fetch_add(size, std::memory_order_relaxed);
+    return static_cast<char*>(block) + kHeader;
+}
+
+void deallocate(void* ptr) noexcept {
+    if (ptr == nullptr) return;
+    void* block = static_cast<char*>(ptr) - kHeader;
+    totals.deallocations.fetch_add(1, std::memory_order_relaxed);
+    totals.live_bytes.fetch_sub(*static_cast<size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+}
+
+void* operator new(size_t size) { return alloc_hook::allocate(size); }
+void* operator new[](size_t size) { return alloc_hook::allocate(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try { return alloc_hook::allocate(size); } catch (const std::bad_alloc&) { return nullptr; }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try { return alloc_hook::allocate(size); } catch (const std::bad_alloc&) { return nullptr; }
+}
+void operator delete(void* ptr) noexcept { alloc_hook::deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { alloc_hook::deallocate(ptr); }
+void operator delete(void* ptr, size_t) noexcept { alloc_hook::deallocate(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { alloc_hook::deallocate(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { alloc_hook::deallocate(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { alloc_hook::deallocate(ptr); }
+
+/*
+ * Counts the heap allocations made between its construction and each call.
+ *
+ * Usage:
+ *      allocation_scope scope;
+ *      map.insert({1, 1});
+ *      VERIFY_TRUE(scope.allocations() == 1, __LINE__);
+ */
+class allocation_scope {
+public:
+    allocation_scope() : _start(alloc_hook::totals.load()) {}
+
+    size_t allocations() const { return alloc_hook::totals.load().allocations - _start.allocations; }
+    size_t deallocations() const { return alloc_hook::totals.load().deallocations - _start.deallocations; }
+
+    // bytes allocated since construction that are still allocated (negative if more were freed)
+    long leaked_bytes() const {
+        return static_cast<long>(alloc_hook::totals.load().live_bytes) - static_cast<long>(_start.live_bytes);
+    }
+
+private:
+    alloc_hook::counts _start;
+};
+
 
 // ----------------------------------------------------------------------------------------------
 /* Starter Code Test Cases (DO NOT EDIT) */
@@ -1057,6 +1174,1569 @@ void B_range_ctor() {
 
 using std::cout;
 using std::endl;
+#if RUN_TEST_8A
+void A_sparse_iteration() {
+    /* Grows a map, erases almost everything, and checks that iteration over the
+     * mostly empty bucket array (and after shrink_to_fit) still visits exactly
+     * the remaining elements. */
+    HashMap<int, int> map(5000);
+    std::map<int, int> answer;
+    for (int i = 0; i < 5000; ++i) {
+        map.insert({i, i * 2});
+    }
+    for (int i = 0; i < 5000; ++i) {
+        if (i % 1000 != 999) map.erase(i);
+    }
+    for (int i = 999; i < 5000; i += 1000) {
+        answer.insert({i, i * 2});
+    }
+
+    std::map<int, int> visited {map.begin(), map.end()};
+    VERIFY_TRUE(visited == answer, __LINE__);
+    VERIFY_TRUE(check_map_equal(map, answer), __LINE__);
+
+    map.shrink_to_fit();
+    VERIFY_TRUE(map.bucket_count() == answer.size(), __LINE__);
+    std::map<int, int> visited_shrunk {map.begin(), map.end()};
+    VERIFY_TRUE(visited_shrunk == answer, __LINE__);
+    VERIFY_TRUE(check_map_equal(map, answer), __LINE__);
+
+    map.clear();
+    map.shrink_to_fit();
+    VERIFY_TRUE(map.bucket_count() == 1, __LINE__);
+    VERIFY_TRUE(map.begin() == map.end(), __LINE__);
+}
+#endif
+
+#if RUN_TEST_8B
+void B_ordered_hashmap() {
+    /* OrderedHashMap must behave like HashMap, but iterate (and print) in insertion order,
+     * including after erasing enough elements to trigger a compaction and after rehash. */
+    OrderedHashMap<std::string, int> map;
+    std::map<std::string, int> answer;
+    for (const auto& kv_pair : vec) {
+        map.insert(kv_pair);
+        answer.insert(kv_pair);
+        VERIFY_TRUE(check_map_equal(map, answer), __LINE__);
+    }
+    std::ostringstream oss;
+    oss << map;
+    VERIFY_TRUE(oss.str() == "{A:3, B:2, C:1}", __LINE__);
+
+    map.erase("A");
+    map["A"] = 7;
+    map.rehash(1);
+    std::vector<std::string> order;
+    for (const auto& [key, mapped] : map) order.push_back(key);
+    VERIFY_TRUE((order == std::vector<std::string>{"B", "C", "A"}), __LINE__);
+
+    OrderedHashMap<int, int> ints(100);
+    for (int i = 0; i < 1000; ++i) ints.insert({i, -i});
+    for (int i = 0; i < 1000; ++i) {
+        if (i % 10 != 0) ints.erase(i);
+    }
+    int expected = 0;
+    for (const auto& [key, mapped] : ints) {
+        VERIFY_TRUE(key == expected && mapped == -expected, __LINE__);
+        expected += 10;
+    }
+    VERIFY_TRUE(expected == 1000 && ints.size() == 100, __LINE__);
+    VERIFY_TRUE(ints.find(500) != ints.end() && ints.find(501) == ints.end(), __LINE__);
+
+    // operator[] on a present key allocates nothing, on a new one only the key's copy
+    OrderedHashMap<std::string, int> counts(16);
+    std::string word(40, 'w');
+    counts[word] = 1;
+    counts["x"] = counts["y"] = 0;          // three entries: the vector has room for a fourth
+    {
+        allocation_scope scope;
+        for (int i = 0; i < 10; ++i) ++counts[word];
+        VERIFY_TRUE(scope.allocations() == 0 && counts.at(word) == 11, __LINE__);
+    }
+    {
+        std::string other(40, 'o');
+        allocation_scope scope;
+        counts[other] = 2;
+        VERIFY_TRUE(scope.allocations() == 1 && counts.size() == 4, __LINE__);
+    }
+}
+#endif
+
+#if RUN_TEST_8C
+// a trivially copyable key with no default constructor
+struct FlatKey {
+    explicit FlatKey(int id) : id(id) {}
+    bool operator==(const FlatKey& other) const = default;
+    int id;
+};
+struct FlatKeyHash {
+    size_t operator()(const FlatKey& key) const { return std::hash<int>()(key.id); }
+};
+
+void C_flat_hashmap() {
+    /* FlatHashMap must agree with std::map through growth, erase (tombstones),
+     * reinsertion and rehash, and CompactHashMap must pick the right layout. */
+    static_assert(std::is_same_v<CompactHashMap<int64_t, int64_t>, FlatHashMap<int64_t, int64_t>>);
+    static_assert(std::is_same_v<CompactHashMap<std::string, int>, HashMap<std::string, int>>);
+
+    FlatHashMap<int64_t, int64_t> map;
+    std::map<int64_t, int64_t> answer;
+    for (int64_t i = 0; i < 10000; ++i) {
+        map.insert({i, i * i});
+        answer.insert({i, i * i});
+    }
+    VERIFY_TRUE(check_map_equal(map, answer), __LINE__);
+    VERIFY_TRUE(!map.insert({5, 0}).second && map.at(5) == 25, __LINE__);
+
+    for (int64_t i = 0; i < 10000; i += 2) {
+        VERIFY_TRUE(map.erase(i), __LINE__);
+        answer.erase(i);
+    }
+    VERIFY_TRUE(!map.erase(0), __LINE__);
+    for (int64_t i = 20000; i < 25000; ++i) {
+        map[i] = -i;
+        answer[i] = -i;
+    }
+    VERIFY_TRUE(check_map_equal(map, answer), __LINE__);
+
+    map.rehash(1);
+    VERIFY_TRUE(check_map_equal(map, answer), __LINE__);
+    std::map<int64_t, int64_t> visited;
+    for (const auto& [key, mapped] : map) visited.insert({key, mapped});
+    VERIFY_TRUE(visited == answer, __LINE__);
+    VERIFY_TRUE(map.find(3)->second == 9 && map.find(4) == map.end(), __LINE__);
+
+    map.clear();
+    VERIFY_TRUE(map.empty() && map.begin() == map.end() && !map.contains(3), __LINE__);
+
+    // the iterator returns a proxy by value: a C++20 forward iterator, a legacy input iterator
+    using flat_iterator = FlatHashMap<int64_t, int64_t>::iterator;
+    static_assert(std::forward_iterator<flat_iterator>);
+    static_assert(std::is_same_v<std::iterator_traits<flat_iterator>::iterator_category, std::input_iterator_tag>);
+
+    // keys without a default constructor are stored too
+    FlatHashMap<FlatKey, int, FlatKeyHash> keyed;
+    for (int i = 0; i < 100; ++i) keyed.insert({FlatKey(i), i});
+    keyed.rehash(1000);
+    VERIFY_TRUE(keyed.size() == 100 && keyed.at(FlatKey(42)) == 42 && !keyed.contains(FlatKey(100)), __LINE__);
+}
+#endif
+
+#if RUN_TEST_8D
+// a hash with state, which a default-constructed copy would not reproduce
+struct SeededHash {
+    uint64_t seed = 0;
+    size_t operator()(const int& key) const { return static_cast<size_t>((key ^ seed) * 0xff51afd7ed558ccdULL); }
+};
+
+// a trivially copyable value of our own, which mapped_codec needs a tag for
+struct MappedPoint {
+    int32_t x = 0, y = 0;
+    bool operator==(const MappedPoint&) const = default;
+};
+template <>
+struct mapped_codec<MappedPoint> : trivial_mapped_codec<MappedPoint, codec_tag(codec_kind::user, 1)> {};
+
+void D_mapped_hashmap() {
+    /* Saves maps to disk and checks that MappedHashMap answers every lookup
+     * from the mapped file, for both trivially copyable and string values. */
+    auto path = (std::filesystem::temp_directory_path() / "cs106l_mapped_hashmap_test.hmap").string();
+
+    HashMap<std::string, int> map(7);
+    std::map<std::string, int> answer;
+    for (int i = 0; i < 1000; ++i) {
+        map.insert({"key" + std::to_string(i), i});
+        answer.insert({"key" + std::to_string(i), i});
+    }
+    save_mapped(map, path);
+    {
+        MappedHashMap<std::string, int> mapped(path);
+        VERIFY_TRUE(mapped.size() == 1000, __LINE__);
+        for (const auto& [key, mapped_value] : answer) {
+            VERIFY_TRUE(mapped.contains(key) && mapped.at(key) == mapped_value, __LINE__);
+        }
+        VERIFY_TRUE(!mapped.contains("key1000") && mapped.find("nope") == mapped.end(), __LINE__);
+        VERIFY_TRUE(mapped.find("key42")->second == 42, __LINE__);
+
+        std::map<std::string, int> visited;
+        for (const auto& [key, mapped_value] : mapped) visited.insert({std::string(key), mapped_value});
+        VERIFY_TRUE(visited == answer, __LINE__);
+
+        bool correct_exception = false;
+        try {
+            mapped.at("missing");
+        } catch (const std::out_of_range& e) {
+            correct_exception = true;
+        }
+        VERIFY_TRUE(correct_exception, __LINE__);
+    }
+
+    // opening with the wrong mapped type must fail rather than misread the file
+    bool rejected = false;
+    try {
+        MappedHashMap<std::string, std::string> wrong(path);
+    } catch (const std::runtime_error& e) {
+        rejected = true;
+    }
+    VERIFY_TRUE(rejected, __LINE__);
+
+    // nor with a mapped type of the same size
+    auto opens = [&path]<typename Mapped>(Mapped) {
+        try {
+            MappedHashMap<std::string, Mapped> wrong(path);
+        } catch (const std::runtime_error& e) {
+            return false;
+        }
+        return true;
+    };
+    VERIFY_TRUE(opens(int{}) && !opens(float{}) && !opens(unsigned{}), __LINE__);
+
+    HashMap<std::string, double> ratios;
+    ratios.insert({"half", 0.5});
+    save_mapped(ratios, path);
+    VERIFY_TRUE(opens(double{}) && !opens(int64_t{}) && !opens(uint64_t{}), __LINE__);
+
+    // a trivially copyable type of our own is stored under the tag it picks
+    HashMap<std::string, MappedPoint> points;
+    points.insert({"origin", MappedPoint{0, 0}});
+    points.insert({"corner", MappedPoint{3, -4}});
+    save_mapped(points, path);
+    {
+        MappedHashMap<std::string, MappedPoint> mapped(path);
+        VERIFY_TRUE(mapped.at("corner") == (MappedPoint{3, -4}) && mapped.at("origin") == MappedPoint{}, __LINE__);
+    }
+    VERIFY_TRUE(!opens(int64_t{}) && !opens(double{}), __LINE__);
+
+    HashMap<std::string, std::string> capitals;
+    capitals.insert({"France", "Paris"});
+    capitals.insert({"Japan", "Tokyo"});
+    capitals.insert({"Empty", ""});
+    save_mapped(capitals, path, 1);
+    {
+        MappedHashMap<std::string, std::string> mapped(path);
+        VERIFY_TRUE(mapped.bucket_count() == 1 && mapped.size() == 3, __LINE__);
+        VERIFY_TRUE(mapped.at("France") == "Paris" && mapped.at("Japan") == "Tokyo", __LINE__);
+        VERIFY_TRUE(mapped.contains("Empty") && mapped.at("Empty").empty(), __LINE__);
+    }
+
+    // without an explicit hash, the file is laid out with the map's own hash function
+    HashMap<int, int, SeededHash> seeded(16, SeededHash{0x9e3779b97f4a7c15});
+    for (int i = 0; i < 100; ++i) seeded.insert({i, -i});
+    save_mapped(seeded, path);
+    {
+        MappedHashMap<int, int, SeededHash> mapped(path, seeded.hash_function());
+        bool all_found = true;
+        for (int i = 0; i < 100; ++i) all_found = all_found && mapped.contains(i) && mapped.at(i) == -i;
+        VERIFY_TRUE(all_found && !mapped.contains(100), __LINE__);
+    }
+
+    save_mapped(HashMap<std::string, int>(), path);
+    {
+        MappedHashMap<std::string, int> mapped(path);
+        VERIFY_TRUE(mapped.empty() && mapped.begin() == mapped.end() && !mapped.contains("A"), __LINE__);
+    }
+    std::filesystem::remove(path);
+}
+#endif
+
+#if RUN_TEST_8E
+// a trivially copyable key of our own, saved as raw bytes under a tag it picks
+struct GridPoint {
+    int32_t x, y;
+    bool operator==(const GridPoint&) const = default;
+};
+struct GridPointHash {
+    size_t operator()(const GridPoint& p) const { return std::hash<int64_t>()(int64_t{p.x} << 32 | uint32_t(p.y)); }
+};
+template <>
+struct binary_codec<GridPoint> : trivial_binary_codec<GridPoint, codec_tag(codec_kind::user, 1)> {};
+
+// a value that counts its copies, which load should never make
+struct CopyCounted {
+    static inline int copies = 0;
+    std::string text;
+    CopyCounted() = default;
+    explicit CopyCounted(std::string text) : text(std::move(text)) {}
+    CopyCounted(const CopyCounted& other) : text(other.text) { ++copies; }
+    CopyCounted(CopyCounted&&) = default;
+    CopyCounted& operator=(const CopyCounted& other) { text = other.text; ++copies; return *this; }
+    CopyCounted& operator=(CopyCounted&&) = default;
+};
+template <>
+struct binary_codec<CopyCounted> {
+    static constexpr uint32_t tag = codec_tag(codec_kind::user, 2);
+    static constexpr bool is_trivial = false;
+    static size_t size(const CopyCounted& value) { return binary_codec<std::string>::size(value.text); }
+    template <typename Writer>
+    static void write(Writer& out, const CopyCounted& value) { binary_codec<std::string>::write(out, value.text); }
+    template <typename Reader>
+    static CopyCounted read(Reader& in) { return CopyCounted(binary_codec<std::string>::read(in)); }
+};
+
+void E_binary_save_load() {
+    /* Round trips maps through save/load, with streams and spans, for both the
+     * trivially copyable fast path and length-prefixed strings. */
+    HashMap<int, double> numbers(37);
+    std::map<int, double> numbers_answer;
+    for (int i = -500; i < 500; ++i) {
+        numbers.insert({i, i / 4.0});
+        numbers_answer.insert({i, i / 4.0});
+    }
+    std::stringstream stream;
+    numbers.save(stream);
+    VERIFY_TRUE(stream.str().size() == numbers.serialized_size(), __LINE__);
+
+    HashMap<int, double> loaded;
+    loaded.insert({12345, 1.0});            // load replaces the old contents
+    loaded.load(stream);
+    VERIFY_TRUE(check_map_equal(loaded, numbers_answer), __LINE__);
+    VERIFY_TRUE(loaded.bucket_count() == 1000, __LINE__);   // pre-sized from the element count
+
+    HashMap<std::string, std::string> words;
+    std::map<std::string, std::string> words_answer;
+    for (const auto& [key, mapped] : vec) {
+        words.insert({key, std::to_string(mapped)});
+        words_answer.insert({key, std::to_string(mapped)});
+    }
+    words.insert({"", "empty key"});
+    words_answer.insert({"", "empty key"});
+    std::vector<std::byte> bytes(words.serialized_size());
+    VERIFY_TRUE(words.save(std::span<std::byte>(bytes)) == bytes.size(), __LINE__);
+    HashMap<std::string, std::string> words_loaded;
+    words_loaded.load(std::span<const std::byte>(bytes));
+    VERIFY_TRUE(check_map_equal(words_loaded, words_answer), __LINE__);
+
+    bool too_small = false;
+    try {
+        std::vector<std::byte> small(bytes.size() - 1);
+        words.save(std::span<std::byte>(small));
+    } catch (const std::length_error& e) {
+        too_small = true;
+    }
+    VERIFY_TRUE(too_small, __LINE__);
+
+    bool truncated = false;
+    try {
+        words_loaded.load(std::span<const std::byte>(bytes.data(), bytes.size() - 1));
+    } catch (const std::runtime_error& e) {
+        truncated = true;
+    }
+    VERIFY_TRUE(truncated && words_loaded.empty(), __LINE__);
+
+    bool wrong_type = false;
+    try {
+        HashMap<std::string, int> other;
+        other.load(std::span<const std::byte>(bytes));
+    } catch (const std::runtime_error& e) {
+        wrong_type = true;
+    }
+    VERIFY_TRUE(wrong_type, __LINE__);
+
+    // types of the same size are still different types
+    auto rejects = [](auto& map, const std::string& saved) {
+        std::stringstream in(saved);
+        try {
+            map.load(in);
+        } catch (const std::runtime_error& e) {
+            return true;
+        }
+        return false;
+    };
+    HashMap<int32_t, int64_t> int_map;
+    int_map.insert({1, -1});
+    std::stringstream int_stream;
+    int_map.save(int_stream);
+    HashMap<float, int64_t> float_keys;
+    HashMap<uint32_t, int64_t> unsigned_keys;
+    HashMap<int32_t, double> double_values;
+    HashMap<int32_t, uint64_t> unsigned_values;
+    VERIFY_TRUE(rejects(float_keys, int_stream.str()) && rejects(unsigned_keys, int_stream.str()), __LINE__);
+    VERIFY_TRUE(rejects(double_values, int_stream.str()) && rejects(unsigned_values, int_stream.str()), __LINE__);
+
+    HashMap<GridPoint, int, GridPointHash> grid;
+    for (int i = 0; i < 100; ++i) grid.insert({GridPoint{i, -i}, i});
+    std::stringstream grid_stream;
+    grid.save(grid_stream);
+    HashMap<GridPoint, int, GridPointHash> grid_loaded;
+    grid_loaded.load(grid_stream);
+    VERIFY_TRUE(grid_loaded == grid && grid_loaded.at(GridPoint{7, -7}) == 7, __LINE__);
+    HashMap<int64_t, int> same_size;
+    VERIFY_TRUE(rejects(same_size, grid_stream.str()), __LINE__);
+
+    // load moves the elements it read into the nodes
+    HashMap<int, CopyCounted> texts;
+    for (int i = 0; i < 100; ++i) texts.insert({i, CopyCounted("text number " + std::to_string(i))});
+    std::stringstream texts_stream;
+    texts.save(texts_stream);
+    HashMap<int, CopyCounted> texts_loaded;
+    CopyCounted::copies = 0;
+    texts_loaded.load(texts_stream);
+    VERIFY_TRUE(CopyCounted::copies == 0 && texts_loaded.size() == 100 && texts_loaded.at(42).text == "text number 42", __LINE__);
+
+    // corrupt counts and lengths must throw, not allocate what they claim
+    auto load_fails = [](auto& map, const std::vector<std::byte>& input) {
+        try {
+            map.load(std::span<const std::byte>(input));
+        } catch (const std::runtime_error& e) {
+            return map.empty();
+        }
+        return false;
+    };
+    auto patch = [](std::vector<std::byte> input, size_t offset, auto value) {
+        std::memcpy(input.data() + offset, &value, sizeof(value));
+        return input;
+    };
+    constexpr size_t size_offset = offsetof(hashmap_codec_detail::header, size);
+    constexpr size_t buckets_offset = offsetof(hashmap_codec_detail::header, bucket_count);
+    std::vector<std::byte> number_bytes(numbers.serialized_size());
+    numbers.save(std::span<std::byte>(number_bytes));
+    VERIFY_TRUE(load_fails(loaded, patch(number_bytes, size_offset, uint64_t{1} << 60)), __LINE__);
+    VERIFY_TRUE(load_fails(words_loaded, patch(bytes, size_offset, ~uint64_t{0})), __LINE__);
+    VERIFY_TRUE(load_fails(words_loaded, patch(bytes, sizeof(hashmap_codec_detail::header), ~uint32_t{0})), __LINE__);
+
+    // a corrupt bucket count is only a hint, and is bounded by the element count
+    loaded.load(std::span<const std::byte>(patch(number_bytes, buckets_offset, uint64_t{1} << 60)));
+    VERIFY_TRUE(check_map_equal(loaded, numbers_answer) && loaded.bucket_count() <= 2 * 1000 + 1024, __LINE__);
+}
+#endif
+
+#if RUN_TEST_8F
+// a distinct hash type, so that only this test's maps count operations
+struct CountedHash {
+    size_t operator()(const int& key) const { return static_cast<size_t>(key); }
+};
+template <>
+struct hashmap_policy<int, int, CountedHash> : counting_hashmap_policy {};
+
+void F_stats() {
+    /* Checks the chain statistics on a map with a known layout, the lifetime counters,
+     * and the per-operation counters enabled through hashmap_policy. */
+    HashMap<int, int, CountedHash> map(4);
+    // bucket(elements): 0(3), 1(1), 2(0), 3(2)
+    for (int key : {0, 4, 8, 1, 3, 7}) map.insert({key, key});
+
+    HashMapStats stats = map.stats();
+    VERIFY_TRUE(stats.size == 6 && stats.bucket_count == 4, __LINE__);
+    VERIFY_TRUE((stats.chain_length_histogram == std::vector<size_t>{1, 1, 1, 1}), __LINE__);
+    VERIFY_TRUE(stats.empty_buckets == 1 && stats.empty_bucket_ratio == 0.25, __LINE__);
+    VERIFY_TRUE(stats.max_chain_length == 3 && stats.mean_chain_length == 2.0, __LINE__);
+    VERIFY_TRUE(stats.max_probe_length == 3, __LINE__);
+    VERIFY_TRUE(stats.mean_probe_length == (1 + 2 + 3 + 1 + 1 + 2) / 6.0, __LINE__);
+    VERIFY_TRUE(stats.node_allocations == 6 && stats.rehash_count == 0, __LINE__);
+    VERIFY_TRUE(stats.bytes_used >= 6 * sizeof(std::pair<const int, int>), __LINE__);
+
+    VERIFY_TRUE(stats.counts_operations, __LINE__);
+    VERIFY_TRUE(stats.op_counts.inserts == 6 && stats.op_counts.lookups == 6, __LINE__);
+    VERIFY_TRUE(stats.op_counts.probes == 0 + 1 + 2 + 0 + 0 + 1, __LINE__);
+
+    map.contains(8);            // 1 probe, new nodes go to the front of the chain: 8 -> 4 -> 0
+    map.erase(4);               // 2 probes
+    map.rehash(9);              // one key per bucket
+    stats = map.stats();
+    VERIFY_TRUE(stats.op_counts.lookups == 8 && stats.op_counts.probes == 4 + 1 + 2, __LINE__);
+    VERIFY_TRUE(stats.op_counts.erases == 1, __LINE__);
+    VERIFY_TRUE(stats.rehash_count == 1 && stats.max_chain_length == 1, __LINE__);
+
+    // concurrent readers of a const map must not lose counts
+    const HashMap<int, int, CountedHash>& shared = map;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.emplace_back([&shared] {
+            for (int i = 0; i < 10000; ++i) shared.contains(i % 16);
+        });
+    }
+    for (auto& reader : readers) reader.join();
+    VERIFY_TRUE(map.stats().op_counts.lookups == 8 + 4 * 10000, __LINE__);
+
+    // maps with the default policy report zero operation counts
+    HashMap<int, int> plain;
+    plain.insert({1, 1});
+    plain.contains(1);
+    VERIFY_TRUE(!plain.stats().counts_operations && plain.stats().op_counts.lookups == 0, __LINE__);
+
+    std::ostringstream oss;
+    oss << map.stats();
+    VERIFY_TRUE(oss.str().find("size: 5") == 0, __LINE__);
+}
+#endif
+
+#if RUN_TEST_8G
+void G_allocation_counts() {
+    /* Checks the exact number of heap allocations made by each operation, through the
+     * operator new hook at the top of this file, and that the map frees everything. */
+    allocation_scope whole_test;
+    {
+        HashMap<int, int> map(8);
+        {
+            allocation_scope scope;
+            for (int i = 0; i < 10; ++i) map.insert({i, i});
+            VERIFY_TRUE(scope.allocations() == 10 && scope.deallocations() == 0, __LINE__);
+        }
+        {
+            // lookups, and inserts of keys already present, never allocate
+            allocation_scope scope;
+            map.insert({3, 30});
+            int found = 0;
+            for (int i = 0; i < 20; ++i) found += map.contains(i);
+            found += map.at(5) + map[6] + (map.find(7) != map.end());
+            const auto& cmap = map;
+            found += cmap.at(1) + (cmap.find(2) != cmap.end());
+            for (const auto& [key, mapped] : map) found += mapped;
+            VERIFY_TRUE(scope.allocations() == 0 && found > 0, __LINE__);
+        }
+        {
+            // operator[] on a new key allocates its node and nothing else
+            allocation_scope scope;
+            map[42] = 42;
+            VERIFY_TRUE(scope.allocations() == 1 && map.at(42) == 42, __LINE__);
+        }
+        {
+            allocation_scope scope;
+            map.erase(42);
+            VERIFY_TRUE(scope.allocations() == 0 && scope.deallocations() == 1, __LINE__);
+        }
+        {
+            // moves hand over the buckets and nodes
+            allocation_scope scope;
+            HashMap<int, int> moved(std::move(map));
+            map = std::move(moved);
+            VERIFY_TRUE(scope.allocations() == 0 && scope.deallocations() == 0, __LINE__);
+            VERIFY_TRUE(map.size() == 10 && map.at(9) == 9, __LINE__);
+        }
+        {
+            // a copy allocates its bucket array, its bitmap and one node per element
+            allocation_scope scope;
+            HashMap<int, int> copy(map);
+            VERIFY_TRUE(scope.allocations() == 2 + map.size(), __LINE__);
+            VERIFY_TRUE(copy == map, __LINE__);
+
+            // copy assignment frees the old nodes and reuses arrays of the same size
+            HashMap<int, int> assigned(8);
+            assigned.insert({100, 100});
+            allocation_scope assign;
+            assigned = map;
+            VERIFY_TRUE(assign.allocations() == map.size() && assign.deallocations() == 1, __LINE__);
+            VERIFY_TRUE(assigned == map, __LINE__);
+        }
+        {
+            // rehash replaces the bucket array and the bitmap, and reuses every node
+            allocation_scope scope;
+            map.rehash(100);
+            VERIFY_TRUE(scope.allocations() == 2 && scope.deallocations() == 2, __LINE__);
+        }
+        {
+            allocation_scope scope;
+            size_t size = map.size();
+            map.clear();
+            VERIFY_TRUE(scope.allocations() == 0 && scope.deallocations() == size, __LINE__);
+        }
+    }
+    {
+        // strings too long for the small string buffer show every copy of a key or value
+        auto long_string = [](const char* prefix, int i) {
+            return std::string(prefix) + "-too-long-for-the-small-string-buffer-" + std::to_string(i);
+        };
+        std::vector<std::pair<const std::string, std::string>> pairs;
+        for (int i = 0; i < 10; ++i) pairs.emplace_back(long_string("key", i), long_string("value", i));
+
+        HashMap<std::string, std::string> map(8);
+        {
+            // the node, and its copies of the key and of the value
+            allocation_scope scope;
+            for (const auto& pair : pairs) map.insert(pair);
+            VERIFY_TRUE(scope.allocations() == 3 * pairs.size() && scope.deallocations() == 0, __LINE__);
+        }
+        {
+            // operator[] builds the node from the key: the node and its copy of the key
+            std::string key = long_string("key", 42);
+            allocation_scope scope;
+            map[key] = pairs[0].second;
+            VERIFY_TRUE(scope.allocations() == 3 && scope.deallocations() == 0, __LINE__);
+            VERIFY_TRUE(map.at(key) == pairs[0].second, __LINE__);
+            map.erase(key);
+        }
+        {
+            // rehash moves the nodes without touching their keys or values
+            allocation_scope scope;
+            map.rehash(100);
+            VERIFY_TRUE(scope.allocations() == 2 && scope.deallocations() == 2, __LINE__);
+        }
+        {
+            allocation_scope scope;
+            HashMap<std::string, std::string> copy(map);
+            VERIFY_TRUE(scope.allocations() == 2 + 3 * map.size(), __LINE__);
+            allocation_scope compare;
+            VERIFY_TRUE(copy == map && !(copy != map), __LINE__);
+            VERIFY_TRUE(compare.allocations() == 0, __LINE__);
+        }
+    }
+    VERIFY_TRUE(whole_test.leaked_bytes() == 0, __LINE__);
+}
+#endif
+
+#if RUN_TEST_8H
+// a type that owns heap memory unknown to the default heap_size_estimator
+struct Blob {
+    std::vector<char> bytes;
+    bool operator==(const Blob& other) const { return bytes == other.bytes; }
+};
+template <>
+struct heap_size_estimator<Blob> {
+    static void add(const Blob& blob, heap_tally& tally) {
+        if (blob.bytes.capacity() > 0) tally.add_block(blob.bytes.capacity());
+    }
+};
+
+void H_memory_usage() {
+    /* Checks memory_usage against the bytes the allocation hook saw being requested,
+     * for keys and values with and without heap memory of their own. */
+    {
+        allocation_scope scope;
+        HashMap<int, int> map(100);
+        for (int i = 0; i < 50; ++i) map.insert({i, i});
+        HashMapMemoryUsage usage = map.memory_usage();
+        VERIFY_TRUE(usage.size == 50 && usage.bucket_count == 100, __LINE__);
+        VERIFY_TRUE(usage.key_heap_bytes == 0 && usage.mapped_heap_bytes == 0, __LINE__);
+        VERIFY_TRUE(usage.heap_blocks == 2 + 50, __LINE__);
+        VERIFY_TRUE(usage.bucket_bytes == 100 * sizeof(void*) + 2 * sizeof(uint64_t), __LINE__);
+        VERIFY_TRUE(static_cast<long>(usage.total() - usage.allocator_overhead) == scope.leaked_bytes(), __LINE__);
+        VERIFY_TRUE(usage.allocator_overhead > 0 && usage.total() == map.stats().bytes_used, __LINE__);
+        VERIFY_TRUE(usage.bytes_per_entry() == static_cast<double>(usage.total()) / 50, __LINE__);
+    }
+    {
+        // short strings are stored inline and own no heap; long ones do
+        allocation_scope scope;
+        HashMap<std::string, std::string> map;
+        map.insert({"short", std::string(100, 'v')});
+        map.insert({std::string(40, 'k'), "v"});
+        HashMapMemoryUsage usage = map.memory_usage();
+        VERIFY_TRUE(usage.key_heap_bytes == 41 && usage.mapped_heap_bytes == 101, __LINE__);
+        VERIFY_TRUE(static_cast<long>(usage.total() - usage.allocator_overhead) == scope.leaked_bytes(), __LINE__);
+    }
+    {
+        allocation_scope scope;
+        HashMap<int, Blob> map;
+        map.insert({1, Blob{std::vector<char>(1000)}});
+        map.insert({2, Blob{}});
+        HashMapMemoryUsage usage = map.memory_usage();
+        VERIFY_TRUE(usage.mapped_heap_bytes == 1000, __LINE__);
+        VERIFY_TRUE(static_cast<long>(usage.total() - usage.allocator_overhead) == scope.leaked_bytes(), __LINE__);
+    }
+    VERIFY_TRUE(HashMap<int, int>(1).memory_usage().node_bytes == 0, __LINE__);
+    VERIFY_TRUE(malloc_block_size(1) == 4 * sizeof(void*), __LINE__);
+    VERIFY_TRUE(malloc_block_size(24) == 32 && malloc_block_size(25) == 48, __LINE__);
+}
+#endif
+
+#if RUN_TEST_8I
+void I_set_and_multimap() {
+    /* HashSet and HashMultiMap are thin layers over HashMap; checks their
+     * behaviour against std::set and std::multimap. */
+    HashSet<std::string> links{"/wiki/Apple", "/wiki/Pear", "/wiki/Apple"};
+    VERIFY_TRUE(links.size() == 2 && links.contains("/wiki/Pear") && links.count("/wiki/Fig") == 0, __LINE__);
+    auto [stored, added] = links.insert("/wiki/Fig");
+    VERIFY_TRUE(added && *stored == "/wiki/Fig" && !links.insert("/wiki/Fig").second, __LINE__);
+    VERIFY_TRUE(links.find("/wiki/Fig") != links.end() && *links.find("/wiki/Fig") == "/wiki/Fig", __LINE__);
+    VERIFY_TRUE(links.find("/wiki/Kiwi") == links.end(), __LINE__);
+    std::set<std::string> seen(links.begin(), links.end());
+    VERIFY_TRUE(seen == std::set<std::string>({"/wiki/Apple", "/wiki/Pear", "/wiki/Fig"}), __LINE__);
+    VERIFY_TRUE(links.erase("/wiki/Apple") && !links.erase("/wiki/Apple") && links.size() == 2, __LINE__);
+
+    HashSet<int> a(7), b(100);
+    std::set<int> answer;
+    std::mt19937 rng(106);
+    for (int i = 0; i < 500; ++i) {
+        int key = rng() % 200;
+        VERIFY_TRUE(a.insert(key).second == answer.insert(key).second, __LINE__);
+        b.insert(key);
+    }
+    VERIFY_TRUE(a.size() == answer.size() && a == b, __LINE__);
+    a.rehash(1000);
+    VERIFY_TRUE(a == b && std::set<int>(a.begin(), a.end()) == answer, __LINE__);
+    b.erase(*answer.begin());
+    VERIFY_TRUE(a != b, __LINE__);
+    HashSet<int> copy = a;
+    a.clear();
+    VERIFY_TRUE(a.empty() && copy.size() == answer.size(), __LINE__);
+
+    // a set node is the key and the next pointer, smaller than a HashMap<K, bool> node
+    {
+        HashSet<uint64_t> ids(1000);
+        HashMap<uint64_t, bool> flags(1000);
+        HashSet<std::string> names(1000);
+        HashMap<std::string, bool> named(1000);
+        for (uint64_t i = 0; i < 1000; ++i) {
+            ids.insert(i);
+            flags.insert({i, true});
+            names.insert(std::to_string(i));
+            named.insert({std::to_string(i), true});
+        }
+        HashMapMemoryUsage set_usage = ids.memory_usage(), map_usage = flags.memory_usage();
+        VERIFY_TRUE(set_usage.node_bytes == 1000 * (sizeof(uint64_t) + sizeof(void*)), __LINE__);
+        VERIFY_TRUE(set_usage.node_bytes * 3 == map_usage.node_bytes * 2, __LINE__);
+        VERIFY_TRUE(set_usage.bucket_bytes == map_usage.bucket_bytes && set_usage.total() <= map_usage.total(), __LINE__);
+        // std::string nodes drop from 48 to 40 bytes, and to a smaller malloc block
+        VERIFY_TRUE(names.memory_usage().node_bytes < named.memory_usage().node_bytes, __LINE__);
+        VERIFY_TRUE(names.memory_usage().total() < named.memory_usage().total(), __LINE__);
+    }
+
+    HashMultiMap<int, std::string> multimap(16);
+    std::multimap<int, std::string> reference;
+    for (int i = 0; i < 300; ++i) {
+        int key = rng() % 50;
+        std::string value = std::to_string(i);
+        VERIFY_TRUE(multimap.insert({key, value}) == value, __LINE__);
+        reference.insert({key, value});
+    }
+    VERIFY_TRUE(multimap.size() == reference.size(), __LINE__);
+    size_t keys = 0;
+    for (const auto& [key, values] : multimap) {
+        ++keys;
+        auto [first, last] = reference.equal_range(key);
+        std::vector<std::string> expected;
+        for (; first != last; ++first) expected.push_back(first->second);
+        auto range = multimap.equal_range(key);
+        // the values of a key are contiguous, in insertion order
+        VERIFY_TRUE(std::vector<std::string>(range.begin(), range.end()) == expected, __LINE__);
+        VERIFY_TRUE(values.data() == range.data() && multimap.count(key) == expected.size(), __LINE__);
+    }
+    VERIFY_TRUE(keys == multimap.key_count(), __LINE__);
+    VERIFY_TRUE(multimap.equal_range(1000).empty() && multimap.count(1000) == 0, __LINE__);
+
+    int key = reference.begin()->first;
+    VERIFY_TRUE(multimap.erase(key) == reference.erase(key), __LINE__);
+    VERIFY_TRUE(!multimap.contains(key) && multimap.size() == reference.size(), __LINE__);
+    multimap.equal_range(reference.begin()->first)[0] = "changed";
+    VERIFY_TRUE(multimap.equal_range(reference.begin()->first)[0] == "changed", __LINE__);
+
+    // a key with one value allocates no vector
+    HashMultiMap<int, int> single{{1, 10}, {2, 20}, {2, 21}};
+    HashMapMemoryUsage usage = single.memory_usage();
+    VERIFY_TRUE(usage.mapped_heap_bytes == 2 * sizeof(int) && single.size() == 3, __LINE__);
+    VERIFY_TRUE((single == HashMultiMap<int, int>{{2, 20}, {1, 10}, {2, 21}}), __LINE__);
+    VERIFY_TRUE((single != HashMultiMap<int, int>{{1, 10}, {2, 21}, {2, 20}}), __LINE__);
+}
+#endif
+
+#if RUN_TEST_8J
+void J_bounded_caches() {
+    /* LruCache evicts exactly the least recently used entry; ClockCache gives
+     * referenced entries a second chance. Both keep their counters and byte
+     * totals consistent, and free everything they evict. */
+    LruCache<int, std::string> lru(CacheCapacity::entries(3));
+    lru.put(1, "one");
+    lru.put(2, "two");
+    lru.put(3, "three");
+    VERIFY_TRUE(lru.get(1) != nullptr && *lru.get(1) == "one", __LINE__);      // order now 1, 3, 2
+    lru.put(4, "four");                                                         // evicts 2
+    VERIFY_TRUE(!lru.contains(2) && lru.contains(1) && lru.contains(3) && lru.size() == 3, __LINE__);
+    VERIFY_TRUE(lru.peek(3) != nullptr && lru.get(2) == nullptr, __LINE__);     // peek does not touch 3
+    lru.put(5, "five");                                                         // evicts 3
+    VERIFY_TRUE(!lru.contains(3), __LINE__);
+    std::vector<int> order;
+    lru.for_each([&](int key, const std::string&) { order.push_back(key); });
+    VERIFY_TRUE((order == std::vector<int>{5, 4, 1}), __LINE__);
+    lru.put(4, "FOUR");                                                         // update, moves to front
+    VERIFY_TRUE(*lru.peek(4) == "FOUR" && lru.size() == 3, __LINE__);
+    CacheStats stats = lru.stats();
+    VERIFY_TRUE(stats.hits == 2 && stats.misses == 1 && stats.insertions == 5 && stats.updates == 1, __LINE__);
+    VERIFY_TRUE(stats.evictions == 2 && stats.hit_rate() == 2.0 / 3, __LINE__);
+    VERIFY_TRUE(lru.erase(1) && !lru.erase(1) && lru.size() == 2 && lru.stats().evictions == 2, __LINE__);
+
+    // byte capacity: long strings are charged for their heap
+    {
+        allocation_scope scope;
+        LruCache<int, std::string> pages(CacheCapacity::bytes(4000));
+        for (int i = 0; i < 100; ++i) {
+            VERIFY_TRUE(pages.put(i, std::string(500, 'p')), __LINE__);
+            VERIFY_TRUE(pages.bytes() <= 4000 && pages.contains(i), __LINE__);
+        }
+        size_t held = pages.size();
+        VERIFY_TRUE(held >= 5 && held < 8 && pages.stats().evictions == 100 - held, __LINE__);
+        VERIFY_TRUE(!pages.put(1000, std::string(5000, 'p')) && !pages.contains(1000), __LINE__);
+        VERIFY_TRUE(pages.bytes() > held * 500, __LINE__);
+        pages.clear();
+        VERIFY_TRUE(pages.empty() && pages.bytes() == 0, __LINE__);
+    }
+
+    ClockCache<int, int> clock(CacheCapacity::entries(4));
+    for (int i = 0; i < 4; ++i) clock.put(i, i);
+    VERIFY_TRUE(clock.get(0) && clock.get(1), __LINE__);
+    clock.put(4, 4);                    // 0 and 1 get a second chance, 2 is evicted
+    VERIFY_TRUE(clock.contains(0) && clock.contains(1) && !clock.contains(2), __LINE__);
+    VERIFY_TRUE(clock.contains(3) && clock.contains(4), __LINE__);
+    clock.put(5, 5);                    // the hand is past 0 and 1, whose bits are clear: 3 goes
+    VERIFY_TRUE(!clock.contains(3) && clock.size() == 4 && clock.stats().evictions == 2, __LINE__);
+    VERIFY_TRUE(clock.erase(0) && clock.size() == 3, __LINE__);
+
+    // under a skewed workload both caches keep the hot keys
+    LruCache<int, int> hot_lru(CacheCapacity::entries(100));
+    ClockCache<int, int> hot_clock(CacheCapacity::entries(100));
+    std::mt19937 rng(106);
+    for (int i = 0; i < 20000; ++i) {
+        int key = (rng() % 4 == 0) ? static_cast<int>(rng() % 10000) : static_cast<int>(rng() % 50);
+        if (!hot_lru.get(key)) hot_lru.put(key, key);
+        if (!hot_clock.get(key)) hot_clock.put(key, key);
+        VERIFY_TRUE(hot_lru.size() <= 100 && hot_clock.size() <= 100, __LINE__);
+    }
+    VERIFY_TRUE(hot_lru.stats().hit_rate() > 0.6 && hot_clock.stats().hit_rate() > 0.6, __LINE__);
+    VERIFY_TRUE(hot_lru.stats().hits + hot_lru.stats().misses == 20000, __LINE__);
+
+    // a copy has its own recency list and ring, which outlive the source
+    auto keys_of = [](const auto& cache) {
+        std::vector<int> keys;
+        cache.for_each([&](int key, const auto&) { keys.push_back(key); });
+        return keys;
+    };
+    {
+        auto source = std::make_unique<LruCache<int, std::string>>(CacheCapacity::entries(3));
+        for (int i = 0; i < 3; ++i) source->put(i, std::string(40, 'a' + i));
+        source->get(0);                                                         // order 0, 2, 1
+        size_t source_bytes = source->bytes();
+        LruCache<int, std::string> copy(*source);
+        LruCache<int, std::string> assigned(CacheCapacity::entries(1));
+        assigned.put(9, "nine");
+        assigned = *source;
+        source->put(3, "three");                                                // evicts 1 from the source only
+        source.reset();
+        VERIFY_TRUE((keys_of(copy) == std::vector<int>{0, 2, 1}) && keys_of(assigned) == keys_of(copy), __LINE__);
+        VERIFY_TRUE(copy.bytes() == source_bytes && assigned.bytes() == source_bytes, __LINE__);
+        copy.put(4, "four");                                                    // evicts 1
+        VERIFY_TRUE((keys_of(copy) == std::vector<int>{4, 0, 2}) && assigned.contains(1), __LINE__);
+
+        LruCache<int, std::string> moved(std::move(copy));
+        VERIFY_TRUE((keys_of(moved) == std::vector<int>{4, 0, 2}) && moved.get(2) != nullptr, __LINE__);
+        assigned = std::move(moved);
+        VERIFY_TRUE((keys_of(assigned) == std::vector<int>{2, 4, 0}) && assigned.size() == 3, __LINE__);
+    }
+    {
+        auto source = std::make_unique<ClockCache<int, int>>(CacheCapacity::entries(3));
+        for (int i = 0; i < 3; ++i) source->put(i, i);
+        source->get(0);
+        ClockCache<int, int> copy(*source);
+        ClockCache<int, int> assigned(CacheCapacity::entries(1));
+        assigned = *source;
+        source.reset();
+        VERIFY_TRUE(keys_of(copy) == keys_of(assigned) && copy.size() == 3, __LINE__);
+        copy.put(3, 3);                                                         // 0 is referenced: 1 goes
+        VERIFY_TRUE(copy.contains(0) && !copy.contains(1) && copy.contains(3), __LINE__);
+        VERIFY_TRUE(assigned.contains(1) && assigned.stats().evictions == 0, __LINE__);
+
+        ClockCache<int, int> moved(std::move(copy));
+        moved.put(4, 4);
+        VERIFY_TRUE(moved.size() == 3 && moved.contains(4) && moved.stats().evictions == 2, __LINE__);
+    }
+}
+#endif
+
+#if RUN_TEST_8K
+/*
+* Clock for TtlHashMap whose time only moves when the test says so.
+*/
+struct manual_clock {
+    using duration = std::chrono::milliseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using time_point = std::chrono::time_point<manual_clock>;
+    static constexpr bool is_steady = true;
+    static inline time_point current{};
+    static time_point now() { return current; }
+};
+
+void K_ttl_hashmap() {
+    /* Entries must disappear exactly when they expire: lazily on lookup, and
+     * from the timer wheel, whatever the distance to their expiry. */
+    using std::chrono::milliseconds;
+    using std::chrono::hours;
+    manual_clock::current = manual_clock::time_point();
+    TtlHashMap<int, std::string, std::hash<int>, manual_clock> map(milliseconds(100));
+    VERIFY_TRUE(map.insert(1, "one") && map.insert(2, "two", milliseconds(50)), __LINE__);
+    VERIFY_TRUE(!map.insert(2, "TWO", milliseconds(50)) && *map.find(2) == "TWO", __LINE__);
+    manual_clock::current += milliseconds(49);
+    VERIFY_TRUE(map.contains(2) && map.expire() == 0, __LINE__);
+    manual_clock::current += milliseconds(1);
+    // expired: invisible to lookups even before the wheel gets to it
+    VERIFY_TRUE(!map.contains(2) && !map.expiry(2) && map.size() == 2, __LINE__);
+    VERIFY_TRUE(map.expire() == 1 && map.size() == 1 && map.expired_count() == 1, __LINE__);
+    VERIFY_TRUE(map.touch(1, milliseconds(1000)) && map.expiry(1) == manual_clock::current + milliseconds(1000), __LINE__);
+    manual_clock::current += milliseconds(999);
+    VERIFY_TRUE(map.expire() == 0 && map.find(1) != nullptr, __LINE__);
+    manual_clock::current += milliseconds(1);
+    VERIFY_TRUE(map.find(1) == nullptr && map.empty() && map.expired_count() == 2, __LINE__);
+    map.insert(3, "three");
+    VERIFY_TRUE(map.erase(3) && !map.erase(3) && map.expired_count() == 2, __LINE__);
+
+    // random expiries spanning every level of the wheel, and beyond the top one
+    TtlHashMap<int, int, std::hash<int>, manual_clock> wheel(milliseconds(1), milliseconds(1), 64);
+    std::map<int, manual_clock::time_point> reference;
+    std::mt19937_64 rng(106);
+    auto random_ttl = [&]() {
+        switch (rng() % 5) {
+        case 0: return milliseconds(rng() % 64);
+        case 1: return milliseconds(rng() % 4096);
+        case 2: return milliseconds(rng() % 262144);
+        case 3: return milliseconds(rng() % 16777216);
+        default: return std::chrono::duration_cast<milliseconds>(hours(5 + rng() % 100));
+        }
+    };
+    for (int key = 0; key < 2000; ++key) {
+        auto ttl = random_ttl();
+        wheel.insert(key, key, ttl);
+        reference[key] = manual_clock::current + ttl;
+        manual_clock::current += milliseconds(rng() % 3);
+    }
+    for (int step = 0; step < 400; ++step) {
+        manual_clock::current += milliseconds(rng() % 5 == 0 ? rng() % 4000000 : rng() % 300);
+        size_t before = wheel.expired_count();
+        VERIFY_TRUE(wheel.expire() == wheel.expired_count() - before, __LINE__);
+        size_t live = 0;
+        for (const auto& [key, expiry] : reference) live += expiry > manual_clock::current;
+        // every expired entry has been swept, and no live entry has
+        VERIFY_TRUE(wheel.size() == live && wheel.expired_count() == reference.size() - live, __LINE__);
+    }
+    for (const auto& [key, expiry] : reference) {
+        VERIFY_TRUE(wheel.contains(key) == (expiry > manual_clock::current), __LINE__);
+    }
+    manual_clock::current += hours(200);
+    wheel.expire();
+    VERIFY_TRUE(wheel.expired_count() == reference.size() && wheel.empty(), __LINE__);
+}
+#endif
+
+#if RUN_TEST_8L
+void L_cow_snapshots() {
+    /* A snapshot must allocate nothing, whatever the size of the map, must never
+     * see later writes, and writes after it must copy only the segments they touch. */
+    CowHashMap<int, int> map(6400);
+    std::map<int, int> answer;
+    for (int i = 0; i < 5000; ++i) {
+        VERIFY_TRUE(map.insert({i, i}), __LINE__);
+        answer[i] = i;
+    }
+    VERIFY_TRUE(!map.insert({7, 0}) && map.at(7) == 7 && map.size() == 5000, __LINE__);
+    VERIFY_TRUE(map.segment_count() == 100 && map.segment_copies() == 0, __LINE__);
+
+    CowHashMap<int, int> snapshot;
+    {
+        allocation_scope scope;
+        snapshot = map.snapshot();
+        VERIFY_TRUE(scope.allocations() == 0, __LINE__);
+    }
+    {
+        // the first write copies the directory and one segment: its 64 buckets and ~50 nodes
+        allocation_scope scope;
+        map[7] = 70;
+        VERIFY_TRUE(map.segment_copies() == 1 && scope.allocations() < 100, __LINE__);
+        map[8] = 80;                    // same segment: no copy
+        map.erase(9);
+        VERIFY_TRUE(map.segment_copies() == 1, __LINE__);
+    }
+    map.insert({100000, 1});
+    map.erase(4999);
+    VERIFY_TRUE(map.segment_copies() <= 3, __LINE__);
+
+    // the snapshot still sees the map as it was
+    VERIFY_TRUE(snapshot.size() == 5000 && snapshot.at(7) == 7 && snapshot.contains(9), __LINE__);
+    VERIFY_TRUE(snapshot.contains(4999) && !snapshot.contains(100000), __LINE__);
+    VERIFY_TRUE(std::map<int, int>(snapshot.begin(), snapshot.end()) == answer, __LINE__);
+    VERIFY_TRUE(map.at(7) == 70 && map.at(8) == 80 && !map.contains(9) && map.size() == 4999, __LINE__);
+    VERIFY_TRUE(snapshot != map, __LINE__);
+
+    // a chain of snapshots, each one write apart
+    std::vector<CowHashMap<int, int>> versions;
+    CowHashMap<int, int> live(256);
+    std::mt19937 rng(106);
+    std::vector<std::map<int, int>> expected;
+    std::map<int, int> current;
+    for (int v = 0; v < 200; ++v) {
+        int key = rng() % 1000;
+        if (rng() % 3 == 0) {
+            live.erase(key);
+            current.erase(key);
+        } else {
+            live[key] = v;
+            current[key] = v;
+        }
+        versions.push_back(live.snapshot());
+        expected.push_back(current);
+    }
+    for (size_t v = 0; v < versions.size(); ++v) {
+        VERIFY_TRUE(std::map<int, int>(versions[v].begin(), versions[v].end()) == expected[v], __LINE__);
+        VERIFY_TRUE(versions[v].size() == expected[v].size(), __LINE__);
+    }
+
+    live.rehash(2000);
+    VERIFY_TRUE(live == versions.back() && live.bucket_count() == 2000, __LINE__);
+    live.clear();
+    VERIFY_TRUE(live.empty() && live.begin() == live.end() && versions.back().size() == current.size(), __LINE__);
+
+    {
+        // operator[] on an unshared segment: a hit allocates nothing, a miss only its node and key
+        CowHashMap<std::string, int> words(64);
+        std::string word(40, 'w'), other(40, 'o');
+        words[word] = 1;
+        allocation_scope scope;
+        for (int i = 0; i < 10; ++i) ++words[word];
+        VERIFY_TRUE(scope.allocations() == 0 && words.at(word) == 11, __LINE__);
+        words[other] = 2;
+        VERIFY_TRUE(scope.allocations() == 2 && words.size() == 2 && words.at(other) == 2, __LINE__);
+    }
+    {
+        allocation_scope scope;
+        CowHashMap<int, int> small{{1, 1}, {2, 2}};
+        VERIFY_TRUE(static_cast<long>(small.memory_usage().total() - small.memory_usage().allocator_overhead)
+                    == scope.leaked_bytes(), __LINE__);
+    }
+}
+#endif
+
+#if RUN_TEST_8M
+void M_persistent_hashmap() {
+    /* Every version must keep its own contents, modified copies must only
+     * allocate the path to the key, and without must keep the trie canonical. */
+    PersistentHashMap<int, int> empty;
+    auto one = empty.with(1, 10);
+    VERIFY_TRUE(empty.empty() && one.size() == 1 && one.at(1) == 10 && !empty.contains(1), __LINE__);
+    VERIFY_TRUE(one.with(1, 11).at(1) == 11 && one.at(1) == 10 && one.with(1, 11).size() == 1, __LINE__);
+    VERIFY_TRUE(one.without(1).empty() && one.without(2).shares_root_with(one), __LINE__);
+    VERIFY_TRUE(one.find(1) != one.end() && one.find(1)->second == 10 && one.find(2) == one.end(), __LINE__);
+
+    std::vector<PersistentHashMap<int, int>> versions{empty};
+    std::vector<std::map<int, int>> expected{{}};
+    std::mt19937 rng(106);
+    for (int v = 0; v < 3000; ++v) {
+        int key = rng() % 1500;
+        std::map<int, int> next = expected.back();
+        if (rng() % 4 == 0) {
+            versions.push_back(versions.back().without(key));
+            next.erase(key);
+        } else {
+            versions.push_back(versions.back().with(key, v));
+            next[key] = v;
+        }
+        expected.push_back(next);
+    }
+    for (size_t v = 0; v < versions.size(); v += 97) {
+        const auto& version = versions[v];
+        VERIFY_TRUE(version.size() == expected[v].size(), __LINE__);
+        VERIFY_TRUE(std::map<int, int>(version.begin(), version.end()) == expected[v], __LINE__);
+        for (const auto& [key, mapped] : expected[v]) {
+            VERIFY_TRUE(version.at(key) == mapped && version.find(key)->first == key, __LINE__);
+        }
+    }
+
+    // the same contents built in different orders compare equal and iterate identically
+    PersistentHashMap<int, int> forward, backward;
+    for (int i = 0; i < 2000; ++i) forward = forward.with(i, i);
+    for (int i = 1999; i >= 0; --i) backward = backward.with(i, i).with(i + 5000, 0).without(i + 5000);
+    VERIFY_TRUE(forward == backward && std::equal(forward.begin(), forward.end(), backward.begin()), __LINE__);
+    // find returns an iterator that continues the iteration
+    size_t visited = 0;
+    for (auto it = forward.find(forward.begin()->first); it != forward.end(); ++it) ++visited;
+    VERIFY_TRUE(visited == 2000, __LINE__);
+
+    // colliding hashes share a collision node at the bottom of the trie
+    auto collide = [](int key) { return static_cast<size_t>(key % 3); };
+    PersistentHashMap<int, int, decltype(collide)> collisions(collide);
+    for (int i = 0; i < 30; ++i) collisions = collisions.with(i, i);
+    VERIFY_TRUE(collisions.size() == 30 && collisions.at(29) == 29, __LINE__);
+    for (int i = 0; i < 30; i += 2) collisions = collisions.without(i);
+    VERIFY_TRUE(collisions.size() == 15 && !collisions.contains(28) && collisions.at(27) == 27, __LINE__);
+
+    // a modified copy only allocates the path to its key: a few blocks, not a map
+    {
+        PersistentHashMap<int, int> big;
+        for (int i = 0; i < 20000; ++i) big = big.with(i, i);
+        allocation_scope scope;
+        std::vector<PersistentHashMap<int, int>> configs;
+        configs.reserve(1000);
+        for (int i = 0; i < 1000; ++i) configs.push_back(big.with(i * 7, -i));
+        VERIFY_TRUE(scope.allocations() < 1 + 1000 * 2 * 5, __LINE__);
+        VERIFY_TRUE(configs[999].at(999 * 7) == -999 && big.at(999 * 7) == 999 * 7, __LINE__);
+    }
+    {
+        allocation_scope scope;
+        PersistentHashMap<int, std::string> small{{1, "one"}, {2, std::string(100, 't')}};
+        HashMapMemoryUsage usage = small.memory_usage();
+        VERIFY_TRUE(static_cast<long>(usage.total() - usage.allocator_overhead) == scope.leaked_bytes(), __LINE__);
+    }
+}
+#endif
+
+#if RUN_TEST_8N
+// a distinct hash type, so that only this test's maps have a Bloom filter
+struct FilteredHash {
+    size_t operator()(const int& key) const { return static_cast<size_t>(key); }
+};
+template <>
+struct hashmap_policy<int, int, FilteredHash> : bloom_hashmap_policy {};
+
+void N_bloom_filter() {
+    /* The filter must never hide a key that is present (through inserts, erases,
+     * rehashes, copies and clears), must stop most lookups of absent keys, and must
+     * be counted in stats() and memory_usage(). */
+    HashMap<int, int, FilteredHash> map(1000);
+    std::set<int> expected;
+    for (int i = 0; i < 10000; i += 2) {
+        map.insert({i, i});
+        expected.insert(i);
+    }
+    auto matches = [&] {
+        for (int i = -10; i < 10010; ++i) {
+            if (map.contains(i) != (expected.count(i) == 1)) return false;
+        }
+        return true;
+    };
+    VERIFY_TRUE(matches(), __LINE__);
+
+    HashMapStats before = map.stats();
+    for (int i = 1; i < 10000; i += 2) map.contains(i);
+    HashMapStats after = map.stats();
+    size_t negatives = after.bloom_counts.negatives - before.bloom_counts.negatives;
+    size_t false_positives = after.bloom_counts.false_positives - before.bloom_counts.false_positives;
+    VERIFY_TRUE(after.bloom_filter && after.bloom_bytes > 0, __LINE__);
+    VERIFY_TRUE(negatives + false_positives == 5000 && false_positives < 100, __LINE__);
+    VERIFY_TRUE(after.bloom_false_positive_rate < 0.02, __LINE__);
+
+    // readers of a const map share the filter counters without losing updates
+    {
+        const HashMap<int, int, FilteredHash>& shared = map;
+        std::vector<std::thread> readers;
+        for (int t = 0; t < 4; ++t) {
+            readers.emplace_back([&shared] {
+                for (int i = 1; i < 10000; i += 2) shared.contains(i);
+            });
+        }
+        for (std::thread& reader : readers) reader.join();
+        HashMapBloomCounts counts = map.stats().bloom_counts;
+        VERIFY_TRUE(counts.queries - after.bloom_counts.queries == 4 * 5000, __LINE__);
+        VERIFY_TRUE(counts.negatives + counts.false_positives
+                    - after.bloom_counts.negatives - after.bloom_counts.false_positives == 4 * 5000, __LINE__);
+    }
+
+    // erased keys leave stale bits until the erased keys outnumber the live ones
+    size_t rebuilds = map.stats().bloom_counts.rebuilds;
+    for (int i = 0; i < 10000; i += 4) {
+        map.erase(i);
+        expected.erase(i);
+    }
+    VERIFY_TRUE(map.stats().bloom_counts.rebuilds == rebuilds && matches(), __LINE__);
+    map.erase(2);
+    expected.erase(2);
+    VERIFY_TRUE(map.stats().bloom_counts.rebuilds == rebuilds + 1 && matches(), __LINE__);
+    map.rehash(10007);
+    VERIFY_TRUE(map.stats().bloom_counts.rebuilds == rebuilds + 2 && matches(), __LINE__);
+
+    HashMap<int, int, FilteredHash> copy(map);
+    VERIFY_TRUE(copy == map && copy.contains(6) && !copy.contains(4), __LINE__);
+    HashMap<int, int, FilteredHash> moved(std::move(copy));
+    VERIFY_TRUE(moved == map && moved.contains(6), __LINE__);
+    map.clear();
+    expected.clear();
+    VERIFY_TRUE(matches() && map.insert({4, 4}).second && map.contains(4), __LINE__);
+
+    // maps with the default policy have no filter
+    HashMap<int, int> plain;
+    plain.insert({1, 1});
+    VERIFY_TRUE(!plain.stats().bloom_filter && plain.stats().bloom_bytes == 0, __LINE__);
+    {
+        allocation_scope scope;
+        HashMap<int, int, FilteredHash> small;
+        for (int i = 0; i < 100; ++i) small.insert({i, i});
+        HashMapMemoryUsage usage = small.memory_usage();
+        VERIFY_TRUE(static_cast<long>(usage.total() - usage.allocator_overhead) == scope.leaked_bytes(), __LINE__);
+    }
+}
+#endif
+
+#if RUN_TEST_8O
+void O_parallel_algorithms() {
+    /* The bucket range must be a proper random-access range, and the parallel
+     * algorithms must visit every element exactly once, on any number of threads,
+     * with skewed chains and with exceptions. */
+    using Map = HashMap<int, long>;
+    using buckets_type = Map::const_bucket_range;
+    static_assert(std::random_access_iterator<buckets_type::iterator>);
+    static_assert(std::forward_iterator<buckets_type::bucket::iterator>);
+    static_assert(std::ranges::random_access_range<buckets_type>);
+    static_assert(std::ranges::sized_range<buckets_type>);
+
+    Map map(1000);
+    for (int i = 0; i < 5000; ++i) map.insert({i, i});
+    const Map& const_map = map;
+    auto buckets = const_map.buckets();
+    VERIFY_TRUE(buckets.size() == 1000 && buckets.end() - buckets.begin() == 1000, __LINE__);
+    VERIFY_TRUE(buckets[7].size() == 5 && (*(buckets.begin() + 7)).size() == 5, __LINE__);
+    VERIFY_TRUE(buckets.begin()[7].begin()->first % 1000 == 7, __LINE__);
+    VERIFY_TRUE(buckets.slice(10, 20).size() == 10 && buckets.slice(10, 20)[0].begin()->first % 1000 == 10, __LINE__);
+    size_t counted = 0;
+    for (auto bucket : buckets) counted += bucket.size();
+    VERIFY_TRUE(counted == map.size(), __LINE__);
+
+    long expected_sum = 5000L * 4999 / 2;
+    for (size_t threads : {1, 3, 8}) {
+        thread_pool pool(threads);
+        VERIFY_TRUE(pool.size() == std::max<size_t>(threads, 1), __LINE__);
+        parallel_for_each(map, [](auto& element) { element.second += 1; }, pool);
+        long sum = parallel_reduce(map, 0L, std::plus<>(), [](const auto& element) { return element.second; }, pool);
+        expected_sum += 5000;
+        VERIFY_TRUE(sum == expected_sum, __LINE__);
+    }
+    VERIFY_TRUE(map.at(4999) == 4999 + 3, __LINE__);
+
+    thread_pool pool(4);
+    // reduce need not be commutative: the chunks are combined in bucket order
+    HashMap<int, int> ordered(64);
+    for (int i = 0; i < 64; ++i) ordered.insert({i, i});
+    auto concatenated = parallel_reduce(ordered, std::string(), std::plus<>(),
+                                        [](const auto& element) { return std::to_string(element.first) + ","; }, pool);
+    std::string in_order;
+    for (const auto& [key, mapped] : ordered) in_order += std::to_string(key) + ",";
+    VERIFY_TRUE(concatenated == in_order, __LINE__);
+
+    auto names = parallel_transform(map, [](const auto& element) { return std::to_string(element.first); }, pool);
+    VERIFY_TRUE(names.size() == map.size() && names.at(1234) == "1234", __LINE__);
+
+    // every key in one bucket: the chain cannot be split, but it is still visited once
+    auto collide = [](const int&) { return size_t{0}; };
+    HashMap<int, int, decltype(collide)> skewed(100, collide);
+    for (int i = 0; i < 300; ++i) skewed.insert({i, 1});
+    std::atomic<int> visits{0};
+    parallel_for_each(std::as_const(skewed), [&](const auto& element) { visits += element.second; }, pool);
+    VERIFY_TRUE(visits == 300, __LINE__);
+
+    HashMap<int, int> empty;
+    VERIFY_TRUE(parallel_reduce(empty, 5, std::plus<>(), [](const auto&) { return 1; }, pool) == 5, __LINE__);
+
+    bool thrown = false;
+    try {
+        parallel_for_each(map, [](auto& element) {
+            if (element.first == 2500) throw std::runtime_error("stop");
+        }, pool);
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    VERIFY_TRUE(thrown, __LINE__);
+    // the pool is still usable after an exception
+    VERIFY_TRUE(parallel_reduce(map, 0, std::plus<>(), [](const auto&) { return 1; }, pool) == 5000, __LINE__);
+}
+#endif
+
+#if RUN_TEST_8P
+void P_ranges_and_views() {
+    /* The iterators must model std::forward_iterator, iterator must convert to
+     * const_iterator, keys() and values() must be lazy views that allocate nothing,
+     * and erasing through iterators must continue at the next element. */
+    using Map = HashMap<int, int>;
+    static_assert(std::forward_iterator<Map::iterator>);
+    static_assert(std::forward_iterator<Map::const_iterator>);
+    static_assert(std::ranges::forward_range<Map> && std::ranges::forward_range<const Map>);
+    static_assert(std::ranges::common_range<Map>);
+    static_assert(std::is_convertible_v<Map::iterator, Map::const_iterator>);
+    static_assert(!std::is_convertible_v<Map::const_iterator, Map::iterator>);
+    static_assert(std::ranges::view<decltype(std::declval<const Map&>().keys())>);
+
+    Map map;
+    for (int i = 0; i < 100; ++i) map.insert({i, i * i});
+    Map::const_iterator converted = map.begin();
+    VERIFY_TRUE(converted == map.cbegin() && map.cend() == Map::const_iterator(map.end()), __LINE__);
+
+    size_t counted = 0;
+    for (auto it = map.begin(); it != std::default_sentinel; ++it) ++counted;
+    VERIFY_TRUE(counted == 100 && std::ranges::distance(map) == 100, __LINE__);
+
+    // multi-pass: max_element keeps an iterator while it goes on scanning
+    auto largest = std::ranges::max_element(map, {}, [](const auto& element) { return element.second; });
+    VERIFY_TRUE(largest->first == 99, __LINE__);
+    {
+        allocation_scope scope;
+        long key_sum = 0;
+        for (int key : map.keys()) key_sum += key;
+        auto even = map.values() | std::views::filter([](int v) { return v % 2 == 0; });
+        long even_count = std::ranges::distance(even);
+        VERIFY_TRUE(key_sum == 99 * 100 / 2 && even_count == 50, __LINE__);
+        for (int& mapped : map.values()) mapped = -mapped;
+        VERIFY_TRUE(scope.allocations() == 0, __LINE__);
+    }
+    VERIFY_TRUE(map.at(7) == -49, __LINE__);
+    std::set<int> keys(map.keys().begin(), map.keys().end());
+    VERIFY_TRUE(keys.size() == 100 && *keys.rbegin() == 99, __LINE__);
+
+    // erase while iterating: erase(it) returns the next element
+    for (auto it = map.begin(); it != map.end();) {
+        it = it->first % 3 == 0 ? map.erase(it) : std::next(it);
+    }
+    VERIFY_TRUE(map.size() == 66 && !map.contains(3) && map.contains(4), __LINE__);
+    auto first = map.begin();
+    auto last = std::next(first, 10);
+    int kept = last->first;
+    VERIFY_TRUE(map.erase(first, last) == last && map.size() == 56 && map.contains(kept), __LINE__);
+    VERIFY_TRUE(map.erase(map.begin(), map.end()) == map.end() && map.empty(), __LINE__);
+}
+#endif
+
+#if RUN_TEST_8Q
+// counts its default constructions, which operator[] should only make for new keys
+struct DefaultCounted {
+    static inline int constructed = 0;
+    DefaultCounted() { ++constructed; }
+    int value = 0;
+};
+
+void Q_string_hashmap() {
+    /* StringHashMap must behave like a map from std::string, for keys stored inline
+     * and in the pool, through erases (which move the last entry), growth, copies
+     * and pool compaction; and memory_usage must match the bytes actually allocated. */
+    StringHashMap<int> map;
+    std::map<std::string, int> answer;
+    auto key_of = [](int i) { return std::string(static_cast<size_t>(i % 40), 'k') + std::to_string(i); };
+    for (int i = 0; i < 2000; ++i) {
+        auto [mapped, added] = map.insert({key_of(i), i});
+        VERIFY_TRUE(added && *mapped == i, __LINE__);
+        answer.insert({key_of(i), i});
+    }
+    VERIFY_TRUE(!map.insert({key_of(5), -1}).second && map.at(key_of(5)) == 5, __LINE__);
+    VERIFY_TRUE(map.insert({"", 7}).second && map.at("") == 7 && map.erase(""), __LINE__);
+    for (int i = 0; i < 2000; i += 3) {
+        VERIFY_TRUE(map.erase(key_of(i)), __LINE__);
+        answer.erase(key_of(i));
+    }
+    VERIFY_TRUE(!map.erase(key_of(0)) && !map.contains(key_of(3)) && map.contains(key_of(4)), __LINE__);
+    ++map[key_of(4)];
+    ++answer[key_of(4)];
+    map["new key, long enough for the pool"] = 1;
+    answer["new key, long enough for the pool"] = 1;
+
+    // operator[] constructs a mapped value only for a new key
+    {
+        StringHashMap<DefaultCounted> counted;
+        counted["a key long enough for the pool"].value = 1;
+        DefaultCounted::constructed = 0;
+        for (int i = 0; i < 10; ++i) ++counted["a key long enough for the pool"].value;
+        VERIFY_TRUE(DefaultCounted::constructed == 0 && counted.at("a key long enough for the pool").value == 11, __LINE__);
+        counted["another"];
+        VERIFY_TRUE(DefaultCounted::constructed == 1 && counted.size() == 2, __LINE__);
+    }
+
+    std::map<std::string, int> seen;
+    for (auto [key, mapped] : map) seen.emplace(std::string(key), mapped);
+    VERIFY_TRUE(seen == answer && map.size() == answer.size(), __LINE__);
+    VERIFY_TRUE(map.find(key_of(1))->second == 1 && map.find(key_of(3)) == map.end(), __LINE__);
+    try {
+        map.at(key_of(3));
+        VERIFY_TRUE(false, __LINE__);
+    } catch (const std::out_of_range&) {}
+
+    // the copy has its own pool: it outlives the original's keys
+    StringHashMap<int> copy(map);
+    map.clear();
+    VERIFY_TRUE(map.empty() && !map.contains(key_of(1)) && map.memory_usage().key_heap_bytes == 0, __LINE__);
+    seen.clear();
+    for (auto [key, mapped] : copy) seen.emplace(std::string(key), mapped);
+    VERIFY_TRUE(seen == answer, __LINE__);
+
+    // erased keys stay in the pool until it is compacted
+    size_t pool_before = copy.memory_usage().key_heap_bytes;
+    for (const auto& [key, mapped] : answer) {
+        if (mapped % 2 == 0) copy.erase(key);
+    }
+    copy.shrink_to_fit();
+    VERIFY_TRUE(copy.memory_usage().key_heap_bytes < pool_before && copy.contains(key_of(1)), __LINE__);
+    VERIFY_TRUE(!copy.contains(key_of(2)) && copy.load_factor() < 0.875f, __LINE__);
+
+    {
+        allocation_scope scope;
+        StringHashMap<std::string> strings;
+        for (int i = 0; i < 500; ++i) strings.insert({key_of(i), std::string(static_cast<size_t>(i % 30), 'v')});
+        strings.insert({std::string(100000, 'x'), "huge key"});
+        HashMapMemoryUsage usage = strings.memory_usage();
+        VERIFY_TRUE(usage.size == 501 && usage.mapped_heap_bytes > 0, __LINE__);
+        VERIFY_TRUE(static_cast<long>(usage.total() - usage.allocator_overhead) == scope.leaked_bytes(), __LINE__);
+        VERIFY_TRUE(strings.at(std::string(100000, 'x')) == "huge key", __LINE__);
+    }
+    {
+        // the point of the exercise: well under HashMap<std::string, int>, and about
+        // half of it when the size is known up front. 150000 keys also make sure that
+        // building a large map stays linear.
+        const int n = 150000;
+        std::vector<std::string> urls;
+        for (int i = 0; i < n; ++i) urls.push_back("/wiki/Page_number_" + std::to_string(1000000 + i));
+        HashMap<std::string, int> nodes(urls.size());
+        StringHashMap<int> grown;
+        StringHashMap<int> reserved;
+        reserved.reserve(n);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < n; ++i) grown.insert({urls[i], i});
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        for (int i = 0; i < n; ++i) {
+            nodes.insert({urls[i], i});
+            reserved.insert({urls[i], i});
+        }
+        VERIFY_TRUE(elapsed < std::chrono::seconds(2), __LINE__);
+        VERIFY_TRUE(grown.size() == n && grown.at(urls[n - 1]) == n - 1 && reserved.at(urls[0]) == 0, __LINE__);
+        size_t node_bytes = nodes.memory_usage().total();
+        VERIFY_TRUE(grown.memory_usage().total() * 4 < node_bytes * 3, __LINE__);
+        VERIFY_TRUE(reserved.memory_usage().total() * 10 < node_bytes * 6, __LINE__);
+    }
+}
+#endif
+
+#if RUN_TEST_8R
+void R_packed_hashmap() {
+    /* PackedHashMap must agree with std::map through inserts, assignments and erases
+     * of keys and values of every encoded width (including negative numbers, which
+     * widen a block when they arrive), through growth and copies; and it must use
+     * a fraction of the memory of FlatHashMap for small integers. */
+    PackedHashMap<int64_t, int32_t> map;
+    std::map<int64_t, int32_t> answer;
+    std::mt19937_64 random(8);
+    for (int i = 0; i < 30000; ++i) {
+        int64_t key;
+        switch (random() % 4) {
+        case 0: key = static_cast<int64_t>(random() % 1000) - 500; break;
+        case 1: key = static_cast<int64_t>(random()); break;
+        default: key = static_cast<int64_t>(random() % 50000); break;
+        }
+        int32_t mapped = random() % 3 == 0 ? static_cast<int32_t>(random()) : static_cast<int32_t>(random() % 10);
+        switch (random() % 5) {
+        case 0:
+        case 1: {
+            auto [value, added] = map.insert({key, mapped});
+            auto expected = answer.insert({key, mapped});
+            VERIFY_TRUE(added == expected.second && value == expected.first->second, __LINE__);
+            break;
+        }
+        case 2:
+            VERIFY_TRUE(map.insert_or_assign(key, mapped) == answer.insert_or_assign(key, mapped).second, __LINE__);
+            break;
+        case 3:
+            VERIFY_TRUE(map.erase(key) == (answer.erase(key) == 1), __LINE__);
+            break;
+        default:
+            VERIFY_TRUE(map.contains(key) == answer.contains(key), __LINE__);
+            if (answer.contains(key)) VERIFY_TRUE(map.at(key) == answer.at(key), __LINE__);
+        }
+    }
+    VERIFY_TRUE(map.size() == answer.size() && map.load_factor() <= 32, __LINE__);
+    VERIFY_TRUE(std::map<int64_t, int32_t>(map.begin(), map.end()) == answer, __LINE__);
+    try {
+        map.at(std::numeric_limits<int64_t>::min());
+        VERIFY_TRUE(false, __LINE__);
+    } catch (const std::out_of_range&) {}
+
+    PackedHashMap<int64_t, int32_t> copy(map);
+    map.clear();
+    VERIFY_TRUE(map.empty() && map.begin() == map.end() && map.memory_usage().node_bytes == 0, __LINE__);
+    VERIFY_TRUE(std::map<int64_t, int32_t>(copy.begin(), copy.end()) == answer, __LINE__);
+
+    // the quotient search (AVX2 when built with HASHMAP_AVX2) finds every position of
+    // every width, in and after the 32 byte steps, including the first of duplicates
+    {
+        uint8_t bytes[40 * 8] = {};
+        auto check_width = [&]<size_t W, typename U>(std::integral_constant<size_t, W>, U) {
+            for (size_t count : {0, 1, 31, 32, 33, 40}) {
+                for (size_t i = 0; i < count; ++i) {
+                    U stored = static_cast<U>(i * 3 + 1);
+                    std::memcpy(bytes + i * W, &stored, W);
+                }
+                for (size_t i = 0; i < count; ++i)
+                    VERIFY_TRUE(packed_hashmap_detail::find<W, U>(bytes, count, i * 3 + 1) == i, __LINE__);
+                VERIFY_TRUE(packed_hashmap_detail::find<W, U>(bytes, count, 2) == count, __LINE__);
+                if (count > 1) {
+                    std::memcpy(bytes + (count - 1) * W, bytes, W);
+                    VERIFY_TRUE(packed_hashmap_detail::find<W, U>(bytes, count, 1) == 0, __LINE__);
+                }
+            }
+        };
+        check_width(std::integral_constant<size_t, 1>{}, uint8_t{});
+        check_width(std::integral_constant<size_t, 2>{}, uint16_t{});
+        check_width(std::integral_constant<size_t, 4>{}, uint32_t{});
+        check_width(std::integral_constant<size_t, 8>{}, uint64_t{});
+    }
+
+    // the extremes of unsigned and narrow types survive the encoding
+    PackedHashMap<uint64_t, int8_t> extremes;
+    extremes.insert({0, -128});
+    extremes.insert({UINT64_MAX, 127});
+    extremes.insert({1ULL << 63, 0});
+    VERIFY_TRUE(extremes.at(UINT64_MAX) == 127 && extremes.at(0) == -128 && extremes.at(1ULL << 63) == 0, __LINE__);
+
+    {
+        allocation_scope scope;
+        PackedHashMap<int64_t, int64_t> ids;
+        for (int64_t i = 0; i < 100000; ++i) ids.insert({i * 13, i % 1000});
+        HashMapMemoryUsage usage = ids.memory_usage();
+        VERIFY_TRUE(usage.size == 100000 && usage.bucket_count == ids.bucket_count(), __LINE__);
+        VERIFY_TRUE(static_cast<long>(usage.total() - usage.allocator_overhead) == scope.leaked_bytes(), __LINE__);
+        // 16 bytes of payload in under 8 bytes; FlatHashMap needs 22 or more
+        VERIFY_TRUE(usage.bytes_per_entry() < 8, __LINE__);
+        VERIFY_TRUE(ids.at(13 * 4321) == 321 && !ids.contains(13 * 4321 + 1), __LINE__);
+    }
+}
+#endif
+
+#if RUN_TEST_8S
+struct HugePageHash {
+    size_t operator()(const int& key) const { return std::hash<int>()(key); }
+};
+template <>
+struct hashmap_policy<int, int, HugePageHash> : huge_page_hashmap_policy {};
+template <>
+struct hashmap_policy<int, std::string, HugePageHash> : interleaved_huge_page_hashmap_policy {};
+
+void S_huge_pages() {
+    /* Maps whose nodes come from slabs and whose bucket arrays may be mapped regions
+     * must behave like any other map: through erases (which recycle nodes), rehashes,
+     * copies, moves and clears. Large allocations must be huge page aligned, and
+     * memory_usage must still match what was allocated. */
+    std::vector<uint64_t, huge_page_allocator<uint64_t>> table(1 << 20, 7);
+    VERIFY_TRUE(reinterpret_cast<uintptr_t>(table.data()) % (2 << 20) == 0 && table[12345] == 7, __LINE__);
+    std::vector<uint64_t, huge_page_allocator<uint64_t, true>> small(10, 1);
+    VERIFY_TRUE(small.back() == 1, __LINE__);
+
+    HashMap<int, int, HugePageHash> map(1000);
+    std::map<int, int> answer;
+    for (int i = 0; i < 20000; ++i) {
+        map.insert({i, -i});
+        answer.insert({i, -i});
+    }
+    for (int i = 0; i < 20000; i += 2) {
+        map.erase(i);
+        answer.erase(i);
+    }
+    HashMapMemoryUsage before = map.memory_usage();
+    // the erased nodes are reused, so these inserts need no new slab
+    for (int i = 0; i < 5000; ++i) {
+        map.insert({-i - 1, i});
+        answer.insert({-i - 1, i});
+    }
+    VERIFY_TRUE(map.memory_usage().node_bytes == before.node_bytes, __LINE__);
+    map.rehash(300000);         // 2.4 MB of buckets: a mapped region
+    VERIFY_TRUE(std::map<int, int>(map.begin(), map.end()) == answer, __LINE__);
+
+    HashMap<int, int, HugePageHash> copy(map);
+    HashMap<int, int, HugePageHash> moved(std::move(map));
+    map = copy;
+    VERIFY_TRUE(map == moved && std::map<int, int>(copy.begin(), copy.end()) == answer, __LINE__);
+    moved.clear();
+    VERIFY_TRUE(moved.empty() && moved.memory_usage().node_bytes == 0 && !moved.contains(1), __LINE__);
+    moved.insert({1, 1});
+    VERIFY_TRUE(moved.at(1) == 1 && copy.at(1) == -1, __LINE__);
+
+    {
+        // nothing is mapped yet, so the allocation hook sees all of it
+        allocation_scope scope;
+        HashMap<int, std::string, HugePageHash> strings(100);
+        for (int i = 0; i < 500; ++i) strings.insert({i, std::string(static_cast<size_t>(i % 40), 's')});
+        HashMapMemoryUsage usage = strings.memory_usage();
+        // the strings of 16 or more characters are about 300 blocks; the nodes only a few
+        VERIFY_TRUE(usage.heap_blocks < 320, __LINE__);
+        VERIFY_TRUE(static_cast<long>(usage.total() - usage.allocator_overhead) == scope.leaked_bytes(), __LINE__);
+        VERIFY_TRUE(strings.at(39) == std::string(39, 's'), __LINE__);
+    }
+}
+#endif
+
 int run_starter_code_tests();
 int run_milestone1_tests();
 int run_milestone2_tests();
@@ -1064,11 +2744,34 @@ int run_milestone3_tests();
 int run_milestone5_tests();
 int run_milestone6_tests();
 int run_milestone7_tests();
+int run_milestone8_tests();
+// Set the environment variable HASHMAP_PERF (to anything) to print the hardware
+// counters of each test, e.g. HASHMAP_PERF=1 ./HashMap
+const bool kPrintPerfCounters = std::getenv("HASHMAP_PERF") != nullptr;
+
+// number of tests run_test and skip_test have seen, from which main computes the
+// denominators of the summary
+int tests_run = 0;
+int tests_skipped = 0;
+
 template <typename T>
 int run_test(const T& test, const string& test_name) {
+    ++tests_run;
+    allocation_scope scope;
+    std::optional<perf_counters> counters;
+    if (kPrintPerfCounters) counters.emplace();
     try {
+        if (counters) counters->start();
         test();
-        cout << "Test "  << std::setw(30) << left << test_name  << right << " PASS " << endl;
+        perf_counts counts = counters ? counters->stop() : perf_counts();
+        cout << "Test "  << std::setw(30) << left << test_name  << right << " PASS ";
+        if (scope.leaked_bytes() > 0) cout << "(leaked " << scope.leaked_bytes() << " bytes)";
+        cout << endl;
+        if (counters) {
+            cout << "     ";
+            print_perf_counts(cout, counts);
+            cout << endl;
+        }
         return 1;
     } catch (const VerifyTrueAssertionFailure& e)  {
         cout << "Test "  << std::setw(30) << left << test_name << right
@@ -1088,6 +2791,7 @@ int run_test(const T& test, const string& test_name) {
 }
 
 void skip_test(const string& test_name) {
+    ++tests_skipped;
     cout << "Test "  << std::setw(30) << left << test_name  << right << " SKIP " << endl;
 }
 
@@ -1098,25 +2802,42 @@ int main(){
     cout << "Written by Avery Wang (2019-2020 lecturer)" << endl << endl;
     int required_pass = 0;
     int bonus_pass = 0;
+    // the denominators count the tests enabled in test_settings.hpp, as they run
+    int required_total = 0;
+    int required_skipped = 0;
+    int bonus_total = 0;
+    int bonus_skipped = 0;
+    auto run_section = [&](int (*section)(), int& total, int& skipped) {
+        int run_before = tests_run;
+        int skipped_before = tests_skipped;
+        int passed = section();
+        total += tests_run - run_before;
+        skipped += tests_skipped - skipped_before;
+        return passed;
+    };
     cout << "----- Starter Code Tests (Provided) -----" << endl;
-    required_pass += run_starter_code_tests();
+    required_pass += run_section(run_starter_code_tests, required_total, required_skipped);
     cout << endl << "----- Milestone 1 Tests (Optional) -----" << endl;
-    required_pass += run_milestone1_tests();
+    required_pass += run_section(run_milestone1_tests, required_total, required_skipped);
     cout << endl << "----- Milestone 2 Tests (Required) -----" << endl;
-    required_pass += run_milestone2_tests();
+    required_pass += run_section(run_milestone2_tests, required_total, required_skipped);
     cout << endl << "----- Milestone 3 Tests (Required) -----" << endl;
-    required_pass += run_milestone3_tests();
+    required_pass += run_section(run_milestone3_tests, required_total, required_skipped);
     cout << endl << "----- Milestone 4 Tests (Required) -----" << endl;
     cout << "(9 short answers graded manually)" << endl;
     cout << endl << "----- Milestone 5 Tests (Optional) -----" << endl;
-    bonus_pass += run_milestone5_tests();
+    bonus_pass += run_section(run_milestone5_tests, bonus_total, bonus_skipped);
     cout << endl << "----- Milestone 6 Tests (Optional) -----" << endl;
-    bonus_pass +=  run_milestone6_tests();
+    bonus_pass += run_section(run_milestone6_tests, bonus_total, bonus_skipped);
 
-    bonus_pass +=  run_milestone7_tests();
+    bonus_pass += run_section(run_milestone7_tests, bonus_total, bonus_skipped);
+    cout << endl << "----- Milestone 8 Tests (Extensions) -----" << endl;
+    bonus_pass += run_section(run_milestone8_tests, bonus_total, bonus_skipped);
     cout << endl << "----- Test Harness Summary -----" << endl;
-    cout << "Required tests: " << required_pass << "/14 (excluding short answers)" << endl;
-    cout << "Optional tests: " << bonus_pass << "/10" << endl << endl;
+    cout << "Required tests: " << required_pass << "/" << required_total << " (excluding short answers";
+    if (required_skipped > 0) cout << ", " << required_skipped << " skipped";
+    cout << ")" << endl;
+    cout << "Optional tests: " << bonus_pass << "/" << bonus_total << endl << endl;
 
 
     if (required_pass <= 7) {
@@ -1125,12 +2846,12 @@ int main(){
         cout << "You are making progress! Keep going! " << endl;
     } else if (required_pass <= 11) {
         cout << "Halfway there! " << endl;
-    } else if (required_pass <= 13) {
+    } else if (required_pass < required_total || required_skipped > 0) {
         cout << "Super close! " << endl;
     } else {
         cout << "You passed all required tests! Great job!" << endl;
     }
-    if (required_pass < 14) {
+    if (required_pass < required_total || required_skipped > 0) {
         cout << "Some tests were failed or skipped. " << endl;
         cout << "If stuck, try adding a map.debug() call before a VERIFY_TRUE." << endl;
     }
@@ -1286,4 +3007,123 @@ int run_milestone7_tests(){
     int pass = 0;
     pass += run_test(milestone_7, "milestone_7");
     return pass;
-}
\ No newline at end of file
+}
+
+int run_milestone8_tests() {
+    int passed = 0;
+#if RUN_TEST_8A
+    passed += run_test(A_sparse_iteration, "A_sparse_iteration");
+#else
+    skip_test("A_sparse_iteration");
+#endif
+
+#if RUN_TEST_8B
+    passed += run_test(B_ordered_hashmap, "B_ordered_hashmap");
+#else
+    skip_test("B_ordered_hashmap");
+#endif
+
+#if RUN_TEST_8C
+    passed += run_test(C_flat_hashmap, "C_flat_hashmap");
+#else
+    skip_test("C_flat_hashmap");
+#endif
+
+#if RUN_TEST_8D
+    passed += run_test(D_mapped_hashmap, "D_mapped_hashmap");
+#else
+    skip_test("D_mapped_hashmap");
+#endif
+
+#if RUN_TEST_8E
+    passed += run_test(E_binary_save_load, "E_binary_save_load");
+#else
+    skip_test("E_binary_save_load");
+#endif
+
+#if RUN_TEST_8F
+    passed += run_test(F_stats, "F_stats");
+#else
+    skip_test("F_stats");
+#endif
+
+#if RUN_TEST_8G
+    passed += run_test(G_allocation_counts, "G_allocation_counts");
+#else
+    skip_test("G_allocation_counts");
+#endif
+
+#if RUN_TEST_8H
+    passed += run_test(H_memory_usage, "H_memory_usage");
+#else
+    skip_test("H_memory_usage");
+#endif
+
+#if RUN_TEST_8I
+    passed += run_test(I_set_and_multimap, "I_set_and_multimap");
+#else
+    skip_test("I_set_and_multimap");
+#endif
+
+#if RUN_TEST_8J
+    passed += run_test(J_bounded_caches, "J_bounded_caches");
+#else
+    skip_test("J_bounded_caches");
+#endif
+
+#if RUN_TEST_8K
+    passed += run_test(K_ttl_hashmap, "K_ttl_hashmap");
+#else
+    skip_test("K_ttl_hashmap");
+#endif
+
+#if RUN_TEST_8L
+    passed += run_test(L_cow_snapshots, "L_cow_snapshots");
+#else
+    skip_test("L_cow_snapshots");
+#endif
+
+#if RUN_TEST_8M
+    passed += run_test(M_persistent_hashmap, "M_persistent_hashmap");
+#else
+    skip_test("M_persistent_hashmap");
+#endif
+
+#if RUN_TEST_8N
+    passed += run_test(N_bloom_filter, "N_bloom_filter");
+#else
+    skip_test("N_bloom_filter");
+#endif
+
+#if RUN_TEST_8O
+    passed += run_test(O_parallel_algorithms, "O_parallel_algorithms");
+#else
+    skip_test("O_parallel_algorithms");
+#endif
+
+#if RUN_TEST_8P
+    passed += run_test(P_ranges_and_views, "P_ranges_and_views");
+#else
+    skip_test("P_ranges_and_views");
+#endif
+
+#if RUN_TEST_8Q
+    passed += run_test(Q_string_hashmap, "Q_string_hashmap");
+#else
+    skip_test("Q_string_hashmap");
+#endif
+
+#if RUN_TEST_8R
+    passed += run_test(R_packed_hashmap, "R_packed_hashmap");
+#else
+    skip_test("R_packed_hashmap");
+#endif
+
+#if RUN_TEST_8S
+    passed += run_test(S_huge_pages, "S_huge_pages");
+#else
+    skip_test("S_huge_pages");
+#endif
+
+    return passed;
+}